@@ -58,6 +58,8 @@ static inline void bfq_group_init_entity(struct bfqio_cgroup *bgrp,
 	entity->ioprio_class = entity->new_ioprio_class = bgrp->ioprio_class;
 	entity->ioprio_changed = 1;
 	entity->my_sched_data = &bfqg->sched_data;
+	bfqg->foreground = bgrp->foreground;
+	bfqg->raising_coeff = 1;
 }
 
 static inline void bfq_group_set_parent(struct bfq_group *bfqg,
@@ -266,6 +268,17 @@ static void bfq_bfqq_move(struct bfq_data *bfqd, struct bfq_queue *bfqq,
 	entity->parent = bfqg->my_entity;
 	entity->sched_data = &bfqg->sched_data;
 
+	/*
+	 * A task moved into a foreground cgroup is most likely an
+	 * application being launched or brought to the front: raise
+	 * its weight for a while.  A task moved out of it loses any
+	 * raising it still has.
+	 */
+	if (bfqg->foreground)
+		bfq_bfqq_start_raising(bfqd, bfqq);
+	else
+		bfq_bfqq_end_raising(bfqd, bfqq);
+
 	if (busy && resume)
 		bfq_activate_bfqq(bfqd, bfqq);
 }
@@ -372,6 +385,41 @@ static struct bfq_group *bfq_cic_update_cgroup(struct cfq_io_context *cic)
 	return bfqg;
 }
 
+static inline int bfq_group_foreground(struct bfq_group *bfqg)
+{
+	return bfqg->foreground;
+}
+
+/*
+ * The queues of a group compete with the other groups through the group
+ * entity, so raising only the weight of a queue would not help it against
+ * the tasks of another cgroup.  The entity of a foreground group is raised
+ * together with its queues.
+ */
+static void bfq_group_start_raising(struct bfq_data *bfqd,
+				    struct bfq_group *bfqg)
+{
+	struct bfq_entity *entity = bfqg->my_entity;
+
+	if (entity == NULL || !bfqg->foreground)
+		return;
+
+	bfqg->raising_end = jiffies + bfqd->bfq_raising_max_time;
+	if (bfqg->raising_coeff == 1 && bfqd->bfq_raising_coeff > 1) {
+		bfqg->raising_coeff = bfqd->bfq_raising_coeff;
+		entity->ioprio_changed = 1;
+	}
+}
+
+static void bfq_group_update_raising_data(struct bfq_group *bfqg)
+{
+	if (bfqg->raising_coeff > 1 &&
+	    (!bfqg->foreground || time_is_before_jiffies(bfqg->raising_end))) {
+		bfqg->raising_coeff = 1;
+		bfqg->my_entity->ioprio_changed = 1;
+	}
+}
+
 /**
  * bfq_flush_idle_tree - deactivate any entity on the idle tree of @st.
  * @st: the service tree being flushed.
@@ -497,6 +545,7 @@ static struct bfq_group *bfq_alloc_root_group(struct bfq_data *bfqd, int node)
 		return NULL;
 
 	bfqg->entity.parent = NULL;
+	bfqg->raising_coeff = 1;
 	for (i = 0; i < BFQ_IOPRIO_CLASSES; i++)
 		bfqg->sched_data.service_tree[i] = BFQ_SERVICE_TREE_INIT;
 
@@ -531,6 +580,7 @@ static u64 bfqio_cgroup_##__VAR##_read(struct cgroup *cgroup,		\
 
 SHOW_FUNCTION(ioprio);
 SHOW_FUNCTION(ioprio_class);
+SHOW_FUNCTION(foreground);
 #undef SHOW_FUNCTION
 
 #define STORE_FUNCTION(__VAR, __MIN, __MAX)				\
@@ -568,6 +618,37 @@ STORE_FUNCTION(ioprio, 0, IOPRIO_BE_NR - 1);
 STORE_FUNCTION(ioprio_class, IOPRIO_CLASS_RT, IOPRIO_CLASS_IDLE);
 #undef STORE_FUNCTION
 
+/*
+ * The new value is seen by each bfq_group the next time one of its
+ * queues is created or a task joins the cgroup; queues already raised
+ * keep their raising until it expires.
+ */
+static int bfqio_cgroup_foreground_write(struct cgroup *cgroup,
+					 struct cftype *cftype, u64 val)
+{
+	struct bfqio_cgroup *bgrp;
+	struct bfq_group *bfqg;
+	struct hlist_node *n;
+
+	if (val > 1)
+		return -EINVAL;
+
+	if (!cgroup_lock_live_group(cgroup))
+		return -ENODEV;
+
+	bgrp = cgroup_to_bfqio(cgroup);
+
+	spin_lock_irq(&bgrp->lock);
+	bgrp->foreground = val;
+	hlist_for_each_entry(bfqg, n, &bgrp->group_data, group_node)
+		bfqg->foreground = val;
+	spin_unlock_irq(&bgrp->lock);
+
+	cgroup_unlock();
+
+	return 0;
+}
+
 static struct cftype bfqio_files[] = {
 	{
 		.name = "ioprio",
@@ -579,6 +660,11 @@ static struct cftype bfqio_files[] = {
 		.read_u64 = bfqio_cgroup_ioprio_class_read,
 		.write_u64 = bfqio_cgroup_ioprio_class_write,
 	},
+	{
+		.name = "foreground",
+		.read_u64 = bfqio_cgroup_foreground_read,
+		.write_u64 = bfqio_cgroup_foreground_write,
+	},
 };
 
 static int bfqio_populate(struct cgroup_subsys *subsys, struct cgroup *cgroup)
@@ -603,6 +689,7 @@ static struct cgroup_subsys_state *bfqio_create(struct cgroup_subsys *subsys,
 	INIT_HLIST_HEAD(&bgrp->group_data);
 	bgrp->ioprio = BFQ_DEFAULT_GRP_IOPRIO;
 	bgrp->ioprio_class = BFQ_DEFAULT_GRP_CLASS;
+	bgrp->foreground = 0;
 
 	return &bgrp->css;
 }
@@ -709,6 +796,20 @@ bfq_cic_update_cgroup(struct cfq_io_context *cic)
 	return bfqd->root_group;
 }
 
+static inline int bfq_group_foreground(struct bfq_group *bfqg)
+{
+	return 0;
+}
+
+static inline void bfq_group_start_raising(struct bfq_data *bfqd,
+					   struct bfq_group *bfqg)
+{
+}
+
+static inline void bfq_group_update_raising_data(struct bfq_group *bfqg)
+{
+}
+
 static inline void bfq_bfqq_move(struct bfq_data *bfqd,
 				 struct bfq_queue *bfqq,
 				 struct bfq_entity *entity,
@@ -70,6 +70,10 @@ static const int bfq_max_budget_async_rq = 4;
 static const int bfq_timeout_sync = HZ / 8;
 static int bfq_timeout_async = HZ / 25;
 
+/* Default weight raising factor and duration (jiffies). */
+static const int bfq_raising_coeff = 10;
+static const int bfq_raising_max_time = 3 * HZ;
+
 struct kmem_cache *bfq_pool;
 struct kmem_cache *bfq_ioc_pool;
 
@@ -109,6 +113,57 @@ static inline int bfq_class_idle(struct bfq_queue *bfqq)
 	return bfqq->entity.ioprio_class == IOPRIO_CLASS_IDLE;
 }
 
+/*
+ * Weight raising: for bfq_raising_max_time after it starts, the weight of
+ * a sync queue is multiplied by bfq_raising_coeff, so that the short
+ * bursts of reads done by a task that has just started, or that has just
+ * been moved to a foreground cgroup, are not held up behind long-running
+ * background streams.  The new weight is used from the next activation
+ * of the queue.
+ */
+static inline struct bfq_group *bfq_bfqq_group(struct bfq_queue *bfqq)
+{
+	return container_of(bfqq->entity.sched_data, struct bfq_group,
+			    sched_data);
+}
+
+static void bfq_bfqq_start_raising(struct bfq_data *bfqd,
+				   struct bfq_queue *bfqq)
+{
+	if (!bfq_bfqq_sync(bfqq) || bfq_class_idle(bfqq))
+		return;
+
+	bfq_group_start_raising(bfqd, bfq_bfqq_group(bfqq));
+
+	bfqq->raising_end = jiffies + bfqd->bfq_raising_max_time;
+	if (bfqq->raising_coeff == 1 && bfqd->bfq_raising_coeff > 1) {
+		bfqq->raising_coeff = bfqd->bfq_raising_coeff;
+		bfqq->entity.ioprio_changed = 1;
+		bfq_log_bfqq(bfqd, bfqq, "raising started, coeff %u",
+			     bfqq->raising_coeff);
+	}
+}
+
+static void bfq_bfqq_end_raising(struct bfq_data *bfqd, struct bfq_queue *bfqq)
+{
+	if (bfqq->raising_coeff == 1)
+		return;
+
+	bfqq->raising_coeff = 1;
+	bfqq->entity.ioprio_changed = 1;
+	bfq_log_bfqq(bfqd, bfqq, "raising ended");
+}
+
+static inline void bfq_update_raising_data(struct bfq_data *bfqd,
+					   struct bfq_queue *bfqq)
+{
+	if (bfqq->raising_coeff > 1 &&
+	    time_is_before_jiffies(bfqq->raising_end))
+		bfq_bfqq_end_raising(bfqd, bfqq);
+
+	bfq_group_update_raising_data(bfq_bfqq_group(bfqq));
+}
+
 static inline int bfq_sample_valid(int samples)
 {
 	return samples > 80;
@@ -331,6 +386,8 @@ static void bfq_add_rq_rb(struct request *rq)
 	bfqq->queued[rq_is_sync(rq)]++;
 	bfqd->queued++;
 
+	bfq_update_raising_data(bfqd, bfqq);
+
 	/*
 	 * Looks a little odd, but the first insert might return an alias,
 	 * if that happens, put the alias on the dispatch list.
@@ -1222,6 +1279,7 @@ retry:
 
 		atomic_set(&bfqq->ref, 0);
 		bfqq->bfqd = bfqd;
+		bfqq->raising_coeff = 1;
 
 		bfq_mark_bfqq_prio_changed(bfqq);
 
@@ -1236,6 +1294,9 @@ retry:
 		bfqq->max_budget = bfq_default_budget(bfqd, bfqq);
 		bfqq->pid = current->pid;
 
+		if (bfqd->low_latency || bfq_group_foreground(bfqg))
+			bfq_bfqq_start_raising(bfqd, bfqq);
+
 		bfq_log_bfqq(bfqd, bfqq, "allocated");
 	}
 
@@ -1784,6 +1845,10 @@ static void *bfq_init_queue(struct request_queue *q)
 	bfqd->bfq_timeout[ASYNC] = bfq_timeout_async;
 	bfqd->bfq_timeout[SYNC] = bfq_timeout_sync;
 
+	bfqd->low_latency = 1;
+	bfqd->bfq_raising_coeff = bfq_raising_coeff;
+	bfqd->bfq_raising_max_time = bfq_raising_max_time;
+
 	return bfqd;
 }
 
@@ -1846,6 +1911,9 @@ SHOW_FUNCTION(bfq_max_budget_show, bfqd->bfq_user_max_budget, 0);
 SHOW_FUNCTION(bfq_max_budget_async_rq_show, bfqd->bfq_max_budget_async_rq, 0);
 SHOW_FUNCTION(bfq_timeout_sync_show, bfqd->bfq_timeout[SYNC], 1);
 SHOW_FUNCTION(bfq_timeout_async_show, bfqd->bfq_timeout[ASYNC], 1);
+SHOW_FUNCTION(bfq_low_latency_show, bfqd->low_latency, 0);
+SHOW_FUNCTION(bfq_raising_coeff_show, bfqd->bfq_raising_coeff, 0);
+SHOW_FUNCTION(bfq_raising_max_time_show, bfqd->bfq_raising_max_time, 1);
 #undef SHOW_FUNCTION
 
 #define STORE_FUNCTION(__FUNC, __PTR, MIN, MAX, __CONV)			\
@@ -1878,6 +1946,11 @@ STORE_FUNCTION(bfq_max_budget_async_rq_store, &bfqd->bfq_max_budget_async_rq,
 		1, INT_MAX, 0);
 STORE_FUNCTION(bfq_timeout_async_store, &bfqd->bfq_timeout[ASYNC], 0,
 		INT_MAX, 1);
+STORE_FUNCTION(bfq_low_latency_store, &bfqd->low_latency, 0, 1, 0);
+STORE_FUNCTION(bfq_raising_coeff_store, &bfqd->bfq_raising_coeff, 1,
+		INT_MAX / IOPRIO_BE_NR, 0);
+STORE_FUNCTION(bfq_raising_max_time_store, &bfqd->bfq_raising_max_time, 0,
+		INT_MAX, 1);
 #undef STORE_FUNCTION
 
 static inline bfq_service_t bfq_estimated_max_budget(struct bfq_data *bfqd)
@@ -1943,6 +2016,9 @@ static struct elv_fs_entry bfq_attrs[] = {
 	BFQ_ATTR(max_budget_async_rq),
 	BFQ_ATTR(timeout_sync),
 	BFQ_ATTR(timeout_async),
+	BFQ_ATTR(low_latency),
+	BFQ_ATTR(raising_coeff),
+	BFQ_ATTR(raising_max_time),
 	__ATTR_NULL
 };
 
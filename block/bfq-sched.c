@@ -522,6 +522,22 @@ static void bfq_bfqq_charge_full_budget(struct bfq_queue *bfqq)
 	bfq_bfqq_served(bfqq, entity->budget - entity->service);
 }
 
+/**
+ * bfq_entity_raising_coeff - return the weight raising factor of @entity.
+ * @entity: the entity to consider.
+ */
+static inline unsigned int bfq_entity_raising_coeff(struct bfq_entity *entity)
+{
+	struct bfq_queue *bfqq = bfq_entity_to_bfqq(entity);
+
+#ifdef CONFIG_CGROUP_BFQIO
+	if (bfqq == NULL)
+		return container_of(entity, struct bfq_group,
+				    entity)->raising_coeff;
+#endif
+	return bfqq->raising_coeff;
+}
+
 static struct bfq_service_tree *
 __bfq_entity_update_prio(struct bfq_service_tree *old_st,
 			 struct bfq_entity *entity)
@@ -534,7 +550,8 @@ __bfq_entity_update_prio(struct bfq_service_tree *old_st,
 		entity->ioprio_changed = 0;
 
 		old_st->wsum -= entity->weight;
-		entity->weight = bfq_ioprio_to_weight(entity->ioprio);
+		entity->weight = bfq_ioprio_to_weight(entity->ioprio) *
+				 bfq_entity_raising_coeff(entity);
 
 		/*
 		 * NOTE: here we may be changing the weight too early,
@@ -199,6 +199,9 @@ struct bfq_group;
  *               they are charged for the whole allocated budget, to try
  *               to preserve a behavior reasonably fair among them, but
  *               without service-domain guarantees).
+ * @low_latency: if set, raise the weight of newly created sync queues.
+ * @bfq_raising_coeff: factor the weight of a raised queue is multiplied by.
+ * @bfq_raising_max_time: duration of weight raising (jiffies).
  *
  * All the fields are protected by the @queue lock.
  */
@@ -244,6 +247,10 @@ struct bfq_data {
 	unsigned int bfq_user_max_budget;
 	unsigned int bfq_max_budget_async_rq;
 	unsigned int bfq_timeout[2];
+
+	unsigned int low_latency;
+	unsigned int bfq_raising_coeff;
+	unsigned int bfq_raising_max_time;
 };
 
 /**
@@ -263,6 +270,8 @@ struct bfq_data {
  * @budgets_assigned: number of budgets assigned.
  * @org_ioprio: saved ioprio during boosted periods.
  * @org_ioprio_class: saved ioprio_class during boosted periods.
+ * @raising_coeff: current weight raising factor, 1 if not raised.
+ * @raising_end: end of the current weight raising period (in jiffies).
  * @flags: status flags.
  * @bfqq_list: node for active/idle bfqq list inside our bfqd.
  * @pid: pid of the process owning the queue, used for logging purposes.
@@ -296,6 +305,9 @@ struct bfq_queue {
 	unsigned short org_ioprio;
 	unsigned short org_ioprio_class;
 
+	unsigned int raising_coeff;
+	unsigned long raising_end;
+
 	unsigned int flags;
 
 	struct list_head bfqq_list;
@@ -370,6 +382,9 @@ enum bfqq_expiration {
  * @async_idle_bfqq: async queue for the idle class (ioprio is ignored).
  * @my_entity: pointer to @entity, %NULL for the toplevel group; used
  *             to avoid too many special cases during group creation/migration.
+ * @foreground: copy of the foreground flag of the containing cgroup.
+ * @raising_coeff: weight raising factor of @entity, 1 if not raised.
+ * @raising_end: end of the current weight raising period (in jiffies).
  *
  * Each (device, cgroup) pair has its own bfq_group, i.e., for each cgroup
  * there is a set of bfq_groups, each one collecting the lower-level
@@ -395,6 +410,10 @@ struct bfq_group {
 	struct bfq_queue *async_idle_bfqq;
 
 	struct bfq_entity *my_entity;
+
+	int foreground;
+	unsigned int raising_coeff;
+	unsigned long raising_end;
 };
 
 /**
@@ -402,7 +421,11 @@ struct bfq_group {
  * @css: subsystem state for bfq in the containing cgroup.
  * @ioprio: cgroup ioprio.
  * @ioprio_class: cgroup ioprio_class.
- * @lock: spinlock that protects @ioprio, @ioprio_class and @group_data.
+ * @foreground: if set, the sync queues of the tasks in the cgroup get their
+ *              weight raised when the tasks join the cgroup or start doing
+ *              I/O in it.
+ * @lock: spinlock that protects @ioprio, @ioprio_class, @foreground
+ *        and @group_data.
  * @group_data: list containing the bfq_group belonging to this cgroup.
  *
  * @group_data is accessed using RCU, with @lock protecting the updates,
@@ -412,6 +435,7 @@ struct bfqio_cgroup {
 	struct cgroup_subsys_state css;
 
 	unsigned short ioprio, ioprio_class;
+	unsigned short foreground;
 
 	spinlock_t lock;
 	struct hlist_head group_data;
@@ -511,4 +535,7 @@ static struct bfq_queue *bfq_get_queue(struct bfq_data *bfqd,
 				       struct io_context *ioc, gfp_t gfp_mask);
 static void bfq_put_async_queues(struct bfq_data *bfqd, struct bfq_group *bfqg);
 static void bfq_exit_bfqq(struct bfq_data *bfqd, struct bfq_queue *bfqq);
+static void bfq_bfqq_start_raising(struct bfq_data *bfqd,
+				   struct bfq_queue *bfqq);
+static void bfq_bfqq_end_raising(struct bfq_data *bfqd, struct bfq_queue *bfqq);
 #endif
@@ -409,6 +409,9 @@ void blk_sync_queue(struct request_queue *q)
 	del_timer_sync(&q->unplug_timer);
 	del_timer_sync(&q->timeout);
 	cancel_work_sync(&q->unplug_work);
+#ifdef CONFIG_BLK_DEV_DISCARD_BATCH
+	cancel_delayed_work_sync(&q->discard_batch.work);
+#endif
 }
 EXPORT_SYMBOL(blk_sync_queue);
 
@@ -532,6 +535,7 @@ struct request_queue *blk_alloc_queue_node(gfp_t gfp_mask, int node_id)
 	setup_timer(&q->timeout, blk_rq_timed_out_timer, (unsigned long) q);
 	INIT_LIST_HEAD(&q->timeout_list);
 	INIT_WORK(&q->unplug_work, blk_unplug_work);
+	blk_discard_batch_init(q);
 
 	kobject_init(&q->kobj, &blk_queue_ktype);
 
@@ -1130,6 +1134,7 @@ void init_request_from_bio(struct request *req, struct bio *bio)
 	req->hard_sector = req->sector = bio->bi_sector;
 	req->ioprio = bio_prio(bio);
 	req->start_time = jiffies;
+	blk_rq_set_start_time_ns(req);
 	blk_rq_bio_prep(req->q, req, bio);
 }
 
@@ -1448,12 +1453,19 @@ static inline void __generic_make_request(struct bio *bio)
 			err = -EOPNOTSUPP;
 			goto end_io;
 		}
-		if (bio_barrier(bio) && bio_has_data(bio) &&
+		/*
+		 * A barrier discard only orders the requests around it
+		 * (REQ_SOFTBARRIER), it needs no ordered mode.
+		 */
+		if (bio_barrier(bio) && bio_has_data(bio) && !bio_discard(bio) &&
 		    (q->next_ordered == QUEUE_ORDERED_NONE)) {
 			err = -EOPNOTSUPP;
 			goto end_io;
 		}
 
+		if (blk_discard_batch_active(q) && blk_discard_batch_bio(q, bio))
+			break;
+
 		ret = q->make_request_fn(q, bio);
 	} while (ret);
 
@@ -1710,6 +1722,38 @@ static void blk_account_io_done(struct request *req)
 	}
 }
 
+#ifdef CONFIG_BLK_DEV_LATENCY_HIST
+static inline void blk_latency_hist_add(unsigned long *hist, u64 ns)
+{
+	int b = fls64(div_u64(ns, NSEC_PER_USEC));
+
+	hist[min(b, BLK_LATENCY_BUCKETS - 1)]++;
+}
+
+/*
+ * Called with the queue lock held when @rq completes.  Requests that
+ * never went through elv_next_request(), and the internal barrier
+ * request, are not accounted.
+ */
+void blk_account_io_latency(struct request *rq)
+{
+	struct blk_latency_hist *hist;
+	u64 now;
+
+	if (!blk_fs_request(rq) || rq == &rq->q->bar_rq ||
+	    !rq->io_start_time_ns)
+		return;
+
+	now = ktime_to_ns(ktime_get());
+	hist = &rq->q->latency_hist[rq_data_dir(rq)];
+	if (rq->start_time_ns && rq->io_start_time_ns >= rq->start_time_ns)
+		blk_latency_hist_add(hist->queue,
+				     rq->io_start_time_ns - rq->start_time_ns);
+	if (now >= rq->io_start_time_ns)
+		blk_latency_hist_add(hist->device, now - rq->io_start_time_ns);
+}
+#endif
+
 /**
  * __end_that_request_first - end I/O on a request
  * @req:      the request being processed
@@ -1837,6 +1881,7 @@ static void end_that_request_last(struct request *req, int error)
 	blk_delete_timer(req);
 
 	blk_account_io_done(req);
+	blk_account_io_latency(req);
 
 	if (req->end_io)
 		req->end_io(req, error);
@@ -2148,6 +2193,13 @@ int kblockd_schedule_work(struct request_queue *q, struct work_struct *work)
 }
 EXPORT_SYMBOL(kblockd_schedule_work);
 
+int kblockd_schedule_delayed_work(struct request_queue *q,
+				  struct delayed_work *dwork, unsigned long delay)
+{
+	return queue_delayed_work(kblockd_workqueue, dwork, delay);
+}
+EXPORT_SYMBOL(kblockd_schedule_delayed_work);
+
 int __init blk_dev_init(void)
 {
 	kblockd_workqueue = create_workqueue("kblockd");
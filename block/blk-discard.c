@@ -0,0 +1,449 @@
+/*
+ * Batching of discard requests
+ *
+ * Filesystems discard the blocks they free as they free them, which on
+ * eMMC and SD cards gives a stream of small discards, each of them a slow
+ * command holding up the reads and writes queued behind it.  When batching
+ * is enabled for a queue (queue/discard_batch_kb), the discards submitted
+ * to it are completed at once and their ranges kept in a tree, merged with
+ * the adjacent and overlapping ones.  The merged ranges are passed to the
+ * driver from kdiscardd once the queue has seen no reads or writes for
+ * queue/discard_idle_ms, as soon as the backlog is over discard_batch_kb,
+ * and when the disk is closed.  kdiscardd is a workqueue of its own, as
+ * submitting a discard may have to wait for a free request, which may
+ * take work on kblockd.
+ *
+ * Filesystems may reuse the blocks they discarded as soon as the discard
+ * is submitted, so a write to a pending range removes the written part
+ * from the range.  The ranges are passed on as barrier discards, one
+ * piece of at most max_discard_sectors at a time, so that the writes
+ * submitted after a piece can not be moved ahead of it.  A write to the
+ * piece being submitted is held back and resubmitted once the piece is
+ * in the queue.
+ */
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/bio.h>
+#include <linux/blkdev.h>
+#include <linux/rbtree.h>
+#include <linux/sched.h>
+
+#include "blk.h"
+
+#define DISCARD_BATCH_IDLE_MSECS	1000
+
+/* flush even if not idle past that many ranges, to bound the memory used */
+#define DISCARD_BATCH_MAX_RANGES	1024
+
+static struct workqueue_struct *kdiscardd_workqueue;
+
+struct discard_range {
+	struct rb_node		rb_node;
+	sector_t		start;
+	sector_t		end;		/* first sector after the range */
+};
+
+#define rb_entry_range(node)	rb_entry((node), struct discard_range, rb_node)
+
+static struct discard_range *discard_range_next(struct discard_range *range)
+{
+	struct rb_node *next = rb_next(&range->rb_node);
+
+	return next ? rb_entry_range(next) : NULL;
+}
+
+/* The first range ending at or after @sector */
+static struct discard_range *discard_range_find(struct blk_discard_batch *db,
+						sector_t sector)
+{
+	struct rb_node *n = db->ranges.rb_node;
+	struct discard_range *range, *found = NULL;
+
+	while (n) {
+		range = rb_entry_range(n);
+		if (range->end >= sector) {
+			found = range;
+			n = n->rb_left;
+		} else
+			n = n->rb_right;
+	}
+	return found;
+}
+
+static void discard_range_insert(struct blk_discard_batch *db,
+				 struct discard_range *new)
+{
+	struct rb_node **p = &db->ranges.rb_node;
+	struct rb_node *parent = NULL;
+
+	while (*p) {
+		parent = *p;
+		if (new->start < rb_entry_range(parent)->start)
+			p = &(*p)->rb_left;
+		else
+			p = &(*p)->rb_right;
+	}
+	rb_link_node(&new->rb_node, parent, p);
+	rb_insert_color(&new->rb_node, &db->ranges);
+	db->nr_ranges++;
+}
+
+static void discard_range_erase(struct blk_discard_batch *db,
+				struct discard_range *range)
+{
+	rb_erase(&range->rb_node, &db->ranges);
+	db->nr_ranges--;
+	kfree(range);
+}
+
+/*
+ * Add [start, end) to the pending ranges.  The ranges it touches are merged
+ * into the first of them; if there is none, *@new is inserted and cleared.
+ */
+static void discard_range_add(struct blk_discard_batch *db, sector_t start,
+			      sector_t end, struct discard_range **new)
+{
+	struct discard_range *range, *next, *merged = NULL;
+
+	range = discard_range_find(db, start);
+	while (range && range->start <= end) {
+		next = discard_range_next(range);
+		start = min(start, range->start);
+		end = max(end, range->end);
+		db->nr_sectors -= range->end - range->start;
+		if (merged)
+			discard_range_erase(db, range);
+		else
+			merged = range;
+		range = next;
+	}
+
+	if (merged) {
+		db->merged++;
+	} else {
+		merged = *new;
+		*new = NULL;
+		merged->start = start;
+		discard_range_insert(db, merged);
+	}
+	/* the ranges before it end before @start, so the order is kept */
+	merged->start = start;
+	merged->end = end;
+	db->nr_sectors += end - start;
+}
+
+/* Remove [start, end), which is being written, from the pending ranges */
+static void discard_range_trim(struct blk_discard_batch *db, sector_t start,
+			       sector_t end)
+{
+	struct discard_range *range, *next, *tail;
+	sector_t trimmed;
+
+	range = discard_range_find(db, start + 1);
+	while (range && range->start < end) {
+		next = discard_range_next(range);
+
+		if (range->start < start && range->end > end) {
+			/*
+			 * Split the range.  If that fails drop its tail,
+			 * a discard is only a hint.
+			 */
+			tail = kmalloc(sizeof(*tail), GFP_ATOMIC);
+			if (tail) {
+				tail->start = end;
+				tail->end = range->end;
+				discard_range_insert(db, tail);
+			} else
+				db->nr_sectors -= range->end - end;
+			trimmed = end - start;
+			range->end = start;
+		} else if (range->start < start) {
+			trimmed = range->end - start;
+			range->end = start;
+		} else if (range->end > end) {
+			trimmed = end - range->start;
+			range->start = end;
+		} else {
+			trimmed = range->end - range->start;
+			discard_range_erase(db, range);
+		}
+		db->nr_sectors -= trimmed;
+		db->cancelled += trimmed;
+		range = next;
+	}
+}
+
+static int discard_batch_full(struct blk_discard_batch *db)
+{
+	return db->nr_sectors > (sector_t)db->max_kb << 1 ||
+		db->nr_ranges > DISCARD_BATCH_MAX_RANGES;
+}
+
+static void discard_batch_schedule(struct blk_discard_batch *db,
+				   unsigned long delay)
+{
+	queue_delayed_work(kdiscardd_workqueue, &db->work, delay);
+}
+
+/*
+ * @bio writes [start, end).  Remove that from the pending ranges, or if
+ * it overlaps the piece being submitted, hold @bio back until the piece
+ * is in the queue and return 1.
+ */
+static int discard_batch_write(struct blk_discard_batch *db, struct bio *bio,
+			       sector_t start, sector_t end)
+{
+	int held = 0;
+
+	spin_lock(&db->lock);
+	if (db->issuer && start < db->issue_end && end > db->issue_start) {
+		bio->bi_next = NULL;
+		if (db->deferred)
+			db->deferred_tail->bi_next = bio;
+		else
+			db->deferred = bio;
+		db->deferred_tail = bio;
+		held = 1;
+	} else
+		discard_range_trim(db, start, end);
+	spin_unlock(&db->lock);
+	return held;
+}
+
+/**
+ * blk_discard_batch_bio - queue a discard for batching
+ * @q:		the request queue
+ * @bio:	the bio about to be passed to @q
+ *
+ * Description:
+ *    Called by __generic_make_request() for each bio to a queue with
+ *    discard batching, after the partition remapping.  Returns 1 if @bio
+ *    was a discard that has been added to the pending ranges and
+ *    completed, or a write held back until the discard it overlaps has
+ *    been submitted, 0 if @bio is to be passed to the driver.
+ */
+int blk_discard_batch_bio(struct request_queue *q, struct bio *bio)
+{
+	struct blk_discard_batch *db = &q->discard_batch;
+	sector_t start = bio->bi_sector;
+	sector_t end = start + bio_sectors(bio);
+	struct discard_range *new;
+	unsigned long delay;
+
+	if (!bio_discard(bio)) {
+		if (start == end)
+			return 0;
+		db->last_io = jiffies;
+		if (bio_data_dir(bio) == WRITE && db->bdev)
+			return discard_batch_write(db, bio, start, end);
+		return 0;
+	}
+
+	/* our own discards, or batching was just disabled */
+	if (db->issuer == current || !db->max_kb || start == end)
+		return 0;
+
+	new = kmalloc(sizeof(*new), GFP_NOIO);
+	if (!new)
+		return 0;
+
+	spin_lock(&db->lock);
+	if (!db->bdev)
+		db->bdev = bdgrab(bio->bi_bdev);
+	db->queued++;
+	discard_range_add(db, start, end, &new);
+	delay = discard_batch_full(db) ? 0 : msecs_to_jiffies(db->idle_msecs);
+	spin_unlock(&db->lock);
+	kfree(new);
+
+	/* if the backlog is full, do not wait for a pending idle timer */
+	if (!delay)
+		cancel_delayed_work(&db->work);
+	discard_batch_schedule(db, delay);
+
+	bio_endio(bio, 0);
+	return 1;
+}
+
+/*
+ * Take the first piece of the first pending range off the tree and mark
+ * it as being issued by the current task.  Unless @force, only do so if
+ * the queue has been idle long enough or the backlog is full, else return
+ * 0 with *@delay set to the time left until the queue is idle.
+ */
+static int discard_batch_start(struct blk_discard_batch *db, int force,
+			       struct block_device **bdev, sector_t *start,
+			       sector_t *end, unsigned long *delay)
+{
+	struct request_queue *q =
+		container_of(db, struct request_queue, discard_batch);
+	struct discard_range *range;
+	sector_t len;
+	unsigned long idle;
+	int ret = 0;
+
+	*delay = 0;
+	spin_lock(&db->lock);
+	if (RB_EMPTY_ROOT(&db->ranges))
+		goto out;
+
+	if (!force && db->max_kb && !discard_batch_full(db)) {
+		idle = db->last_io + msecs_to_jiffies(db->idle_msecs);
+		if (time_before(jiffies, idle)) {
+			*delay = idle - jiffies;
+			goto out;
+		}
+	}
+
+	range = rb_entry_range(rb_first(&db->ranges));
+	len = range->end - range->start;
+	if (q->limits.max_discard_sectors)
+		len = min_t(sector_t, len, q->limits.max_discard_sectors);
+
+	*bdev = db->bdev;
+	*start = db->issue_start = range->start;
+	*end = db->issue_end = range->start + len;
+	db->issuer = current;
+	db->nr_sectors -= len;
+	if (*end == range->end)
+		discard_range_erase(db, range);
+	else
+		range->start = *end;
+	ret = 1;
+out:
+	spin_unlock(&db->lock);
+	return ret;
+}
+
+/*
+ * The piece is in the queue: resubmit the writes held back meanwhile, and
+ * drop the block device once nothing is left pending.
+ */
+static void discard_batch_done(struct blk_discard_batch *db)
+{
+	struct block_device *bdev = NULL;
+	struct bio *bio, *next;
+
+	spin_lock(&db->lock);
+	db->issuer = NULL;
+	db->issued++;
+	bio = db->deferred;
+	db->deferred = NULL;
+	if (RB_EMPTY_ROOT(&db->ranges)) {
+		bdev = db->bdev;
+		db->bdev = NULL;
+	}
+	spin_unlock(&db->lock);
+
+	while (bio) {
+		next = bio->bi_next;
+		bio->bi_next = NULL;
+		generic_make_request(bio);
+		bio = next;
+	}
+	if (bdev)
+		bdput(bdev);
+}
+
+/*
+ * Pass the pending ranges to the driver, lowest first.  Unless @flags has
+ * DISCARD_FL_WAIT this only waits for the pieces to be queued, not for
+ * them to complete.  Returns the delay after which to look again if the
+ * queue stopped being idle.
+ */
+static unsigned long discard_batch_issue(struct blk_discard_batch *db,
+					 int force, int flags)
+{
+	struct block_device *bdev;
+	sector_t start, end;
+	unsigned long delay;
+
+	while (discard_batch_start(db, force, &bdev, &start, &end, &delay)) {
+		blkdev_issue_discard(bdev, start, end - start, GFP_NOIO,
+				     flags | DISCARD_FL_BARRIER);
+		discard_batch_done(db);
+	}
+	return delay;
+}
+
+static void blk_discard_batch_work(struct work_struct *work)
+{
+	struct blk_discard_batch *db =
+		container_of(work, struct blk_discard_batch, work.work);
+	unsigned long delay;
+
+	delay = discard_batch_issue(db, 0, 0);
+	if (delay)
+		discard_batch_schedule(db, delay);
+}
+
+/**
+ * blk_discard_batch_kick - look at the pending discards now
+ * @q:		the request queue
+ *
+ * Description:
+ *    Called when the batching settings of @q change, so that a lower
+ *    limit, or batching being disabled, takes effect at once.
+ */
+void blk_discard_batch_kick(struct request_queue *q)
+{
+	struct blk_discard_batch *db = &q->discard_batch;
+
+	if (!db->bdev)
+		return;
+	cancel_delayed_work(&db->work);
+	discard_batch_schedule(db, 0);
+}
+
+/**
+ * blk_discard_batch_flush - issue the pending discards of a queue
+ * @q:		the request queue
+ *
+ * Description:
+ *    Passes all the pending discards of @q to the driver and waits for
+ *    them.  Called on the last close of the disk, after which the block
+ *    device the ranges were queued through goes away.
+ */
+void blk_discard_batch_flush(struct request_queue *q)
+{
+	struct blk_discard_batch *db = &q->discard_batch;
+
+	if (!db->bdev)
+		return;
+	cancel_delayed_work_sync(&db->work);
+	discard_batch_issue(db, 1, DISCARD_FL_WAIT);
+}
+
+void blk_discard_batch_init(struct request_queue *q)
+{
+	struct blk_discard_batch *db = &q->discard_batch;
+
+	spin_lock_init(&db->lock);
+	db->ranges = RB_ROOT;
+	db->idle_msecs = DISCARD_BATCH_IDLE_MSECS;
+	INIT_DELAYED_WORK(&db->work, blk_discard_batch_work);
+}
+
+/* Drop whatever is still pending when the queue goes away */
+void blk_discard_batch_exit(struct request_queue *q)
+{
+	struct blk_discard_batch *db = &q->discard_batch;
+	struct rb_node *n;
+
+	cancel_delayed_work_sync(&db->work);
+	while ((n = rb_first(&db->ranges)))
+		discard_range_erase(db, rb_entry_range(n));
+	db->nr_sectors = 0;
+	if (db->bdev)
+		bdput(db->bdev);
+	db->bdev = NULL;
+}
+
+static int __init blk_discard_batch_setup(void)
+{
+	kdiscardd_workqueue = create_singlethread_workqueue("kdiscardd");
+	if (!kdiscardd_workqueue)
+		panic("Failed to create kdiscardd\n");
+	return 0;
+}
+subsys_initcall(blk_discard_batch_setup);
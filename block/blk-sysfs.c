@@ -243,6 +243,143 @@ static ssize_t queue_iostats_store(struct request_queue *q, const char *page,
 	return ret;
 }
 
+#ifdef CONFIG_BLK_DEV_LATENCY_HIST
+static ssize_t queue_latency_show(struct request_queue *q, char *page, int rw)
+{
+	struct blk_latency_hist hist;
+	char *p = page;
+	int i;
+
+	spin_lock_irq(q->queue_lock);
+	hist = q->latency_hist[rw];
+	spin_unlock_irq(q->queue_lock);
+
+	p += sprintf(p, "%10s %10s %10s\n", "usecs", "queue", "device");
+	for (i = 0; i < BLK_LATENCY_BUCKETS - 1; i++)
+		p += sprintf(p, "<%9lu %10lu %10lu\n", 1UL << i,
+			     hist.queue[i], hist.device[i]);
+	p += sprintf(p, ">=%8lu %10lu %10lu\n", 1UL << (i - 1),
+		     hist.queue[i], hist.device[i]);
+
+	return p - page;
+}
+
+static ssize_t queue_latency_store(struct request_queue *q, const char *page,
+				   size_t count, int rw)
+{
+	spin_lock_irq(q->queue_lock);
+	memset(&q->latency_hist[rw], 0, sizeof(q->latency_hist[rw]));
+	spin_unlock_irq(q->queue_lock);
+
+	return count;
+}
+
+static ssize_t queue_read_latency_show(struct request_queue *q, char *page)
+{
+	return queue_latency_show(q, page, READ);
+}
+
+static ssize_t queue_read_latency_store(struct request_queue *q,
+					const char *page, size_t count)
+{
+	return queue_latency_store(q, page, count, READ);
+}
+
+static ssize_t queue_write_latency_show(struct request_queue *q, char *page)
+{
+	return queue_latency_show(q, page, WRITE);
+}
+
+static ssize_t queue_write_latency_store(struct request_queue *q,
+					 const char *page, size_t count)
+{
+	return queue_latency_store(q, page, count, WRITE);
+}
+
+static struct queue_sysfs_entry queue_read_latency_entry = {
+	.attr = {.name = "read_latency", .mode = S_IRUGO | S_IWUSR },
+	.show = queue_read_latency_show,
+	.store = queue_read_latency_store,
+};
+
+static struct queue_sysfs_entry queue_write_latency_entry = {
+	.attr = {.name = "write_latency", .mode = S_IRUGO | S_IWUSR },
+	.show = queue_write_latency_show,
+	.store = queue_write_latency_store,
+};
+#endif
+
+#ifdef CONFIG_BLK_DEV_DISCARD_BATCH
+static ssize_t queue_discard_batch_show(struct request_queue *q, char *page)
+{
+	return queue_var_show(q->discard_batch.max_kb, page);
+}
+
+static ssize_t
+queue_discard_batch_store(struct request_queue *q, const char *page,
+			  size_t count)
+{
+	unsigned long max_kb;
+	ssize_t ret = queue_var_store(&max_kb, page, count);
+
+	if (!blk_queue_discard(q) && max_kb)
+		return -EINVAL;
+
+	q->discard_batch.max_kb = max_kb;
+	blk_discard_batch_kick(q);
+	return ret;
+}
+
+static ssize_t queue_discard_idle_show(struct request_queue *q, char *page)
+{
+	return queue_var_show(q->discard_batch.idle_msecs, page);
+}
+
+static ssize_t
+queue_discard_idle_store(struct request_queue *q, const char *page,
+			 size_t count)
+{
+	unsigned long msecs;
+	ssize_t ret = queue_var_store(&msecs, page, count);
+
+	q->discard_batch.idle_msecs = msecs;
+	blk_discard_batch_kick(q);
+	return ret;
+}
+
+static ssize_t queue_discard_stats_show(struct request_queue *q, char *page)
+{
+	struct blk_discard_batch *db = &q->discard_batch;
+	ssize_t ret;
+
+	spin_lock(&db->lock);
+	ret = sprintf(page, "queued %lu\nmerged %lu\nissued %lu\n"
+		      "cancelled_sectors %llu\npending_ranges %u\n"
+		      "pending_sectors %llu\n", db->queued, db->merged,
+		      db->issued, db->cancelled, db->nr_ranges,
+		      (unsigned long long)db->nr_sectors);
+	spin_unlock(&db->lock);
+	return ret;
+}
+
+static struct queue_sysfs_entry queue_discard_batch_entry = {
+	.attr = {.name = "discard_batch_kb", .mode = S_IRUGO | S_IWUSR },
+	.show = queue_discard_batch_show,
+	.store = queue_discard_batch_store,
+};
+
+static struct queue_sysfs_entry queue_discard_idle_entry = {
+	.attr = {.name = "discard_idle_ms", .mode = S_IRUGO | S_IWUSR },
+	.show = queue_discard_idle_show,
+	.store = queue_discard_idle_store,
+};
+
+static struct queue_sysfs_entry queue_discard_stats_entry = {
+	.attr = {.name = "discard_batch_stats", .mode = S_IRUGO },
+	.show = queue_discard_stats_show,
+};
+#endif
+
 static struct queue_sysfs_entry queue_requests_entry = {
 	.attr = {.name = "nr_requests", .mode = S_IRUGO | S_IWUSR },
 	.show = queue_requests_show,
@@ -348,6 +485,15 @@ static struct attribute *default_attrs[] = {
 	&queue_nomerges_entry.attr,
 	&queue_rq_affinity_entry.attr,
 	&queue_iostats_entry.attr,
+#ifdef CONFIG_BLK_DEV_LATENCY_HIST
+	&queue_read_latency_entry.attr,
+	&queue_write_latency_entry.attr,
+#endif
+#ifdef CONFIG_BLK_DEV_DISCARD_BATCH
+	&queue_discard_batch_entry.attr,
+	&queue_discard_idle_entry.attr,
+	&queue_discard_stats_entry.attr,
+#endif
 	NULL,
 };
 
@@ -417,6 +563,7 @@ static void blk_release_queue(struct kobject *kobj)
 	struct request_list *rl = &q->rq;
 
 	blk_sync_queue(q);
+	blk_discard_batch_exit(q);
 
 	if (rl->rq_pool)
 		mempool_destroy(rl->rq_pool);
@@ -57,6 +57,76 @@ static inline int blk_should_fake_timeout(struct request_queue *q)
 
 struct io_context *current_io_context(gfp_t gfp_flags, int node);
 
+#ifdef CONFIG_BLK_DEV_LATENCY_HIST
+static inline void blk_rq_set_start_time_ns(struct request *rq)
+{
+	rq->start_time_ns = ktime_to_ns(ktime_get());
+}
+
+static inline void blk_rq_set_io_start_time_ns(struct request *rq)
+{
+	rq->io_start_time_ns = ktime_to_ns(ktime_get());
+}
+
+static inline void blk_rq_merge_start_time_ns(struct request *rq,
+					      struct request *next)
+{
+	if (next->start_time_ns < rq->start_time_ns)
+		rq->start_time_ns = next->start_time_ns;
+}
+
+void blk_account_io_latency(struct request *rq);
+#else
+static inline void blk_rq_set_start_time_ns(struct request *rq)
+{
+}
+
+static inline void blk_rq_set_io_start_time_ns(struct request *rq)
+{
+}
+
+static inline void blk_rq_merge_start_time_ns(struct request *rq,
+					      struct request *next)
+{
+}
+
+static inline void blk_account_io_latency(struct request *rq)
+{
+}
+#endif
+
+#ifdef CONFIG_BLK_DEV_DISCARD_BATCH
+void blk_discard_batch_init(struct request_queue *q);
+void blk_discard_batch_exit(struct request_queue *q);
+int blk_discard_batch_bio(struct request_queue *q, struct bio *bio);
+void blk_discard_batch_kick(struct request_queue *q);
+
+/* batching is enabled, or was and ranges are still pending */
+static inline int blk_discard_batch_active(struct request_queue *q)
+{
+	return q->discard_batch.max_kb || q->discard_batch.bdev;
+}
+#else
+static inline void blk_discard_batch_init(struct request_queue *q)
+{
+}
+
+static inline void blk_discard_batch_exit(struct request_queue *q)
+{
+}
+
+static inline int blk_discard_batch_bio(struct request_queue *q,
+					struct bio *bio)
+{
+	return 0;
+}
+
+static inline int blk_discard_batch_active(struct request_queue *q)
+{
+	return 0;
+}
+#endif
+
 int ll_back_merge_fn(struct request_queue *q, struct request *req,
 		     struct bio *bio);
 int ll_front_merge_fn(struct request_queue *q, struct request *req, 
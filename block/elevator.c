@@ -771,6 +771,7 @@ struct request *elv_next_request(struct request_queue *q)
 			 * not be passed by new incoming requests
 			 */
 			rq->cmd_flags |= REQ_STARTED;
+			blk_rq_set_io_start_time_ns(rq);
 			trace_block_rq_issue(q, rq);
 		}
 
@@ -0,0 +1,519 @@
+/*
+ * Flash IO scheduler
+ * Based on the Simple (SIO) and Deadline IO schedulers.
+ *
+ * This scheduler is meant for devices without a seek penalty, such as
+ * eMMC, SD cards and NAND behind a translation layer.  Requests are not
+ * sorted.  They are kept in three FIFOs: sync reads, sync writes and
+ * async requests.  Each dispatch round, every non-empty FIFO can send
+ * up to its budget of requests, and the FIFOs are served in that order.
+ * Foreground reads therefore get ahead of writeback without starving
+ * it.  A request that has waited longer than its FIFO's expire time is
+ * sent before anything else.
+ *
+ * For each FIFO, the number of requests dispatched and a histogram of
+ * the latency from insertion to completion are kept.  They are shown in
+ * the elevator's sysfs directory together with the merge counts; see
+ * Documentation/block/flash-iosched.txt.
+ */
+#include <linux/blkdev.h>
+#include <linux/elevator.h>
+#include <linux/bio.h>
+#include <linux/module.h>
+#include <linux/init.h>
+#include <linux/slab.h>
+#include <linux/ktime.h>
+#include <linux/math64.h>
+
+enum {
+	SYNC_READ,
+	SYNC_WRITE,
+	ASYNC,
+	FLASH_NR_QUEUES,
+};
+
+static const char *flash_queue_names[FLASH_NR_QUEUES] = {
+	"sync_read", "sync_write", "async",
+};
+
+/* Tunables */
+static const int sync_read_expire = HZ / 10;	/* max time before a sync read is submitted */
+static const int sync_write_expire = HZ / 4;	/* ditto for sync writes */
+static const int async_expire = HZ;		/* ditto for async requests */
+static const int sync_read_budget = 8;		/* requests per dispatch round */
+static const int sync_write_budget = 4;
+static const int async_budget = 2;
+
+/* bucket i counts latencies below 2^i microseconds */
+#define FLASH_LAT_BUCKETS	24
+
+struct flash_stats {
+	unsigned long dispatched;
+	unsigned long expired;		/* of those, sent because they expired */
+	unsigned long completed;
+	u64 total_us;
+	unsigned long max_us;
+	unsigned long lat[FLASH_LAT_BUCKETS];
+};
+
+/* Elevator data */
+struct flash_data {
+	/* Request queues */
+	struct list_head fifo_list[FLASH_NR_QUEUES];
+
+	/* Requests sent from each queue in the current round */
+	int served[FLASH_NR_QUEUES];
+
+	/* Settings */
+	int fifo_expire[FLASH_NR_QUEUES];
+	int budget[FLASH_NR_QUEUES];
+
+	/* Statistics */
+	struct flash_stats stats[FLASH_NR_QUEUES];
+	unsigned long bio_merges;
+	unsigned long rq_merges;
+};
+
+/*
+ * elevator_private holds the time the request was added in microseconds,
+ * elevator_private2 the queue it was added to.
+ */
+#define RQ_ADDED_US(rq)		((unsigned long)(rq)->elevator_private)
+#define RQ_QUEUE(rq)		((int)(unsigned long)(rq)->elevator_private2)
+
+static inline unsigned long flash_now_us(void)
+{
+	return (unsigned long)ktime_to_us(ktime_get());
+}
+
+static inline int flash_rq_queue(struct request *rq)
+{
+	if (!rq_is_sync(rq))
+		return ASYNC;
+	return rq_data_dir(rq) == READ ? SYNC_READ : SYNC_WRITE;
+}
+
+static int
+flash_allow_merge(struct request_queue *q, struct request *rq,
+		  struct bio *bio)
+{
+	/*
+	 * Keep sync and async writes apart, or a sync write could end up
+	 * waiting in the async queue.
+	 */
+	if (bio_data_dir(bio) == WRITE && !!bio_sync(bio) != rq_is_sync(rq))
+		return 0;
+
+	return 1;
+}
+
+static void
+flash_merged_request(struct request_queue *q, struct request *rq, int type)
+{
+	struct flash_data *fd = q->elevator->elevator_data;
+
+	fd->bio_merges++;
+}
+
+static void
+flash_merged_requests(struct request_queue *q, struct request *rq,
+		      struct request *next)
+{
+	struct flash_data *fd = q->elevator->elevator_data;
+
+	/*
+	 * If next expires before rq, assign its expire time and queue to
+	 * rq and move into next position (next will be deleted) in fifo.
+	 */
+	if (!list_empty(&rq->queuelist) && !list_empty(&next->queuelist)) {
+		if (time_before(rq_fifo_time(next), rq_fifo_time(rq))) {
+			list_move(&rq->queuelist, &next->queuelist);
+			rq_set_fifo_time(rq, rq_fifo_time(next));
+			rq->elevator_private2 = next->elevator_private2;
+		}
+	}
+
+	/* Account the latency from whichever was added first */
+	if ((long)(RQ_ADDED_US(next) - RQ_ADDED_US(rq)) < 0)
+		rq->elevator_private = next->elevator_private;
+
+	/* Delete next request */
+	rq_fifo_clear(next);
+
+	fd->rq_merges++;
+}
+
+static void
+flash_add_request(struct request_queue *q, struct request *rq)
+{
+	struct flash_data *fd = q->elevator->elevator_data;
+	const int i = flash_rq_queue(rq);
+
+	rq->elevator_private = (void *)flash_now_us();
+	rq->elevator_private2 = (void *)(unsigned long)i;
+
+	/*
+	 * Add request to the proper fifo list and set its
+	 * expire time.
+	 */
+	rq_set_fifo_time(rq, jiffies + fd->fifo_expire[i]);
+	list_add_tail(&rq->queuelist, &fd->fifo_list[i]);
+}
+
+static int
+flash_queue_empty(struct request_queue *q)
+{
+	struct flash_data *fd = q->elevator->elevator_data;
+	int i;
+
+	for (i = 0; i < FLASH_NR_QUEUES; i++)
+		if (!list_empty(&fd->fifo_list[i]))
+			return 0;
+	return 1;
+}
+
+/*
+ * Of the requests at the head of each fifo that have expired, return
+ * the one that expired first.
+ */
+static struct request *
+flash_expired_request(struct flash_data *fd)
+{
+	struct request *rq, *oldest = NULL;
+	int i;
+
+	for (i = 0; i < FLASH_NR_QUEUES; i++) {
+		if (list_empty(&fd->fifo_list[i]))
+			continue;
+
+		rq = rq_entry_fifo(fd->fifo_list[i].next);
+		if (!time_after(jiffies, rq_fifo_time(rq)))
+			continue;
+
+		if (!oldest || time_before(rq_fifo_time(rq),
+					   rq_fifo_time(oldest)))
+			oldest = rq;
+	}
+
+	return oldest;
+}
+
+/*
+ * Pick the first non-empty fifo, in priority order, that has budget
+ * left in this round.  Once every non-empty fifo has used up its
+ * budget, start a new round.
+ */
+static int
+flash_choose_queue(struct flash_data *fd)
+{
+	int i;
+
+	for (i = 0; i < FLASH_NR_QUEUES; i++)
+		if (!list_empty(&fd->fifo_list[i]) &&
+		    fd->served[i] < fd->budget[i])
+			return i;
+
+	memset(fd->served, 0, sizeof(fd->served));
+
+	for (i = 0; i < FLASH_NR_QUEUES; i++)
+		if (!list_empty(&fd->fifo_list[i]))
+			return i;
+
+	return -1;
+}
+
+static int
+flash_dispatch_requests(struct request_queue *q, int force)
+{
+	struct flash_data *fd = q->elevator->elevator_data;
+	struct request *rq;
+	int i;
+
+	/* Expired requests go first, whatever the budgets say */
+	rq = flash_expired_request(fd);
+	if (rq) {
+		i = RQ_QUEUE(rq);
+		fd->stats[i].expired++;
+	} else {
+		i = flash_choose_queue(fd);
+		if (i < 0)
+			return 0;
+		rq = rq_entry_fifo(fd->fifo_list[i].next);
+	}
+
+	/*
+	 * Remove the request from the fifo list
+	 * and dispatch it.
+	 */
+	rq_fifo_clear(rq);
+	elv_dispatch_add_tail(rq->q, rq);
+
+	fd->served[i]++;
+	fd->stats[i].dispatched++;
+
+	return 1;
+}
+
+static void
+flash_completed_request(struct request_queue *q, struct request *rq)
+{
+	struct flash_data *fd = q->elevator->elevator_data;
+	struct flash_stats *st = &fd->stats[RQ_QUEUE(rq)];
+	unsigned long us = flash_now_us() - RQ_ADDED_US(rq);
+	int b = 0;
+
+	while (b < FLASH_LAT_BUCKETS - 1 && us >= (1UL << b))
+		b++;
+
+	st->completed++;
+	st->total_us += us;
+	if (us > st->max_us)
+		st->max_us = us;
+	st->lat[b]++;
+}
+
+static struct request *
+flash_former_request(struct request_queue *q, struct request *rq)
+{
+	struct flash_data *fd = q->elevator->elevator_data;
+
+	if (rq->queuelist.prev == &fd->fifo_list[RQ_QUEUE(rq)])
+		return NULL;
+
+	/* Return former request */
+	return list_entry(rq->queuelist.prev, struct request, queuelist);
+}
+
+static struct request *
+flash_latter_request(struct request_queue *q, struct request *rq)
+{
+	struct flash_data *fd = q->elevator->elevator_data;
+
+	if (rq->queuelist.next == &fd->fifo_list[RQ_QUEUE(rq)])
+		return NULL;
+
+	/* Return latter request */
+	return list_entry(rq->queuelist.next, struct request, queuelist);
+}
+
+static void *
+flash_init_queue(struct request_queue *q)
+{
+	struct flash_data *fd;
+	int i;
+
+	/* Allocate structure */
+	fd = kmalloc_node(sizeof(*fd), GFP_KERNEL | __GFP_ZERO, q->node);
+	if (!fd)
+		return NULL;
+
+	/* Initialize fifo lists */
+	for (i = 0; i < FLASH_NR_QUEUES; i++)
+		INIT_LIST_HEAD(&fd->fifo_list[i]);
+
+	/* Initialize data */
+	fd->fifo_expire[SYNC_READ] = sync_read_expire;
+	fd->fifo_expire[SYNC_WRITE] = sync_write_expire;
+	fd->fifo_expire[ASYNC] = async_expire;
+	fd->budget[SYNC_READ] = sync_read_budget;
+	fd->budget[SYNC_WRITE] = sync_write_budget;
+	fd->budget[ASYNC] = async_budget;
+
+	return fd;
+}
+
+static void
+flash_exit_queue(struct elevator_queue *e)
+{
+	struct flash_data *fd = e->elevator_data;
+	int i;
+
+	for (i = 0; i < FLASH_NR_QUEUES; i++)
+		BUG_ON(!list_empty(&fd->fifo_list[i]));
+
+	/* Free structure */
+	kfree(fd);
+}
+
+/*
+ * sysfs code
+ */
+
+static ssize_t
+flash_var_show(int var, char *page)
+{
+	return sprintf(page, "%d\n", var);
+}
+
+static ssize_t
+flash_var_store(int *var, const char *page, size_t count)
+{
+	char *p = (char *) page;
+
+	*var = simple_strtol(p, &p, 10);
+	return count;
+}
+
+#define SHOW_FUNCTION(__FUNC, __VAR, __CONV)				\
+static ssize_t __FUNC(struct elevator_queue *e, char *page)		\
+{									\
+	struct flash_data *fd = e->elevator_data;			\
+	int __data = __VAR;						\
+	if (__CONV)							\
+		__data = jiffies_to_msecs(__data);			\
+	return flash_var_show(__data, (page));				\
+}
+SHOW_FUNCTION(flash_sync_read_expire_show, fd->fifo_expire[SYNC_READ], 1);
+SHOW_FUNCTION(flash_sync_write_expire_show, fd->fifo_expire[SYNC_WRITE], 1);
+SHOW_FUNCTION(flash_async_expire_show, fd->fifo_expire[ASYNC], 1);
+SHOW_FUNCTION(flash_sync_read_budget_show, fd->budget[SYNC_READ], 0);
+SHOW_FUNCTION(flash_sync_write_budget_show, fd->budget[SYNC_WRITE], 0);
+SHOW_FUNCTION(flash_async_budget_show, fd->budget[ASYNC], 0);
+#undef SHOW_FUNCTION
+
+#define STORE_FUNCTION(__FUNC, __PTR, MIN, MAX, __CONV)			\
+static ssize_t __FUNC(struct elevator_queue *e, const char *page, size_t count)	\
+{									\
+	struct flash_data *fd = e->elevator_data;			\
+	int __data;							\
+	int ret = flash_var_store(&__data, (page), count);		\
+	if (__data < (MIN))						\
+		__data = (MIN);						\
+	else if (__data > (MAX))					\
+		__data = (MAX);						\
+	if (__CONV)							\
+		*(__PTR) = msecs_to_jiffies(__data);			\
+	else								\
+		*(__PTR) = __data;					\
+	return ret;							\
+}
+STORE_FUNCTION(flash_sync_read_expire_store, &fd->fifo_expire[SYNC_READ], 0, INT_MAX, 1);
+STORE_FUNCTION(flash_sync_write_expire_store, &fd->fifo_expire[SYNC_WRITE], 0, INT_MAX, 1);
+STORE_FUNCTION(flash_async_expire_store, &fd->fifo_expire[ASYNC], 0, INT_MAX, 1);
+STORE_FUNCTION(flash_sync_read_budget_store, &fd->budget[SYNC_READ], 1, INT_MAX, 0);
+STORE_FUNCTION(flash_sync_write_budget_store, &fd->budget[SYNC_WRITE], 1, INT_MAX, 0);
+STORE_FUNCTION(flash_async_budget_store, &fd->budget[ASYNC], 1, INT_MAX, 0);
+#undef STORE_FUNCTION
+
+static ssize_t
+flash_stats_show(struct flash_data *fd, int i, char *page)
+{
+	struct flash_stats *st = &fd->stats[i];
+	char *p = page;
+	int b, first, last;
+
+	p += sprintf(p, "%s: dispatched %lu expired %lu completed %lu\n",
+		     flash_queue_names[i], st->dispatched, st->expired,
+		     st->completed);
+	p += sprintf(p, "%s: latency avg %llu max %lu us\n",
+		     flash_queue_names[i],
+		     st->completed ? (unsigned long long)
+			div_u64(st->total_us, st->completed) : 0ULL,
+		     st->max_us);
+
+	for (first = 0; first < FLASH_LAT_BUCKETS && !st->lat[first]; first++)
+		;
+	for (last = FLASH_LAT_BUCKETS - 1; last > first && !st->lat[last];
+	     last--)
+		;
+	for (b = first; b <= last && b < FLASH_LAT_BUCKETS; b++)
+		p += sprintf(p, "%s: < %8lu us %lu\n", flash_queue_names[i],
+			     1UL << b, st->lat[b]);
+
+	return p - page;
+}
+
+#define STATS_FUNCTIONS(__NAME, __QUEUE)				\
+static ssize_t flash_##__NAME##_stats_show(struct elevator_queue *e,	\
+					   char *page)			\
+{									\
+	return flash_stats_show(e->elevator_data, __QUEUE, page);	\
+}									\
+static ssize_t flash_##__NAME##_stats_store(struct elevator_queue *e,	\
+					    const char *page,		\
+					    size_t count)		\
+{									\
+	struct flash_data *fd = e->elevator_data;			\
+	memset(&fd->stats[__QUEUE], 0, sizeof(fd->stats[__QUEUE]));	\
+	return count;							\
+}
+STATS_FUNCTIONS(sync_read, SYNC_READ);
+STATS_FUNCTIONS(sync_write, SYNC_WRITE);
+STATS_FUNCTIONS(async, ASYNC);
+#undef STATS_FUNCTIONS
+
+static ssize_t
+flash_merges_show(struct elevator_queue *e, char *page)
+{
+	struct flash_data *fd = e->elevator_data;
+
+	return sprintf(page, "bio %lu request %lu\n", fd->bio_merges,
+		       fd->rq_merges);
+}
+
+static ssize_t
+flash_merges_store(struct elevator_queue *e, const char *page, size_t count)
+{
+	struct flash_data *fd = e->elevator_data;
+
+	fd->bio_merges = fd->rq_merges = 0;
+	return count;
+}
+
+#define DD_ATTR(name) \
+	__ATTR(name, S_IRUGO|S_IWUSR, flash_##name##_show, \
+				      flash_##name##_store)
+
+static struct elv_fs_entry flash_attrs[] = {
+	DD_ATTR(sync_read_expire),
+	DD_ATTR(sync_write_expire),
+	DD_ATTR(async_expire),
+	DD_ATTR(sync_read_budget),
+	DD_ATTR(sync_write_budget),
+	DD_ATTR(async_budget),
+	DD_ATTR(sync_read_stats),
+	DD_ATTR(sync_write_stats),
+	DD_ATTR(async_stats),
+	DD_ATTR(merges),
+	__ATTR_NULL
+};
+
+static struct elevator_type iosched_flash = {
+	.ops = {
+		.elevator_allow_merge_fn	= flash_allow_merge,
+		.elevator_merged_fn		= flash_merged_request,
+		.elevator_merge_req_fn		= flash_merged_requests,
+		.elevator_dispatch_fn		= flash_dispatch_requests,
+		.elevator_add_req_fn		= flash_add_request,
+		.elevator_queue_empty_fn	= flash_queue_empty,
+		.elevator_completed_req_fn	= flash_completed_request,
+		.elevator_former_req_fn		= flash_former_request,
+		.elevator_latter_req_fn		= flash_latter_request,
+		.elevator_init_fn		= flash_init_queue,
+		.elevator_exit_fn		= flash_exit_queue,
+	},
+
+	.elevator_attrs = flash_attrs,
+	.elevator_name = "flash",
+	.elevator_owner = THIS_MODULE,
+};
+
+static int __init flash_init(void)
+{
+	/* Register elevator */
+	elv_register(&iosched_flash);
+
+	return 0;
+}
+
+static void __exit flash_exit(void)
+{
+	/* Unregister elevator */
+	elv_unregister(&iosched_flash);
+}
+
+module_init(flash_init);
+module_exit(flash_exit);
+
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("Flash IO scheduler");
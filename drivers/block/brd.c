@@ -170,6 +170,26 @@ static void brd_free_pages(struct brd_device *brd)
 	} while (nr_pages == FREE_BATCH);
 }
 
+/*
+ * Zero the pages wholly inside a discarded range.  They are not freed:
+ * brd_lookup_page relies on pages never being deleted while the device is
+ * open.
+ */
+static void discard_from_brd(struct brd_device *brd,
+			sector_t sector, size_t n)
+{
+	struct page *page;
+	sector_t end = sector + (n >> SECTOR_SHIFT);
+
+	sector = ALIGN(sector, PAGE_SECTORS);
+	while (sector + PAGE_SECTORS <= end) {
+		page = brd_lookup_page(brd, sector);
+		if (page)
+			clear_highpage(page);
+		sector += PAGE_SECTORS;
+	}
+}
+
 /*
  * copy_to_brd_setup must be called before copy_to_brd. It may sleep.
  */
@@ -298,6 +318,12 @@ static int brd_make_request(struct request_queue *q, struct bio *bio)
 						get_capacity(bdev->bd_disk))
 		goto out;
 
+	if (unlikely(bio_discard(bio))) {
+		err = 0;
+		discard_from_brd(brd, sector, bio->bi_size);
+		goto out;
+	}
+
 	rw = bio_rw(bio);
 	if (rw == READA)
 		rw = READ;
@@ -438,6 +464,10 @@ static struct brd_device *brd_alloc(int i)
 	blk_queue_max_sectors(brd->brd_queue, 1024);
 	blk_queue_bounce_limit(brd->brd_queue, BLK_BOUNCE_ANY);
 
+	brd->brd_queue->limits.discard_granularity = PAGE_SIZE;
+	blk_queue_max_discard_sectors(brd->brd_queue, UINT_MAX);
+	queue_flag_set_unlocked(QUEUE_FLAG_DISCARD, brd->brd_queue);
+
 	disk = brd->brd_disk = alloc_disk(1 << part_shift);
 	if (!disk)
 		goto out_free_queue;
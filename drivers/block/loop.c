@@ -74,6 +74,8 @@
 #include <linux/gfp.h>
 #include <linux/kthread.h>
 #include <linux/splice.h>
+#include <linux/vmalloc.h>
+#include <linux/mempool.h>
 
 #include <asm/uaccess.h>
 
@@ -82,6 +84,9 @@ static DEFINE_MUTEX(loop_devices_mutex);
 
 static int max_part;
 static int part_shift;
+static int use_bmap;
+static struct bio_set *loop_bio_set;
+static mempool_t *loop_map_pool;
 
 /*
  * Transfer functions
@@ -509,6 +514,415 @@ static struct bio *loop_get_bio(struct loop_device *lo)
 	return bio;
 }
 
+/*
+ * With the bmap module parameter set, a loop device backed by a regular
+ * file whose blocks are all allocated sends its bios straight to the
+ * file's blocks on the underlying block device, found with bmap() when the
+ * device is set up, instead of through the file's page cache.  The data is
+ * then cached once, for the loop device, rather than also for the backing
+ * file, and no copy is made.  As with swap files, the file is marked
+ * S_SWAPFILE meanwhile so that it can not be truncated, and its page cache
+ * is dropped as it would go stale, when the mapping is set up and again
+ * once the bios sent to the blocks have completed when it is released.
+ * Files with unwritten (preallocated) extents are not mapped: bmap() gives
+ * their blocks like any other, but those must read back as zeroes.
+ * Anything else takes the loop thread path.
+ */
+struct loop_extent {
+	sector_t	sector;		/* on the loop device */
+	sector_t	nr_sects;
+	sector_t	phys;		/* on lo_map_bdev */
+};
+
+/* beyond that the file is too fragmented to be worth mapping */
+#define LOOP_MAX_EXTENTS	65536
+
+/* tracks the pieces of a bio which spans several extents */
+struct loop_split {
+	struct loop_device	*lo;
+	struct bio		*bio;
+	atomic_t		remaining;
+	int			error;
+};
+
+/* a bio sent to the backing file's blocks as it is */
+struct loop_map_io {
+	struct loop_device	*lo;
+	bio_end_io_t		*end_io;
+	void			*private;
+};
+
+/* flags of the fiemap extents which do not hold the data bmap() points at */
+#define LOOP_FIEMAP_UNMAPPABLE	(FIEMAP_EXTENT_UNKNOWN | \
+				 FIEMAP_EXTENT_DELALLOC | \
+				 FIEMAP_EXTENT_ENCODED | \
+				 FIEMAP_EXTENT_NOT_ALIGNED | \
+				 FIEMAP_EXTENT_DATA_INLINE | \
+				 FIEMAP_EXTENT_DATA_TAIL | \
+				 FIEMAP_EXTENT_UNWRITTEN)
+
+#define LOOP_FIEMAP_BATCH	32
+
+static struct loop_extent *loop_find_extent(struct loop_device *lo,
+					    sector_t sector)
+{
+	int lo_ext = 0, hi_ext = lo->lo_nr_extents - 1, mid;
+
+	while (lo_ext < hi_ext) {
+		mid = (lo_ext + hi_ext + 1) / 2;
+		if (lo->lo_extents[mid].sector <= sector)
+			lo_ext = mid;
+		else
+			hi_ext = mid - 1;
+	}
+	return &lo->lo_extents[lo_ext];
+}
+
+/* a bio sent to the backing file's blocks has completed */
+static void loop_map_put(struct loop_device *lo)
+{
+	if (atomic_dec_and_test(&lo->lo_map_inflight))
+		wake_up(&lo->lo_map_wait);
+}
+
+static void loop_map_end_io(struct bio *bio, int error)
+{
+	struct loop_map_io *io = bio->bi_private;
+	struct loop_device *lo = io->lo;
+
+	bio->bi_end_io = io->end_io;
+	bio->bi_private = io->private;
+	mempool_free(io, loop_map_pool);
+	bio_endio(bio, error);
+	loop_map_put(lo);
+}
+
+static void loop_split_put(struct loop_split *split)
+{
+	struct loop_device *lo = split->lo;
+
+	if (atomic_dec_and_test(&split->remaining)) {
+		bio_endio(split->bio, split->error);
+		kfree(split);
+		loop_map_put(lo);
+	}
+}
+
+static void loop_split_end_io(struct bio *bio, int error)
+{
+	struct loop_split *split = bio->bi_private;
+
+	if (error)
+		split->error = error;
+	bio_put(bio);
+	loop_split_put(split);
+}
+
+static void loop_bio_destructor(struct bio *bio)
+{
+	bio_free(bio, loop_bio_set);
+}
+
+static struct bio *loop_split_alloc(struct loop_device *lo,
+				    struct loop_split *split, sector_t phys,
+				    int nr_vecs)
+{
+	struct bio *bio;
+
+	bio = bio_alloc_bioset(GFP_NOIO, min(nr_vecs, BIO_MAX_PAGES),
+			       loop_bio_set);
+	if (!bio)
+		return NULL;
+	bio->bi_destructor = loop_bio_destructor;
+	bio->bi_sector = phys;
+	bio->bi_bdev = lo->lo_map_bdev;
+	bio->bi_rw = split->bio->bi_rw;
+	bio->bi_end_io = loop_split_end_io;
+	bio->bi_private = split;
+	atomic_inc(&split->remaining);
+	return bio;
+}
+
+/*
+ * Send a bio spanning several extents as one bio per physically contiguous
+ * part.  Only happens for bios crossing a discontiguity in the file.
+ */
+static void loop_bmap_split(struct loop_device *lo, struct bio *bio)
+{
+	struct loop_split *split;
+	struct loop_extent *ext;
+	struct bio_vec *bvec;
+	struct bio *child = NULL;
+	sector_t sector = bio->bi_sector;
+	sector_t phys, next_phys = 0;
+	unsigned int off, len, n;
+	int i;
+
+	split = kmalloc(sizeof(*split), GFP_NOIO);
+	if (!split) {
+		bio_endio(bio, -ENOMEM);
+		return;
+	}
+	atomic_inc(&lo->lo_map_inflight);
+	split->lo = lo;
+	split->bio = bio;
+	split->error = 0;
+	atomic_set(&split->remaining, 1);
+
+	bio_for_each_segment(bvec, bio, i) {
+		off = bvec->bv_offset;
+		len = bvec->bv_len;
+		while (len) {
+			ext = loop_find_extent(lo, sector);
+			phys = ext->phys + sector - ext->sector;
+			n = min_t(sector_t, len >> 9,
+				  ext->sector + ext->nr_sects - sector) << 9;
+
+			if (child && (phys != next_phys ||
+			    bio_add_page(child, bvec->bv_page, n, off) < n)) {
+				generic_make_request(child);
+				child = NULL;
+			}
+			if (!child) {
+				child = loop_split_alloc(lo, split, phys,
+							 bio->bi_vcnt - i + 1);
+				if (!child ||
+				    bio_add_page(child, bvec->bv_page, n, off) < n)
+					goto fail;
+			}
+			next_phys = phys + (n >> 9);
+			sector += n >> 9;
+			off += n;
+			len -= n;
+		}
+	}
+	generic_make_request(child);
+	loop_split_put(split);
+	return;
+
+fail:
+	split->error = -EIO;
+	if (child)
+		bio_endio(child, -EIO);
+	loop_split_put(split);
+}
+
+/*
+ * Remap a bio to the backing file's blocks, or queue it for the loop thread
+ * if the mapping went away.  Returns 1 if the bio was remapped in place and
+ * is to be resubmitted, as a make_request_fn does.
+ */
+static int loop_bmap_request(struct loop_device *lo, struct bio *bio)
+{
+	struct loop_extent *ext;
+	struct loop_map_io *io;
+	sector_t sector = bio->bi_sector;
+	int ret = 0;
+
+	down_read(&lo->lo_map_sem);
+	if (unlikely(!lo->lo_extents)) {
+		spin_lock_irq(&lo->lo_lock);
+		loop_add_bio(lo, bio);
+		wake_up(&lo->lo_event);
+		spin_unlock_irq(&lo->lo_lock);
+		goto out;
+	}
+
+	ext = loop_find_extent(lo, sector);
+	if (likely(bio_sectors(bio) <= ext->sector + ext->nr_sects - sector)) {
+		/* see its completion, so that release can wait for it */
+		io = mempool_alloc(loop_map_pool, GFP_NOIO);
+		io->lo = lo;
+		io->end_io = bio->bi_end_io;
+		io->private = bio->bi_private;
+		bio->bi_end_io = loop_map_end_io;
+		bio->bi_private = io;
+		atomic_inc(&lo->lo_map_inflight);
+
+		bio->bi_bdev = lo->lo_map_bdev;
+		bio->bi_sector = ext->phys + sector - ext->sector;
+		ret = 1;
+	} else
+		loop_bmap_split(lo, bio);
+out:
+	up_read(&lo->lo_map_sem);
+	return ret;
+}
+
+/*
+ * Ask the filesystem, if it supports fiemap, whether the bytes [start, end)
+ * of the file are all in extents that hold their data where bmap() says.
+ * Returns 0 if they are or it can not tell, an error if they are not.
+ */
+static int loop_bmap_check_extents(struct inode *inode, u64 start, u64 end)
+{
+	struct fiemap_extent_info fieinfo;
+	struct fiemap_extent *extents, *ext;
+	mm_segment_t old_fs;
+	u64 next;
+	int i, ret = 0;
+
+	if (!inode->i_op->fiemap)
+		return 0;
+
+	extents = kmalloc(LOOP_FIEMAP_BATCH * sizeof(*extents), GFP_KERNEL);
+	if (!extents)
+		return -ENOMEM;
+
+	/* fiemap copies the extents out to user space */
+	old_fs = get_fs();
+	set_fs(KERNEL_DS);
+	while (start < end) {
+		memset(&fieinfo, 0, sizeof(fieinfo));
+		fieinfo.fi_extents_max = LOOP_FIEMAP_BATCH;
+		fieinfo.fi_extents_start = extents;
+		ret = inode->i_op->fiemap(inode, &fieinfo, start, end - start);
+		if (ret || !fieinfo.fi_extents_mapped)
+			break;
+
+		for (i = 0; i < fieinfo.fi_extents_mapped; i++)
+			if (extents[i].fe_flags & LOOP_FIEMAP_UNMAPPABLE)
+				ret = -EINVAL;
+		ext = &extents[fieinfo.fi_extents_mapped - 1];
+		next = ext->fe_logical + ext->fe_length;
+		if (ret || (ext->fe_flags & FIEMAP_EXTENT_LAST) || next <= start)
+			break;
+		start = next;
+	}
+	set_fs(old_fs);
+
+	kfree(extents);
+	return ret;
+}
+
+/*
+ * Map the whole of the device onto the backing file's blocks.  Returns 0
+ * if the device can bypass the backing file, or an error if it can not.
+ */
+static int loop_bmap_setup(struct loop_device *lo)
+{
+	struct file *file = lo->lo_backing_file;
+	struct address_space *mapping = file->f_mapping;
+	struct inode *inode = mapping->host;
+	struct block_device *bdev = inode->i_sb->s_bdev;
+	unsigned blkbits = inode->i_blkbits;
+	sector_t size = get_capacity(lo->lo_disk);
+	sector_t first, last, block, phys, prev = 0;
+	struct loop_extent *extents = NULL;
+	int nr, nr_alloc = 0;
+
+	if (!S_ISREG(inode->i_mode) || !mapping->a_ops->bmap || !bdev ||
+	    lo->lo_encryption || !size ||
+	    (lo->lo_offset & ((1 << blkbits) - 1)) ||
+	    bdev_logical_block_size(bdev) != 512 ||
+	    bdev_get_queue(bdev)->merge_bvec_fn)
+		return -EINVAL;
+
+	/* keep the blocks where they are, as swapon does */
+	mutex_lock(&inode->i_mutex);
+	if (IS_SWAPFILE(inode)) {
+		mutex_unlock(&inode->i_mutex);
+		return -EBUSY;
+	}
+	inode->i_flags |= S_SWAPFILE;
+	mutex_unlock(&inode->i_mutex);
+
+	/* have the delayed allocations done, bmap does not see them */
+	filemap_write_and_wait(mapping);
+
+	first = lo->lo_offset >> blkbits;
+	last = (lo->lo_offset + ((loff_t)size << 9) - 1) >> blkbits;
+
+	/* bmap() does not tell unwritten extents from written ones */
+	if (loop_bmap_check_extents(inode, (u64)first << blkbits,
+				    (u64)(last + 1) << blkbits))
+		goto fail;
+
+	/* count the extents, then fill them in */
+again:
+	nr = -1;
+	for (block = first; block <= last; block++) {
+		phys = bmap(inode, block);
+		if (!phys)
+			goto fail;		/* a hole */
+		if (nr >= 0 && phys == prev + 1) {
+			if (extents)
+				extents[nr].nr_sects += 1 << (blkbits - 9);
+		} else if (++nr == LOOP_MAX_EXTENTS ||
+			   (extents && nr == nr_alloc)) {
+			goto fail;
+		} else if (extents) {
+			extents[nr].sector = (block - first) << (blkbits - 9);
+			extents[nr].nr_sects = 1 << (blkbits - 9);
+			extents[nr].phys = phys << (blkbits - 9);
+		}
+		prev = phys;
+		cond_resched();
+	}
+	nr++;
+	if (!extents) {
+		nr_alloc = nr;
+		extents = vmalloc(nr_alloc * sizeof(*extents));
+		if (!extents)
+			goto fail;
+		goto again;
+	}
+
+	/* the pages cached for the file would go stale */
+	invalidate_inode_pages2(mapping);
+	blk_queue_stack_limits(lo->lo_queue, bdev_get_queue(bdev));
+
+	down_write(&lo->lo_map_sem);
+	lo->lo_extents = extents;
+	lo->lo_nr_extents = nr;
+	lo->lo_map_bdev = bdev;
+	lo->lo_flags |= LO_FLAGS_BMAP;
+	up_write(&lo->lo_map_sem);
+
+	printk(KERN_INFO "loop%d: %d extents mapped on %s\n", lo->lo_number,
+	       nr, bdev->bd_disk->disk_name);
+	return 0;
+
+fail:
+	vfree(extents);
+	mutex_lock(&inode->i_mutex);
+	inode->i_flags &= ~S_SWAPFILE;
+	mutex_unlock(&inode->i_mutex);
+	return -EINVAL;
+}
+
+/*
+ * Go back to reading and writing through the backing file.  New bios wait
+ * on lo_map_sem until the bios already sent to the file's blocks have
+ * completed and the pages the file got meanwhile, which may be stale, have
+ * been dropped.
+ */
+static void loop_bmap_release(struct loop_device *lo)
+{
+	struct address_space *mapping = lo->lo_backing_file->f_mapping;
+	struct inode *inode = mapping->host;
+	struct loop_extent *extents;
+
+	if (!(lo->lo_flags & LO_FLAGS_BMAP))
+		return;
+
+	down_write(&lo->lo_map_sem);
+	wait_event(lo->lo_map_wait, !atomic_read(&lo->lo_map_inflight));
+	truncate_inode_pages(mapping, 0);
+
+	extents = lo->lo_extents;
+	lo->lo_extents = NULL;
+	lo->lo_nr_extents = 0;
+	lo->lo_map_bdev = NULL;
+	lo->lo_flags &= ~LO_FLAGS_BMAP;
+	up_write(&lo->lo_map_sem);
+	vfree(extents);
+
+	mutex_lock(&inode->i_mutex);
+	inode->i_flags &= ~S_SWAPFILE;
+	mutex_unlock(&inode->i_mutex);
+}
+
 static int loop_make_request(struct request_queue *q, struct bio *old_bio)
 {
 	struct loop_device *lo = q->queuedata;
@@ -524,6 +938,10 @@ static int loop_make_request(struct request_queue *q, struct bio *old_bio)
 		goto out;
 	if (unlikely(rw == WRITE && (lo->lo_flags & LO_FLAGS_READ_ONLY)))
 		goto out;
+	if (lo->lo_flags & LO_FLAGS_BMAP) {
+		spin_unlock_irq(&lo->lo_lock);
+		return loop_bmap_request(lo, old_bio);
+	}
 	loop_add_bio(lo, old_bio);
 	wake_up(&lo->lo_event);
 	spin_unlock_irq(&lo->lo_lock);
@@ -671,7 +1089,7 @@ static int loop_change_fd(struct loop_device *lo, struct block_device *bdev,
 {
 	struct file	*file, *old_file;
 	struct inode	*inode;
-	int		error;
+	int		error, remap;
 
 	error = -ENXIO;
 	if (lo->lo_state != Lo_bound)
@@ -704,7 +1122,11 @@ static int loop_change_fd(struct loop_device *lo, struct block_device *bdev,
 		goto out_putf;
 
 	/* and ... switch */
+	remap = lo->lo_flags & LO_FLAGS_BMAP;
+	loop_bmap_release(lo);
 	error = loop_switch(lo, file);
+	if (remap)
+		loop_bmap_setup(lo);
 	if (error)
 		goto out_putf;
 
@@ -830,6 +1252,9 @@ static int loop_set_fd(struct loop_device *lo, fmode_t mode,
 
 	set_blocksize(bdev, lo_blocksize);
 
+	if (use_bmap)
+		loop_bmap_setup(lo);
+
 	lo->lo_thread = kthread_create(loop_thread, lo, "loop%d",
 						lo->lo_number);
 	if (IS_ERR(lo->lo_thread)) {
@@ -843,6 +1268,7 @@ static int loop_set_fd(struct loop_device *lo, fmode_t mode,
 	return 0;
 
 out_clr:
+	loop_bmap_release(lo);
 	lo->lo_thread = NULL;
 	lo->lo_device = NULL;
 	lo->lo_backing_file = NULL;
@@ -916,6 +1342,7 @@ static int loop_clr_fd(struct loop_device *lo, struct block_device *bdev)
 	spin_unlock_irq(&lo->lo_lock);
 
 	kthread_stop(lo->lo_thread);
+	loop_bmap_release(lo);
 
 	lo->lo_queue->unplug_fn = NULL;
 	lo->lo_backing_file = NULL;
@@ -979,16 +1406,28 @@ loop_set_status(struct loop_device *lo, const struct loop_info64 *info)
 	} else
 		xfer = NULL;
 
+	/* the transfer functions are run by the loop thread */
+	if (xfer)
+		loop_bmap_release(lo);
+
 	err = loop_init_xfer(lo, xfer, info);
 	if (err)
 		return err;
 
 	if (lo->lo_offset != info->lo_offset ||
 	    lo->lo_sizelimit != info->lo_sizelimit) {
+		int remap = lo->lo_flags & LO_FLAGS_BMAP;
+
+		loop_bmap_release(lo);
 		lo->lo_offset = info->lo_offset;
 		lo->lo_sizelimit = info->lo_sizelimit;
 		if (figure_loop_size(lo))
 			return -EFBIG;
+		if (remap) {
+			/* let the bios queued meanwhile through the file */
+			loop_flush(lo);
+			loop_bmap_setup(lo);
+		}
 	}
 
 	memcpy(lo->lo_file_name, info->lo_file_name, LO_NAME_SIZE);
@@ -1404,6 +1843,8 @@ module_param(max_loop, int, 0);
 MODULE_PARM_DESC(max_loop, "Maximum number of loop devices");
 module_param(max_part, int, 0);
 MODULE_PARM_DESC(max_part, "Maximum number of partitions per loop device");
+module_param_named(bmap, use_bmap, bool, 0644);
+MODULE_PARM_DESC(bmap, "Bypass the page cache of fully allocated backing files");
 MODULE_LICENSE("GPL");
 MODULE_ALIAS_BLOCKDEV_MAJOR(LOOP_MAJOR);
 
@@ -1461,6 +1902,9 @@ static struct loop_device *loop_alloc(int i)
 		goto out_free_queue;
 
 	mutex_init(&lo->lo_ctl_mutex);
+	init_rwsem(&lo->lo_map_sem);
+	atomic_set(&lo->lo_map_inflight, 0);
+	init_waitqueue_head(&lo->lo_map_wait);
 	lo->lo_number		= i;
 	lo->lo_thread		= NULL;
 	init_waitqueue_head(&lo->lo_event);
@@ -1562,8 +2006,21 @@ static int __init loop_init(void)
 		range = 1UL << (MINORBITS - part_shift);
 	}
 
-	if (register_blkdev(LOOP_MAJOR, "loop"))
+	loop_bio_set = bioset_create(BIO_POOL_SIZE, 0);
+	if (!loop_bio_set)
+		return -ENOMEM;
+	loop_map_pool = mempool_create_kmalloc_pool(BIO_POOL_SIZE,
+						    sizeof(struct loop_map_io));
+	if (!loop_map_pool) {
+		bioset_free(loop_bio_set);
+		return -ENOMEM;
+	}
+
+	if (register_blkdev(LOOP_MAJOR, "loop")) {
+		mempool_destroy(loop_map_pool);
+		bioset_free(loop_bio_set);
 		return -EIO;
+	}
 
 	for (i = 0; i < nr; i++) {
 		lo = loop_alloc(i);
@@ -1590,6 +2047,8 @@ Enomem:
 		loop_free(lo);
 
 	unregister_blkdev(LOOP_MAJOR, "loop");
+	mempool_destroy(loop_map_pool);
+	bioset_free(loop_bio_set);
 	return -ENOMEM;
 }
 
@@ -1605,6 +2064,8 @@ static void __exit loop_exit(void)
 
 	blk_unregister_region(MKDEV(LOOP_MAJOR, 0), range);
 	unregister_blkdev(LOOP_MAJOR, "loop");
+	mempool_destroy(loop_map_pool);
+	bioset_free(loop_bio_set);
 }
 
 module_init(loop_init);
@@ -51,6 +51,38 @@ MODULE_ALIAS("mmc:block");
 
 static DECLARE_BITMAP(dev_use, MMC_NUM_MINORS);
 
+/*
+ * Most requests mmc_blk_pack_writes() puts into one transfer.
+ */
+#define MMC_BLK_PACK_MAX	16
+
+/*
+ * Why mmc_blk_pack_writes() stopped adding requests to a transfer.
+ */
+enum mmc_blk_pack_stop {
+	MMC_BLK_PACK_EMPTY,		/* nothing else queued */
+	MMC_BLK_PACK_NOT_WRITE,		/* next is a read or not a fs request */
+	MMC_BLK_PACK_NOT_CONTIG,	/* next does not follow on */
+	MMC_BLK_PACK_BARRIER,		/* barrier on either side */
+	MMC_BLK_PACK_SECTORS,		/* transfer would get too long */
+	MMC_BLK_PACK_SEGMENTS,		/* sg list would get too long */
+	MMC_BLK_PACK_FULL,		/* MMC_BLK_PACK_MAX requests */
+	MMC_BLK_PACK_STOP_NR,
+};
+
+static const char *mmc_blk_pack_stop_names[MMC_BLK_PACK_STOP_NR] = {
+	"empty", "not_write", "not_contig", "barrier", "sectors",
+	"segments", "full",
+};
+
+struct mmc_blk_pack_stats {
+	unsigned long	writes;		/* write transfers */
+	unsigned long	packed;		/* of those, with more than one request */
+	unsigned long	unpacked;	/* split up again after an error */
+	unsigned long	nr_reqs[MMC_BLK_PACK_MAX + 1];	/* by requests */
+	unsigned long	stop[MMC_BLK_PACK_STOP_NR];
+};
+
 /*
  * There is one mmc_blk_data per slot.
  */
@@ -61,6 +93,9 @@ struct mmc_blk_data {
 
 	unsigned int	usage;
 	unsigned int	read_only;
+
+	unsigned int	write_packing;	/* sysfs write_packing */
+	struct mmc_blk_pack_stats pack_stats;
 };
 
 static DEFINE_MUTEX(open_lock);
@@ -144,13 +179,6 @@ static struct block_device_operations mmc_bdops = {
 	.owner			= THIS_MODULE,
 };
 
-struct mmc_blk_request {
-	struct mmc_request	mrq;
-	struct mmc_command	cmd;
-	struct mmc_command	stop;
-	struct mmc_data		data;
-};
-
 static u32 mmc_sd_num_wr_blocks(struct mmc_card *card)
 {
 	int err;
@@ -268,208 +296,479 @@ mmc_blk_set_blksize(struct mmc_blk_data *md, struct mmc_card *card)
 }
 
 
-static int mmc_blk_issue_rq(struct mmc_queue *mq, struct request *req)
+/*
+ * Sectors covered by the transfer for mqrq, including packed writes
+ */
+static unsigned int mmc_blk_rq_sectors(struct mmc_queue_req *mqrq)
+{
+	if (mqrq->packed_num)
+		return mqrq->packed_sectors;
+	return mqrq->req->nr_sectors;
+}
+
+/*
+ * Small writes tend to reach us one request at a time, each one costing
+ * a command and a busy wait.  If write packing is on, take the writes
+ * queued behind req that carry on where it ends and send them in the
+ * same multi-block write, for as long as they fit in one transfer.
+ *
+ * Cards with packed command support could take writes that do not
+ * follow on as well, but we have no packed command support.
+ */
+static void mmc_blk_pack_writes(struct mmc_queue *mq,
+				struct mmc_queue_req *mqrq)
 {
 	struct mmc_blk_data *md = mq->data;
-	struct mmc_card *card = md->queue.card;
-	struct mmc_blk_request brq;
-	int ret = 1, disable_multi = 0;
+	struct mmc_host *host = mq->card->host;
+	struct request_queue *q = mq->queue;
+	struct request *req = mqrq->req, *next;
+	unsigned int max_sectors, max_segs, sectors, segs;
+	sector_t end;
+	int stop;
+
+	mqrq->packed_num = 0;
+
+	if (!md->write_packing || rq_data_dir(req) != WRITE)
+		return;
+
+	max_sectors = min(queue_max_hw_sectors(q), host->max_blk_count);
+	max_sectors = min(max_sectors, host->max_req_size >> 9);
+	max_segs = min(queue_max_phys_segments(q), queue_max_hw_segments(q));
+
+	sectors = req->nr_sectors;
+	segs = req->nr_phys_segments;
+	end = req->sector + req->nr_sectors;
+
+	spin_lock_irq(q->queue_lock);
+	for (;;) {
+		if (blk_barrier_rq(req)) {
+			stop = MMC_BLK_PACK_BARRIER;
+			break;
+		}
+		if (mqrq->packed_num + 1 >= MMC_BLK_PACK_MAX) {
+			stop = MMC_BLK_PACK_FULL;
+			break;
+		}
 
-#ifdef CONFIG_MMC_BLOCK_DEFERRED_RESUME
-	if (mmc_bus_needs_resume(card->host)) {
-		mmc_resume_bus(card->host);
-		mmc_blk_set_blksize(md, card);
+		next = NULL;
+		if (!blk_queue_plugged(q))
+			next = elv_next_request(q);
+		if (!next) {
+			stop = MMC_BLK_PACK_EMPTY;
+			break;
+		}
+		if (!blk_fs_request(next) || rq_data_dir(next) != WRITE) {
+			stop = MMC_BLK_PACK_NOT_WRITE;
+			break;
+		}
+		if (blk_barrier_rq(next)) {
+			stop = MMC_BLK_PACK_BARRIER;
+			break;
+		}
+		if (next->sector != end) {
+			stop = MMC_BLK_PACK_NOT_CONTIG;
+			break;
+		}
+		if (sectors + next->nr_sectors > max_sectors) {
+			stop = MMC_BLK_PACK_SECTORS;
+			break;
+		}
+		if (segs + next->nr_phys_segments > max_segs) {
+			stop = MMC_BLK_PACK_SEGMENTS;
+			break;
+		}
+
+		blkdev_dequeue_request(next);
+		list_add_tail(&next->queuelist, &mqrq->packed_list);
+		mqrq->packed_num++;
+
+		sectors += next->nr_sectors;
+		segs += next->nr_phys_segments;
+		end += next->nr_sectors;
 	}
-#endif
+	spin_unlock_irq(q->queue_lock);
 
-	mmc_claim_host(card->host);
+	mqrq->packed_sectors = sectors;
 
-	do {
-		struct mmc_command cmd;
-		u32 readcmd, writecmd, status = 0;
-
-		memset(&brq, 0, sizeof(struct mmc_blk_request));
-		brq.mrq.cmd = &brq.cmd;
-		brq.mrq.data = &brq.data;
-
-		brq.cmd.arg = req->sector;
-		if (!mmc_card_blockaddr(card))
-			brq.cmd.arg <<= 9;
-		brq.cmd.flags = MMC_RSP_SPI_R1 | MMC_RSP_R1 | MMC_CMD_ADTC;
-		brq.data.blksz = 512;
-		brq.stop.opcode = MMC_STOP_TRANSMISSION;
-		brq.stop.arg = 0;
-		brq.stop.flags = MMC_RSP_SPI_R1B | MMC_RSP_R1B | MMC_CMD_AC;
-		brq.data.blocks = req->nr_sectors;
+	md->pack_stats.writes++;
+	if (mqrq->packed_num)
+		md->pack_stats.packed++;
+	md->pack_stats.nr_reqs[mqrq->packed_num + 1]++;
+	md->pack_stats.stop[stop]++;
+}
 
-		/*
-		 * The block layer doesn't support all sector count
-		 * restrictions, so we need to be prepared for too big
-		 * requests.
-		 */
-		if (brq.data.blocks > card->host->max_blk_count)
-			brq.data.blocks = card->host->max_blk_count;
+/*
+ * The packed transfer went through, complete all of its requests.
+ */
+static int mmc_blk_end_packed(struct mmc_blk_data *md,
+			      struct mmc_queue_req *mqrq)
+{
+	struct request *req;
 
-		/*
-		 * After a read error, we redo the request one sector at a time
-		 * in order to accurately determine which sectors can be read
-		 * successfully.
-		 */
-		if (disable_multi && brq.data.blocks > 1)
-			brq.data.blocks = 1;
+	spin_lock_irq(&md->lock);
+	__blk_end_request(mqrq->req, 0, blk_rq_bytes(mqrq->req));
+	while (!list_empty(&mqrq->packed_list)) {
+		req = list_entry(mqrq->packed_list.next, struct request,
+				 queuelist);
+		list_del_init(&req->queuelist);
+		__blk_end_request(req, 0, blk_rq_bytes(req));
+	}
+	spin_unlock_irq(&md->lock);
 
-		if (brq.data.blocks > 1) {
-			/* SPI multiblock writes terminate using a special
-			 * token, not a STOP_TRANSMISSION request.
-			 */
-			if (!mmc_host_is_spi(card->host)
-					|| rq_data_dir(req) == READ)
-				brq.mrq.stop = &brq.stop;
-			readcmd = MMC_READ_MULTIPLE_BLOCK;
-			writecmd = MMC_WRITE_MULTIPLE_BLOCK;
-		} else {
-			brq.mrq.stop = NULL;
-			readcmd = MMC_READ_SINGLE_BLOCK;
-			writecmd = MMC_WRITE_BLOCK;
-		}
+	mqrq->packed_num = 0;
 
-		if (rq_data_dir(req) == READ) {
-			brq.cmd.opcode = readcmd;
-			brq.data.flags |= MMC_DATA_READ;
-		} else {
-			brq.cmd.opcode = writecmd;
-			brq.data.flags |= MMC_DATA_WRITE;
+	return 0;
+}
+
+/*
+ * The packed transfer failed or fell short.  Put the requests packed
+ * behind the first one back at the head of the queue, where they will
+ * be issued again on their own, and carry on with the first request as
+ * if it had been sent alone.
+ */
+static void mmc_blk_unpack(struct mmc_blk_data *md,
+			   struct mmc_queue_req *mqrq)
+{
+	struct request_queue *q = md->queue.queue;
+	struct request *req;
+
+	spin_lock_irq(&md->lock);
+	while (!list_empty(&mqrq->packed_list)) {
+		req = list_entry(mqrq->packed_list.prev, struct request,
+				 queuelist);
+		list_del_init(&req->queuelist);
+		blk_requeue_request(q, req);
+	}
+	spin_unlock_irq(&md->lock);
+
+	mqrq->packed_num = 0;
+	mqrq->brq.data.bytes_xfered = min(mqrq->brq.data.bytes_xfered,
+					  blk_rq_bytes(mqrq->req));
+	md->pack_stats.unpacked++;
+}
+
+/*
+ * Put a request that was fetched and prepared but never started back at
+ * the head of the queue, with the requests packed behind it.
+ */
+static void mmc_blk_requeue(struct mmc_blk_data *md,
+			    struct mmc_queue_req *mqrq)
+{
+	struct request_queue *q = md->queue.queue;
+	struct request *req;
+
+	spin_lock_irq(&md->lock);
+	while (!list_empty(&mqrq->packed_list)) {
+		req = list_entry(mqrq->packed_list.prev, struct request,
+				 queuelist);
+		list_del_init(&req->queuelist);
+		blk_requeue_request(q, req);
+	}
+	blk_requeue_request(q, mqrq->req);
+	spin_unlock_irq(&md->lock);
+
+	mqrq->packed_num = 0;
+	mqrq->req = NULL;
+}
+
+enum mmc_blk_status {
+	MMC_BLK_SUCCESS = 0,
+	MMC_BLK_PARTIAL,
+	MMC_BLK_RETRY_SINGLE,
+	MMC_BLK_DATA_ERR,
+	MMC_BLK_CMD_ERR,
+};
+
+/*
+ * Called by the core as soon as a request has completed, before the
+ * next one is started, so anything that has to happen between two
+ * requests (waiting for the card to leave programming mode) goes here.
+ * A non zero return keeps the next request from being started.
+ */
+static int mmc_blk_err_check(struct mmc_card *card,
+			     struct mmc_async_req *areq)
+{
+	struct mmc_queue_req *mq_mrq = container_of(areq, struct mmc_queue_req,
+						    mmc_active);
+	struct mmc_blk_request *brq = &mq_mrq->brq;
+	struct request *req = mq_mrq->req;
+	struct mmc_command cmd;
+	u32 status = 0;
+
+	/*
+	 * Check for errors here, but don't give up until later as we
+	 * need to wait for the card to leave programming mode even when
+	 * things go wrong.
+	 */
+	if (brq->cmd.error || brq->data.error || brq->stop.error) {
+		if (brq->data.blocks > 1 && rq_data_dir(req) == READ) {
+			/* Redo read one sector at a time */
+			printk(KERN_WARNING "%s: retrying using single "
+			       "block read\n", req->rq_disk->disk_name);
+			return MMC_BLK_RETRY_SINGLE;
 		}
+		status = get_card_status(card, req);
+	}
+
+	if (brq->cmd.error) {
+		printk(KERN_ERR "%s: error %d sending read/write "
+		       "command, response %#x, card status %#x\n",
+		       req->rq_disk->disk_name, brq->cmd.error,
+		       brq->cmd.resp[0], status);
+	}
+
+	if (brq->data.error) {
+		if (brq->data.error == -ETIMEDOUT && brq->mrq.stop)
+			/* 'Stop' response contains card status */
+			status = brq->mrq.stop->resp[0];
+		printk(KERN_ERR "%s: error %d transferring data,"
+		       " sector %u, nr %u, card status %#x\n",
+		       req->rq_disk->disk_name, brq->data.error,
+		       (unsigned)req->sector,
+		       (unsigned)req->nr_sectors, status);
+	}
+
+	if (brq->stop.error) {
+		printk(KERN_ERR "%s: error %d sending stop command, "
+		       "response %#x, card status %#x\n",
+		       req->rq_disk->disk_name, brq->stop.error,
+		       brq->stop.resp[0], status);
+	}
 
-		mmc_set_data_timeout(&brq.data, card);
+	if (!mmc_host_is_spi(card->host) && rq_data_dir(req) != READ) {
+		do {
+			int err;
+
+			cmd.opcode = MMC_SEND_STATUS;
+			cmd.arg = card->rca << 16;
+			cmd.flags = MMC_RSP_R1 | MMC_CMD_AC;
+			err = mmc_wait_for_cmd(card->host, &cmd, 5);
+			if (err) {
+				printk(KERN_ERR "%s: error %d requesting status\n",
+				       req->rq_disk->disk_name, err);
+				return MMC_BLK_CMD_ERR;
+			}
+			/*
+			 * Some cards mishandle the status bits,
+			 * so make sure to check both the busy
+			 * indication and the card state.
+			 */
+		} while (!(cmd.resp[0] & R1_READY_FOR_DATA) ||
+			(R1_CURRENT_STATE(cmd.resp[0]) == 7));
 
-		brq.data.sg = mq->sg;
-		brq.data.sg_len = mmc_queue_map_sg(mq);
+#if 0
+		if (cmd.resp[0] & ~0x00000900)
+			printk(KERN_ERR "%s: status = %08x\n",
+			       req->rq_disk->disk_name, cmd.resp[0]);
+		if (mmc_decode_status(cmd.resp))
+			return MMC_BLK_CMD_ERR;
+#endif
+	}
 
+	if (brq->cmd.error || brq->stop.error || brq->data.error) {
 		/*
-		 * Adjust the sg list so it is the same size as the
-		 * request.
+		 * After an error, we redo I/O one sector at a time, so
+		 * for reads we only reach here after trying to read a
+		 * single sector.
 		 */
-		if (brq.data.blocks != req->nr_sectors) {
-			int i, data_size = brq.data.blocks << 9;
-			struct scatterlist *sg;
-
-			for_each_sg(brq.data.sg, sg, brq.data.sg_len, i) {
-				data_size -= sg->length;
-				if (data_size <= 0) {
-					sg->length += data_size;
-					i++;
-					break;
-				}
-			}
-			brq.data.sg_len = i;
-		}
+		if (rq_data_dir(req) == READ)
+			return MMC_BLK_DATA_ERR;
+		return MMC_BLK_CMD_ERR;
+	}
 
-		mmc_queue_bounce_pre(mq);
+	if (brq->data.bytes_xfered != mmc_blk_rq_sectors(mq_mrq) << 9)
+		return MMC_BLK_PARTIAL;
 
-		mmc_wait_for_req(card->host, &brq.mrq);
+	return MMC_BLK_SUCCESS;
+}
 
-		mmc_queue_bounce_post(mq);
+static void mmc_blk_rw_rq_prep(struct mmc_queue_req *mqrq,
+			       struct mmc_card *card,
+			       int disable_multi,
+			       struct mmc_queue *mq)
+{
+	u32 readcmd, writecmd;
+	struct mmc_blk_request *brq = &mqrq->brq;
+	struct request *req = mqrq->req;
+
+	memset(brq, 0, sizeof(struct mmc_blk_request));
+	brq->mrq.cmd = &brq->cmd;
+	brq->mrq.data = &brq->data;
+
+	brq->cmd.arg = req->sector;
+	if (!mmc_card_blockaddr(card))
+		brq->cmd.arg <<= 9;
+	brq->cmd.flags = MMC_RSP_SPI_R1 | MMC_RSP_R1 | MMC_CMD_ADTC;
+	brq->data.blksz = 512;
+	brq->stop.opcode = MMC_STOP_TRANSMISSION;
+	brq->stop.arg = 0;
+	brq->stop.flags = MMC_RSP_SPI_R1B | MMC_RSP_R1B | MMC_CMD_AC;
+	brq->data.blocks = mmc_blk_rq_sectors(mqrq);
 
-		/*
-		 * Check for errors here, but don't jump to cmd_err
-		 * until later as we need to wait for the card to leave
-		 * programming mode even when things go wrong.
+	/*
+	 * The block layer doesn't support all sector count
+	 * restrictions, so we need to be prepared for too big
+	 * requests.
+	 */
+	if (brq->data.blocks > card->host->max_blk_count)
+		brq->data.blocks = card->host->max_blk_count;
+
+	/*
+	 * After a read error, we redo the request one sector at a time
+	 * in order to accurately determine which sectors can be read
+	 * successfully.
+	 */
+	if (disable_multi && brq->data.blocks > 1)
+		brq->data.blocks = 1;
+
+	if (brq->data.blocks > 1) {
+		/* SPI multiblock writes terminate using a special
+		 * token, not a STOP_TRANSMISSION request.
 		 */
-		if (brq.cmd.error || brq.data.error || brq.stop.error) {
-			if (brq.data.blocks > 1 && rq_data_dir(req) == READ) {
-				/* Redo read one sector at a time */
-				printk(KERN_WARNING "%s: retrying using single "
-				       "block read\n", req->rq_disk->disk_name);
-				disable_multi = 1;
-				continue;
+		if (!mmc_host_is_spi(card->host)
+				|| rq_data_dir(req) == READ)
+			brq->mrq.stop = &brq->stop;
+		readcmd = MMC_READ_MULTIPLE_BLOCK;
+		writecmd = MMC_WRITE_MULTIPLE_BLOCK;
+	} else {
+		brq->mrq.stop = NULL;
+		readcmd = MMC_READ_SINGLE_BLOCK;
+		writecmd = MMC_WRITE_BLOCK;
+	}
+
+	if (rq_data_dir(req) == READ) {
+		brq->cmd.opcode = readcmd;
+		brq->data.flags |= MMC_DATA_READ;
+	} else {
+		brq->cmd.opcode = writecmd;
+		brq->data.flags |= MMC_DATA_WRITE;
+	}
+
+	mmc_set_data_timeout(&brq->data, card);
+
+	brq->data.sg = mqrq->sg;
+	brq->data.sg_len = mmc_queue_map_sg(mq, mqrq);
+
+	/*
+	 * Adjust the sg list so it is the same size as the
+	 * request.
+	 */
+	if (brq->data.blocks != mmc_blk_rq_sectors(mqrq)) {
+		int i, data_size = brq->data.blocks << 9;
+		struct scatterlist *sg;
+
+		for_each_sg(brq->data.sg, sg, brq->data.sg_len, i) {
+			data_size -= sg->length;
+			if (data_size <= 0) {
+				sg->length += data_size;
+				i++;
+				break;
 			}
-			status = get_card_status(card, req);
-		} else if (disable_multi == 1) {
-			disable_multi = 0;
 		}
+		brq->data.sg_len = i;
+	}
 
-		if (brq.cmd.error) {
-			printk(KERN_ERR "%s: error %d sending read/write "
-			       "command, response %#x, card status %#x\n",
-			       req->rq_disk->disk_name, brq.cmd.error,
-			       brq.cmd.resp[0], status);
-		}
+	mqrq->mmc_active.mrq = &brq->mrq;
+	mqrq->mmc_active.err_check = mmc_blk_err_check;
 
-		if (brq.data.error) {
-			if (brq.data.error == -ETIMEDOUT && brq.mrq.stop)
-				/* 'Stop' response contains card status */
-				status = brq.mrq.stop->resp[0];
-			printk(KERN_ERR "%s: error %d transferring data,"
-			       " sector %u, nr %u, card status %#x\n",
-			       req->rq_disk->disk_name, brq.data.error,
-			       (unsigned)req->sector,
-			       (unsigned)req->nr_sectors, status);
-		}
+	mmc_queue_bounce_pre(mqrq);
+}
 
-		if (brq.stop.error) {
-			printk(KERN_ERR "%s: error %d sending stop command, "
-			       "response %#x, card status %#x\n",
-			       req->rq_disk->disk_name, brq.stop.error,
-			       brq.stop.resp[0], status);
-		}
+/*
+ * Start rqc (if any) and finish the request started by the previous
+ * call.  rqc is prepared and handed to the host before we wait for the
+ * previous request, so its mapping overlaps that transfer.  If the
+ * previous request needs another go (an error, or the host could not
+ * take all of it at once) rqc is held back, the rest of the previous
+ * request is redone synchronously, and rqc is started afterwards.
+ */
+static int mmc_blk_issue_rw_rq(struct mmc_queue *mq, struct request *rqc)
+{
+	struct mmc_blk_data *md = mq->data;
+	struct mmc_card *card = md->queue.card;
+	struct mmc_blk_request *brq;
+	struct mmc_queue_req *mq_rq;
+	struct mmc_async_req *areq;
+	struct request *req;
+	int ret = 1, disable_multi = 0, status;
+
+	if (!rqc && !mq->mqrq_prev->req)
+		return 0;
 
-		if (!mmc_host_is_spi(card->host) && rq_data_dir(req) != READ) {
-			do {
-				int err;
-
-				cmd.opcode = MMC_SEND_STATUS;
-				cmd.arg = card->rca << 16;
-				cmd.flags = MMC_RSP_R1 | MMC_CMD_AC;
-				err = mmc_wait_for_cmd(card->host, &cmd, 5);
-				if (err) {
-					printk(KERN_ERR "%s: error %d requesting status\n",
-					       req->rq_disk->disk_name, err);
-					goto cmd_err;
-				}
-				/*
-				 * Some cards mishandle the status bits,
-				 * so make sure to check both the busy
-				 * indication and the card state.
-				 */
-			} while (!(cmd.resp[0] & R1_READY_FOR_DATA) ||
-				(R1_CURRENT_STATE(cmd.resp[0]) == 7));
+	if (rqc) {
+		mmc_blk_pack_writes(mq, mq->mqrq_cur);
+		mmc_blk_rw_rq_prep(mq->mqrq_cur, card, 0, mq);
+		areq = &mq->mqrq_cur->mmc_active;
+	} else
+		areq = NULL;
+	areq = mmc_start_req(card->host, areq, &status);
+	if (!areq)
+		return 1;
 
-#if 0
-			if (cmd.resp[0] & ~0x00000900)
-				printk(KERN_ERR "%s: status = %08x\n",
-				       req->rq_disk->disk_name, cmd.resp[0]);
-			if (mmc_decode_status(cmd.resp))
-				goto cmd_err;
-#endif
+	/* rqc is on its way unless the previous request needs more work */
+	if (status == MMC_BLK_SUCCESS)
+		rqc = NULL;
+
+	mq_rq = container_of(areq, struct mmc_queue_req, mmc_active);
+	brq = &mq_rq->brq;
+	req = mq_rq->req;
+
+	do {
+		mmc_queue_bounce_post(mq_rq);
+
+		if (mq_rq->packed_num && status != MMC_BLK_SUCCESS) {
+			/*
+			 * rqc was fetched after the packed requests, so it
+			 * must not be started before they are issued again:
+			 * it goes back on the queue behind them.
+			 */
+			if (rqc) {
+				mmc_blk_requeue(md, mq->mqrq_cur);
+				rqc = NULL;
+			}
+			mmc_blk_unpack(md, mq_rq);
 		}
 
-		if (brq.cmd.error || brq.stop.error || brq.data.error) {
-			if (rq_data_dir(req) == READ) {
-				/*
-				 * After an error, we redo I/O one sector at a
-				 * time, so we only reach here after trying to
-				 * read a single sector.
-				 */
-				spin_lock_irq(&md->lock);
-				ret = __blk_end_request(req, -EIO, brq.data.blksz);
-				spin_unlock_irq(&md->lock);
-				continue;
+		switch (status) {
+		case MMC_BLK_SUCCESS:
+		case MMC_BLK_PARTIAL:
+			disable_multi = 0;
+			if (mq_rq->packed_num) {
+				ret = mmc_blk_end_packed(md, mq_rq);
+				break;
 			}
+			/*
+			 * A block was successfully transferred.
+			 */
+			spin_lock_irq(&md->lock);
+			ret = __blk_end_request(req, 0, brq->data.bytes_xfered);
+			spin_unlock_irq(&md->lock);
+			break;
+		case MMC_BLK_RETRY_SINGLE:
+			disable_multi = 1;
+			break;
+		case MMC_BLK_DATA_ERR:
+			spin_lock_irq(&md->lock);
+			ret = __blk_end_request(req, -EIO, brq->data.blksz);
+			spin_unlock_irq(&md->lock);
+			break;
+		case MMC_BLK_CMD_ERR:
+		default:
 			goto cmd_err;
 		}
 
-		/*
-		 * A block was successfully transferred.
-		 */
-		spin_lock_irq(&md->lock);
-		ret = __blk_end_request(req, 0, brq.data.bytes_xfered);
-		spin_unlock_irq(&md->lock);
+		if (ret) {
+			/*
+			 * Nothing else is in flight now, so redo the rest
+			 * of this request on its own.
+			 */
+			mmc_blk_rw_rq_prep(mq_rq, card, disable_multi, mq);
+			mmc_start_req(card->host, &mq_rq->mmc_active, NULL);
+			mmc_start_req(card->host, NULL, &status);
+		}
 	} while (ret);
 
-	mmc_release_host(card->host);
-
-	return 1;
+	goto start_new_req;
 
  cmd_err:
  	/*
@@ -486,26 +785,132 @@ static int mmc_blk_issue_rq(struct mmc_queue *mq, struct request *req)
 		blocks = mmc_sd_num_wr_blocks(card);
 		if (blocks != (u32)-1) {
 			spin_lock_irq(&md->lock);
-			ret = __blk_end_request(req, 0, blocks << 9);
+			ret = __blk_end_request(req, 0, min(blocks << 9,
+						blk_rq_bytes(req)));
 			spin_unlock_irq(&md->lock);
 		}
 	} else {
 		spin_lock_irq(&md->lock);
-		ret = __blk_end_request(req, 0, brq.data.bytes_xfered);
+		ret = __blk_end_request(req, 0, brq->data.bytes_xfered);
 		spin_unlock_irq(&md->lock);
 	}
 
-	mmc_release_host(card->host);
-
 	spin_lock_irq(&md->lock);
 	while (ret)
 		ret = __blk_end_request(req, -EIO, blk_rq_cur_bytes(req));
 	spin_unlock_irq(&md->lock);
 
-	return 0;
+ start_new_req:
+	if (rqc) {
+		mmc_blk_rw_rq_prep(mq->mqrq_cur, card, 0, mq);
+		mmc_start_req(card->host, &mq->mqrq_cur->mmc_active, NULL);
+	}
+
+	return 1;
+}
+
+static int mmc_blk_issue_rq(struct mmc_queue *mq, struct request *req)
+{
+	struct mmc_blk_data *md = mq->data;
+	struct mmc_card *card = md->queue.card;
+	int ret;
+
+	if (req && !mq->mqrq_prev->req) {
+#ifdef CONFIG_MMC_BLOCK_DEFERRED_RESUME
+		if (mmc_bus_needs_resume(card->host)) {
+			mmc_resume_bus(card->host);
+			mmc_blk_set_blksize(md, card);
+		}
+#endif
+		/* claim host only for the first request of a burst */
+		mmc_claim_host(card->host);
+	}
+
+	ret = mmc_blk_issue_rw_rq(mq, req);
+
+	/*
+	 * release host only when there is nothing left in flight: req may
+	 * also have been put back on the queue.
+	 */
+	if (!req || !mq->mqrq_cur->req)
+		mmc_release_host(card->host);
+
+	return ret;
 }
 
 
+static ssize_t mmc_blk_write_packing_show(struct device *dev,
+	struct device_attribute *attr, char *buf)
+{
+	struct mmc_blk_data *md = mmc_blk_get(dev_to_disk(dev));
+	ssize_t ret;
+
+	if (!md)
+		return -ENODEV;
+	ret = sprintf(buf, "%u\n", md->write_packing);
+	mmc_blk_put(md);
+	return ret;
+}
+
+static ssize_t mmc_blk_write_packing_store(struct device *dev,
+	struct device_attribute *attr, const char *buf, size_t count)
+{
+	struct mmc_blk_data *md = mmc_blk_get(dev_to_disk(dev));
+
+	if (!md)
+		return -ENODEV;
+	md->write_packing = simple_strtoul(buf, NULL, 0) ? 1 : 0;
+	mmc_blk_put(md);
+	return count;
+}
+
+static DEVICE_ATTR(write_packing, S_IRUGO | S_IWUSR,
+		   mmc_blk_write_packing_show, mmc_blk_write_packing_store);
+
+static ssize_t mmc_blk_write_packing_stats_show(struct device *dev,
+	struct device_attribute *attr, char *buf)
+{
+	struct mmc_blk_data *md = mmc_blk_get(dev_to_disk(dev));
+	struct mmc_blk_pack_stats *st;
+	char *p = buf;
+	int i;
+
+	if (!md)
+		return -ENODEV;
+	st = &md->pack_stats;
+
+	p += sprintf(p, "writes %lu\npacked %lu\nunpacked %lu\n",
+		     st->writes, st->packed, st->unpacked);
+	p += sprintf(p, "requests per write:");
+	for (i = 1; i <= MMC_BLK_PACK_MAX; i++)
+		p += sprintf(p, " %lu", st->nr_reqs[i]);
+	p += sprintf(p, "\nstopped on:");
+	for (i = 0; i < MMC_BLK_PACK_STOP_NR; i++)
+		p += sprintf(p, " %s %lu", mmc_blk_pack_stop_names[i],
+			     st->stop[i]);
+	p += sprintf(p, "\n");
+
+	mmc_blk_put(md);
+	return p - buf;
+}
+
+/* Any write clears the statistics */
+static ssize_t mmc_blk_write_packing_stats_store(struct device *dev,
+	struct device_attribute *attr, const char *buf, size_t count)
+{
+	struct mmc_blk_data *md = mmc_blk_get(dev_to_disk(dev));
+
+	if (!md)
+		return -ENODEV;
+	memset(&md->pack_stats, 0, sizeof(md->pack_stats));
+	mmc_blk_put(md);
+	return count;
+}
+
+static DEVICE_ATTR(write_packing_stats, S_IRUGO | S_IWUSR,
+		   mmc_blk_write_packing_stats_show,
+		   mmc_blk_write_packing_stats_store);
+
 static inline int mmc_blk_readonly(struct mmc_card *card)
 {
 	return mmc_card_readonly(card) ||
@@ -630,6 +1035,12 @@ static int mmc_blk_probe(struct mmc_card *card)
 	mmc_set_bus_resume_policy(card->host, 1);
 #endif
 	add_disk(md->disk);
+
+	if (device_create_file(disk_to_dev(md->disk), &dev_attr_write_packing) ||
+	    device_create_file(disk_to_dev(md->disk),
+			       &dev_attr_write_packing_stats))
+		printk(KERN_WARNING "%s: unable to create write packing "
+		       "sysfs files\n", md->disk->disk_name);
 	return 0;
 
  out:
@@ -644,6 +1055,11 @@ static void mmc_blk_remove(struct mmc_card *card)
 	struct mmc_blk_data *md = mmc_get_drvdata(card);
 
 	if (md) {
+		device_remove_file(disk_to_dev(md->disk),
+				   &dev_attr_write_packing_stats);
+		device_remove_file(disk_to_dev(md->disk),
+				   &dev_attr_write_packing);
+
 		/* Stop new requests from getting into the queue */
 		del_gendisk(md->disk);
 
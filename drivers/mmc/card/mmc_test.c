@@ -15,6 +15,7 @@
 #include <linux/mmc/mmc.h>
 
 #include <linux/scatterlist.h>
+#include <linux/ktime.h>
 
 #define RESULT_OK		0
 #define RESULT_FAIL		1
@@ -24,6 +25,8 @@
 #define BUFFER_ORDER		2
 #define BUFFER_SIZE		(PAGE_SIZE << BUFFER_ORDER)
 
+#define PERF_COUNT		256	/* requests per performance pass */
+
 struct mmc_test_card {
 	struct mmc_card	*card;
 
@@ -891,6 +894,151 @@ static int mmc_test_multi_read_high(struct mmc_test_card *test)
 
 #endif /* CONFIG_HIGHMEM */
 
+/*
+ * One request of the performance tests, in the form mmc_start_req()
+ * wants it.
+ */
+struct mmc_test_areq {
+	struct mmc_async_req	areq;
+	struct mmc_request	mrq;
+	struct mmc_command	cmd;
+	struct mmc_command	stop;
+	struct mmc_data		data;
+	struct scatterlist	sg;
+	struct mmc_test_card	*test;
+};
+
+static int mmc_test_check_areq(struct mmc_card *card,
+	struct mmc_async_req *areq)
+{
+	struct mmc_test_areq *tareq =
+		container_of(areq, struct mmc_test_areq, areq);
+	int ret;
+
+	ret = mmc_test_check_result(tareq->test, &tareq->mrq);
+	if (ret)
+		return ret;
+
+	if (tareq->data.flags & MMC_DATA_WRITE)
+		return mmc_test_wait_busy(tareq->test);
+
+	return 0;
+}
+
+static void mmc_test_prepare_areq(struct mmc_test_card *test,
+	struct mmc_test_areq *tareq, u8 *buf, unsigned size,
+	unsigned sector, int write)
+{
+	unsigned dev_addr = sector;
+
+	if (!mmc_card_blockaddr(test->card))
+		dev_addr <<= 9;
+
+	memset(&tareq->mrq, 0, sizeof(struct mmc_request));
+	memset(&tareq->cmd, 0, sizeof(struct mmc_command));
+	memset(&tareq->stop, 0, sizeof(struct mmc_command));
+	memset(&tareq->data, 0, sizeof(struct mmc_data));
+
+	tareq->mrq.cmd = &tareq->cmd;
+	tareq->mrq.data = &tareq->data;
+	tareq->mrq.stop = &tareq->stop;
+
+	sg_init_one(&tareq->sg, buf, size);
+
+	mmc_test_prepare_mrq(test, &tareq->mrq, &tareq->sg, 1, dev_addr,
+		size / 512, 512, write);
+
+	tareq->areq.mrq = &tareq->mrq;
+	tareq->areq.err_check = mmc_test_check_areq;
+	tareq->test = test;
+}
+
+/*
+ * Do PERF_COUNT back to back sequential requests, first waiting for
+ * each one before preparing the next, then through mmc_start_req() so
+ * that the host can prepare a request while the previous one is being
+ * transferred, and print the time taken by both.
+ */
+static int mmc_test_perf(struct mmc_test_card *test, int write)
+{
+	struct mmc_host *host = test->card->host;
+	struct mmc_test_areq *tareq;
+	unsigned int size, i;
+	int ret = 0, nonblock;
+	ktime_t start;
+	u64 us, rate;
+
+	size = BUFFER_SIZE / 2;
+	size = min(size, host->max_req_size);
+	size = min(size, host->max_seg_size);
+	size = min(size, host->max_blk_count * 512);
+	size &= ~511;
+
+	if (!size)
+		return RESULT_UNSUP_HOST;
+
+	tareq = kzalloc(2 * sizeof(struct mmc_test_areq), GFP_KERNEL);
+	if (!tareq)
+		return -ENOMEM;
+
+	ret = mmc_test_set_blksize(test, 512);
+	if (ret)
+		goto out;
+
+	for (nonblock = 0; nonblock < 2; nonblock++) {
+		start = ktime_get();
+
+		for (i = 0; i < PERF_COUNT; i++) {
+			struct mmc_test_areq *t = &tareq[i & 1];
+
+			/* each slot has its own half of the buffer */
+			mmc_test_prepare_areq(test, t,
+				test->buffer + (i & 1) * (BUFFER_SIZE / 2),
+				size, i * (size / 512), write);
+
+			if (!nonblock) {
+				mmc_wait_for_req(host, &t->mrq);
+				ret = mmc_test_check_areq(test->card,
+					&t->areq);
+			} else
+				mmc_start_req(host, &t->areq, &ret);
+			if (ret)
+				goto out;
+		}
+		if (nonblock) {
+			mmc_start_req(host, NULL, &ret);
+			if (ret)
+				goto out;
+		}
+
+		us = ktime_us_delta(ktime_get(), start);
+		rate = (u64)PERF_COUNT * size * 1000000 / 1024;
+		do_div(rate, max_t(u32, us, 1));
+
+		printk(KERN_INFO "%s: %s %u x %u bytes, %s: %llu us, "
+			"%llu KiB/s\n", mmc_hostname(host),
+			write ? "wrote" : "read", PERF_COUNT, size,
+			nonblock ? "non-blocking" : "blocking",
+			(unsigned long long)us, (unsigned long long)rate);
+	}
+
+out:
+	kfree(tareq);
+	if (ret == -EINVAL)
+		ret = RESULT_UNSUP_HOST;
+	return ret;
+}
+
+static int mmc_test_perf_write(struct mmc_test_card *test)
+{
+	return mmc_test_perf(test, 1);
+}
+
+static int mmc_test_perf_read(struct mmc_test_card *test)
+{
+	return mmc_test_perf(test, 0);
+}
+
 static const struct mmc_test_case mmc_test_cases[] = {
 	{
 		.name = "Basic write (no data verification)",
@@ -1038,6 +1186,16 @@ static const struct mmc_test_case mmc_test_cases[] = {
 
 #endif /* CONFIG_HIGHMEM */
 
+	{
+		.name = "Sequential write performance, blocking vs non-blocking",
+		.run = mmc_test_perf_write,
+	},
+
+	{
+		.name = "Sequential read performance, blocking vs non-blocking",
+		.run = mmc_test_perf_read,
+	},
+
 };
 
 static DEFINE_MUTEX(mmc_test_lock);
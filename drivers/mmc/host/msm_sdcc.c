@@ -277,8 +277,10 @@ msmsdcc_dma_complete_tlet(unsigned long data)
 		if (!mrq->data->error)
 			mrq->data->error = -EIO;
 	}
-	dma_unmap_sg(mmc_dev(host->mmc), host->dma.sg, host->dma.num_ents,
-		     host->dma.dir);
+	/* A list mapped by msmsdcc_pre_req() is unmapped in post_req */
+	if (!mrq->data->host_cookie)
+		dma_unmap_sg(mmc_dev(host->mmc), host->dma.sg,
+			     host->dma.num_ents, host->dma.dir);
 
 	if (host->curr.user_pages) {
 		struct scatterlist *sg = host->dma.sg;
@@ -452,9 +454,15 @@ static int msmsdcc_config_dma(struct msmsdcc_host *host, struct mmc_data *data)
 			       DMOV_CMD_ADDR(host->dma.cmdptr_busaddr);
 	host->dma.hdr.complete_func = msmsdcc_dma_complete_func;
 
-	n = dma_map_sg(mmc_dev(host->mmc), host->dma.sg,
-			host->dma.num_ents, host->dma.dir);
-	/* dsb inside dma_map_sg will write nc out to mem as well */
+	if (data->host_cookie) {
+		/* Mapped ahead of time by msmsdcc_pre_req(); write nc out */
+		dsb();
+		n = host->dma.num_ents;
+	} else {
+		n = dma_map_sg(mmc_dev(host->mmc), host->dma.sg,
+				host->dma.num_ents, host->dma.dir);
+		/* dsb inside dma_map_sg will write nc out to mem as well */
+	}
 
 	if (n != host->dma.num_ents) {
 		pr_err("%s: Unable to map in all sg elements\n",
@@ -1171,7 +1179,49 @@ static void msmsdcc_enable_sdio_irq(struct mmc_host *mmc, int enable)
 }
 #endif /* CONFIG_MMC_MSM_SDIO_SUPPORT */
 
+/*
+ * Map the sg list of the next request while the current one is still
+ * being transferred, so the cache maintenance is off the critical path.
+ * host_cookie tells msmsdcc_config_dma() and the DMA completion tasklet
+ * that the mapping is owned by pre_req/post_req.
+ */
+static void msmsdcc_pre_req(struct mmc_host *mmc, struct mmc_request *mrq,
+			    bool is_first_req)
+{
+	struct msmsdcc_host *host = mmc_priv(mmc);
+	struct mmc_data *data = mrq->data;
+	enum dma_data_direction dir;
+
+	if (!data)
+		return;
+
+	data->host_cookie = 0;
+	if (validate_dma(host, data) || data->sg_len > NR_SG)
+		return;
+
+	dir = (data->flags & MMC_DATA_READ) ? DMA_FROM_DEVICE : DMA_TO_DEVICE;
+	if (dma_map_sg(mmc_dev(mmc), data->sg, data->sg_len, dir) ==
+	    data->sg_len)
+		data->host_cookie = 1;
+}
+
+static void msmsdcc_post_req(struct mmc_host *mmc, struct mmc_request *mrq,
+			     int err)
+{
+	struct mmc_data *data = mrq->data;
+	enum dma_data_direction dir;
+
+	if (!data || !data->host_cookie)
+		return;
+
+	dir = (data->flags & MMC_DATA_READ) ? DMA_FROM_DEVICE : DMA_TO_DEVICE;
+	dma_unmap_sg(mmc_dev(mmc), data->sg, data->sg_len, dir);
+	data->host_cookie = 0;
+}
+
 static const struct mmc_host_ops msmsdcc_ops = {
+	.pre_req	= msmsdcc_pre_req,
+	.post_req	= msmsdcc_post_req,
 	.request	= msmsdcc_request,
 	.set_ios	= msmsdcc_set_ios,
 	.get_ro		= msmsdcc_get_ro,
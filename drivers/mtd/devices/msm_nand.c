@@ -406,43 +406,250 @@ static struct flash_identification supported_flash[] =
 
 
 
-static int msm_nand_read_oob(struct mtd_info *mtd, loff_t from,
-			     struct mtd_oob_ops *ops)
+/*
+ * With pipelining on, a request for more than one page keeps the command
+ * list for the next page queued on the datamover while the status of the
+ * current one is checked.  The datamover starts a queued command as soon
+ * as the one ahead of it finishes, so the controller moves on to page
+ * N + 1 while the CPU looks at the ECC results of page N.
+ */
+static int msm_nand_pipeline = 1;
+module_param_named(pipeline, msm_nand_pipeline, int, 0644);
+MODULE_PARM_DESC(pipeline, "Overlap multi-page transfers with status checks");
+
+#define MSM_NAND_PIPE_DEPTH 2
+
+struct msm_nand_dmov_req {
+	struct msm_dmov_cmd dmov;
+	struct completion done;
+	unsigned int result;
+};
+
+static void msm_nand_dmov_complete(struct msm_dmov_cmd *cmd,
+				   unsigned int result,
+				   struct msm_dmov_errdata *err)
 {
-	struct msm_nand_chip *chip = mtd->priv;
+	struct msm_nand_dmov_req *req =
+		container_of(cmd, struct msm_nand_dmov_req, dmov);
+
+	req->result = result;
+	complete(&req->done);
+}
+
+static void msm_nand_dmov_submit(struct msm_nand_chip *chip,
+				 struct msm_nand_dmov_req *req,
+				 unsigned *cmdptr)
+{
+	req->dmov.cmdptr = DMOV_CMD_PTR_LIST |
+		DMOV_CMD_ADDR(msm_virt_to_dma(chip, cmdptr));
+	req->dmov.complete_func = msm_nand_dmov_complete;
+	init_completion(&req->done);
+
+	dsb();
+	msm_dmov_enqueue_cmd(chip->dma_channel, &req->dmov);
+}
+
+static void msm_nand_dmov_wait(struct msm_nand_dmov_req *req)
+{
+	wait_for_completion_io(&req->done);
+	dsb();
 
+	if (req->result != 0x80000002)
+		pr_err("msm_nand: dmov error, result %x\n", req->result);
+}
+
+/* where the next page of a multi-page request goes in the caller's buffers */
+struct msm_nand_cursor {
+	dma_addr_t data;
+	dma_addr_t oob;
+	uint32_t oob_len;
+};
+
+struct msm_nand_read_dma {
+	dmov_s cmd[8 * 5 + 2];
+	unsigned cmdptr;
 	struct {
-		dmov_s cmd[8 * 5 + 2];
-		unsigned cmdptr;
+		uint32_t cmd;
+		uint32_t addr0;
+		uint32_t addr1;
+		uint32_t chipsel;
+		uint32_t cfg0;
+		uint32_t cfg1;
+		uint32_t exec;
+		uint32_t ecccfg;
 		struct {
-			uint32_t cmd;
-			uint32_t addr0;
-			uint32_t addr1;
-			uint32_t chipsel;
-			uint32_t cfg0;
-			uint32_t cfg1;
-			uint32_t exec;
-			uint32_t ecccfg;
-			struct {
-				uint32_t flash_status;
-				uint32_t buffer_status;
-			} result[8];
-		} data;
-	} *dma_buffer;
-	dmov_s *cmd;
-	unsigned n;
-	unsigned page = 0;
-	uint32_t oob_len;
+			uint32_t flash_status;
+			uint32_t buffer_status;
+		} result[8];
+	} data;
+} __aligned(8);
+
+static void msm_nand_prep_read_page(struct mtd_info *mtd,
+				    struct mtd_oob_ops *ops,
+				    struct msm_nand_read_dma *dma_buffer,
+				    unsigned page, unsigned start_sector,
+				    uint32_t oob_col,
+				    struct msm_nand_cursor *cur)
+{
+	struct msm_nand_chip *chip = mtd->priv;
+	unsigned cwperpage = (mtd->writesize >> 9);
 	uint32_t sectordatasize;
 	uint32_t sectoroobsize;
+	dmov_s *cmd = dma_buffer->cmd;
+	unsigned n;
+
+	/* CMD / ADDR0 / ADDR1 / CHIPSEL program values */
+	if (ops->mode != MTD_OOB_RAW) {
+		dma_buffer->data.cmd = NAND_CMD_PAGE_READ_ECC;
+		dma_buffer->data.cfg0 = (chip->CFG0 & ~(7U << 6)) |
+			(((cwperpage-1) - start_sector) << 6);
+		dma_buffer->data.cfg1 = chip->CFG1;
+	} else {
+		dma_buffer->data.cmd = NAND_CMD_PAGE_READ;
+		dma_buffer->data.cfg0 = (NAND_CFG0_RAW & ~(7U << 6)) |
+			((cwperpage-1) << 6);
+		dma_buffer->data.cfg1 = NAND_CFG1_RAW |
+			(chip->CFG1 & CFG1_WIDE_FLASH);
+	}
+
+	dma_buffer->data.addr0 = (page << 16) | oob_col;
+	dma_buffer->data.addr1 = (page >> 16) & 0xff; /* qc example is (page >> 16) && 0xff !? */
+	dma_buffer->data.chipsel = 0 | 4; /* flash0 + undoc bit */
+
+
+	/* GO bit for the EXEC register */
+	dma_buffer->data.exec = 1;
+
+
+	BUILD_BUG_ON(8 != ARRAY_SIZE(dma_buffer->data.result));
+
+	for (n = start_sector; n < cwperpage; n++) {
+		/* flash + buffer status return words */
+		dma_buffer->data.result[n].flash_status = 0xeeeeeeee;
+		dma_buffer->data.result[n].buffer_status = 0xeeeeeeee;
+
+		/* block on cmd ready, then
+		 * write CMD / ADDR0 / ADDR1 / CHIPSEL
+		 * regs in a burst
+		 */
+		cmd->cmd = DST_CRCI_NAND_CMD;
+		cmd->src = msm_virt_to_dma(chip, &dma_buffer->data.cmd);
+		cmd->dst = NAND_FLASH_CMD;
+		if (n == start_sector)
+			cmd->len = 16;
+		else
+			cmd->len = 4;
+		cmd++;
+
+		if (n == start_sector) {
+			cmd->cmd = 0;
+			cmd->src = msm_virt_to_dma(chip,&dma_buffer->data.cfg0);
+			cmd->dst = NAND_DEV0_CFG0;
+			cmd->len = 8;
+			cmd++;
+
+			dma_buffer->data.ecccfg = chip->ecc_buf_cfg;
+			cmd->cmd = 0;
+			cmd->src = msm_virt_to_dma(chip,&dma_buffer->data.ecccfg);
+			cmd->dst = NAND_EBI2_ECC_BUF_CFG;
+			cmd->len = 4;
+			cmd++;
+		}
+
+		/* kick the execute register */
+		cmd->cmd = 0;
+		cmd->src =
+			msm_virt_to_dma(chip, &dma_buffer->data.exec);
+		cmd->dst = NAND_EXEC_CMD;
+		cmd->len = 4;
+		cmd++;
+
+		/* block on data ready, then
+		 * read the status register
+		 */
+		cmd->cmd = SRC_CRCI_NAND_DATA;
+		cmd->src = NAND_FLASH_STATUS;
+		cmd->dst = msm_virt_to_dma(chip,
+					   &dma_buffer->data.result[n]);
+		/* NAND_FLASH_STATUS + NAND_BUFFER_STATUS */
+		cmd->len = 8;
+		cmd++;
+
+		/* read data block
+		 * (only valid if status says success)
+		 */
+		if (ops->datbuf) {
+			if (ops->mode != MTD_OOB_RAW)
+				sectordatasize = (n < (cwperpage - 1))
+				? 516 : (512 - ((cwperpage - 1) << 2));
+			else
+				sectordatasize = 528;
+
+			cmd->cmd = 0;
+			cmd->src = NAND_FLASH_BUFFER;
+			cmd->dst = cur->data;
+			cur->data += sectordatasize;
+			cmd->len = sectordatasize;
+			cmd++;
+		}
+
+		if (ops->oobbuf && (n == (cwperpage - 1)
+		     || ops->mode != MTD_OOB_AUTO)) {
+			cmd->cmd = 0;
+			if (n == (cwperpage - 1)) {
+				cmd->src = NAND_FLASH_BUFFER +
+					(512 - ((cwperpage - 1) << 2));
+				sectoroobsize = (cwperpage << 2);
+				if (ops->mode != MTD_OOB_AUTO)
+					sectoroobsize += 10;
+			} else {
+				cmd->src = NAND_FLASH_BUFFER + 516;
+				sectoroobsize = 10;
+			}
+
+			cmd->dst = cur->oob;
+			if (sectoroobsize < cur->oob_len)
+				cmd->len = sectoroobsize;
+			else
+				cmd->len = cur->oob_len;
+			cur->oob += cmd->len;
+			cur->oob_len -= cmd->len;
+			if (cmd->len > 0)
+				cmd++;
+		}
+	}
+
+	BUILD_BUG_ON(8 * 5 + 2 != ARRAY_SIZE(dma_buffer->cmd));
+	BUG_ON(cmd - dma_buffer->cmd > ARRAY_SIZE(dma_buffer->cmd));
+	dma_buffer->cmd[0].cmd |= CMD_OCB;
+	cmd[-1].cmd |= CMD_OCU | CMD_LC;
+
+	dma_buffer->cmdptr =
+		(msm_virt_to_dma(chip, dma_buffer->cmd) >> 3)
+		| CMD_PTR_LP;
+}
+
+static int msm_nand_read_oob(struct mtd_info *mtd, loff_t from,
+			     struct mtd_oob_ops *ops)
+{
+	struct msm_nand_chip *chip = mtd->priv;
+	struct msm_nand_read_dma *dma_buffer;
+	struct msm_nand_read_dma *buf;
+	struct msm_nand_dmov_req req[MSM_NAND_PIPE_DEPTH];
+	struct msm_nand_cursor cur;
+	/* how far into oobbuf each queued page starts and ends */
+	uint32_t oob_start[MSM_NAND_PIPE_DEPTH];
+	uint32_t oob_end[MSM_NAND_PIPE_DEPTH];
+	unsigned n;
+	unsigned page = 0;
 	int err, pageerr, rawerr;
 	dma_addr_t data_dma_addr = 0;
 	dma_addr_t oob_dma_addr = 0;
-	dma_addr_t data_dma_addr_curr = 0;
-	dma_addr_t oob_dma_addr_curr = 0;
 	uint32_t oob_col = 0;
 	unsigned page_count;
 	unsigned pages_read = 0;
+	unsigned pages_queued = 0;
+	unsigned depth;
 	unsigned start_sector = 0;
 	uint32_t ecc_errors;
 	uint32_t total_ecc_errors = 0;
@@ -454,7 +661,9 @@ static int msm_nand_read_oob(struct mtd_info *mtd, loff_t from,
 	if (mtd->writesize == 4096)
 		page = from >> 12;
 
-	oob_len = ops->ooblen;
+	cur.data = 0;
+	cur.oob = 0;
+	cur.oob_len = ops->ooblen;
 	cwperpage = (mtd->writesize >> 9);
 
 	if (from & (mtd->writesize - 1)) {
@@ -511,7 +720,7 @@ static int msm_nand_read_oob(struct mtd_info *mtd, loff_t from,
 #endif
 	if (ops->datbuf) {
 		/* memset(ops->datbuf, 0x55, ops->len); */
-		data_dma_addr_curr = data_dma_addr =
+		cur.data = data_dma_addr =
 			dma_map_single(chip->dev, ops->datbuf, ops->len,
 				       DMA_FROM_DEVICE);
 		if (dma_mapping_error(chip->dev, data_dma_addr)) {
@@ -522,7 +731,7 @@ static int msm_nand_read_oob(struct mtd_info *mtd, loff_t from,
 	}
 	if (ops->oobbuf) {
 		memset(ops->oobbuf, 0xff, ops->ooblen);
-		oob_dma_addr_curr = oob_dma_addr =
+		cur.oob = oob_dma_addr =
 			dma_map_single(chip->dev, ops->oobbuf,
 				       ops->ooblen, DMA_BIDIRECTIONAL);
 		if (dma_mapping_error(chip->dev, oob_dma_addr)) {
@@ -535,155 +744,41 @@ static int msm_nand_read_oob(struct mtd_info *mtd, loff_t from,
 
 	wait_event(chip->wait_queue,
 		   (dma_buffer = msm_nand_get_dma_buffer(
-			    chip, sizeof(*dma_buffer))));
+			    chip, sizeof(*dma_buffer) * MSM_NAND_PIPE_DEPTH)));
 
 	oob_col = start_sector * 0x210;
 	if (chip->CFG1 & CFG1_WIDE_FLASH)
 		oob_col >>= 1;
 
-	err = 0;
-	while (page_count-- > 0) {
-		cmd = dma_buffer->cmd;
-
-		/* CMD / ADDR0 / ADDR1 / CHIPSEL program values */
-		if (ops->mode != MTD_OOB_RAW) {
-			dma_buffer->data.cmd = NAND_CMD_PAGE_READ_ECC;
-			dma_buffer->data.cfg0 = (chip->CFG0 & ~(7U << 6)) | (((cwperpage-1) - start_sector) << 6);
-			dma_buffer->data.cfg1 = chip->CFG1;
-		} else {
-			dma_buffer->data.cmd = NAND_CMD_PAGE_READ;
-			dma_buffer->data.cfg0 = (NAND_CFG0_RAW & ~(7U << 6)) | ((cwperpage-1) << 6);
-			dma_buffer->data.cfg1 = NAND_CFG1_RAW | (chip->CFG1 & CFG1_WIDE_FLASH);
-		}
-
-		dma_buffer->data.addr0 = (page << 16) | oob_col;
-		dma_buffer->data.addr1 = (page >> 16) & 0xff; /* qc example is (page >> 16) && 0xff !? */
-		dma_buffer->data.chipsel = 0 | 4; /* flash0 + undoc bit */
-
-
-		/* GO bit for the EXEC register */
-		dma_buffer->data.exec = 1;
-
-
-		BUILD_BUG_ON(8 != ARRAY_SIZE(dma_buffer->data.result));
-
-		for (n = start_sector; n < cwperpage; n++) {
-			/* flash + buffer status return words */
-			dma_buffer->data.result[n].flash_status = 0xeeeeeeee;
-			dma_buffer->data.result[n].buffer_status = 0xeeeeeeee;
-
-			/* block on cmd ready, then
-			 * write CMD / ADDR0 / ADDR1 / CHIPSEL
-			 * regs in a burst
-			 */
-			cmd->cmd = DST_CRCI_NAND_CMD;
-			cmd->src = msm_virt_to_dma(chip, &dma_buffer->data.cmd);
-			cmd->dst = NAND_FLASH_CMD;
-			if (n == start_sector)
-				cmd->len = 16;
-			else
-				cmd->len = 4;
-			cmd++;
-
-			if (n == start_sector) {
-				cmd->cmd = 0;
-				cmd->src = msm_virt_to_dma(chip,&dma_buffer->data.cfg0);
-				cmd->dst = NAND_DEV0_CFG0;
-				cmd->len = 8;
-				cmd++;
-
-				dma_buffer->data.ecccfg = chip->ecc_buf_cfg;
-				cmd->cmd = 0;
-				cmd->src = msm_virt_to_dma(chip,&dma_buffer->data.ecccfg);
-				cmd->dst = NAND_EBI2_ECC_BUF_CFG;
-				cmd->len = 4;
-				cmd++;
-			}
+	depth = (msm_nand_pipeline && page_count > 1) ?
+		MSM_NAND_PIPE_DEPTH : 1;
 
-			/* kick the execute register */
-			cmd->cmd = 0;
-			cmd->src =
-				msm_virt_to_dma(chip, &dma_buffer->data.exec);
-			cmd->dst = NAND_EXEC_CMD;
-			cmd->len = 4;
-			cmd++;
-
-			/* block on data ready, then
-			 * read the status register
-			 */
-			cmd->cmd = SRC_CRCI_NAND_DATA;
-			cmd->src = NAND_FLASH_STATUS;
-			cmd->dst = msm_virt_to_dma(chip,
-						   &dma_buffer->data.result[n]);
-			/* NAND_FLASH_STATUS + NAND_BUFFER_STATUS */
-			cmd->len = 8;
-			cmd++;
-
-			/* read data block
-			 * (only valid if status says success)
-			 */
-			if (ops->datbuf) {
-				if (ops->mode != MTD_OOB_RAW)
-					sectordatasize = (n < (cwperpage - 1))
-					? 516 : (512 - ((cwperpage - 1) << 2));
-				else
-					sectordatasize = 528;
-
-				cmd->cmd = 0;
-				cmd->src = NAND_FLASH_BUFFER;
-				cmd->dst = data_dma_addr_curr;
-				data_dma_addr_curr += sectordatasize;
-				cmd->len = sectordatasize;
-				cmd++;
-			}
-
-			if (ops->oobbuf && (n == (cwperpage - 1)
-			     || ops->mode != MTD_OOB_AUTO)) {
-				cmd->cmd = 0;
-				if (n == (cwperpage - 1)) {
-					cmd->src = NAND_FLASH_BUFFER +
-						(512 - ((cwperpage - 1) << 2));
-					sectoroobsize = (cwperpage << 2);
-					if (ops->mode != MTD_OOB_AUTO)
-						sectoroobsize += 10;
-				} else {
-					cmd->src = NAND_FLASH_BUFFER + 516;
-					sectoroobsize = 10;
-				}
-
-				cmd->dst = oob_dma_addr_curr;
-				if (sectoroobsize < oob_len)
-					cmd->len = sectoroobsize;
-				else
-					cmd->len = oob_len;
-				oob_dma_addr_curr += cmd->len;
-				oob_len -= cmd->len;
-				if (cmd->len > 0)
-					cmd++;
-			}
+	err = 0;
+	while (pages_read < page_count) {
+		/* keep up to depth pages queued on the datamover */
+		while (pages_queued < page_count &&
+		       pages_queued - pages_read < depth) {
+			n = pages_queued % MSM_NAND_PIPE_DEPTH;
+			oob_start[n] = ops->ooblen - cur.oob_len;
+			msm_nand_prep_read_page(mtd, ops, &dma_buffer[n],
+						page + pages_queued,
+						start_sector, oob_col, &cur);
+			oob_end[n] = ops->ooblen - cur.oob_len;
+			msm_nand_dmov_submit(chip, &req[n],
+					     &dma_buffer[n].cmdptr);
+			pages_queued++;
 		}
 
-		BUILD_BUG_ON(8 * 5 + 2 != ARRAY_SIZE(dma_buffer->cmd));
-		BUG_ON(cmd - dma_buffer->cmd > ARRAY_SIZE(dma_buffer->cmd));
-		dma_buffer->cmd[0].cmd |= CMD_OCB;
-		cmd[-1].cmd |= CMD_OCU | CMD_LC;
-
-		dma_buffer->cmdptr =
-			(msm_virt_to_dma(chip, dma_buffer->cmd) >> 3)
-			| CMD_PTR_LP;
-
-		dsb();
-		msm_dmov_exec_cmd(
-			chip->dma_channel, DMOV_CMD_PTR_LIST | DMOV_CMD_ADDR(
-				msm_virt_to_dma(chip, &dma_buffer->cmdptr)));
-		dsb();
+		n = pages_read % MSM_NAND_PIPE_DEPTH;
+		buf = &dma_buffer[n];
+		msm_nand_dmov_wait(&req[n]);
 
 		/* if any of the writes failed (0x10), or there
 		 * was a protection violation (0x100), we lose
 		 */
 		pageerr = rawerr = 0;
 		for (n = start_sector; n < cwperpage; n++) {
-			if (dma_buffer->data.result[n].flash_status & 0x110) {
+			if (buf->data.result[n].flash_status & 0x110) {
 				rawerr = -EIO;
 				break;
 			}
@@ -692,9 +787,11 @@ static int msm_nand_read_oob(struct mtd_info *mtd, loff_t from,
 			if (ops->datbuf && ops->mode != MTD_OOB_RAW) {
 				uint8_t *datbuf = ops->datbuf +
 					pages_read * mtd->writesize;
+				dma_addr_t page_dma_addr = data_dma_addr +
+					pages_read * mtd->writesize;
 
 				dma_sync_single_for_cpu(chip->dev,
-					data_dma_addr_curr-mtd->writesize,
+					page_dma_addr,
 					mtd->writesize, DMA_BIDIRECTIONAL);
 
 				for (n = 0; n < mtd->writesize; n++) {
@@ -710,12 +807,18 @@ static int msm_nand_read_oob(struct mtd_info *mtd, loff_t from,
 				}
 
 				dma_sync_single_for_device(chip->dev,
-					data_dma_addr_curr-mtd->writesize,
+					page_dma_addr,
 					mtd->writesize, DMA_BIDIRECTIONAL);
 
 			}
 			if (ops->oobbuf) {
-				for (n = 0; n < ops->ooblen; n++) {
+				/* only this page's share of oobbuf, the
+				 * next page may already be landing in it
+				 */
+				for (n = oob_start[pages_read %
+						   MSM_NAND_PIPE_DEPTH];
+				     n < oob_end[pages_read %
+						 MSM_NAND_PIPE_DEPTH]; n++) {
 					if (ops->oobbuf[n] != 0xff) {
 						pageerr = rawerr;
 						break;
@@ -725,8 +828,7 @@ static int msm_nand_read_oob(struct mtd_info *mtd, loff_t from,
 		}
 		if (pageerr) {
 			for (n = start_sector; n < cwperpage; n++) {
-				if (dma_buffer->data.result[n].buffer_status
-						& 0x8) {
+				if (buf->data.result[n].buffer_status & 0x8) {
 					/* not thread safe */
 					mtd->ecc_stats.failed++;
 					pageerr = -EBADMSG;
@@ -736,7 +838,7 @@ static int msm_nand_read_oob(struct mtd_info *mtd, loff_t from,
 		}
 		if (!rawerr) { /* check for corretable errors */
 			for (n = start_sector; n < cwperpage; n++) {
-				ecc_errors = dma_buffer->data.
+				ecc_errors = buf->data.
 					result[n].buffer_status & 0x7;
 				if (ecc_errors) {
 					total_ecc_errors += ecc_errors;
@@ -753,35 +855,43 @@ static int msm_nand_read_oob(struct mtd_info *mtd, loff_t from,
 #if VERBOSE
 		if (rawerr && !pageerr) {
 			pr_err("msm_nand_read_oob %llx %x %x empty page\n",
-			       (loff_t)page * mtd->writesize, ops->len,
-			       ops->ooblen);
+			       (loff_t)(page + pages_read) * mtd->writesize,
+			       ops->len, ops->ooblen);
 		} else {
 			pr_info("status: %x %x %x %x %x %x %x %x %x \
 					%x %x %x %x %x %x %x \n",
-				dma_buffer->data.result[0].flash_status,
-				dma_buffer->data.result[0].buffer_status,
-				dma_buffer->data.result[1].flash_status,
-				dma_buffer->data.result[1].buffer_status,
-				dma_buffer->data.result[2].flash_status,
-				dma_buffer->data.result[2].buffer_status,
-				dma_buffer->data.result[3].flash_status,
-				dma_buffer->data.result[3].buffer_status,
-				dma_buffer->data.result[4].flash_status,
-				dma_buffer->data.result[4].buffer_status,
-				dma_buffer->data.result[5].flash_status,
-				dma_buffer->data.result[5].buffer_status,
-				dma_buffer->data.result[6].flash_status,
-				dma_buffer->data.result[6].buffer_status,
-				dma_buffer->data.result[7].flash_status,
-				dma_buffer->data.result[7].buffer_status);
+				buf->data.result[0].flash_status,
+				buf->data.result[0].buffer_status,
+				buf->data.result[1].flash_status,
+				buf->data.result[1].buffer_status,
+				buf->data.result[2].flash_status,
+				buf->data.result[2].buffer_status,
+				buf->data.result[3].flash_status,
+				buf->data.result[3].buffer_status,
+				buf->data.result[4].flash_status,
+				buf->data.result[4].buffer_status,
+				buf->data.result[5].flash_status,
+				buf->data.result[5].buffer_status,
+				buf->data.result[6].flash_status,
+				buf->data.result[6].buffer_status,
+				buf->data.result[7].flash_status,
+				buf->data.result[7].buffer_status);
 		}
 #endif
 		if (err && err != -EUCLEAN && err != -EBADMSG)
 			break;
 		pages_read++;
-		page++;
 	}
-	msm_nand_release_dma_buffer(chip, dma_buffer, sizeof(*dma_buffer));
+
+	/* let pages queued behind a failed one finish, then forget them */
+	if (pages_queued > pages_read + 1)
+		cur.oob_len = ops->ooblen -
+			oob_start[(pages_read + 1) % MSM_NAND_PIPE_DEPTH];
+	for (n = pages_read + 1; n < pages_queued; n++)
+		msm_nand_dmov_wait(&req[n % MSM_NAND_PIPE_DEPTH]);
+
+	msm_nand_release_dma_buffer(chip, dma_buffer,
+				    sizeof(*dma_buffer) * MSM_NAND_PIPE_DEPTH);
 
 	if (ops->oobbuf) {
 		dma_unmap_single(chip->dev, oob_dma_addr,
@@ -798,7 +908,7 @@ err_dma_map_oobbuf_failed:
 	else
 		ops->retlen = (mtd->writesize +  mtd->oobsize) *
 							pages_read;
-	ops->oobretlen = ops->ooblen - oob_len;
+	ops->oobretlen = ops->ooblen - cur.oob_len;
 	if (err)
 		pr_err("msm_nand_read_oob %llx %x %x failed %d, corrected %d\n",
 		       from, ops->datbuf ? ops->len : 0, ops->ooblen, err,
@@ -828,39 +938,196 @@ msm_nand_read(struct mtd_info *mtd, loff_t from, size_t len,
 	return ret;
 }
 
+struct msm_nand_write_dma {
+	dmov_s cmd[8 * 7 + 2];
+	unsigned cmdptr;
+	struct {
+		uint32_t cmd;
+		uint32_t addr0;
+		uint32_t addr1;
+		uint32_t chipsel;
+		uint32_t cfg0;
+		uint32_t cfg1;
+		uint32_t exec;
+		uint32_t ecccfg;
+		uint32_t clrfstatus;
+		uint32_t clrrstatus;
+		uint32_t flash_status[8];
+	} data;
+} __aligned(8);
+
+static void msm_nand_prep_write_page(struct mtd_info *mtd,
+				     struct mtd_oob_ops *ops,
+				     struct msm_nand_write_dma *dma_buffer,
+				     unsigned page,
+				     struct msm_nand_cursor *cur)
+{
+	struct msm_nand_chip *chip = mtd->priv;
+	unsigned cwperpage = (mtd->writesize >> 9);
+	uint32_t sectordatawritesize;
+	dmov_s *cmd = dma_buffer->cmd;
+	unsigned n;
+
+	/* CMD / ADDR0 / ADDR1 / CHIPSEL program values */
+	if (ops->mode != MTD_OOB_RAW) {
+		dma_buffer->data.cfg0 = chip->CFG0;
+		dma_buffer->data.cfg1 = chip->CFG1;
+	} else {
+		dma_buffer->data.cfg0 = (NAND_CFG0_RAW & ~(7U << 6)) |
+			((cwperpage-1) << 6);
+		dma_buffer->data.cfg1 = NAND_CFG1_RAW |
+					(chip->CFG1 & CFG1_WIDE_FLASH);
+	}
+
+	dma_buffer->data.cmd = NAND_CMD_PRG_PAGE;
+	dma_buffer->data.addr0 = page << 16;
+	dma_buffer->data.addr1 = (page >> 16) & 0xff;
+	dma_buffer->data.chipsel = 0 | 4; /* flash0 + undoc bit */
+
+
+		/* GO bit for the EXEC register */
+	dma_buffer->data.exec = 1;
+	dma_buffer->data.clrfstatus = 0x00000020;
+	dma_buffer->data.clrrstatus = 0x000000C0;
+
+	BUILD_BUG_ON(8 != ARRAY_SIZE(dma_buffer->data.flash_status));
+
+	for (n = 0; n < cwperpage ; n++) {
+		/* status return words */
+		dma_buffer->data.flash_status[n] = 0xeeeeeeee;
+		/* block on cmd ready, then
+		 * write CMD / ADDR0 / ADDR1 / CHIPSEL regs in a burst
+		 */
+		cmd->cmd = DST_CRCI_NAND_CMD;
+		cmd->src =
+			msm_virt_to_dma(chip, &dma_buffer->data.cmd);
+		cmd->dst = NAND_FLASH_CMD;
+		if (n == 0)
+			cmd->len = 16;
+		else
+			cmd->len = 4;
+		cmd++;
+
+		if (n == 0) {
+			cmd->cmd = 0;
+			cmd->src = msm_virt_to_dma(chip,
+						&dma_buffer->data.cfg0);
+			cmd->dst = NAND_DEV0_CFG0;
+			cmd->len = 8;
+			cmd++;
+
+			dma_buffer->data.ecccfg = chip->ecc_buf_cfg;
+			cmd->cmd = 0;
+			cmd->src = msm_virt_to_dma(chip,
+					 &dma_buffer->data.ecccfg);
+			cmd->dst = NAND_EBI2_ECC_BUF_CFG;
+			cmd->len = 4;
+			cmd++;
+		}
+
+			/* write data block */
+		if (ops->mode != MTD_OOB_RAW)
+			sectordatawritesize = (n < (cwperpage - 1)) ?
+				516 : (512 - ((cwperpage - 1) << 2));
+		else
+			sectordatawritesize = 528;
+
+		cmd->cmd = 0;
+		cmd->src = cur->data;
+		cur->data += sectordatawritesize;
+		cmd->dst = NAND_FLASH_BUFFER;
+		cmd->len = sectordatawritesize;
+		cmd++;
+
+		if (ops->oobbuf) {
+			if (n == (cwperpage - 1)) {
+				cmd->cmd = 0;
+				cmd->src = cur->oob;
+				cmd->dst = NAND_FLASH_BUFFER +
+					(512 - ((cwperpage - 1) << 2));
+				if ((cwperpage << 2) < cur->oob_len)
+					cmd->len = (cwperpage << 2);
+				else
+					cmd->len = cur->oob_len;
+				cur->oob += cmd->len;
+				cur->oob_len -= cmd->len;
+				if (cmd->len > 0)
+					cmd++;
+			}
+			if (ops->mode != MTD_OOB_AUTO) {
+				/* skip ecc bytes in oobbuf */
+				if (cur->oob_len < 10) {
+					cur->oob += 10;
+					cur->oob_len -= 10;
+				} else {
+					cur->oob += cur->oob_len;
+					cur->oob_len = 0;
+				}
+			}
+		}
+
+		/* kick the execute register */
+		cmd->cmd = 0;
+		cmd->src =
+			msm_virt_to_dma(chip, &dma_buffer->data.exec);
+		cmd->dst = NAND_EXEC_CMD;
+		cmd->len = 4;
+		cmd++;
+
+		/* block on data ready, then
+		 * read the status register
+		 */
+		cmd->cmd = SRC_CRCI_NAND_DATA;
+		cmd->src = NAND_FLASH_STATUS;
+		cmd->dst = msm_virt_to_dma(chip,
+				     &dma_buffer->data.flash_status[n]);
+		cmd->len = 4;
+		cmd++;
+
+		cmd->cmd = 0;
+		cmd->src = msm_virt_to_dma(chip,
+					&dma_buffer->data.clrfstatus);
+		cmd->dst = NAND_FLASH_STATUS;
+		cmd->len = 4;
+		cmd++;
+
+		cmd->cmd = 0;
+		cmd->src = msm_virt_to_dma(chip,
+					&dma_buffer->data.clrrstatus);
+		cmd->dst = NAND_READ_STATUS;
+		cmd->len = 4;
+		cmd++;
+
+	}
+
+	dma_buffer->cmd[0].cmd |= CMD_OCB;
+	cmd[-1].cmd |= CMD_OCU | CMD_LC;
+	BUILD_BUG_ON(8 * 7 + 2 != ARRAY_SIZE(dma_buffer->cmd));
+	BUG_ON(cmd - dma_buffer->cmd > ARRAY_SIZE(dma_buffer->cmd));
+	dma_buffer->cmdptr =
+		(msm_virt_to_dma(chip, dma_buffer->cmd) >> 3) |
+		CMD_PTR_LP;
+}
+
 static int
 msm_nand_write_oob(struct mtd_info *mtd, loff_t to, struct mtd_oob_ops *ops)
 {
 	struct msm_nand_chip *chip = mtd->priv;
-	struct {
-		dmov_s cmd[8 * 7 + 2];
-		unsigned cmdptr;
-		struct {
-			uint32_t cmd;
-			uint32_t addr0;
-			uint32_t addr1;
-			uint32_t chipsel;
-			uint32_t cfg0;
-			uint32_t cfg1;
-			uint32_t exec;
-			uint32_t ecccfg;
-			uint32_t clrfstatus;
-			uint32_t clrrstatus;
-			uint32_t flash_status[8];
-		} data;
-	} *dma_buffer;
-	dmov_s *cmd;
+	struct msm_nand_write_dma *dma_buffer;
+	struct msm_nand_write_dma *buf;
+	struct msm_nand_dmov_req req[MSM_NAND_PIPE_DEPTH];
+	struct msm_nand_cursor cur;
+	/* oob_len before each queued page was set up */
+	uint32_t oob_left[MSM_NAND_PIPE_DEPTH];
 	unsigned n;
 	unsigned page = 0;
-	uint32_t oob_len;
-	uint32_t sectordatawritesize;
 	int err;
 	dma_addr_t data_dma_addr = 0;
 	dma_addr_t oob_dma_addr = 0;
-	dma_addr_t data_dma_addr_curr = 0;
-	dma_addr_t oob_dma_addr_curr = 0;
 	unsigned page_count;
 	unsigned pages_written = 0;
+	unsigned pages_queued = 0;
+	unsigned depth;
 	unsigned cwperpage;
 
 	if (mtd->writesize == 2048)
@@ -869,7 +1136,9 @@ msm_nand_write_oob(struct mtd_info *mtd, loff_t to, struct mtd_oob_ops *ops)
 	if (mtd->writesize == 4096)
 		page = to >> 12;
 
-	oob_len = ops->ooblen;
+	cur.data = 0;
+	cur.oob = 0;
+	cur.oob_len = ops->ooblen;
 	cwperpage = (mtd->writesize >> 9);
 
 	if (to & (mtd->writesize - 1)) {
@@ -915,7 +1184,7 @@ msm_nand_write_oob(struct mtd_info *mtd, loff_t to, struct mtd_oob_ops *ops)
 	}
 
 	if (ops->datbuf) {
-		data_dma_addr_curr = data_dma_addr =
+		cur.data = data_dma_addr =
 			dma_map_single(chip->dev, ops->datbuf,
 				       ops->len, DMA_TO_DEVICE);
 		if (dma_mapping_error(chip->dev, data_dma_addr)) {
@@ -925,7 +1194,7 @@ msm_nand_write_oob(struct mtd_info *mtd, loff_t to, struct mtd_oob_ops *ops)
 		}
 	}
 	if (ops->oobbuf) {
-		oob_dma_addr_curr = oob_dma_addr =
+		cur.oob = oob_dma_addr =
 			dma_map_single(chip->dev, ops->oobbuf,
 				       ops->ooblen, DMA_TO_DEVICE);
 		if (dma_mapping_error(chip->dev, oob_dma_addr)) {
@@ -941,197 +1210,81 @@ msm_nand_write_oob(struct mtd_info *mtd, loff_t to, struct mtd_oob_ops *ops)
 		page_count = ops->len / (mtd->writesize + mtd->oobsize);
 
 	wait_event(chip->wait_queue, (dma_buffer =
-			msm_nand_get_dma_buffer(chip, sizeof(*dma_buffer))));
-
-	while (page_count-- > 0) {
-		cmd = dma_buffer->cmd;
-
-		/* CMD / ADDR0 / ADDR1 / CHIPSEL program values */
-		if (ops->mode != MTD_OOB_RAW) {
-			dma_buffer->data.cfg0 = chip->CFG0;
-			dma_buffer->data.cfg1 = chip->CFG1;
-		} else {
-			dma_buffer->data.cfg0 = (NAND_CFG0_RAW & ~(7U << 6)) |
-				((cwperpage-1) << 6);
-			dma_buffer->data.cfg1 = NAND_CFG1_RAW |
-						(chip->CFG1 & CFG1_WIDE_FLASH);
-		}
+			msm_nand_get_dma_buffer(chip,
+				sizeof(*dma_buffer) * MSM_NAND_PIPE_DEPTH)));
 
-		dma_buffer->data.cmd = NAND_CMD_PRG_PAGE;
-		dma_buffer->data.addr0 = page << 16;
-		dma_buffer->data.addr1 = (page >> 16) & 0xff;
-		dma_buffer->data.chipsel = 0 | 4; /* flash0 + undoc bit */
-
-
-			/* GO bit for the EXEC register */
-		dma_buffer->data.exec = 1;
-		dma_buffer->data.clrfstatus = 0x00000020;
-		dma_buffer->data.clrrstatus = 0x000000C0;
-
-		BUILD_BUG_ON(8 != ARRAY_SIZE(dma_buffer->data.flash_status));
-
-		for (n = 0; n < cwperpage ; n++) {
-			/* status return words */
-			dma_buffer->data.flash_status[n] = 0xeeeeeeee;
-			/* block on cmd ready, then
-			 * write CMD / ADDR0 / ADDR1 / CHIPSEL regs in a burst
-			 */
-			cmd->cmd = DST_CRCI_NAND_CMD;
-			cmd->src =
-				msm_virt_to_dma(chip, &dma_buffer->data.cmd);
-			cmd->dst = NAND_FLASH_CMD;
-			if (n == 0)
-				cmd->len = 16;
-			else
-				cmd->len = 4;
-			cmd++;
-
-			if (n == 0) {
-				cmd->cmd = 0;
-				cmd->src = msm_virt_to_dma(chip,
-							&dma_buffer->data.cfg0);
-				cmd->dst = NAND_DEV0_CFG0;
-				cmd->len = 8;
-				cmd++;
-
-				dma_buffer->data.ecccfg = chip->ecc_buf_cfg;
-				cmd->cmd = 0;
-				cmd->src = msm_virt_to_dma(chip,
-						 &dma_buffer->data.ecccfg);
-				cmd->dst = NAND_EBI2_ECC_BUF_CFG;
-				cmd->len = 4;
-				cmd++;
-			}
-
-				/* write data block */
-			if (ops->mode != MTD_OOB_RAW)
-				sectordatawritesize = (n < (cwperpage - 1)) ?
-					516 : (512 - ((cwperpage - 1) << 2));
-			else
-				sectordatawritesize = 528;
-
-			cmd->cmd = 0;
-			cmd->src = data_dma_addr_curr;
-			data_dma_addr_curr += sectordatawritesize;
-			cmd->dst = NAND_FLASH_BUFFER;
-			cmd->len = sectordatawritesize;
-			cmd++;
-
-			if (ops->oobbuf) {
-				if (n == (cwperpage - 1)) {
-					cmd->cmd = 0;
-					cmd->src = oob_dma_addr_curr;
-					cmd->dst = NAND_FLASH_BUFFER +
-						(512 - ((cwperpage - 1) << 2));
-					if ((cwperpage << 2) < oob_len)
-						cmd->len = (cwperpage << 2);
-					else
-						cmd->len = oob_len;
-					oob_dma_addr_curr += cmd->len;
-					oob_len -= cmd->len;
-					if (cmd->len > 0)
-						cmd++;
-				}
-				if (ops->mode != MTD_OOB_AUTO) {
-					/* skip ecc bytes in oobbuf */
-					if (oob_len < 10) {
-						oob_dma_addr_curr += 10;
-						oob_len -= 10;
-					} else {
-						oob_dma_addr_curr += oob_len;
-						oob_len = 0;
-					}
-				}
-			}
-
-			/* kick the execute register */
-			cmd->cmd = 0;
-			cmd->src =
-				msm_virt_to_dma(chip, &dma_buffer->data.exec);
-			cmd->dst = NAND_EXEC_CMD;
-			cmd->len = 4;
-			cmd++;
-
-			/* block on data ready, then
-			 * read the status register
-			 */
-			cmd->cmd = SRC_CRCI_NAND_DATA;
-			cmd->src = NAND_FLASH_STATUS;
-			cmd->dst = msm_virt_to_dma(chip,
-					     &dma_buffer->data.flash_status[n]);
-			cmd->len = 4;
-			cmd++;
-
-			cmd->cmd = 0;
-			cmd->src = msm_virt_to_dma(chip,
-						&dma_buffer->data.clrfstatus);
-			cmd->dst = NAND_FLASH_STATUS;
-			cmd->len = 4;
-			cmd++;
-
-			cmd->cmd = 0;
-			cmd->src = msm_virt_to_dma(chip,
-						&dma_buffer->data.clrrstatus);
-			cmd->dst = NAND_READ_STATUS;
-			cmd->len = 4;
-			cmd++;
+	depth = (msm_nand_pipeline && page_count > 1) ?
+		MSM_NAND_PIPE_DEPTH : 1;
 
+	err = 0;
+	while (pages_written < page_count) {
+		/* keep up to depth pages queued on the datamover */
+		while (pages_queued < page_count &&
+		       pages_queued - pages_written < depth) {
+			n = pages_queued % MSM_NAND_PIPE_DEPTH;
+			oob_left[n] = cur.oob_len;
+			msm_nand_prep_write_page(mtd, ops, &dma_buffer[n],
+						 page + pages_queued, &cur);
+			msm_nand_dmov_submit(chip, &req[n],
+					     &dma_buffer[n].cmdptr);
+			pages_queued++;
 		}
 
-		dma_buffer->cmd[0].cmd |= CMD_OCB;
-		cmd[-1].cmd |= CMD_OCU | CMD_LC;
-		BUILD_BUG_ON(8 * 7 + 2 != ARRAY_SIZE(dma_buffer->cmd));
-		BUG_ON(cmd - dma_buffer->cmd > ARRAY_SIZE(dma_buffer->cmd));
-		dma_buffer->cmdptr =
-			(msm_virt_to_dma(chip, dma_buffer->cmd) >> 3) |
-			CMD_PTR_LP;
-
-		dsb();
-		msm_dmov_exec_cmd(chip->dma_channel,
-			DMOV_CMD_PTR_LIST | DMOV_CMD_ADDR(
-				msm_virt_to_dma(chip, &dma_buffer->cmdptr)));
-		dsb();
+		n = pages_written % MSM_NAND_PIPE_DEPTH;
+		buf = &dma_buffer[n];
+		msm_nand_dmov_wait(&req[n]);
 
 		/* if any of the writes failed (0x10), or there was a
 		 * protection violation (0x100), or the program success
 		 * bit (0x80) is unset, we lose
 		 */
-		err = 0;
 		for (n = 0; n < cwperpage; n++) {
-			if (dma_buffer->data.flash_status[n] & 0x110) {
+			if (buf->data.flash_status[n] & 0x110) {
 				err = -EIO;
 				break;
 			}
-			if (!(dma_buffer->data.flash_status[n] & 0x80)) {
+			if (!(buf->data.flash_status[n] & 0x80)) {
 				err = -EIO;
 				break;
 			}
 		}
 
 #if VERBOSE
-		pr_info("write pg %d: status: %x %x %x %x %x %x %x %x\n", page,
-			dma_buffer->data.flash_status[0],
-			dma_buffer->data.flash_status[1],
-			dma_buffer->data.flash_status[2],
-			dma_buffer->data.flash_status[3],
-			dma_buffer->data.flash_status[4],
-			dma_buffer->data.flash_status[5],
-			dma_buffer->data.flash_status[6],
-			dma_buffer->data.flash_status[7]);
+		pr_info("write pg %d: status: %x %x %x %x %x %x %x %x\n",
+			page + pages_written,
+			buf->data.flash_status[0],
+			buf->data.flash_status[1],
+			buf->data.flash_status[2],
+			buf->data.flash_status[3],
+			buf->data.flash_status[4],
+			buf->data.flash_status[5],
+			buf->data.flash_status[6],
+			buf->data.flash_status[7]);
 #endif
 		if (err)
 			break;
 		pages_written++;
-		page++;
 	}
+
+	/* a page queued behind a failed one has been programmed by the
+	 * time we get here, but is not counted: the caller retires the
+	 * block anyway
+	 */
+	if (pages_queued > pages_written + 1)
+		cur.oob_len =
+			oob_left[(pages_written + 1) % MSM_NAND_PIPE_DEPTH];
+	for (n = pages_written + 1; n < pages_queued; n++)
+		msm_nand_dmov_wait(&req[n % MSM_NAND_PIPE_DEPTH]);
+
 	if (ops->mode != MTD_OOB_RAW)
 		ops->retlen = mtd->writesize * pages_written;
 	else
 		ops->retlen = (mtd->writesize + mtd->oobsize) * pages_written;
 
-	ops->oobretlen = ops->ooblen - oob_len;
+	ops->oobretlen = ops->ooblen - cur.oob_len;
 
-	msm_nand_release_dma_buffer(chip, dma_buffer, sizeof(*dma_buffer));
+	msm_nand_release_dma_buffer(chip, dma_buffer,
+				    sizeof(*dma_buffer) * MSM_NAND_PIPE_DEPTH);
 
 	if (ops->oobbuf)
 		dma_unmap_single(chip->dev, oob_dma_addr,
@@ -41,6 +41,8 @@
 #include <linux/sched.h>
 #include <linux/fs.h>
 #include <linux/pagemap.h>
+#include <linux/mutex.h>
+#include <linux/ktime.h>
 
 /* Default simulator parameters values */
 #if !defined(CONFIG_NANDSIM_FIRST_ID_BYTE)  || \
@@ -104,18 +106,20 @@ static char *gravepages = NULL;
 static unsigned int rptwear = 0;
 static unsigned int overridesize = 0;
 static char *cache_file = NULL;
+static unsigned int pipeline = 0;
+static unsigned int delay_jitter = 0;
 
 module_param(first_id_byte,  uint, 0400);
 module_param(second_id_byte, uint, 0400);
 module_param(third_id_byte,  uint, 0400);
 module_param(fourth_id_byte, uint, 0400);
-module_param(access_delay,   uint, 0400);
-module_param(programm_delay, uint, 0400);
-module_param(erase_delay,    uint, 0400);
+module_param(access_delay,   uint, 0644);
+module_param(programm_delay, uint, 0644);
+module_param(erase_delay,    uint, 0644);
 module_param(output_cycle,   uint, 0400);
 module_param(input_cycle,    uint, 0400);
 module_param(bus_width,      uint, 0400);
-module_param(do_delays,      uint, 0400);
+module_param(do_delays,      uint, 0644);
 module_param(log,            uint, 0400);
 module_param(dbg,            uint, 0400);
 module_param_array(parts, ulong, &parts_num, 0400);
@@ -127,6 +131,8 @@ module_param(gravepages,     charp, 0400);
 module_param(rptwear,        uint, 0400);
 module_param(overridesize,   uint, 0400);
 module_param(cache_file,     charp, 0400);
+module_param(pipeline,       uint, 0400);
+module_param(delay_jitter,   uint, 0644);
 
 MODULE_PARM_DESC(first_id_byte,  "The first byte returned by NAND Flash 'read ID' command (manufacturer ID)");
 MODULE_PARM_DESC(second_id_byte, "The second byte returned by NAND Flash 'read ID' command (chip ID)");
@@ -159,6 +165,11 @@ MODULE_PARM_DESC(overridesize,   "Specifies the NAND Flash size overriding the I
 				 "The size is specified in erase blocks and as the exponent of a power of two"
 				 " e.g. 5 means a size of 32 erase blocks");
 MODULE_PARM_DESC(cache_file,     "File to use to cache nand pages instead of memory");
+MODULE_PARM_DESC(pipeline,       "Overlap page access and programm delays of the pages of a"
+				 " multi-page MTD request, like cache read and cache programm"
+				 " (only makes a difference with do_delays)");
+MODULE_PARM_DESC(delay_jitter,   "Lengthen each access, programm and erase delay by a random"
+				 " amount of up to this many percent");
 
 /* The largest possible page size */
 #define NS_LARGEST_PAGE_SIZE	2048
@@ -354,6 +365,22 @@ struct nandsim {
 	void *file_buf;
 	struct page *held_pages[NS_MAX_HELD_PAGES];
 	int held_cnt;
+
+	/* Fields needed when simulating pipelined multi-page requests */
+	struct nandsim_pipe {
+		struct mutex lock;  /* one MTD request at a time */
+		int active;         /* the request spans more than one page */
+		uint next_row;      /* page the array is loading ahead */
+		ktime_t ready;      /* time the array is done with its work */
+		int (*read)(struct mtd_info *mtd, loff_t from, size_t len,
+			    size_t *retlen, u_char *buf);
+		int (*write)(struct mtd_info *mtd, loff_t to, size_t len,
+			     size_t *retlen, const u_char *buf);
+		int (*read_oob)(struct mtd_info *mtd, loff_t from,
+				struct mtd_oob_ops *ops);
+		int (*write_oob)(struct mtd_info *mtd, loff_t to,
+				 struct mtd_oob_ops *ops);
+	} pipe;
 };
 
 /*
@@ -1568,6 +1595,64 @@ static int prog_page(struct nandsim *ns, int num)
 	return 0;
 }
 
+/*
+ * Real chips do not take the same time for every page and block, so the
+ * access, programm and erase delays can be randomly stretched.
+ */
+static uint ns_jitter(uint delay)
+{
+	if (!delay_jitter || !delay)
+		return delay;
+	return delay + random32() % (delay * delay_jitter / 100 + 1);
+}
+
+/*
+ * Wait until the array has finished what it was doing in the background
+ * (only happens in pipelined multi-page requests).
+ */
+static void ns_wait_array(struct nandsim *ns)
+{
+	s64 us = ktime_us_delta(ns->pipe.ready, ktime_get());
+
+	if (us > 0)
+		NS_UDELAY(us);
+}
+
+/*
+ * Page access delay.  Inside a pipelined multi-page request the chip starts
+ * loading the next page as soon as the current one is in the cache
+ * register, so the time the host spends reading out and checking a page
+ * is taken off the access time of the next one.
+ */
+static void ns_access_delay(struct nandsim *ns)
+{
+	ns_wait_array(ns);
+	if (!ns->pipe.active || ns->regs.row != ns->pipe.next_row)
+		NS_UDELAY(ns_jitter(access_delay));
+
+	if (ns->pipe.active) {
+		ns->pipe.next_row = ns->regs.row + 1;
+		ns->pipe.ready = ktime_add_us(ktime_get(),
+					      ns_jitter(access_delay));
+	}
+}
+
+/*
+ * Page programm delay.  Inside a pipelined multi-page request the page is
+ * programmed in the background while the host sends the next one, and the
+ * chip only reports busy until the previous programm has finished.
+ */
+static void ns_programm_delay(struct nandsim *ns)
+{
+	ns_wait_array(ns);
+	if (ns->pipe.active) {
+		ns->pipe.next_row = -1;
+		ns->pipe.ready = ktime_add_us(ktime_get(),
+					      ns_jitter(programm_delay));
+	} else
+		NS_UDELAY(ns_jitter(programm_delay));
+}
+
 /*
  * If state has any action bit, perform this action.
  *
@@ -1612,7 +1697,7 @@ static int do_state_action(struct nandsim *ns, uint32_t action)
 		else
 			NS_LOG("read OOB of page %d\n", ns->regs.row);
 
-		NS_UDELAY(access_delay);
+		ns_access_delay(ns);
 		NS_UDELAY(input_cycle * ns->geom.pgsz / 1000 / busdiv);
 
 		break;
@@ -1645,7 +1730,8 @@ static int do_state_action(struct nandsim *ns, uint32_t action)
 
 		erase_sector(ns);
 
-		NS_MDELAY(erase_delay);
+		ns_wait_array(ns);
+		NS_MDELAY(ns_jitter(erase_delay));
 
 		if (erase_block_wear)
 			update_wear(erase_block_no);
@@ -1683,7 +1769,7 @@ static int do_state_action(struct nandsim *ns, uint32_t action)
 			num, ns->regs.row, ns->regs.column, NS_RAW_OFFSET(ns) + ns->regs.off);
 		NS_LOG("programm page %d\n", ns->regs.row);
 
-		NS_UDELAY(programm_delay);
+		ns_programm_delay(ns);
 		NS_UDELAY(output_cycle * ns->geom.pgsz / 1000 / busdiv);
 
 		if (write_error(page_no)) {
@@ -2217,6 +2303,106 @@ static int ns_nand_verify_buf(struct mtd_info *mtd, const u_char *buf, int len)
 	}
 }
 
+/*
+ * Pipelined multi-page requests.  The MTD entry points are wrapped so that
+ * the simulator knows when several pages are read or written in one go.
+ */
+static void ns_pipe_begin(struct nandsim *ns, int pages)
+{
+	mutex_lock(&ns->pipe.lock);
+	ns->pipe.active = pages > 1;
+	ns->pipe.next_row = -1;
+}
+
+static void ns_pipe_end(struct nandsim *ns)
+{
+	/* the last page has to be done before the request completes */
+	ns_wait_array(ns);
+	ns->pipe.active = 0;
+	ns->pipe.ready = ktime_set(0, 0);
+	mutex_unlock(&ns->pipe.lock);
+}
+
+static inline struct nandsim *ns_from_mtd(struct mtd_info *mtd)
+{
+	return ((struct nand_chip *)mtd->priv)->priv;
+}
+
+static int ns_oob_ops_pages(struct mtd_info *mtd, struct mtd_oob_ops *ops)
+{
+	if (ops->datbuf)
+		return DIV_ROUND_UP(ops->len, mtd->writesize);
+	return DIV_ROUND_UP(ops->ooblen, ops->mode == MTD_OOB_AUTO ?
+			    mtd->oobavail : mtd->oobsize);
+}
+
+static int ns_pipe_read(struct mtd_info *mtd, loff_t from, size_t len,
+			size_t *retlen, u_char *buf)
+{
+	struct nandsim *ns = ns_from_mtd(mtd);
+	int ret;
+
+	ns_pipe_begin(ns, DIV_ROUND_UP(len, mtd->writesize));
+	ret = ns->pipe.read(mtd, from, len, retlen, buf);
+	ns_pipe_end(ns);
+	return ret;
+}
+
+static int ns_pipe_write(struct mtd_info *mtd, loff_t to, size_t len,
+			 size_t *retlen, const u_char *buf)
+{
+	struct nandsim *ns = ns_from_mtd(mtd);
+	int ret;
+
+	ns_pipe_begin(ns, DIV_ROUND_UP(len, mtd->writesize));
+	ret = ns->pipe.write(mtd, to, len, retlen, buf);
+	ns_pipe_end(ns);
+	return ret;
+}
+
+static int ns_pipe_read_oob(struct mtd_info *mtd, loff_t from,
+			    struct mtd_oob_ops *ops)
+{
+	struct nandsim *ns = ns_from_mtd(mtd);
+	int ret;
+
+	ns_pipe_begin(ns, ns_oob_ops_pages(mtd, ops));
+	ret = ns->pipe.read_oob(mtd, from, ops);
+	ns_pipe_end(ns);
+	return ret;
+}
+
+static int ns_pipe_write_oob(struct mtd_info *mtd, loff_t to,
+			     struct mtd_oob_ops *ops)
+{
+	struct nandsim *ns = ns_from_mtd(mtd);
+	int ret;
+
+	ns_pipe_begin(ns, ns_oob_ops_pages(mtd, ops));
+	ret = ns->pipe.write_oob(mtd, to, ops);
+	ns_pipe_end(ns);
+	return ret;
+}
+
+static void setup_pipeline(struct mtd_info *mtd)
+{
+	struct nandsim *ns = ns_from_mtd(mtd);
+
+	mutex_init(&ns->pipe.lock);
+	if (!pipeline)
+		return;
+
+	ns->pipe.read = mtd->read;
+	ns->pipe.write = mtd->write;
+	ns->pipe.read_oob = mtd->read_oob;
+	ns->pipe.write_oob = mtd->write_oob;
+	mtd->read = ns_pipe_read;
+	mtd->write = ns_pipe_write;
+	mtd->read_oob = ns_pipe_read_oob;
+	mtd->write_oob = ns_pipe_write_oob;
+	NS_INFO("pipelined multi-page requests enabled\n");
+}
+
 /*
  * Module initialization function
  */
@@ -2315,6 +2501,8 @@ static int __init ns_init_module(void)
 	if ((retval = init_nandsim(nsmtd)) != 0)
 		goto err_exit;
 
+	setup_pipeline(nsmtd);
+
 	if ((retval = parse_badblocks(nand, nsmtd)) != 0)
 		goto err_exit;
 
@@ -0,0 +1,405 @@
+/*
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as published by
+ * the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; see the file COPYING. If not, write to the Free Software
+ * Foundation, 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ * Measure the latency distribution of eraseblock erase, page write, page
+ * read and multi-page write and read requests on a MTD device.
+ *
+ * For each kind of request the minimum, average and maximum latency, the
+ * 50th, 90th and 99th percentile and a log2 histogram are printed, along
+ * with the throughput.  The percentiles are the upper bounds of histogram
+ * buckets.
+ *
+ * To compare filesystem or driver changes without hardware, run it on
+ * nandsim with do_delays=1 and access_delay, programm_delay, erase_delay
+ * (and delay_jitter) set to the timings of the flash being modelled, e.g.
+ *
+ *	modprobe nandsim first_id_byte=0xec second_id_byte=0xaa \
+ *		do_delays=1 access_delay=25 programm_delay=250 \
+ *		erase_delay=2 delay_jitter=20
+ *	modprobe mtd_latencytest dev=0 count=64 multipage=4
+ *
+ * All data on the eraseblocks used is destroyed.
+ */
+
+#include <linux/init.h>
+#include <linux/module.h>
+#include <linux/moduleparam.h>
+#include <linux/err.h>
+#include <linux/mtd/mtd.h>
+#include <linux/sched.h>
+#include <linux/ktime.h>
+#include <linux/math64.h>
+
+#define PRINT_PREF KERN_INFO "mtd_latencytest: "
+
+static int dev;
+module_param(dev, int, S_IRUGO);
+MODULE_PARM_DESC(dev, "MTD device number to use");
+
+static int count;
+module_param(count, int, S_IRUGO);
+MODULE_PARM_DESC(count, "Number of eraseblocks to use (default all)");
+
+static int multipage = 4;
+module_param(multipage, int, S_IRUGO);
+MODULE_PARM_DESC(multipage, "Pages per request in the multi-page tests");
+
+/* bucket i holds latencies below 2^i microseconds */
+#define LAT_BUCKETS 24
+
+struct lat_stats {
+	const char *name;
+	unsigned long n;
+	s64 min, max, total;
+	unsigned long bucket[LAT_BUCKETS];
+};
+
+static struct mtd_info *mtd;
+static unsigned char *iobuf;
+static unsigned char *bbt;
+
+static int pgsize;
+static int ebcnt;
+static int pgcnt;
+static int goodebcnt;
+static unsigned long next = 1;
+
+static inline unsigned int simple_rand(void)
+{
+	next = next * 1103515245 + 12345;
+	return (unsigned int)((next / 65536) % 32768);
+}
+
+static inline void simple_srand(unsigned long seed)
+{
+	next = seed;
+}
+
+static void set_random_data(unsigned char *buf, size_t len)
+{
+	size_t i;
+
+	for (i = 0; i < len; ++i)
+		buf[i] = simple_rand();
+}
+
+static void lat_init(struct lat_stats *st, const char *name)
+{
+	memset(st, 0, sizeof(*st));
+	st->name = name;
+	st->min = LLONG_MAX;
+}
+
+static void lat_add(struct lat_stats *st, ktime_t start)
+{
+	s64 us = ktime_us_delta(ktime_get(), start);
+	int b = 0;
+
+	if (us < 0)
+		us = 0;
+	st->n += 1;
+	st->total += us;
+	if (us < st->min)
+		st->min = us;
+	if (us > st->max)
+		st->max = us;
+	while (b < LAT_BUCKETS - 1 && us >= (1LL << b))
+		b += 1;
+	st->bucket[b] += 1;
+}
+
+/* upper bound of the bucket holding the pct'th percentile */
+static long long lat_percentile(struct lat_stats *st, int pct)
+{
+	unsigned long want = (st->n * pct + 99) / 100, seen = 0;
+	int b;
+
+	for (b = 0; b < LAT_BUCKETS; b++) {
+		seen += st->bucket[b];
+		if (seen >= want)
+			return 1LL << b;
+	}
+	return st->max;
+}
+
+static void lat_report(struct lat_stats *st, u64 bytes)
+{
+	u64 avg;
+	int b;
+
+	if (!st->n)
+		return;
+	avg = div_u64(st->total, st->n);
+
+	printk(PRINT_PREF "%s: %lu requests, min %lld avg %lld max %lld us\n",
+	       st->name, st->n, st->min, (long long)avg, st->max);
+	printk(PRINT_PREF "%s: p50 < %lld p90 < %lld p99 < %lld us\n",
+	       st->name, lat_percentile(st, 50), lat_percentile(st, 90),
+	       lat_percentile(st, 99));
+	if (bytes && st->total) {
+		u64 speed = div64_u64(bytes * 1000000 / 1024, st->total);
+
+		printk(PRINT_PREF "%s: %llu KiB/s\n", st->name,
+		       (unsigned long long)speed);
+	}
+	for (b = 0; b < LAT_BUCKETS; b++)
+		if (st->bucket[b])
+			printk(PRINT_PREF "%s:   < %8lld us %lu\n", st->name,
+			       1LL << b, st->bucket[b]);
+}
+
+static int erase_eraseblock(int ebnum, struct lat_stats *st)
+{
+	int err;
+	struct erase_info ei;
+	loff_t addr = ebnum * mtd->erasesize;
+	ktime_t start;
+
+	memset(&ei, 0, sizeof(struct erase_info));
+	ei.mtd  = mtd;
+	ei.addr = addr;
+	ei.len  = mtd->erasesize;
+
+	start = ktime_get();
+	err = mtd->erase(mtd, &ei);
+	if (st)
+		lat_add(st, start);
+	if (err) {
+		printk(PRINT_PREF "error %d while erasing EB %d\n", err, ebnum);
+		return err;
+	}
+
+	if (ei.state == MTD_ERASE_FAILED) {
+		printk(PRINT_PREF "some erase error occurred at EB %d\n",
+		       ebnum);
+		return -EIO;
+	}
+
+	return 0;
+}
+
+static int erase_all(struct lat_stats *st)
+{
+	int err;
+	unsigned int i;
+
+	for (i = 0; i < ebcnt; ++i) {
+		if (bbt[i])
+			continue;
+		err = erase_eraseblock(i, st);
+		if (err)
+			return err;
+		cond_resched();
+	}
+	return 0;
+}
+
+/* write or read an eraseblock in requests of npages pages */
+static int rw_eraseblock(int ebnum, int npages, int write,
+			 struct lat_stats *st)
+{
+	size_t done = 0, sz;
+	int i, err = 0;
+	loff_t addr = ebnum * mtd->erasesize;
+	void *buf = iobuf;
+	ktime_t start;
+
+	for (i = 0; i < pgcnt; i += npages) {
+		sz = min(npages, pgcnt - i) * pgsize;
+		start = ktime_get();
+		if (write)
+			err = mtd->write(mtd, addr, sz, &done, buf);
+		else
+			err = mtd->read(mtd, addr, sz, &done, buf);
+		lat_add(st, start);
+		/* Ignore corrected ECC errors */
+		if (err == -EUCLEAN)
+			err = 0;
+		if (err || done != sz) {
+			printk(PRINT_PREF "error: %s failed at %#llx\n",
+			       write ? "write" : "read", addr);
+			if (!err)
+				err = -EINVAL;
+			return err;
+		}
+		addr += sz;
+		buf += sz;
+	}
+
+	return 0;
+}
+
+static int rw_all(int npages, int write, struct lat_stats *st)
+{
+	int i, err;
+
+	for (i = 0; i < ebcnt; ++i) {
+		if (bbt[i])
+			continue;
+		err = rw_eraseblock(i, npages, write, st);
+		if (err)
+			return err;
+		cond_resched();
+	}
+	return 0;
+}
+
+static int is_block_bad(int ebnum)
+{
+	loff_t addr = ebnum * mtd->erasesize;
+	int ret;
+
+	ret = mtd->block_isbad(mtd, addr);
+	if (ret)
+		printk(PRINT_PREF "block %d is bad\n", ebnum);
+	return ret;
+}
+
+static int scan_for_bad_eraseblocks(void)
+{
+	int i, bad = 0;
+
+	bbt = kzalloc(ebcnt, GFP_KERNEL);
+	if (!bbt) {
+		printk(PRINT_PREF "error: cannot allocate memory\n");
+		return -ENOMEM;
+	}
+
+	printk(PRINT_PREF "scanning for bad eraseblocks\n");
+	for (i = 0; i < ebcnt; ++i) {
+		bbt[i] = is_block_bad(i) ? 1 : 0;
+		if (bbt[i])
+			bad += 1;
+		cond_resched();
+	}
+	printk(PRINT_PREF "scanned %d eraseblocks, %d are bad\n", i, bad);
+	goodebcnt = ebcnt - bad;
+	return 0;
+}
+
+static int __init mtd_latencytest_init(void)
+{
+	static struct lat_stats st;
+	u64 bytes;
+	int err;
+	uint64_t tmp;
+
+	printk(KERN_INFO "\n");
+	printk(KERN_INFO "=================================================\n");
+	printk(PRINT_PREF "MTD device: %d\n", dev);
+
+	mtd = get_mtd_device(NULL, dev);
+	if (IS_ERR(mtd)) {
+		err = PTR_ERR(mtd);
+		printk(PRINT_PREF "error: cannot get MTD device\n");
+		return err;
+	}
+
+	if (mtd->writesize == 1) {
+		printk(PRINT_PREF "not NAND flash, assume page size is 512 "
+		       "bytes.\n");
+		pgsize = 512;
+	} else
+		pgsize = mtd->writesize;
+
+	tmp = mtd->size;
+	do_div(tmp, mtd->erasesize);
+	ebcnt = tmp;
+	if (count > 0 && count < ebcnt)
+		ebcnt = count;
+	pgcnt = mtd->erasesize / pgsize;
+	if (multipage < 2)
+		multipage = 2;
+
+	printk(PRINT_PREF "MTD device size %llu, eraseblock size %u, "
+	       "page size %u, using %u eraseblocks, pages per "
+	       "eraseblock %u, %d pages per multi-page request\n",
+	       (unsigned long long)mtd->size, mtd->erasesize,
+	       pgsize, ebcnt, pgcnt, multipage);
+
+	err = -ENOMEM;
+	iobuf = kmalloc(mtd->erasesize, GFP_KERNEL);
+	if (!iobuf) {
+		printk(PRINT_PREF "error: cannot allocate memory\n");
+		goto out;
+	}
+
+	simple_srand(1);
+	set_random_data(iobuf, mtd->erasesize);
+
+	err = scan_for_bad_eraseblocks();
+	if (err)
+		goto out;
+
+	/* the first pass may find blocks in any state, do not time it */
+	err = erase_all(NULL);
+	if (err)
+		goto out;
+
+	bytes = (u64)goodebcnt * mtd->erasesize;
+
+	lat_init(&st, "page write");
+	err = rw_all(1, 1, &st);
+	if (err)
+		goto out;
+	lat_report(&st, bytes);
+
+	lat_init(&st, "page read");
+	err = rw_all(1, 0, &st);
+	if (err)
+		goto out;
+	lat_report(&st, bytes);
+
+	lat_init(&st, "eraseblock erase");
+	err = erase_all(&st);
+	if (err)
+		goto out;
+	lat_report(&st, bytes);
+
+	lat_init(&st, "multi-page write");
+	err = rw_all(multipage, 1, &st);
+	if (err)
+		goto out;
+	lat_report(&st, bytes);
+
+	lat_init(&st, "multi-page read");
+	err = rw_all(multipage, 0, &st);
+	if (err)
+		goto out;
+	lat_report(&st, bytes);
+
+	err = erase_all(NULL);
+	if (err)
+		goto out;
+
+	printk(PRINT_PREF "finished\n");
+out:
+	kfree(iobuf);
+	kfree(bbt);
+	put_mtd_device(mtd);
+	if (err)
+		printk(PRINT_PREF "error %d occurred\n", err);
+	printk(KERN_INFO "=================================================\n");
+	return err;
+}
+module_init(mtd_latencytest_init);
+
+static void __exit mtd_latencytest_exit(void)
+{
+	return;
+}
+module_exit(mtd_latencytest_exit);
+
+MODULE_DESCRIPTION("Latency test module");
+MODULE_LICENSE("GPL");
@@ -587,6 +587,18 @@ long nr_blockdev_pages(void)
 	return ret;
 }
 
+/**
+ * bdgrab -- Grab a reference to an already referenced block device
+ * @bdev:	Block device to grab a reference to.
+ */
+struct block_device *bdgrab(struct block_device *bdev)
+{
+	atomic_inc(&bdev->bd_inode->i_count);
+	return bdev;
+}
+
+EXPORT_SYMBOL(bdgrab);
+
 void bdput(struct block_device *bdev)
 {
 	iput(bdev->bd_inode);
@@ -1347,6 +1359,8 @@ static int __blkdev_put(struct block_device *bdev, fmode_t mode, int for_part)
 
 	if (!--bdev->bd_openers) {
 		sync_blockdev(bdev);
+		if (bdev->bd_contains == bdev)
+			blk_discard_batch_flush(disk->queue);
 		kill_bdev(bdev);
 	}
 	if (bdev->bd_contains == bdev) {
@@ -0,0 +1,253 @@
+/*
+ * linux/fs/ext4/debugfs.c
+ *
+ * Allocation statistics of a mounted filesystem, in debugfs under
+ * ext4/<device>/:
+ *
+ *   extents	the number of extents of each regular file in the inode
+ *		cache, to see how fragmented the files being written are
+ *   alloc_stats	the kilobytes written to files with write(2) and those
+ *		written to the device since the mount, their ratio (the
+ *		write amplification, journal and metadata included), and
+ *		the preallocation and flash profile counters of mballoc.
+ *		Writing anything to it restarts the write counts.
+ *
+ * The files keep the superblock in i_private until it is unregistered, and
+ * an open file holds an active reference on it: the filesystem is only
+ * shut down once the files are closed, even if it is unmounted before.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#include <linux/fs.h>
+#include <linux/genhd.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
+#include <linux/sched.h>
+#include <linux/writeback.h>
+#include "ext4.h"
+#include "ext4_extents.h"
+
+static struct dentry *ext4_debugfs_root;
+
+/* serialises taking a reference through i_private with unregistering */
+static DEFINE_MUTEX(ext4_debugfs_mutex);
+
+static int ext4_debugfs_open(struct inode *inode, struct file *file,
+			     int (*show)(struct seq_file *, void *))
+{
+	struct super_block *sb;
+	int ret = -ENODEV;
+
+	mutex_lock(&ext4_debugfs_mutex);
+	sb = inode->i_private;
+	if (sb && atomic_inc_not_zero(&sb->s_active))
+		ret = 0;
+	mutex_unlock(&ext4_debugfs_mutex);
+	if (ret)
+		return ret;
+
+	ret = single_open(file, show, sb);
+	if (ret)
+		deactivate_super(sb);
+	return ret;
+}
+
+static int ext4_debugfs_release(struct inode *inode, struct file *file)
+{
+	struct super_block *sb =
+		((struct seq_file *)file->private_data)->private;
+
+	single_release(inode, file);
+	deactivate_super(sb);
+	return 0;
+}
+
+static int ext4_count_extents_cb(struct inode *inode,
+				 struct ext4_ext_path *path,
+				 struct ext4_ext_cache *newex,
+				 struct ext4_extent *ex, void *data)
+{
+	if (newex->ec_type == EXT4_EXT_CACHE_EXTENT)
+		(*(unsigned int *)data)++;
+	return EXT_CONTINUE;
+}
+
+/* Only the inodes in the cache are listed, this is not fsck */
+static int ext4_extents_show(struct seq_file *seq, void *v)
+{
+	struct super_block *sb = seq->private;
+	struct inode *inode, *toput_inode = NULL;
+	unsigned long files = 0;
+	unsigned long long total = 0;
+	unsigned int extents;
+
+	seq_printf(seq, "# ino size_kb extents\n");
+	spin_lock(&inode_lock);
+	list_for_each_entry(inode, &sb->s_inodes, i_sb_list) {
+		if (inode->i_state & (I_FREEING|I_CLEAR|I_WILL_FREE|I_NEW))
+			continue;
+		if (!S_ISREG(inode->i_mode) || !inode->i_blocks ||
+		    !(EXT4_I(inode)->i_flags & EXT4_EXTENTS_FL))
+			continue;
+		__iget(inode);
+		spin_unlock(&inode_lock);
+
+		extents = 0;
+		down_write(&EXT4_I(inode)->i_data_sem);
+		ext4_ext_walk_space(inode, 0, EXT_MAX_BLOCK,
+				    ext4_count_extents_cb, &extents);
+		up_write(&EXT4_I(inode)->i_data_sem);
+		seq_printf(seq, "%lu %llu %u\n", inode->i_ino,
+			   (unsigned long long)(i_size_read(inode) >> 10),
+			   extents);
+		files++;
+		total += extents;
+
+		iput(toput_inode);
+		toput_inode = inode;
+		cond_resched();
+		spin_lock(&inode_lock);
+	}
+	spin_unlock(&inode_lock);
+	iput(toput_inode);
+
+	seq_printf(seq, "# files %lu extents %llu\n", files, total);
+	return 0;
+}
+
+static int ext4_extents_open(struct inode *inode, struct file *file)
+{
+	return ext4_debugfs_open(inode, file, ext4_extents_show);
+}
+
+static const struct file_operations ext4_extents_fops = {
+	.owner		= THIS_MODULE,
+	.open		= ext4_extents_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= ext4_debugfs_release,
+};
+
+static unsigned long ext4_sectors_written(struct super_block *sb)
+{
+	if (!sb->s_bdev->bd_part)
+		return 0;
+	return part_stat_read(sb->s_bdev->bd_part, sectors[1]) -
+		EXT4_SB(sb)->s_sectors_written_start;
+}
+
+static int ext4_alloc_stats_show(struct seq_file *seq, void *v)
+{
+	struct super_block *sb = seq->private;
+	struct ext4_sb_info *sbi = EXT4_SB(sb);
+	u64 written = percpu_counter_sum_positive(&sbi->s_written_bytes) >> 10;
+	u64 device = ext4_sectors_written(sb) >> 1;
+	u64 ratio;
+
+	seq_printf(seq, "written_kb:           %llu\n",
+		   (unsigned long long)written);
+	seq_printf(seq, "device_written_kb:    %llu\n",
+		   (unsigned long long)device);
+	if (written) {
+		ratio = div64_u64(device * 100, written);
+		seq_printf(seq, "write_amplification:  %llu.%02llu\n",
+			   (unsigned long long)ratio / 100,
+			   (unsigned long long)ratio % 100);
+	} else
+		seq_printf(seq, "write_amplification:  -\n");
+	seq_printf(seq, "preallocated_blocks:  %u\n",
+		   atomic_read(&sbi->s_mb_preallocated));
+	seq_printf(seq, "discarded_blocks:     %u\n",
+		   atomic_read(&sbi->s_mb_discarded));
+	seq_printf(seq, "flash_windows:        %u\n",
+		   atomic_read(&sbi->s_mb_flash_windows));
+	seq_printf(seq, "flash_bounded_scans:  %u\n",
+		   atomic_read(&sbi->s_mb_flash_bounded));
+	return 0;
+}
+
+static int ext4_alloc_stats_open(struct inode *inode, struct file *file)
+{
+	return ext4_debugfs_open(inode, file, ext4_alloc_stats_show);
+}
+
+static ssize_t ext4_alloc_stats_write(struct file *file, const char __user *buf,
+				      size_t count, loff_t *ppos)
+{
+	struct super_block *sb =
+		((struct seq_file *)file->private_data)->private;
+	struct ext4_sb_info *sbi = EXT4_SB(sb);
+
+	percpu_counter_set(&sbi->s_written_bytes, 0);
+	if (sb->s_bdev->bd_part)
+		sbi->s_sectors_written_start =
+			part_stat_read(sb->s_bdev->bd_part, sectors[1]);
+	atomic_set(&sbi->s_mb_flash_windows, 0);
+	atomic_set(&sbi->s_mb_flash_bounded, 0);
+	return count;
+}
+
+static const struct file_operations ext4_alloc_stats_fops = {
+	.owner		= THIS_MODULE,
+	.open		= ext4_alloc_stats_open,
+	.read		= seq_read,
+	.write		= ext4_alloc_stats_write,
+	.llseek		= seq_lseek,
+	.release	= ext4_debugfs_release,
+};
+
+void ext4_register_debugfs(struct super_block *sb)
+{
+	struct ext4_sb_info *sbi = EXT4_SB(sb);
+
+	if (!ext4_debugfs_root)
+		return;
+	sbi->s_debug = debugfs_create_dir(sb->s_id, ext4_debugfs_root);
+	if (!sbi->s_debug)
+		return;
+	sbi->s_debug_extents = debugfs_create_file("extents", S_IRUSR,
+				sbi->s_debug, sb, &ext4_extents_fops);
+	sbi->s_debug_alloc_stats = debugfs_create_file("alloc_stats",
+				S_IRUSR | S_IWUSR, sbi->s_debug, sb,
+				&ext4_alloc_stats_fops);
+}
+
+static void ext4_debugfs_forget(struct dentry *dentry)
+{
+	if (dentry && dentry->d_inode)
+		dentry->d_inode->i_private = NULL;
+}
+
+void ext4_unregister_debugfs(struct super_block *sb)
+{
+	struct ext4_sb_info *sbi = EXT4_SB(sb);
+
+	if (!sbi->s_debug)
+		return;
+
+	/* files still open keep their inode, they must not find sb there */
+	mutex_lock(&ext4_debugfs_mutex);
+	ext4_debugfs_forget(sbi->s_debug_extents);
+	ext4_debugfs_forget(sbi->s_debug_alloc_stats);
+	mutex_unlock(&ext4_debugfs_mutex);
+
+	debugfs_remove_recursive(sbi->s_debug);
+	sbi->s_debug = NULL;
+	sbi->s_debug_extents = NULL;
+	sbi->s_debug_alloc_stats = NULL;
+}
+
+void ext4_debugfs_init(void)
+{
+	ext4_debugfs_root = debugfs_create_dir("ext4", NULL);
+	if (IS_ERR(ext4_debugfs_root))
+		ext4_debugfs_root = NULL;
+}
+
+void ext4_debugfs_exit(void)
+{
+	debugfs_remove(ext4_debugfs_root);
+}
@@ -998,18 +998,25 @@ extern struct proc_dir_entry *ext4_proc_root;
 
 #ifdef CONFIG_PROC_FS
 extern const struct file_operations ext4_ui_proc_fops;
+extern const struct file_operations ext4_ui_nonzero_proc_fops;
 
-#define	EXT4_PROC_HANDLER(name, var)					\
+#define	__EXT4_PROC_HANDLER(name, var, fops)				\
 do {									\
 	proc = proc_create_data(name, mode, sbi->s_proc,		\
-				&ext4_ui_proc_fops, &sbi->s_##var);	\
+				fops, &sbi->s_##var);			\
 	if (proc == NULL) {						\
 		printk(KERN_ERR "EXT4-fs: can't create %s\n", name);	\
 		goto err_out;						\
 	}								\
 } while (0)
+#define	EXT4_PROC_HANDLER(name, var)					\
+	__EXT4_PROC_HANDLER(name, var, &ext4_ui_proc_fops)
+/* the same, for a tunable that 0 makes no sense for */
+#define	EXT4_PROC_HANDLER_NONZERO(name, var)				\
+	__EXT4_PROC_HANDLER(name, var, &ext4_ui_nonzero_proc_fops)
 #else
 #define EXT4_PROC_HANDLER(name, var)
+#define EXT4_PROC_HANDLER_NONZERO(name, var)
 #endif
 
 /*
@@ -1059,6 +1066,19 @@ extern int ext4_htree_store_dirent(struct file *dir_file, __u32 hash,
 				    struct ext4_dir_entry_2 *dirent);
 extern void ext4_htree_free_dir_info(struct dir_private_info *p);
 
+/* debugfs.c */
+#ifdef CONFIG_DEBUG_FS
+extern void ext4_debugfs_init(void);
+extern void ext4_debugfs_exit(void);
+extern void ext4_register_debugfs(struct super_block *sb);
+extern void ext4_unregister_debugfs(struct super_block *sb);
+#else
+static inline void ext4_debugfs_init(void) {}
+static inline void ext4_debugfs_exit(void) {}
+static inline void ext4_register_debugfs(struct super_block *sb) {}
+static inline void ext4_unregister_debugfs(struct super_block *sb) {}
+#endif
+
 /* fsync.c */
 extern int ext4_sync_file(struct file *, struct dentry *, int);
 
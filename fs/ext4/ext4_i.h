@@ -124,6 +124,10 @@ struct ext4_inode_info {
 	/* mballoc */
 	struct list_head i_prealloc_list;
 	spinlock_t i_prealloc_lock;
+	/* growth rate, for the flash allocation profile; under i_data_sem */
+	unsigned long i_mb_grow_time;	/* start of the current sample */
+	ext4_lblk_t i_mb_grow_end;	/* logical end of file at that time */
+	unsigned int i_mb_grow_rate;	/* blocks per second, averaged */
 
 	/* allocation reservation info for delalloc */
 	unsigned int i_reserved_data_blocks;
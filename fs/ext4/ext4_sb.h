@@ -62,8 +62,13 @@ struct ext4_sb_info {
 	struct percpu_counter s_freeinodes_counter;
 	struct percpu_counter s_dirs_counter;
 	struct percpu_counter s_dirtyblocks_counter;
+	struct percpu_counter s_written_bytes;	/* by write(2), for debugfs */
 	struct blockgroup_lock s_blockgroup_lock;
 	struct proc_dir_entry *s_proc;
+	struct dentry *s_debug;
+	struct dentry *s_debug_extents;
+	struct dentry *s_debug_alloc_stats;
+	unsigned long s_sectors_written_start;	/* of the device, at mount */
 
 	/* root of the per fs reservation window tree */
 	spinlock_t s_rsv_window_lock;
@@ -115,6 +120,11 @@ struct ext4_sb_info {
 	unsigned int s_mb_stats;
 	unsigned int s_mb_order2_reqs;
 	unsigned int s_mb_group_prealloc;
+	unsigned int s_mb_max_groups_to_scan;
+	unsigned int s_mb_flash_alloc;
+	unsigned int s_mb_flash_window_secs;
+	unsigned int s_mb_flash_min_window;
+	unsigned int s_mb_flash_max_window;
 	/* where last allocation was done - for stream allocation */
 	unsigned long s_mb_last_group;
 	unsigned long s_mb_last_start;
@@ -142,6 +152,8 @@ struct ext4_sb_info {
 	atomic_t s_mb_lost_chunks;
 	atomic_t s_mb_preallocated;
 	atomic_t s_mb_discarded;
+	atomic_t s_mb_flash_windows;	/* requests sized by growth rate */
+	atomic_t s_mb_flash_bounded;	/* group scans cut short */
 
 	/* locality groups */
 	struct ext4_locality_group *s_locality_groups;
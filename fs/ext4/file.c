@@ -85,6 +85,7 @@ ext4_file_write(struct kiocb *iocb, const struct iovec *iov,
 	 */
 	if (ret <= 0)
 		return ret;
+	percpu_counter_add(&EXT4_SB(inode->i_sb)->s_written_bytes, ret);
 
 	/*
 	 * If the inode is IS_SYNC, or is O_SYNC and we are doing data
@@ -1948,6 +1948,7 @@ ext4_mb_regular_allocator(struct ext4_allocation_context *ac)
 	struct super_block *sb;
 	struct ext4_buddy e4b;
 	loff_t size, isize;
+	unsigned int scanned;
 
 	sb = ac->ac_sb;
 	sbi = EXT4_SB(sb);
@@ -2010,6 +2011,7 @@ repeat:
 		 * from the goal value specified
 		 */
 		group = ac->ac_g_ex.fe_group;
+		scanned = 0;
 
 		for (i = 0; i < EXT4_SB(sb)->s_groups_count; group++, i++) {
 			struct ext4_group_info *grp;
@@ -2073,6 +2075,20 @@ repeat:
 
 			if (ac->ac_status != AC_STATUS_CONTINUE)
 				break;
+
+			/*
+			 * With the flash profile, settle for the best extent
+			 * found so far once enough groups have been scanned
+			 * for it, instead of reading the bitmaps of the whole
+			 * filesystem for a slightly better one.
+			 */
+			if (sbi->s_mb_flash_alloc && cr > 0 &&
+			    ac->ac_b_ex.fe_len > 0 &&
+			    ++scanned >= sbi->s_mb_max_groups_to_scan) {
+				atomic_inc(&sbi->s_mb_flash_bounded);
+				ac->ac_status = AC_STATUS_BREAK;
+				break;
+			}
 		}
 	}
 
@@ -2730,6 +2746,11 @@ int ext4_mb_init(struct super_block *sb, int needs_recovery)
 	sbi->s_mb_order2_reqs = MB_DEFAULT_ORDER2_REQS;
 	sbi->s_mb_history_filter = EXT4_MB_HISTORY_DEFAULT;
 	sbi->s_mb_group_prealloc = MB_DEFAULT_GROUP_PREALLOC;
+	sbi->s_mb_max_groups_to_scan = MB_DEFAULT_MAX_GROUPS_TO_SCAN;
+	sbi->s_mb_flash_alloc = MB_DEFAULT_FLASH_ALLOC;
+	sbi->s_mb_flash_window_secs = MB_DEFAULT_FLASH_WINDOW_SECS;
+	sbi->s_mb_flash_min_window = MB_DEFAULT_FLASH_MIN_WINDOW;
+	sbi->s_mb_flash_max_window = MB_DEFAULT_FLASH_MAX_WINDOW;
 
 	sbi->s_locality_groups = alloc_percpu(struct ext4_locality_group);
 	if (sbi->s_locality_groups == NULL) {
@@ -2896,6 +2917,11 @@ static void release_blocks_on_commit(journal_t *journal, transaction_t *txn)
 #define EXT4_MB_ORDER2_REQ		"order2_req"
 #define EXT4_MB_STREAM_REQ		"stream_req"
 #define EXT4_MB_GROUP_PREALLOC		"group_prealloc"
+#define EXT4_MB_MAX_GROUPS_TO_SCAN	"max_groups_to_scan"
+#define EXT4_MB_FLASH_ALLOC		"flash_alloc"
+#define EXT4_MB_FLASH_WINDOW_SECS	"flash_window_secs"
+#define EXT4_MB_FLASH_MIN_WINDOW	"flash_min_window"
+#define EXT4_MB_FLASH_MAX_WINDOW	"flash_max_window"
 
 static int ext4_mb_init_per_dev_proc(struct super_block *sb)
 {
@@ -2913,9 +2939,20 @@ static int ext4_mb_init_per_dev_proc(struct super_block *sb)
 	EXT4_PROC_HANDLER(EXT4_MB_ORDER2_REQ, mb_order2_reqs);
 	EXT4_PROC_HANDLER(EXT4_MB_STREAM_REQ, mb_stream_request);
 	EXT4_PROC_HANDLER(EXT4_MB_GROUP_PREALLOC, mb_group_prealloc);
+	EXT4_PROC_HANDLER_NONZERO(EXT4_MB_MAX_GROUPS_TO_SCAN,
+				  mb_max_groups_to_scan);
+	EXT4_PROC_HANDLER(EXT4_MB_FLASH_ALLOC, mb_flash_alloc);
+	EXT4_PROC_HANDLER(EXT4_MB_FLASH_WINDOW_SECS, mb_flash_window_secs);
+	EXT4_PROC_HANDLER(EXT4_MB_FLASH_MIN_WINDOW, mb_flash_min_window);
+	EXT4_PROC_HANDLER(EXT4_MB_FLASH_MAX_WINDOW, mb_flash_max_window);
 	return 0;
 
 err_out:
+	remove_proc_entry(EXT4_MB_FLASH_MAX_WINDOW, sbi->s_proc);
+	remove_proc_entry(EXT4_MB_FLASH_MIN_WINDOW, sbi->s_proc);
+	remove_proc_entry(EXT4_MB_FLASH_WINDOW_SECS, sbi->s_proc);
+	remove_proc_entry(EXT4_MB_FLASH_ALLOC, sbi->s_proc);
+	remove_proc_entry(EXT4_MB_MAX_GROUPS_TO_SCAN, sbi->s_proc);
 	remove_proc_entry(EXT4_MB_GROUP_PREALLOC, sbi->s_proc);
 	remove_proc_entry(EXT4_MB_STREAM_REQ, sbi->s_proc);
 	remove_proc_entry(EXT4_MB_ORDER2_REQ, sbi->s_proc);
@@ -2936,6 +2973,11 @@ static int ext4_mb_destroy_per_dev_proc(struct super_block *sb)
 	if (sbi->s_proc == NULL)
 		return -EINVAL;
 
+	remove_proc_entry(EXT4_MB_FLASH_MAX_WINDOW, sbi->s_proc);
+	remove_proc_entry(EXT4_MB_FLASH_MIN_WINDOW, sbi->s_proc);
+	remove_proc_entry(EXT4_MB_FLASH_WINDOW_SECS, sbi->s_proc);
+	remove_proc_entry(EXT4_MB_FLASH_ALLOC, sbi->s_proc);
+	remove_proc_entry(EXT4_MB_MAX_GROUPS_TO_SCAN, sbi->s_proc);
 	remove_proc_entry(EXT4_MB_GROUP_PREALLOC, sbi->s_proc);
 	remove_proc_entry(EXT4_MB_STREAM_REQ, sbi->s_proc);
 	remove_proc_entry(EXT4_MB_ORDER2_REQ, sbi->s_proc);
@@ -3131,6 +3173,68 @@ static void ext4_mb_normalize_group_request(struct ext4_allocation_context *ac)
 		current->pid, ac->ac_g_ex.fe_len);
 }
 
+/*
+ * The flash profile sizes the preallocation of a growing file after how
+ * fast it grows, instead of after its size: a database that gains a few
+ * pages a second gets a small window, kept close to its previous extent,
+ * while a file being copied gets a large one.  Appends served from a
+ * preallocation never get here, so the rate is sampled from how far the
+ * logical end of the file (the end of this request, or i_size) moved since
+ * the last sample, and averaged so that a single burst does not blow the
+ * window up.  Called with i_data_sem held for writing.
+ *
+ * Returns the window in blocks, or 0 if the request does not append to
+ * the file (a hole being filled) and the regular policy applies.
+ */
+static ext4_lblk_t ext4_mb_flash_window(struct ext4_allocation_context *ac,
+					struct ext4_allocation_request *ar)
+{
+	struct ext4_sb_info *sbi = EXT4_SB(ac->ac_sb);
+	struct ext4_inode_info *ei = EXT4_I(ac->ac_inode);
+	unsigned long elapsed = jiffies - ei->i_mb_grow_time;
+	int bsbits = ac->ac_sb->s_blocksize_bits;
+	ext4_lblk_t end, grown;
+	loff_t size;
+	unsigned int sample;
+	u64 window;
+
+	if (ar->pright)
+		return 0;
+
+	end = ac->ac_o_ex.fe_logical + ac->ac_o_ex.fe_len;
+	size = (i_size_read(ac->ac_inode) + (1 << bsbits) - 1) >> bsbits;
+	if (size > end)
+		end = size;
+
+	if (elapsed >= MB_FLASH_SAMPLE_JIFFIES) {
+		/* a truncated file has not grown */
+		grown = end > ei->i_mb_grow_end ? end - ei->i_mb_grow_end : 0;
+		sample = div_u64((u64)grown * HZ, elapsed);
+		if (ei->i_mb_grow_rate)
+			ei->i_mb_grow_rate = (3 * ei->i_mb_grow_rate +
+					      sample) / 4;
+		else
+			ei->i_mb_grow_rate = sample;
+		ei->i_mb_grow_end = end;
+		ei->i_mb_grow_time = jiffies;
+	}
+
+	window = (u64)ei->i_mb_grow_rate * sbi->s_mb_flash_window_secs;
+	if (window > sbi->s_mb_flash_max_window)
+		window = sbi->s_mb_flash_max_window;
+	if (window < sbi->s_mb_flash_min_window)
+		window = sbi->s_mb_flash_min_window;
+	if (window < ac->ac_o_ex.fe_len)
+		window = ac->ac_o_ex.fe_len;
+	/* a power of 2 lets the buddy search find it in one go */
+	window = roundup_pow_of_two(window);
+	if (window > EXT4_BLOCKS_PER_GROUP(ac->ac_sb))
+		window = EXT4_BLOCKS_PER_GROUP(ac->ac_sb);
+
+	atomic_inc(&sbi->s_mb_flash_windows);
+	return window;
+}
+
 /*
  * Normalization means making request better in terms of
  * size and alignment
@@ -3142,7 +3246,7 @@ ext4_mb_normalize_request(struct ext4_allocation_context *ac,
 	int bsbits, max;
 	ext4_lblk_t end;
 	loff_t size, orig_size, start_off;
-	ext4_lblk_t start, orig_start;
+	ext4_lblk_t start, orig_start, window = 0;
 	struct ext4_inode_info *ei = EXT4_I(ac->ac_inode);
 	struct ext4_prealloc_space *pa;
 
@@ -3180,10 +3284,16 @@ ext4_mb_normalize_request(struct ext4_allocation_context *ac,
 #define NRL_CHECK_SIZE(req, size, max, chunk_size)	\
 		(req <= (size) || max <= (chunk_size))
 
+	if (EXT4_SB(ac->ac_sb)->s_mb_flash_alloc)
+		window = ext4_mb_flash_window(ac, ar);
+
 	/* first, try to predict filesize */
 	/* XXX: should this table be tunable? */
 	start_off = 0;
-	if (size <= 16 * 1024) {
+	if (window) {
+		start_off = (loff_t)ac->ac_o_ex.fe_logical << bsbits;
+		size = (loff_t)window << bsbits;
+	} else if (size <= 16 * 1024) {
 		size = 16 * 1024;
 	} else if (size <= 32 * 1024) {
 		size = 32 * 1024;
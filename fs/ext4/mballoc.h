@@ -99,6 +99,22 @@
  */
 #define MB_DEFAULT_GROUP_PREALLOC	512
 
+/*
+ * flash allocation profile, off by default.  When on, the preallocation
+ * of a growing file covers the blocks it is expected to append in the
+ * next MB_DEFAULT_FLASH_WINDOW_SECS, kept between the min and max window
+ * (in blocks), and the group scan settles for the best extent found once
+ * max_groups_to_scan groups have been looked at.
+ * /proc/fs/ext4/<partition>/flash_alloc and friends
+ */
+#define MB_DEFAULT_FLASH_ALLOC		0
+#define MB_DEFAULT_FLASH_WINDOW_SECS	10
+#define MB_DEFAULT_FLASH_MIN_WINDOW	16	/* 64K */
+#define MB_DEFAULT_FLASH_MAX_WINDOW	1024	/* 4M */
+
+/* how often the growth rate of a file is sampled */
+#define MB_FLASH_SAMPLE_JIFFIES		HZ
+
 
 struct ext4_free_data {
 	/* this links the free block information from group_info */
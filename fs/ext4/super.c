@@ -563,6 +563,7 @@ static void ext4_put_super(struct super_block *sb)
 	struct ext4_super_block *es = sbi->s_es;
 	int i, err;
 
+	ext4_unregister_debugfs(sb);
 	ext4_mb_release(sb);
 	ext4_ext_release(sb);
 	ext4_xattr_put_super(sb);
@@ -591,6 +592,7 @@ static void ext4_put_super(struct super_block *sb)
 	percpu_counter_destroy(&sbi->s_freeinodes_counter);
 	percpu_counter_destroy(&sbi->s_dirs_counter);
 	percpu_counter_destroy(&sbi->s_dirtyblocks_counter);
+	percpu_counter_destroy(&sbi->s_written_bytes);
 	brelse(sbi->s_sbh);
 #ifdef CONFIG_QUOTA
 	for (i = 0; i < MAXQUOTAS; i++)
@@ -642,6 +644,9 @@ static struct inode *ext4_alloc_inode(struct super_block *sb)
 	memset(&ei->i_cached_extent, 0, sizeof(struct ext4_ext_cache));
 	INIT_LIST_HEAD(&ei->i_prealloc_list);
 	spin_lock_init(&ei->i_prealloc_lock);
+	ei->i_mb_grow_time = jiffies;
+	ei->i_mb_grow_end = 0;
+	ei->i_mb_grow_rate = 0;
 	/*
 	 * Note:  We can be called before EXT4_SB(sb)->s_journal is set,
 	 * therefore it can be null here.  Don't check it, just initialize
@@ -2386,10 +2391,16 @@ static int ext4_fill_super(struct super_block *sb, void *data, int silent)
 	if (!err) {
 		err = percpu_counter_init(&sbi->s_dirtyblocks_counter, 0);
 	}
+	if (!err) {
+		err = percpu_counter_init(&sbi->s_written_bytes, 0);
+	}
 	if (err) {
 		printk(KERN_ERR "EXT4-fs: insufficient memory\n");
 		goto failed_mount3;
 	}
+	if (sb->s_bdev->bd_part)
+		sbi->s_sectors_written_start =
+			part_stat_read(sb->s_bdev->bd_part, sectors[1]);
 
 	sbi->s_stripe = ext4_get_stripe_size(sbi);
 
@@ -2588,6 +2599,7 @@ no_journal:
 		       err);
 		goto failed_mount4;
 	}
+	ext4_register_debugfs(sb);
 
 	/*
 	 * akpm: core read_super() calls in here with the superblock locked.
@@ -2637,6 +2649,7 @@ failed_mount3:
 	percpu_counter_destroy(&sbi->s_freeinodes_counter);
 	percpu_counter_destroy(&sbi->s_dirs_counter);
 	percpu_counter_destroy(&sbi->s_dirtyblocks_counter);
+	percpu_counter_destroy(&sbi->s_written_bytes);
 failed_mount2:
 	for (i = 0; i < db_count; i++)
 		brelse(sbi->s_group_desc[i]);
@@ -3725,21 +3738,39 @@ static int ext4_ui_proc_open(struct inode *inode, struct file *file)
 	return single_open(file, ext4_ui_proc_show, PDE(inode)->data);
 }
 
-static ssize_t ext4_ui_proc_write(struct file *file, const char __user *buf,
-			       size_t cnt, loff_t *ppos)
+static ssize_t __ext4_ui_proc_write(struct file *file, const char __user *buf,
+				    size_t cnt, int nonzero)
 {
 	unsigned long *p = PDE(file->f_path.dentry->d_inode)->data;
+	unsigned long val;
 	char str[32];
 
 	if (cnt >= sizeof(str))
 		return -EINVAL;
 	if (copy_from_user(str, buf, cnt))
 		return -EFAULT;
+	str[cnt] = '\0';
 
-	*p = simple_strtoul(str, NULL, 0);
+	val = simple_strtoul(str, NULL, 0);
+	if (nonzero && !val)
+		return -EINVAL;
+	*p = val;
 	return cnt;
 }
 
+static ssize_t ext4_ui_proc_write(struct file *file, const char __user *buf,
+			       size_t cnt, loff_t *ppos)
+{
+	return __ext4_ui_proc_write(file, buf, cnt, 0);
+}
+
+static ssize_t ext4_ui_nonzero_proc_write(struct file *file,
+					  const char __user *buf,
+					  size_t cnt, loff_t *ppos)
+{
+	return __ext4_ui_proc_write(file, buf, cnt, 1);
+}
+
 const struct file_operations ext4_ui_proc_fops = {
 	.owner		= THIS_MODULE,
 	.open		= ext4_ui_proc_open,
@@ -3748,6 +3779,15 @@ const struct file_operations ext4_ui_proc_fops = {
 	.release	= single_release,
 	.write		= ext4_ui_proc_write,
 };
+
+const struct file_operations ext4_ui_nonzero_proc_fops = {
+	.owner		= THIS_MODULE,
+	.open		= ext4_ui_proc_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+	.write		= ext4_ui_nonzero_proc_write,
+};
 #endif
 
 static struct file_system_type ext4_fs_type = {
@@ -3784,6 +3824,7 @@ static int __init init_ext4_fs(void)
 	int err;
 
 	ext4_proc_root = proc_mkdir("fs/ext4", NULL);
+	ext4_debugfs_init();
 	err = init_ext4_mballoc();
 	if (err)
 		return err;
@@ -3824,6 +3865,7 @@ static void __exit exit_ext4_fs(void)
 	exit_ext4_xattr();
 	exit_ext4_mballoc();
 	remove_proc_entry("fs/ext4", NULL);
+	ext4_debugfs_exit();
 }
 
 MODULE_AUTHOR("Remy Card, Stephen Tweedie, Andrew Morton, Andreas Dilger, Theodore Ts'o and others");
@@ -985,6 +985,8 @@ restart_loop:
 	stats.ts_type = JBD2_STATS_RUN;
 	stats.ts_tid = commit_transaction->t_tid;
 	stats.u.run.rs_handle_count = commit_transaction->t_handle_count;
+	stats.u.run.rs_sync_count = commit_transaction->t_sync_count;
+	commit_time = ktime_to_ns(ktime_sub(ktime_get(), start_time));
 	spin_lock(&journal->j_history_lock);
 	memcpy(journal->j_history + journal->j_history_cur, &stats,
 			sizeof(stats));
@@ -1001,15 +1003,19 @@ restart_loop:
 	journal->j_stats.u.run.rs_flushing += stats.u.run.rs_flushing;
 	journal->j_stats.u.run.rs_logging += stats.u.run.rs_logging;
 	journal->j_stats.u.run.rs_handle_count += stats.u.run.rs_handle_count;
+	journal->j_stats.u.run.rs_sync_count += stats.u.run.rs_sync_count;
 	journal->j_stats.u.run.rs_blocks += stats.u.run.rs_blocks;
 	journal->j_stats.u.run.rs_blocks_logged += stats.u.run.rs_blocks_logged;
+	journal->j_commit_hist[min_t(int, fls64(div_u64(commit_time, 1000)),
+				     JBD2_COMMIT_HIST_BUCKETS - 1)]++;
+	journal->j_batch_hist[min_t(int, fls(stats.u.run.rs_sync_count),
+				    JBD2_BATCH_HIST_BUCKETS - 1)]++;
 	spin_unlock(&journal->j_history_lock);
 
 	commit_transaction->t_state = T_FINISHED;
 	J_ASSERT(commit_transaction == journal->j_committing_transaction);
 	journal->j_commit_sequence = commit_transaction->t_tid;
 	journal->j_committing_transaction = NULL;
-	commit_time = ktime_to_ns(ktime_sub(ktime_get(), start_time));
 
 	/*
 	 * weight the commit time higher than the average time so we don't
@@ -853,6 +853,10 @@ static int jbd2_seq_info_show(struct seq_file *seq, void *v)
 		   div_u64(s->journal->j_average_commit_time, 1000));
 	seq_printf(seq, "  %lu handles per transaction\n",
 	    s->stats->u.run.rs_handle_count / s->stats->ts_tid);
+	seq_printf(seq, "  %lu synchronous handles per transaction\n",
+	    s->stats->u.run.rs_sync_count / s->stats->ts_tid);
+	seq_printf(seq, "  %lluus between synchronous handles\n",
+		   div_u64(s->journal->j_average_sync_interval, 1000));
 	seq_printf(seq, "  %lu blocks per transaction\n",
 	    s->stats->u.run.rs_blocks / s->stats->ts_tid);
 	seq_printf(seq, "  %lu logged blocks per transaction\n",
@@ -920,6 +924,50 @@ static struct file_operations jbd2_seq_info_fops = {
 	.release        = jbd2_seq_info_release,
 };
 
+/*
+ * Histograms of the commit times, and of the number of synchronous
+ * handles (fsyncs) each commit served, to see how well they are batched.
+ */
+static int jbd2_seq_batch_show(struct seq_file *seq, void *v)
+{
+	journal_t *journal = seq->private;
+	unsigned long commit[JBD2_COMMIT_HIST_BUCKETS];
+	unsigned long batch[JBD2_BATCH_HIST_BUCKETS];
+	int i;
+
+	spin_lock(&journal->j_history_lock);
+	memcpy(commit, journal->j_commit_hist, sizeof(commit));
+	memcpy(batch, journal->j_batch_hist, sizeof(batch));
+	spin_unlock(&journal->j_history_lock);
+
+	seq_printf(seq, "%-12s %10s\n", "commit_us", "commits");
+	for (i = 0; i < JBD2_COMMIT_HIST_BUCKETS - 1; i++)
+		seq_printf(seq, "<%-11lu %10lu\n", 1UL << i, commit[i]);
+	seq_printf(seq, ">=%-10lu %10lu\n", 1UL << (i - 1), commit[i]);
+
+	seq_printf(seq, "\n%-12s %10s\n", "sync_handles", "commits");
+	seq_printf(seq, "%-12d %10lu\n", 0, batch[0]);
+	seq_printf(seq, "%-12d %10lu\n", 1, batch[1]);
+	for (i = 2; i < JBD2_BATCH_HIST_BUCKETS - 1; i++)
+		seq_printf(seq, "%4lu-%-7lu %10lu\n", 1UL << (i - 1),
+			   (1UL << i) - 1, batch[i]);
+	seq_printf(seq, ">=%-10lu %10lu\n", 1UL << (i - 1), batch[i]);
+	return 0;
+}
+
+static int jbd2_seq_batch_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, jbd2_seq_batch_show, PDE(inode)->data);
+}
+
+static struct file_operations jbd2_seq_batch_fops = {
+	.owner		= THIS_MODULE,
+	.open           = jbd2_seq_batch_open,
+	.read           = seq_read,
+	.llseek         = seq_lseek,
+	.release        = single_release,
+};
+
 static struct proc_dir_entry *proc_jbd2_stats;
 
 static void jbd2_stats_proc_init(journal_t *journal)
@@ -930,11 +978,14 @@ static void jbd2_stats_proc_init(journal_t *journal)
 				 &jbd2_seq_history_fops, journal);
 		proc_create_data("info", S_IRUGO, journal->j_proc_entry,
 				 &jbd2_seq_info_fops, journal);
+		proc_create_data("batch", S_IRUGO, journal->j_proc_entry,
+				 &jbd2_seq_batch_fops, journal);
 	}
 }
 
 static void jbd2_stats_proc_exit(journal_t *journal)
 {
+	remove_proc_entry("batch", journal->j_proc_entry);
 	remove_proc_entry("info", journal->j_proc_entry);
 	remove_proc_entry("history", journal->j_proc_entry);
 	remove_proc_entry(journal->j_devname, proc_jbd2_stats);
@@ -1284,19 +1284,50 @@ int jbd2_journal_stop(handle_t *handle)
 	 * greatly helps super fast disks that would see slowdowns as
 	 * more threads started doing fsyncs.
 	 *
+	 * The sleep is only worth it if other synchronous handles are
+	 * arriving faster than a commit takes, so we keep the average
+	 * interval between them.  If they come further apart, nobody is
+	 * likely to join and we commit at once.  Otherwise we wait for up
+	 * to the commit time, but stop as soon as no new synchronous
+	 * handle has joined for twice the average interval: this adapts
+	 * the batch to how many threads are actually doing fsyncs.
+	 *
 	 * But don't do this if this process was the most recent one
 	 * to perform a synchronous write.  We do this to detect the
 	 * case where a single process is doing a stream of sync
 	 * writes.  No point in waiting for joiners in that case.
 	 */
 	pid = current->pid;
+	if (handle->h_sync) {
+		ktime_t now = ktime_get();
+		u64 interval;
+
+		spin_lock(&transaction->t_handle_lock);
+		transaction->t_sync_count++;
+		spin_unlock(&transaction->t_handle_lock);
+
+		spin_lock(&journal->j_state_lock);
+		interval = ktime_to_ns(ktime_sub(now,
+					journal->j_last_sync_time));
+		interval = min_t(u64, interval, NSEC_PER_SEC);
+		journal->j_last_sync_time = now;
+		if (likely(journal->j_average_sync_interval))
+			journal->j_average_sync_interval = (interval +
+				journal->j_average_sync_interval*3) / 4;
+		else
+			journal->j_average_sync_interval = interval;
+		spin_unlock(&journal->j_state_lock);
+	}
 	if (handle->h_sync && journal->j_last_sync_writer != pid) {
-		u64 commit_time, trans_time;
+		u64 commit_time, trans_time, interval, step;
+		ktime_t deadline, expires;
+		int joined;
 
 		journal->j_last_sync_writer = pid;
 
 		spin_lock(&journal->j_state_lock);
 		commit_time = journal->j_average_commit_time;
+		interval = journal->j_average_sync_interval;
 		spin_unlock(&journal->j_state_lock);
 
 		trans_time = ktime_to_ns(ktime_sub(ktime_get(),
@@ -1306,12 +1337,21 @@ int jbd2_journal_stop(handle_t *handle)
 				    1000*journal->j_min_batch_time);
 		commit_time = min_t(u64, commit_time,
 				    1000*journal->j_max_batch_time);
-
-		if (trans_time < commit_time) {
-			ktime_t expires = ktime_add_ns(ktime_get(),
-						       commit_time);
-			set_current_state(TASK_UNINTERRUPTIBLE);
-			schedule_hrtimeout(&expires, HRTIMER_MODE_ABS);
+		step = max_t(u64, 2 * interval,
+			     1000*journal->j_min_batch_time);
+
+		if (trans_time < commit_time && interval < commit_time) {
+			deadline = ktime_add_ns(ktime_get(), commit_time);
+			do {
+				joined = transaction->t_sync_count;
+				expires = ktime_add_ns(ktime_get(), step);
+				if (ktime_to_ns(expires) > ktime_to_ns(deadline))
+					expires = deadline;
+				set_current_state(TASK_UNINTERRUPTIBLE);
+				schedule_hrtimeout(&expires, HRTIMER_MODE_ABS);
+			} while (transaction->t_sync_count != joined &&
+				 ktime_to_ns(ktime_get()) <
+					ktime_to_ns(deadline));
 		}
 	}
 
@@ -80,6 +80,7 @@
 #include <linux/oom.h>
 #include <linux/elf.h>
 #include <linux/pid_namespace.h>
+#include <linux/mm_pressure.h>
 #include "internal.h"
 
 /* NOTE:
@@ -2507,6 +2508,45 @@ static int proc_tgid_io_accounting(struct task_struct *task, char *buffer)
 }
 #endif /* CONFIG_TASK_IO_ACCOUNTING */
 
+#ifdef CONFIG_MM_PRESSURE_STATS
+static int do_mm_pressure(struct task_struct *task, char *buffer, int whole)
+{
+	struct task_mm_pressure mmp = task->mm_pressure;
+	unsigned long flags;
+
+	if (whole && lock_task_sighand(task, &flags)) {
+		struct task_struct *t = task;
+
+		task_mm_pressure_add(&mmp, &task->signal->mm_pressure);
+		while_each_thread(task, t)
+			task_mm_pressure_add(&mmp, &t->mm_pressure);
+
+		unlock_task_sighand(task, &flags);
+	}
+	return sprintf(buffer,
+			"reclaim_stalls: %u\n"
+			"reclaim_stall_ns: %llu\n"
+			"swapins: %u\n"
+			"swapin_wait_ns: %llu\n"
+			"refaults: %u\n",
+			mmp.reclaim_count,
+			(unsigned long long)mmp.reclaim_delay,
+			mmp.swapin_count,
+			(unsigned long long)mmp.swapin_delay,
+			mmp.refault_count);
+}
+
+static int proc_tid_mm_pressure(struct task_struct *task, char *buffer)
+{
+	return do_mm_pressure(task, buffer, 0);
+}
+
+static int proc_tgid_mm_pressure(struct task_struct *task, char *buffer)
+{
+	return do_mm_pressure(task, buffer, 1);
+}
+#endif /* CONFIG_MM_PRESSURE_STATS */
+
 static int proc_pid_personality(struct seq_file *m, struct pid_namespace *ns,
 				struct pid *pid, struct task_struct *task)
 {
@@ -2593,6 +2633,9 @@ static const struct pid_entry tgid_base_stuff[] = {
 #ifdef CONFIG_TASK_IO_ACCOUNTING
 	INF("io",	S_IRUGO, proc_tgid_io_accounting),
 #endif
+#ifdef CONFIG_MM_PRESSURE_STATS
+	INF("mm_pressure", S_IRUGO, proc_tgid_mm_pressure),
+#endif
 };
 
 static int proc_tgid_base_readdir(struct file * filp,
@@ -2928,6 +2971,9 @@ static const struct pid_entry tid_base_stuff[] = {
 #ifdef CONFIG_TASK_IO_ACCOUNTING
 	INF("io",	S_IRUGO, proc_tid_io_accounting),
 #endif
+#ifdef CONFIG_MM_PRESSURE_STATS
+	INF("mm_pressure", S_IRUGO, proc_tid_mm_pressure),
+#endif
 };
 
 static int proc_tid_base_readdir(struct file * filp,
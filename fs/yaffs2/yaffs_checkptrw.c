@@ -17,6 +17,29 @@ const char *yaffs_checkptrw_c_version =
 
 #include "yaffs_checkptrw.h"
 #include "yaffs_getblockinfo.h"
+#include "yaffs_nand.h"
+
+#ifdef CONFIG_YAFFS_CHECKPOINT_LZO
+#include <linux/lzo.h>
+#endif
+
+/* Chunks of a checkpoint block fetched with one multi-chunk read */
+#define YAFFS_CHECKPOINT_READAHEAD	8
+
+/* Compressed checkpoints are a series of frames, each holding up to
+ * YAFFS_CHECKPOINT_LZO_FRAME bytes of the stream. A frame that did not
+ * compress is stored as is, with storedBytes == rawBytes.
+ */
+#define YAFFS_CHECKPOINT_LZO_FRAME	16384
+
+typedef struct {
+	__u32 rawBytes;
+	__u32 storedBytes;
+} yaffs_CheckpointFrame;
+
+static int yaffs_CheckpointWriteRaw(yaffs_Device *dev, const void *data,
+					int nBytes);
+static int yaffs_CheckpointReadRaw(yaffs_Device *dev, void *data, int nBytes);
 
 static int yaffs_CheckpointSpaceOk(yaffs_Device *dev)
 {
@@ -45,6 +68,7 @@ static int yaffs_CheckpointErase(yaffs_Device *dev)
 			T(YAFFS_TRACE_CHECKPOINT, (TSTR("erasing checkpt block %d"TENDSTR), i));
 
 			dev->nBlockErasures++;
+			bi->eraseCount++;
 
 			if (dev->eraseBlockInNAND(dev, i - dev->blockOffset /* realign */)) {
 				bi->blockState = YAFFS_BLOCK_STATE_EMPTY;
@@ -126,6 +150,17 @@ static void yaffs_CheckpointFindNextCheckpointBlock(yaffs_Device *dev)
 	dev->checkpointCurrentBlock = -1;
 }
 
+static void yaffs_CheckpointFreeReadahead(yaffs_Device *dev)
+{
+	if (dev->checkpointReadahead)
+		YFREE(dev->checkpointReadahead);
+	if (dev->checkpointReadaheadTags)
+		YFREE(dev->checkpointReadaheadTags);
+	dev->checkpointReadahead = NULL;
+	dev->checkpointReadaheadTags = NULL;
+	dev->checkpointReadaheadChunks = 0;
+}
+
 
 int yaffs_CheckpointOpen(yaffs_Device *dev, int forWriting)
 {
@@ -143,6 +178,10 @@ int yaffs_CheckpointOpen(yaffs_Device *dev, int forWriting)
 	if (forWriting && !yaffs_CheckpointSpaceOk(dev))
 		return 0;
 
+#ifndef CONFIG_YAFFS_CHECKPOINT_LZO
+	dev->checkpointCompress = 0;
+#endif
+
 	if (!dev->checkpointBuffer)
 		dev->checkpointBuffer = YMALLOC_DMA(dev->totalBytesPerChunk);
 	if (!dev->checkpointBuffer)
@@ -156,6 +195,8 @@ int yaffs_CheckpointOpen(yaffs_Device *dev, int forWriting)
 	dev->checkpointCurrentBlock = -1;
 	dev->checkpointCurrentChunk = -1;
 	dev->checkpointNextBlock = dev->internalStartBlock;
+	dev->checkpointReadaheadChunks = 0;
+	dev->checkpointLzo = 0;
 
 	/* Erase all the blocks in the checkpoint area */
 	if (forWriting) {
@@ -176,6 +217,19 @@ int yaffs_CheckpointOpen(yaffs_Device *dev, int forWriting)
 
 		for (i = 0; i < dev->checkpointMaxBlocks; i++)
 			dev->checkpointBlockList[i] = -1;
+
+		/* Not having it just means reading one chunk at a time */
+		if (dev->readChunksFromNAND && !dev->checkpointReadahead) {
+			dev->checkpointReadahead = YMALLOC_DMA(
+				YAFFS_CHECKPOINT_READAHEAD *
+				dev->nDataBytesPerChunk);
+			dev->checkpointReadaheadTags = YMALLOC(
+				YAFFS_CHECKPOINT_READAHEAD *
+				sizeof(yaffs_ExtendedTags));
+			if (!dev->checkpointReadahead ||
+			    !dev->checkpointReadaheadTags)
+				yaffs_CheckpointFreeReadahead(dev);
+		}
 	}
 
 	return 1;
@@ -242,7 +296,8 @@ static int yaffs_CheckpointFlushBuffer(yaffs_Device *dev)
 }
 
 
-int yaffs_CheckpointWrite(yaffs_Device *dev, const void *data, int nBytes)
+static int yaffs_CheckpointWriteRaw(yaffs_Device *dev, const void *data,
+					int nBytes)
 {
 	int i = 0;
 	int ok = 1;
@@ -252,21 +307,12 @@ int yaffs_CheckpointWrite(yaffs_Device *dev, const void *data, int nBytes)
 
 
 
-	if (!dev->checkpointBuffer)
-		return 0;
-
-	if (!dev->checkpointOpenForWrite)
-		return -1;
-
 	while (i < nBytes && ok) {
 		dev->checkpointBuffer[dev->checkpointByteOffset] = *dataBytes;
-		dev->checkpointSum += *dataBytes;
-		dev->checkpointXor ^= *dataBytes;
 
 		dev->checkpointByteOffset++;
 		i++;
 		dataBytes++;
-		dev->checkpointByteCount++;
 
 
 		if (dev->checkpointByteOffset < 0 ||
@@ -277,83 +323,313 @@ int yaffs_CheckpointWrite(yaffs_Device *dev, const void *data, int nBytes)
 	return i;
 }
 
-int yaffs_CheckpointRead(yaffs_Device *dev, void *data, int nBytes)
+#ifdef CONFIG_YAFFS_CHECKPOINT_LZO
+static int yaffs_CheckpointWriteFrame(yaffs_Device *dev)
 {
-	int i = 0;
-	int ok = 1;
-	yaffs_ExtendedTags tags;
+	yaffs_CheckpointFrame frame;
+	size_t storedBytes;
+	const __u8 *stored = dev->checkpointLzoStored;
 
+	if (dev->checkpointLzoOffset == 0)
+		return 1;
 
-	int chunk;
-	int realignedChunk;
+	frame.rawBytes = dev->checkpointLzoOffset;
 
-	__u8 *dataBytes = (__u8 *)data;
+	if (lzo1x_1_compress(dev->checkpointLzoBuffer, frame.rawBytes,
+			dev->checkpointLzoStored, &storedBytes,
+			dev->checkpointLzoWork) != LZO_E_OK ||
+	    storedBytes >= frame.rawBytes) {
+		stored = dev->checkpointLzoBuffer;
+		storedBytes = frame.rawBytes;
+	}
+	frame.storedBytes = storedBytes;
+	dev->checkpointLzoOffset = 0;
 
-	if (!dev->checkpointBuffer)
+	return yaffs_CheckpointWriteRaw(dev, &frame, sizeof(frame)) ==
+			sizeof(frame) &&
+		yaffs_CheckpointWriteRaw(dev, stored, storedBytes) ==
+			storedBytes;
+}
+
+static int yaffs_CheckpointReadFrame(yaffs_Device *dev)
+{
+	yaffs_CheckpointFrame frame;
+	size_t rawBytes = YAFFS_CHECKPOINT_LZO_FRAME;
+
+	if (yaffs_CheckpointReadRaw(dev, &frame, sizeof(frame)) !=
+			sizeof(frame) ||
+	    frame.rawBytes == 0 ||
+	    frame.rawBytes > YAFFS_CHECKPOINT_LZO_FRAME ||
+	    frame.storedBytes > frame.rawBytes)
 		return 0;
 
+	dev->checkpointLzoOffset = 0;
+	dev->checkpointLzoBytes = frame.rawBytes;
+
+	if (frame.storedBytes == frame.rawBytes)
+		return yaffs_CheckpointReadRaw(dev, dev->checkpointLzoBuffer,
+				frame.rawBytes) == frame.rawBytes;
+
+	if (yaffs_CheckpointReadRaw(dev, dev->checkpointLzoStored,
+			frame.storedBytes) != frame.storedBytes)
+		return 0;
+
+	return lzo1x_decompress_safe(dev->checkpointLzoStored,
+			frame.storedBytes, dev->checkpointLzoBuffer,
+			&rawBytes) == LZO_E_OK &&
+		rawBytes == frame.rawBytes;
+}
+
+static void yaffs_CheckpointFreeLzo(yaffs_Device *dev)
+{
+	if (dev->checkpointLzoBuffer)
+		YFREE_ALT(dev->checkpointLzoBuffer);
+	if (dev->checkpointLzoStored)
+		YFREE_ALT(dev->checkpointLzoStored);
+	if (dev->checkpointLzoWork)
+		YFREE_ALT(dev->checkpointLzoWork);
+	dev->checkpointLzoBuffer = NULL;
+	dev->checkpointLzoStored = NULL;
+	dev->checkpointLzoWork = NULL;
+	dev->checkpointLzo = 0;
+}
+#endif
+
+/*
+ * Switch the rest of the stream to lzo frames. Called straight after the
+ * head validity marker, which is never compressed so that the reader can
+ * tell how the rest was written.
+ */
+int yaffs_CheckpointStartCompression(yaffs_Device *dev)
+{
+#ifdef CONFIG_YAFFS_CHECKPOINT_LZO
+	dev->checkpointLzoBuffer = YMALLOC_ALT(YAFFS_CHECKPOINT_LZO_FRAME);
+	dev->checkpointLzoStored = YMALLOC_ALT(
+			lzo1x_worst_compress(YAFFS_CHECKPOINT_LZO_FRAME));
 	if (dev->checkpointOpenForWrite)
+		dev->checkpointLzoWork = YMALLOC_ALT(LZO1X_1_MEM_COMPRESS);
+
+	if (!dev->checkpointLzoBuffer || !dev->checkpointLzoStored ||
+	    (dev->checkpointOpenForWrite && !dev->checkpointLzoWork)) {
+		yaffs_CheckpointFreeLzo(dev);
+		return 0;
+	}
+
+	dev->checkpointLzoOffset = 0;
+	dev->checkpointLzoBytes = 0;
+	dev->checkpointLzo = 1;
+	return 1;
+#else
+	T(YAFFS_TRACE_CHECKPOINT,
+		(TSTR("compressed checkpoint, no lzo support" TENDSTR)));
+	return 0;
+#endif
+}
+
+int yaffs_CheckpointWrite(yaffs_Device *dev, const void *data, int nBytes)
+{
+	const __u8 *dataBytes = (const __u8 *)data;
+	int i;
+
+	if (!dev->checkpointBuffer)
+		return 0;
+
+	if (!dev->checkpointOpenForWrite)
 		return -1;
 
-	while (i < nBytes && ok) {
+	for (i = 0; i < nBytes; i++) {
+		dev->checkpointSum += dataBytes[i];
+		dev->checkpointXor ^= dataBytes[i];
+	}
+	dev->checkpointByteCount += nBytes;
+
+#ifdef CONFIG_YAFFS_CHECKPOINT_LZO
+	if (dev->checkpointLzo) {
+		int n;
+
+		for (i = 0; i < nBytes; i += n) {
+			if (dev->checkpointLzoOffset == YAFFS_CHECKPOINT_LZO_FRAME &&
+			    !yaffs_CheckpointWriteFrame(dev))
+				break;
+
+			n = YAFFS_CHECKPOINT_LZO_FRAME - dev->checkpointLzoOffset;
+			if (n > nBytes - i)
+				n = nBytes - i;
+			memcpy(dev->checkpointLzoBuffer + dev->checkpointLzoOffset,
+				dataBytes + i, n);
+			dev->checkpointLzoOffset += n;
+		}
+		return i;
+	}
+#endif
 
+	return yaffs_CheckpointWriteRaw(dev, data, nBytes);
+}
 
-		if (dev->checkpointByteOffset < 0 ||
-			dev->checkpointByteOffset >= dev->nDataBytesPerChunk) {
+/* Does a chunk read back belong at this point of the checkpoint? */
+static int yaffs_CheckpointTagsOk(yaffs_Device *dev,
+				  const yaffs_ExtendedTags *tags)
+{
+	return tags->chunkId == (dev->checkpointPageSequence + 1) &&
+		tags->eccResult <= YAFFS_ECC_RESULT_FIXED &&
+		tags->sequenceNumber == YAFFS_SEQUENCE_CHECKPOINT_DATA;
+}
 
-			if (dev->checkpointCurrentBlock < 0) {
-				yaffs_CheckpointFindNextCheckpointBlock(dev);
-				dev->checkpointCurrentChunk = 0;
-			}
+/*
+ * Get the next chunk of the checkpoint into checkpointBuffer. The first
+ * chunk of each block is read on its own. If the device can do
+ * multi-chunk reads, the chunks after it are then read in runs. Either
+ * way the tags of every chunk are checked: a chunk that is out of
+ * sequence, not checkpoint data or has unfixed ECC errors fails the read,
+ * and the mount falls back to a scan.
+ */
+static int yaffs_CheckpointFillBuffer(yaffs_Device *dev)
+{
+	yaffs_ExtendedTags tags;
+	int chunk;
+	int realignedChunk;
+	int nChunks;
+	int ok = 1;
 
-			if (dev->checkpointCurrentBlock < 0)
-				ok = 0;
-			else {
-				chunk = dev->checkpointCurrentBlock *
-					dev->nChunksPerBlock +
-					dev->checkpointCurrentChunk;
-
-				realignedChunk = chunk - dev->chunkOffset;
-				
-				dev->nPageReads++;
-
-				/* read in the next chunk */
-				/* printf("read checkpoint page %d\n",dev->checkpointPage); */
-				dev->readChunkWithTagsFromNAND(dev,
-						realignedChunk,
-						dev->checkpointBuffer,
-						&tags);
-
-				if (tags.chunkId != (dev->checkpointPageSequence + 1) ||
-					tags.eccResult > YAFFS_ECC_RESULT_FIXED ||
-					tags.sequenceNumber != YAFFS_SEQUENCE_CHECKPOINT_DATA)
-					ok = 0;
-
-				dev->checkpointByteOffset = 0;
-				dev->checkpointPageSequence++;
-				dev->checkpointCurrentChunk++;
-
-				if (dev->checkpointCurrentChunk >= dev->nChunksPerBlock)
-					dev->checkpointCurrentBlock = -1;
-			}
+	if (dev->checkpointCurrentBlock < 0) {
+		yaffs_CheckpointFindNextCheckpointBlock(dev);
+		dev->checkpointCurrentChunk = 0;
+		dev->checkpointReadaheadChunks = 0;
+	}
+
+	if (dev->checkpointCurrentBlock < 0)
+		return 0;
+
+	chunk = dev->checkpointCurrentBlock * dev->nChunksPerBlock +
+		dev->checkpointCurrentChunk;
+
+	if (dev->checkpointReadaheadChunks > 0) {
+		if (!yaffs_CheckpointTagsOk(dev, &dev->checkpointReadaheadTags[
+					dev->checkpointReadaheadOffset]))
+			ok = 0;
+
+		memcpy(dev->checkpointBuffer,
+			dev->checkpointReadahead +
+			dev->checkpointReadaheadOffset * dev->nDataBytesPerChunk,
+			dev->nDataBytesPerChunk);
+		dev->checkpointReadaheadOffset++;
+		dev->checkpointReadaheadChunks--;
+	} else {
+		realignedChunk = chunk - dev->chunkOffset;
+
+		dev->nPageReads++;
+
+		dev->readChunkWithTagsFromNAND(dev,
+				realignedChunk,
+				dev->checkpointBuffer,
+				&tags);
+
+		if (!yaffs_CheckpointTagsOk(dev, &tags))
+			ok = 0;
+
+		nChunks = dev->nChunksPerBlock - dev->checkpointCurrentChunk - 1;
+		if (nChunks > YAFFS_CHECKPOINT_READAHEAD)
+			nChunks = YAFFS_CHECKPOINT_READAHEAD;
+
+		if (ok && dev->checkpointReadahead && nChunks > 1 &&
+		    yaffs_ReadChunksFromNAND(dev, chunk + 1, nChunks,
+				dev->checkpointReadahead,
+				dev->checkpointReadaheadTags) == YAFFS_OK) {
+			dev->checkpointReadaheadChunks = nChunks;
+			dev->checkpointReadaheadOffset = 0;
 		}
+	}
+
+	dev->checkpointByteOffset = 0;
+	dev->checkpointPageSequence++;
+	dev->checkpointCurrentChunk++;
+
+	if (dev->checkpointCurrentChunk >= dev->nChunksPerBlock)
+		dev->checkpointCurrentBlock = -1;
+
+	return ok;
+}
+
+static int yaffs_CheckpointReadRaw(yaffs_Device *dev, void *data, int nBytes)
+{
+	int i = 0;
+	int ok = 1;
+
+	__u8 *dataBytes = (__u8 *)data;
+
+	while (i < nBytes && ok) {
+
+
+		if (dev->checkpointByteOffset < 0 ||
+			dev->checkpointByteOffset >= dev->nDataBytesPerChunk)
+			ok = yaffs_CheckpointFillBuffer(dev);
 
 		if (ok) {
 			*dataBytes = dev->checkpointBuffer[dev->checkpointByteOffset];
-			dev->checkpointSum += *dataBytes;
-			dev->checkpointXor ^= *dataBytes;
 			dev->checkpointByteOffset++;
 			i++;
 			dataBytes++;
-			dev->checkpointByteCount++;
 		}
 	}
 
 	return 	i;
 }
 
+int yaffs_CheckpointRead(yaffs_Device *dev, void *data, int nBytes)
+{
+	__u8 *dataBytes = (__u8 *)data;
+	int i;
+
+	if (!dev->checkpointBuffer)
+		return 0;
+
+	if (dev->checkpointOpenForWrite)
+		return -1;
+
+#ifdef CONFIG_YAFFS_CHECKPOINT_LZO
+	if (dev->checkpointLzo) {
+		int n;
+
+		for (i = 0; i < nBytes; i += n) {
+			if (dev->checkpointLzoOffset >= dev->checkpointLzoBytes &&
+			    !yaffs_CheckpointReadFrame(dev))
+				break;
+
+			n = dev->checkpointLzoBytes - dev->checkpointLzoOffset;
+			if (n > nBytes - i)
+				n = nBytes - i;
+			memcpy(dataBytes + i,
+				dev->checkpointLzoBuffer + dev->checkpointLzoOffset,
+				n);
+			dev->checkpointLzoOffset += n;
+		}
+	} else
+#endif
+		i = yaffs_CheckpointReadRaw(dev, data, nBytes);
+
+	nBytes = i;
+	for (i = 0; i < nBytes; i++) {
+		dev->checkpointSum += dataBytes[i];
+		dev->checkpointXor ^= dataBytes[i];
+	}
+	dev->checkpointByteCount += nBytes;
+
+	return nBytes;
+}
+
 int yaffs_CheckpointClose(yaffs_Device *dev)
 {
+	int ok = 1;
+
+#ifdef CONFIG_YAFFS_CHECKPOINT_LZO
+	if (dev->checkpointLzo) {
+		if (dev->checkpointOpenForWrite && dev->checkpointBuffer)
+			ok = yaffs_CheckpointWriteFrame(dev);
+		yaffs_CheckpointFreeLzo(dev);
+	}
+#endif
+
+	yaffs_CheckpointFreeReadahead(dev);
 
 	if (dev->checkpointOpenForWrite) {
 		if (dev->checkpointByteOffset != 0)
@@ -379,14 +655,19 @@ int yaffs_CheckpointClose(yaffs_Device *dev)
 	dev->nErasedBlocks -= dev->blocksInCheckpoint;
 
 
-	T(YAFFS_TRACE_CHECKPOINT, (TSTR("checkpoint byte count %d" TENDSTR),
-			dev->checkpointByteCount));
+	dev->checkpointBytes = dev->checkpointByteCount;
+	dev->checkpointStoredBytes = dev->checkpointPageSequence *
+					dev->nDataBytesPerChunk;
+
+	T(YAFFS_TRACE_CHECKPOINT, (TSTR("checkpoint byte count %d in %d chunks"
+		TENDSTR), dev->checkpointByteCount,
+		dev->checkpointPageSequence));
 
 	if (dev->checkpointBuffer) {
 		/* free the buffer */
 		YFREE(dev->checkpointBuffer);
 		dev->checkpointBuffer = NULL;
-		return 1;
+		return ok;
 	} else
 		return 0;
 }
@@ -51,6 +51,9 @@ extern const char *yaffs_guts_c_version;
 #include <linux/interrupt.h>
 #include <linux/string.h>
 #include <linux/ctype.h>
+#include <linux/kthread.h>
+#include <linux/freezer.h>
+#include <linux/writeback.h>
 
 #include "asm/div64.h"
 
@@ -169,6 +172,7 @@ static struct inode *yaffs_iget(struct super_block *sb, unsigned long ino);
 		} while(0)
 		
 static void yaffs_put_super(struct super_block *sb);
+static int yaffs_remount_fs(struct super_block *sb, int *flags, char *data);
 
 static ssize_t yaffs_file_write(struct file *f, const char *buf, size_t n,
 				loff_t *pos);
@@ -237,8 +241,12 @@ static void yaffs_delete_inode(struct inode *);
 static void yaffs_clear_inode(struct inode *);
 
 static int yaffs_readpage(struct file *file, struct page *page);
+static int yaffs_readpages(struct file *file, struct address_space *mapping,
+			   struct list_head *pages, unsigned nr_pages);
 #if (LINUX_VERSION_CODE > KERNEL_VERSION(2, 5, 0))
 static int yaffs_writepage(struct page *page, struct writeback_control *wbc);
+static int yaffs_writepages(struct address_space *mapping,
+			    struct writeback_control *wbc);
 #else
 static int yaffs_writepage(struct page *page);
 #endif
@@ -269,7 +277,11 @@ static int yaffs_follow_link(struct dentry *dentry, struct nameidata *nd);
 
 static struct address_space_operations yaffs_file_address_operations = {
 	.readpage = yaffs_readpage,
+	.readpages = yaffs_readpages,
 	.writepage = yaffs_writepage,
+#if (LINUX_VERSION_CODE > KERNEL_VERSION(2, 5, 0))
+	.writepages = yaffs_writepages,
+#endif
 #if (YAFFS_USE_WRITE_BEGIN_END > 0)
 	.write_begin = yaffs_write_begin,
 	.write_end = yaffs_write_end,
@@ -359,23 +371,47 @@ static const struct super_operations yaffs_super_ops = {
 	.put_inode = yaffs_put_inode,
 #endif
 	.put_super = yaffs_put_super,
+	.remount_fs = yaffs_remount_fs,
 	.delete_inode = yaffs_delete_inode,
 	.clear_inode = yaffs_clear_inode,
 	.sync_fs = yaffs_sync_fs,
 	.write_super = yaffs_write_super,
 };
 
+/*
+ * grossLock is a reader/writer semaphore.  Anything that can write to
+ * NAND - allocation, GC, checkpointing, object header updates - takes it
+ * exclusive.  Pure readers (readpage, lookup, readdir, readlink, statfs,
+ * inode fill) take it shared and may run alongside each other; the bits
+ * of device state they do touch are covered by dev->stateLock and
+ * dev->lazyLoadLock in yaffs_guts.c.
+ */
 static void yaffs_GrossLock(yaffs_Device *dev)
 {
 	T(YAFFS_TRACE_OS, ("yaffs locking %p\n", current));
-	down(&dev->grossLock);
+	/* Every exclusive user but the GC thread is foreground work */
+	dev->lastForegroundWrite = jiffies;
+	down_write(&dev->grossLock);
 	T(YAFFS_TRACE_OS, ("yaffs locked %p\n", current));
 }
 
 static void yaffs_GrossUnlock(yaffs_Device *dev)
 {
 	T(YAFFS_TRACE_OS, ("yaffs unlocking %p\n", current));
-	up(&dev->grossLock);
+	up_write(&dev->grossLock);
+}
+
+static void yaffs_ReadLock(yaffs_Device *dev)
+{
+	T(YAFFS_TRACE_OS, ("yaffs read locking %p\n", current));
+	down_read(&dev->grossLock);
+	T(YAFFS_TRACE_OS, ("yaffs read locked %p\n", current));
+}
+
+static void yaffs_ReadUnlock(yaffs_Device *dev)
+{
+	T(YAFFS_TRACE_OS, ("yaffs read unlocking %p\n", current));
+	up_read(&dev->grossLock);
 }
 
 static int yaffs_readlink(struct dentry *dentry, char __user *buffer,
@@ -386,11 +422,11 @@ static int yaffs_readlink(struct dentry *dentry, char __user *buffer,
 
 	yaffs_Device *dev = yaffs_DentryToObject(dentry)->myDev;
 
-	yaffs_GrossLock(dev);
+	yaffs_ReadLock(dev);
 
 	alias = yaffs_GetSymlinkAlias(yaffs_DentryToObject(dentry));
 
-	yaffs_GrossUnlock(dev);
+	yaffs_ReadUnlock(dev);
 
 	if (!alias)
 		return -ENOMEM;
@@ -410,11 +446,11 @@ static int yaffs_follow_link(struct dentry *dentry, struct nameidata *nd)
 	int ret;
 	yaffs_Device *dev = yaffs_DentryToObject(dentry)->myDev;
 
-	yaffs_GrossLock(dev);
+	yaffs_ReadLock(dev);
 
 	alias = yaffs_GetSymlinkAlias(yaffs_DentryToObject(dentry));
 
-	yaffs_GrossUnlock(dev);
+	yaffs_ReadUnlock(dev);
 
 	if (!alias) {
 		ret = -ENOMEM;
@@ -450,7 +486,7 @@ static struct dentry *yaffs_lookup(struct inode *dir, struct dentry *dentry)
 
 	yaffs_Device *dev = yaffs_InodeToObject(dir)->myDev;
 
-	yaffs_GrossLock(dev);
+	yaffs_ReadLock(dev);
 
 	T(YAFFS_TRACE_OS,
 		("yaffs_lookup for %d:%s\n",
@@ -462,7 +498,7 @@ static struct dentry *yaffs_lookup(struct inode *dir, struct dentry *dentry)
 	obj = yaffs_GetEquivalentObject(obj);	/* in case it was a hardlink */
 
 	/* Can't hold gross lock when calling yaffs_get_inode() */
-	yaffs_GrossUnlock(dev);
+	yaffs_ReadUnlock(dev);
 
 	if (obj) {
 		T(YAFFS_TRACE_OS,
@@ -589,7 +625,7 @@ static int yaffs_file_flush(struct file *file)
 
 	yaffs_GrossLock(dev);
 
-	yaffs_FlushFile(obj, 1);
+	yaffs_DeferFlushFile(obj);
 
 	yaffs_GrossUnlock(dev);
 
@@ -624,13 +660,13 @@ static int yaffs_readpage_nolock(struct file *f, struct page *pg)
 	pg_buf = kmap(pg);
 	/* FIXME: Can kmap fail? */
 
-	yaffs_GrossLock(dev);
+	yaffs_ReadLock(dev);
 
 	ret = yaffs_ReadDataFromFile(obj, pg_buf,
 				pg->index << PAGE_CACHE_SHIFT,
 				PAGE_CACHE_SIZE);
 
-	yaffs_GrossUnlock(dev);
+	yaffs_ReadUnlock(dev);
 
 	if (ret >= 0)
 		ret = 0;
@@ -662,6 +698,94 @@ static int yaffs_readpage(struct file *f, struct page *pg)
 	return yaffs_readpage_unlock(f, pg);
 }
 
+/*
+ * Readahead.  Runs of consecutive pages are read with one
+ * yaffs_ReadDataFromFile() call into the device's bounce buffer, which
+ * lets the guts turn chunks that are consecutive in NAND into a single
+ * multi-chunk MTD read.  The buffer is shared by all readers of the
+ * device; whoever finds it busy reads page by page instead.
+ */
+#define YAFFS_READAHEAD_PAGES	8
+
+static void yaffs_readpage_run(struct file *f, struct page **run, int nPages)
+{
+	yaffs_Object *obj = yaffs_DentryToObject(f->f_dentry);
+	yaffs_Device *dev = obj->myDev;
+	unsigned char *pg_buf;
+	int ret;
+	int i;
+
+	if (nPages < 2 || !dev->readAheadBuffer ||
+	    !mutex_trylock(&dev->readAheadLock)) {
+		for (i = 0; i < nPages; i++) {
+			yaffs_readpage_unlock(f, run[i]);
+			page_cache_release(run[i]);
+		}
+		return;
+	}
+
+	T(YAFFS_TRACE_OS, ("yaffs_readpages at %08x, %d pages\n",
+			(unsigned)(run[0]->index << PAGE_CACHE_SHIFT), nPages));
+
+	yaffs_ReadLock(dev);
+
+	ret = yaffs_ReadDataFromFile(obj, dev->readAheadBuffer,
+				((loff_t)run[0]->index) << PAGE_CACHE_SHIFT,
+				nPages << PAGE_CACHE_SHIFT);
+
+	yaffs_ReadUnlock(dev);
+
+	for (i = 0; i < nPages; i++) {
+		if (ret >= 0) {
+			pg_buf = kmap(run[i]);
+			memcpy(pg_buf, dev->readAheadBuffer +
+				(i << PAGE_CACHE_SHIFT), PAGE_CACHE_SIZE);
+			flush_dcache_page(run[i]);
+			kunmap(run[i]);
+			SetPageUptodate(run[i]);
+			ClearPageError(run[i]);
+		} else {
+			ClearPageUptodate(run[i]);
+			SetPageError(run[i]);
+		}
+		UnlockPage(run[i]);
+		page_cache_release(run[i]);
+	}
+
+	mutex_unlock(&dev->readAheadLock);
+}
+
+static int yaffs_readpages(struct file *f, struct address_space *mapping,
+			   struct list_head *pages, unsigned nr_pages)
+{
+	struct page *run[YAFFS_READAHEAD_PAGES];
+	struct page *pg;
+	int nRun = 0;
+	unsigned i;
+
+	for (i = 0; i < nr_pages; i++) {
+		pg = list_entry(pages->prev, struct page, lru);
+		list_del(&pg->lru);
+
+		if (add_to_page_cache_lru(pg, mapping, pg->index, GFP_KERNEL)) {
+			page_cache_release(pg);
+			continue;
+		}
+
+		if (nRun && (nRun == YAFFS_READAHEAD_PAGES ||
+			     run[nRun - 1]->index + 1 != pg->index)) {
+			yaffs_readpage_run(f, run, nRun);
+			nRun = 0;
+		}
+		run[nRun++] = pg;
+	}
+
+	if (nRun)
+		yaffs_readpage_run(f, run, nRun);
+
+	return 0;
+}
+
 /* writepage inspired by/stolen from smbfs */
 
 #if (LINUX_VERSION_CODE > KERNEL_VERSION(2, 5, 0))
@@ -744,6 +868,111 @@ static int yaffs_writepage(struct page *page)
 	return (nWritten == nBytes) ? 0 : -ENOSPC;
 }
 
+#if (LINUX_VERSION_CODE > KERNEL_VERSION(2, 5, 0))
+/*
+ * Dirty pages only come from shared writable mappings: write() goes
+ * straight to yaffs through write_end. write_cache_pages() walks the dirty
+ * pages of the mapping (from writeback_index for range_cyclic writeback)
+ * and hands them over locked, in index order; they are collected into
+ * batches of up to YAFFS_WRITEPAGES_BATCH pages that are written under one
+ * hold of the device lock, so consecutive pages land in consecutive chunks
+ * and the lock is not bounced for every page.
+ */
+#define YAFFS_WRITEPAGES_BATCH	16
+
+struct yaffs_WritepagesBatch {
+	struct inode *inode;
+	struct page *pages[YAFFS_WRITEPAGES_BATCH];
+	int nPages;
+	int err;
+};
+
+static void yaffs_writepages_batch(struct yaffs_WritepagesBatch *batch)
+{
+	struct inode *inode = batch->inode;
+	yaffs_Object *obj = yaffs_InodeToObject(inode);
+	loff_t i_size = i_size_read(inode);
+	unsigned long end_index = i_size >> PAGE_CACHE_SHIFT;
+	unsigned nBytes;
+	char *buffer;
+	int i;
+
+	yaffs_GrossLock(obj->myDev);
+
+	for (i = 0; i < batch->nPages; i++) {
+		struct page *page = batch->pages[i];
+
+		if (page->index < end_index)
+			nBytes = PAGE_CACHE_SIZE;
+		else if (page->index == end_index)
+			nBytes = i_size & (PAGE_CACHE_SIZE - 1);
+		else
+			nBytes = 0;
+
+		/* Beyond the end of the file: nothing to write */
+		if (nBytes != PAGE_CACHE_SIZE)
+			zero_user_segment(page, nBytes, PAGE_CACHE_SIZE);
+		if (!nBytes)
+			continue;
+
+		buffer = kmap(page);
+		if (yaffs_WriteDataToFile(obj, buffer,
+				page->index << PAGE_CACHE_SHIFT,
+				nBytes, 0) != nBytes) {
+			SetPageError(page);
+			batch->err = -ENOSPC;
+		}
+		kunmap(page);
+	}
+
+	yaffs_GrossUnlock(obj->myDev);
+
+	for (i = 0; i < batch->nPages; i++) {
+		struct page *page = batch->pages[i];
+
+		set_page_writeback(page);
+		unlock_page(page);
+		end_page_writeback(page);
+		page_cache_release(page);
+	}
+	batch->nPages = 0;
+}
+
+/*
+ * write_cache_pages() callback. The page comes locked and cleaned for io;
+ * it stays locked in the batch until the batch is written. write_cache_pages()
+ * drops its own reference when it moves on, so the batch takes one.
+ */
+static int yaffs_writepages_collect(struct page *page,
+				    struct writeback_control *wbc, void *data)
+{
+	struct yaffs_WritepagesBatch *batch = data;
+
+	page_cache_get(page);
+	batch->pages[batch->nPages++] = page;
+	if (batch->nPages == YAFFS_WRITEPAGES_BATCH)
+		yaffs_writepages_batch(batch);
+	return 0;
+}
+
+static int yaffs_writepages(struct address_space *mapping,
+			    struct writeback_control *wbc)
+{
+	struct yaffs_WritepagesBatch batch;
+	int ret;
+
+	batch.inode = mapping->host;
+	batch.nPages = 0;
+	batch.err = 0;
+
+	ret = write_cache_pages(mapping, wbc, yaffs_writepages_collect, &batch);
+	if (batch.nPages)
+		yaffs_writepages_batch(&batch);
+
+	return ret ? ret : batch.err;
+}
+#endif
+
 
 #if (YAFFS_USE_WRITE_BEGIN_END > 0)
 static int yaffs_write_begin(struct file *filp, struct address_space *mapping,
@@ -1143,7 +1372,7 @@ static int yaffs_readdir(struct file *f, void *dirent, filldir_t filldir)
 	obj = yaffs_DentryToObject(f->f_dentry);
 	dev = obj->myDev;
 
-	yaffs_GrossLock(dev);
+	yaffs_ReadLock(dev);
 
 	offset = f->f_pos;
 
@@ -1206,7 +1435,7 @@ static int yaffs_readdir(struct file *f, void *dirent, filldir_t filldir)
 
 up_and_out:
 out:
-	yaffs_GrossUnlock(dev);
+	yaffs_ReadUnlock(dev);
 
 	return 0;
 }
@@ -1553,7 +1782,7 @@ static int yaffs_statfs(struct super_block *sb, struct statfs *buf)
 
 	T(YAFFS_TRACE_OS, ("yaffs_statfs\n"));
 
-	yaffs_GrossLock(dev);
+	yaffs_ReadLock(dev);
 
 	buf->f_type = YAFFS_MAGIC;
 	buf->f_bsize = sb->s_blocksize;
@@ -1602,7 +1831,7 @@ static int yaffs_statfs(struct super_block *sb, struct statfs *buf)
 	buf->f_ffree = 0;
 	buf->f_bavail = buf->f_bfree;
 
-	yaffs_GrossUnlock(dev);
+	yaffs_ReadUnlock(dev);
 	return 0;
 }
 
@@ -1681,13 +1910,13 @@ static struct inode *yaffs_iget(struct super_block *sb, unsigned long ino)
 	 * need to lock again.
 	 */
 
-	yaffs_GrossLock(dev);
+	yaffs_ReadLock(dev);
 
 	obj = yaffs_FindObjectByNumber(dev, inode->i_ino);
 
 	yaffs_FillInodeFromObject(inode, obj);
 
-	yaffs_GrossUnlock(dev);
+	yaffs_ReadUnlock(dev);
 
 	unlock_new_inode(inode);
 	return inode;
@@ -1708,30 +1937,148 @@ static void yaffs_read_inode(struct inode *inode)
 	T(YAFFS_TRACE_OS,
 		("yaffs_read_inode for %d\n", (int)inode->i_ino));
 
-	yaffs_GrossLock(dev);
+	yaffs_ReadLock(dev);
 
 	obj = yaffs_FindObjectByNumber(dev, inode->i_ino);
 
 	yaffs_FillInodeFromObject(inode, obj);
 
-	yaffs_GrossUnlock(dev);
+	yaffs_ReadUnlock(dev);
 }
 
 #endif
 
 static YLIST_HEAD(yaffs_dev_list);
 
-#if 0 /* not used */
+/*
+ * Background GC.  Once no foreground write has been seen for
+ * YAFFS_BG_GC_IDLE_MS it cleans blocks one bounded step at a time,
+ * dropping the lock between steps, and backs off as soon as a foreground
+ * writer shows up.  The thread is freezable so it is parked across
+ * suspend.
+ */
+#define YAFFS_BG_GC_IDLE_MS	200
+#define YAFFS_BG_GC_SLEEP_MS	2000
+
+/* The thread also writes deferred object headers once they have been
+ * waiting this long.
+ */
+#define YAFFS_DEFERRED_HEADER_MS	1000
+
+static int yaffs_BackgroundGCIdle(yaffs_Device *dev)
+{
+	return time_after_eq(jiffies, dev->lastForegroundWrite +
+			     msecs_to_jiffies(YAFFS_BG_GC_IDLE_MS));
+}
+
+static void yaffs_BackgroundFlushHeaders(yaffs_Device *dev)
+{
+	if (!dev->nDeferredHeaders) {
+		dev->deferredHeadersSeen = jiffies;
+		return;
+	}
+
+	if (time_before(jiffies, dev->deferredHeadersSeen +
+			msecs_to_jiffies(YAFFS_DEFERRED_HEADER_MS)))
+		return;
+
+	down_write(&dev->grossLock);
+	yaffs_FlushDeferredHeaders(dev);
+	up_write(&dev->grossLock);
+	dev->deferredHeadersSeen = jiffies;
+}
+
+static int yaffs_BackgroundGCThread(void *data)
+{
+	yaffs_Device *dev = data;
+	long timeout;
+	int more;
+
+	set_freezable();
+
+	while (!kthread_should_stop()) {
+		timeout = msecs_to_jiffies(YAFFS_BG_GC_SLEEP_MS);
+
+		yaffs_BackgroundFlushHeaders(dev);
+		if (dev->nDeferredHeaders)
+			timeout = msecs_to_jiffies(YAFFS_DEFERRED_HEADER_MS);
+
+		if (yaffs_BackgroundGCIdle(dev)) {
+			do {
+				down_write(&dev->grossLock);
+				more = yaffs_BackgroundGarbageCollect(dev);
+				up_write(&dev->grossLock);
+				cond_resched();
+			} while (more && !kthread_should_stop() &&
+				 !freezing(current) &&
+				 yaffs_BackgroundGCIdle(dev));
+
+			/* Interrupted by a write: look again once it is idle */
+			if (more)
+				timeout = msecs_to_jiffies(YAFFS_BG_GC_IDLE_MS);
+		} else
+			timeout = msecs_to_jiffies(YAFFS_BG_GC_IDLE_MS);
+
+		try_to_freeze();
+		schedule_timeout_interruptible(timeout);
+	}
+
+	return 0;
+}
+
+static void yaffs_StartBackgroundGC(yaffs_Device *dev, int index)
+{
+	struct task_struct *tsk;
+
+	if (dev->noBackgroundGC || dev->bgGCThread)
+		return;
+
+	tsk = kthread_run(yaffs_BackgroundGCThread, dev, "yaffs-gc/%d", index);
+	if (IS_ERR(tsk)) {
+		T(YAFFS_TRACE_ALWAYS,
+		  ("yaffs: could not start background GC: %ld\n",
+		   PTR_ERR(tsk)));
+		return;
+	}
+
+	dev->bgGCThread = tsk;
+	dev->bgGCEnabled = 1;
+
+	/* Deferred headers are written by the background thread */
+	if (!dev->noDeferredHeaders) {
+		dev->deferredHeadersSeen = jiffies;
+		dev->deferHeaders = 1;
+	}
+}
+
+static void yaffs_StopBackgroundGC(yaffs_Device *dev)
+{
+	if (!dev->bgGCThread)
+		return;
+
+	/* Nothing left to write the deferred headers */
+	dev->deferHeaders = 0;
+
+	kthread_stop(dev->bgGCThread);
+	dev->bgGCThread = NULL;
+	dev->bgGCEnabled = 0;
+}
+
 static int yaffs_remount_fs(struct super_block *sb, int *flags, char *data)
 {
 	yaffs_Device    *dev = yaffs_SuperToDevice(sb);
+	struct mtd_info *mtd = dev->genericDevice;
 
-	if (*flags & MS_RDONLY) {
-		struct mtd_info *mtd = yaffs_SuperToDevice(sb)->genericDevice;
+	if ((*flags & MS_RDONLY) == (sb->s_flags & MS_RDONLY))
+		return 0;
 
+	if (*flags & MS_RDONLY) {
 		T(YAFFS_TRACE_OS,
 			("yaffs_remount_fs: %s: RO\n", dev->name));
 
+		/* Nothing may write behind a read-only mount */
+		yaffs_StopBackgroundGC(dev);
+
 		yaffs_GrossLock(dev);
 
 		yaffs_FlushEntireDeviceCache(dev);
@@ -1745,11 +2092,12 @@ static int yaffs_remount_fs(struct super_block *sb, int *flags, char *data)
 	} else {
 		T(YAFFS_TRACE_OS,
 			("yaffs_remount_fs: %s: RW\n", dev->name));
+
+		yaffs_StartBackgroundGC(dev, mtd->index);
 	}
 
 	return 0;
 }
-#endif
 
 static void yaffs_put_super(struct super_block *sb)
 {
@@ -1757,6 +2105,8 @@ static void yaffs_put_super(struct super_block *sb)
 
 	T(YAFFS_TRACE_OS, ("yaffs_put_super\n"));
 
+	yaffs_StopBackgroundGC(dev);
+
 	yaffs_GrossLock(dev);
 
 	yaffs_FlushEntireDeviceCache(dev);
@@ -1778,6 +2128,8 @@ static void yaffs_put_super(struct super_block *sb)
 		dev->spareBuffer = NULL;
 	}
 
+	kfree(dev->readAheadBuffer);
+
 	kfree(dev);
 }
 
@@ -1807,8 +2159,15 @@ typedef struct {
 	int skip_checkpoint_read;
 	int skip_checkpoint_write;
 	int no_cache;
+	int cache_size;
+	int no_bg_gc;
 	int empty_lost_and_found_overridden;
 	int empty_lost_and_found;
+	int block_summary_overridden;
+	int block_summary;
+	int checkpoint_lzo_overridden;
+	int checkpoint_lzo;
+	int no_deferred_headers;
 } yaffs_options;
 
 #define MAX_OPT_LEN 20
@@ -1839,6 +2198,13 @@ static int yaffs_parse_options(yaffs_options *options, const char *options_str)
 			options->inband_tags = 1;
 		else if (!strcmp(cur_opt, "no-cache"))
 			options->no_cache = 1;
+		else if (!strncmp(cur_opt, "cache-size=", 11))
+			options->cache_size =
+				simple_strtoul(cur_opt + 11, NULL, 0);
+		else if (!strcmp(cur_opt, "no-bg-gc"))
+			options->no_bg_gc = 1;
+		else if (!strcmp(cur_opt, "no-deferred-headers"))
+			options->no_deferred_headers = 1;
 		else if (!strcmp(cur_opt, "no-checkpoint-read"))
 			options->skip_checkpoint_read = 1;
 		else if (!strcmp(cur_opt, "no-checkpoint-write"))
@@ -1852,6 +2218,18 @@ static int yaffs_parse_options(yaffs_options *options, const char *options_str)
 		} else if (!strcmp(cur_opt, "empty-lost-and-found-enable")) {
 			options->empty_lost_and_found = 1;
 			options->empty_lost_and_found_overridden = 1;
+		} else if (!strcmp(cur_opt, "no-block-summary")) {
+			options->block_summary = 0;
+			options->block_summary_overridden = 1;
+		} else if (!strcmp(cur_opt, "block-summary")) {
+			options->block_summary = 1;
+			options->block_summary_overridden = 1;
+		} else if (!strcmp(cur_opt, "no-checkpoint-lzo")) {
+			options->checkpoint_lzo = 0;
+			options->checkpoint_lzo_overridden = 1;
+		} else if (!strcmp(cur_opt, "checkpoint-lzo")) {
+			options->checkpoint_lzo = 1;
+			options->checkpoint_lzo_overridden = 1;
 		} else {
 			printk(KERN_INFO "yaffs: Bad mount option \"%s\"\n",
 					cur_opt);
@@ -1862,6 +2240,10 @@ static int yaffs_parse_options(yaffs_options *options, const char *options_str)
 	return error;
 }
 
+/* Default short op cache size: a chunk per 32 blocks, 10 to 128 chunks */
+#define YAFFS_BLOCKS_PER_CACHE		32
+#define YAFFS_DEFAULT_MAX_CACHES	128
+
 static struct super_block *yaffs_internal_read_super(int yaffsVersion,
 						struct super_block *sb,
 						void *data, int silent)
@@ -1964,6 +2346,18 @@ static struct super_block *yaffs_internal_read_super(int yaffsVersion,
 	if(options.empty_lost_and_found_overridden)
 		dev->emptyLostAndFound = options.empty_lost_and_found;
 
+#ifdef CONFIG_YAFFS_BLOCK_SUMMARY
+	dev->blockSummary = 1;
+#endif
+	if (options.block_summary_overridden)
+		dev->blockSummary = options.block_summary;
+
+#ifdef CONFIG_YAFFS_CHECKPOINT_LZO
+	dev->checkpointCompress = 1;
+	if (options.checkpoint_lzo_overridden)
+		dev->checkpointCompress = options.checkpoint_lzo;
+#endif
+
 #ifdef CONFIG_YAFFS_AUTO_YAFFS2
 
 	if (yaffsVersion == 1 && WRITE_SIZE(mtd) >= 2048) {
@@ -2063,9 +2457,13 @@ static struct super_block *yaffs_internal_read_super(int yaffsVersion,
 	dev->nChunksPerBlock = YAFFS_CHUNKS_PER_BLOCK;
 	dev->totalBytesPerChunk = YAFFS_BYTES_PER_CHUNK;
 	dev->nReservedBlocks = 5;
-	dev->nShortOpCaches = (options.no_cache) ? 0 : 10;
 	dev->inbandTags = options.inband_tags;
 
+	/* Not having it just means readahead goes page by page */
+	dev->readAheadBuffer = kmalloc(YAFFS_READAHEAD_PAGES * PAGE_CACHE_SIZE,
+				       GFP_KERNEL);
+	mutex_init(&dev->readAheadLock);
+
 	/* ... and the functions. */
 	if (yaffsVersion == 2) {
 		dev->writeChunkWithTagsToNAND =
@@ -2074,6 +2472,8 @@ static struct super_block *yaffs_internal_read_super(int yaffsVersion,
 		    nandmtd2_ReadChunkWithTagsFromNAND;
 		dev->markNANDBlockBad = nandmtd2_MarkNANDBlockBad;
 		dev->queryNANDBlock = nandmtd2_QueryNANDBlock;
+		if (!dev->inbandTags)
+			dev->readChunksFromNAND = nandmtd2_ReadChunksFromNAND;
 		dev->spareBuffer = YMALLOC(mtd->oobsize);
 		dev->isYaffs2 = 1;
 #if (LINUX_VERSION_CODE > KERNEL_VERSION(2, 6, 17))
@@ -2102,6 +2502,18 @@ static struct super_block *yaffs_internal_read_super(int yaffsVersion,
 #endif
 		dev->isYaffs2 = 0;
 	}
+	/* The short op cache holds the partial chunks of files being
+	 * written, so size it with the partition unless told otherwise.
+	 */
+	if (options.no_cache)
+		dev->nShortOpCaches = 0;
+	else if (options.cache_size)
+		dev->nShortOpCaches = min(options.cache_size,
+					  YAFFS_MAX_SHORT_OP_CACHES);
+	else
+		dev->nShortOpCaches = clamp(nBlocks / YAFFS_BLOCKS_PER_CACHE,
+					    10, YAFFS_DEFAULT_MAX_CACHES);
+
 	/* ... and common functions */
 	dev->eraseBlockInNAND = nandmtd_EraseBlockInNAND;
 	dev->initialiseNAND = nandmtd_InitialiseNAND;
@@ -2126,7 +2538,9 @@ static struct super_block *yaffs_internal_read_super(int yaffsVersion,
 	/* we assume this is protected by lock_kernel() in mount/umount */
 	ylist_add_tail(&dev->devList, &yaffs_dev_list);
 
-	init_MUTEX(&dev->grossLock);
+	init_rwsem(&dev->grossLock);
+	spin_lock_init(&dev->stateLock);
+	mutex_init(&dev->lazyLoadLock);
 
 	yaffs_GrossLock(dev);
 
@@ -2165,6 +2579,13 @@ static struct super_block *yaffs_internal_read_super(int yaffsVersion,
 	T(YAFFS_TRACE_ALWAYS,
 	  ("yaffs_read_super: isCheckpointed %d\n", dev->isCheckpointed));
 
+	/* Keep a little erased headroom beyond the GC trigger */
+	dev->bgGCSpareBlocks = max(4, nBlocks / 64);
+	dev->noBackgroundGC = options.no_bg_gc;
+	dev->noDeferredHeaders = options.no_deferred_headers;
+	if (!(sb->s_flags & MS_RDONLY))
+		yaffs_StartBackgroundGC(dev, mtd->index);
+
 	T(YAFFS_TRACE_OS, ("yaffs_read_super: done\n"));
 	return sb;
 }
@@ -2268,6 +2689,10 @@ static struct proc_dir_entry *my_proc_entry;
 
 static char *yaffs_dump_dev(char *buf, yaffs_Device * dev)
 {
+	__u32 minErase, maxErase, avgErase;
+
+	yaffs_GetEraseCounts(dev, &minErase, &maxErase, &avgErase);
+
 	buf += sprintf(buf, "startBlock......... %d\n", dev->startBlock);
 	buf += sprintf(buf, "endBlock........... %d\n", dev->endBlock);
 	buf += sprintf(buf, "totalBytesPerChunk. %d\n", dev->totalBytesPerChunk);
@@ -2277,6 +2702,10 @@ static char *yaffs_dump_dev(char *buf, yaffs_Device * dev)
 	buf += sprintf(buf, "nErasedBlocks...... %d\n", dev->nErasedBlocks);
 	buf += sprintf(buf, "nReservedBlocks.... %d\n", dev->nReservedBlocks);
 	buf += sprintf(buf, "blocksInCheckpoint. %d\n", dev->blocksInCheckpoint);
+	buf += sprintf(buf, "checkpointLzo...... %d\n", dev->checkpointCompress);
+	buf += sprintf(buf, "checkpointBytes.... %d\n", dev->checkpointBytes);
+	buf += sprintf(buf, "checkpointStored... %d\n",
+		    dev->checkpointStoredBytes);
 	buf += sprintf(buf, "nTnodesCreated..... %d\n", dev->nTnodesCreated);
 	buf += sprintf(buf, "nFreeTnodes........ %d\n", dev->nFreeTnodes);
 	buf += sprintf(buf, "nObjectsCreated.... %d\n", dev->nObjectsCreated);
@@ -2284,11 +2713,31 @@ static char *yaffs_dump_dev(char *buf, yaffs_Device * dev)
 	buf += sprintf(buf, "nFreeChunks........ %d\n", dev->nFreeChunks);
 	buf += sprintf(buf, "nPageWrites........ %d\n", dev->nPageWrites);
 	buf += sprintf(buf, "nPageReads......... %d\n", dev->nPageReads);
+	buf += sprintf(buf, "nMultiChunkReads... %d\n", dev->nMultiChunkReads);
+	buf += sprintf(buf, "nMultiReadChunks... %d\n",
+		    dev->nMultiChunkReadChunks);
 	buf += sprintf(buf, "nBlockErasures..... %d\n", dev->nBlockErasures);
+	buf += sprintf(buf, "eraseCountMin...... %u\n", minErase);
+	buf += sprintf(buf, "eraseCountMax...... %u\n", maxErase);
+	buf += sprintf(buf, "eraseCountAvg...... %u\n", avgErase);
+	buf += sprintf(buf, "nHotAllocBlocks.... %d\n", dev->nHotAllocBlocks);
+	buf += sprintf(buf, "nColdAllocBlocks... %d\n", dev->nColdAllocBlocks);
 	buf += sprintf(buf, "nGCCopies.......... %d\n", dev->nGCCopies);
 	buf += sprintf(buf, "garbageCollections. %d\n", dev->garbageCollections);
 	buf += sprintf(buf, "passiveGCs......... %d\n",
 		    dev->passiveGarbageCollections);
+	buf += sprintf(buf, "bgGCs.............. %d\n",
+		    dev->bgGarbageCollections);
+	buf += sprintf(buf, "bgGCCopies......... %d\n", dev->bgGCCopies);
+	buf += sprintf(buf, "fgGCStalls......... %d\n", dev->fgGCStalls);
+	buf += sprintf(buf, "fgGCCopies......... %d\n", dev->fgGCCopies);
+	buf += sprintf(buf, "blockSummary....... %d\n", dev->blockSummary);
+	buf += sprintf(buf, "nSummariesWritten.. %d\n", dev->nSummariesWritten);
+	buf += sprintf(buf, "nSummaryScans...... %d\n", dev->nSummaryScans);
+	buf += sprintf(buf, "deferHeaders....... %d\n", dev->deferHeaders);
+	buf += sprintf(buf, "nDeferredHeaders... %d\n", dev->nDeferredHeaders);
+	buf += sprintf(buf, "nHeaderWrites...... %d\n", dev->nHeaderWrites);
+	buf += sprintf(buf, "nHeadersCoalesced.. %d\n", dev->nHeadersCoalesced);
 	buf += sprintf(buf, "nRetriedWrites..... %d\n", dev->nRetriedWrites);
 	buf += sprintf(buf, "nShortOpCaches..... %d\n", dev->nShortOpCaches);
 	buf += sprintf(buf, "nRetireBlocks...... %d\n", dev->nRetiredBlocks);
@@ -2297,6 +2746,9 @@ static char *yaffs_dump_dev(char *buf, yaffs_Device * dev)
 	buf += sprintf(buf, "tagsEccFixed....... %d\n", dev->tagsEccFixed);
 	buf += sprintf(buf, "tagsEccUnfixed..... %d\n", dev->tagsEccUnfixed);
 	buf += sprintf(buf, "cacheHits.......... %d\n", dev->cacheHits);
+	buf += sprintf(buf, "cacheCoalesced..... %d\n",
+		    dev->cacheCoalescedWrites);
+	buf += sprintf(buf, "cacheChunkWrites... %d\n", dev->cacheChunkWrites);
 	buf += sprintf(buf, "nDeletedFiles...... %d\n", dev->nDeletedFiles);
 	buf += sprintf(buf, "nUnlinkedFiles..... %d\n", dev->nUnlinkedFiles);
 	buf +=
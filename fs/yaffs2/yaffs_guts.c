@@ -31,10 +31,17 @@ const char *yaffs_guts_c_version =
 
 #include "yaffs_nand.h"
 #include "yaffs_packedtags2.h"
+#include "yaffs_summary.h"
 
 
 #define YAFFS_PASSIVE_GC_CHUNKS 2
 
+/* Blocks written this many blocks ago count as fully cold for GC */
+#define YAFFS_GC_MAX_AGE	65536
+
+/* Empty blocks, from the allocation cursor on, that allocation picks from */
+#define YAFFS_ALLOC_CANDIDATES	8
+
 #include "yaffs_ecc.h"
 
 
@@ -99,6 +106,8 @@ static int yaffs_CheckFileSanity(yaffs_Object *in);
 
 static void yaffs_InvalidateWholeChunkCache(yaffs_Object *in);
 static void yaffs_InvalidateChunkCache(yaffs_Object *object, int chunkId);
+static yaffs_ChunkCache *yaffs_LookupChunkCache(const yaffs_Object *obj,
+						int chunkId);
 
 static void yaffs_InvalidateCheckpoint(yaffs_Device *dev);
 
@@ -211,6 +220,8 @@ __u8 *yaffs_GetTempBuffer(yaffs_Device *dev, int lineNo)
 {
 	int i, j;
 
+	yaffs_LockState(dev);
+
 	dev->tempInUse++;
 	if (dev->tempInUse > dev->maxTemp)
 		dev->maxTemp = dev->tempInUse;
@@ -225,10 +236,14 @@ __u8 *yaffs_GetTempBuffer(yaffs_Device *dev, int lineNo)
 					    dev->tempBuffer[j].line;
 			}
 
+			yaffs_UnlockState(dev);
 			return dev->tempBuffer[i].buffer;
 		}
 	}
 
+	dev->unmanagedTempAllocations++;
+	yaffs_UnlockState(dev);
+
 	T(YAFFS_TRACE_BUFFERS,
 	  (TSTR("Out of temp buffers at line %d, other held by lines:"),
 	   lineNo));
@@ -242,7 +257,6 @@ __u8 *yaffs_GetTempBuffer(yaffs_Device *dev, int lineNo)
 	 * This is not good.
 	 */
 
-	dev->unmanagedTempAllocations++;
 	return YMALLOC(dev->nDataBytesPerChunk);
 
 }
@@ -252,22 +266,29 @@ void yaffs_ReleaseTempBuffer(yaffs_Device *dev, __u8 *buffer,
 {
 	int i;
 
+	yaffs_LockState(dev);
+
 	dev->tempInUse--;
 
 	for (i = 0; i < YAFFS_N_TEMP_BUFFERS; i++) {
 		if (dev->tempBuffer[i].buffer == buffer) {
 			dev->tempBuffer[i].line = 0;
+			yaffs_UnlockState(dev);
 			return;
 		}
 	}
 
+	if (buffer)
+		dev->unmanagedTempDeallocations++;
+
+	yaffs_UnlockState(dev);
+
 	if (buffer) {
 		/* assume it is an unmanaged one. */
 		T(YAFFS_TRACE_BUFFERS,
 		  (TSTR("Releasing unmanaged temp buffer in line %d" TENDSTR),
 		   lineNo));
 		YFREE(buffer);
-		dev->unmanagedTempDeallocations++;
 	}
 
 }
@@ -910,6 +931,7 @@ static int yaffs_WriteNewChunkWithTagsToNAND(struct yaffs_DeviceStruct *dev,
 		 */
 		if (bi->gcPrioritise) {
 			yaffs_DeleteChunk(dev, chunk, 1, __LINE__);
+			yaffs_SummarySkip(dev, chunk);
 			/* try another chunk */
 			continue;
 		}
@@ -927,6 +949,7 @@ static int yaffs_WriteNewChunkWithTagsToNAND(struct yaffs_DeviceStruct *dev,
 				(TSTR("**>> yaffs chunk %d was not erased"
 				TENDSTR), chunk));
 
+				yaffs_SummarySkip(dev, chunk);
 				/* try another chunk */
 				continue;
 			}
@@ -937,6 +960,7 @@ static int yaffs_WriteNewChunkWithTagsToNAND(struct yaffs_DeviceStruct *dev,
 				data, tags);
 		if (writeOk != YAFFS_OK) {
 			yaffs_HandleWriteChunkError(dev, chunk, erasedOk);
+			yaffs_SummarySkip(dev, chunk);
 			/* try another chunk */
 			continue;
 		}
@@ -944,6 +968,8 @@ static int yaffs_WriteNewChunkWithTagsToNAND(struct yaffs_DeviceStruct *dev,
 		/* Copy the data into the robustification buffer */
 		yaffs_HandleWriteChunkOk(dev, chunk, data, tags);
 
+		yaffs_SummaryAdd(dev, chunk, tags);
+
 	} while (writeOk != YAFFS_OK &&
 		(yaffs_wr_attempts <= 0 || attempts <= yaffs_wr_attempts));
 
@@ -1020,6 +1046,8 @@ static void yaffs_HandleUpdateChunk(yaffs_Device *dev, int chunkInNAND,
 
 void yaffs_HandleChunkError(yaffs_Device *dev, yaffs_BlockInfo *bi)
 {
+	/* Also reached from readers, so two of them may hit the same block */
+	yaffs_LockState(dev);
 	if (!bi->gcPrioritise) {
 		bi->gcPrioritise = 1;
 		dev->hasPendingPrioritisedGCs = 1;
@@ -1031,6 +1059,7 @@ void yaffs_HandleChunkError(yaffs_Device *dev, yaffs_BlockInfo *bi)
 
 		}
 	}
+	yaffs_UnlockState(dev);
 }
 
 static void yaffs_HandleWriteChunkError(yaffs_Device *dev, int chunkInNAND,
@@ -1793,6 +1822,7 @@ static yaffs_Object *yaffs_AllocateEmptyObject(yaffs_Device *dev)
 		YINIT_LIST_HEAD(&(tn->hardLinks));
 		YINIT_LIST_HEAD(&(tn->hashLink));
 		YINIT_LIST_HEAD(&tn->siblings);
+		YINIT_LIST_HEAD(&tn->deferredLink);
 
 
 		/* Now make the directory sane */
@@ -1850,11 +1880,24 @@ static void yaffs_UnhashObject(yaffs_Object *tn)
 	}
 }
 
+/* The header is about to be written, or the object freed */
+static void yaffs_UndeferObjectHeader(yaffs_Object *obj)
+{
+	if (!obj->deferredHeader)
+		return;
+
+	obj->deferredHeader = 0;
+	ylist_del_init(&obj->deferredLink);
+	obj->myDev->nDeferredHeaders--;
+}
+
 /*  FreeObject frees up a Object and puts it back on the free list */
 static void yaffs_FreeObject(yaffs_Object *tn)
 {
 	yaffs_Device *dev = tn->myDev;
 
+	yaffs_UndeferObjectHeader(tn);
+
 #ifdef __KERNEL__
 	T(YAFFS_TRACE_OS, (TSTR("FreeObject %p inode %p"TENDSTR), tn, tn->myInode));
 #endif
@@ -1928,6 +1971,8 @@ static void yaffs_InitialiseObjects(yaffs_Device *dev)
 		YINIT_LIST_HEAD(&dev->objectBucket[i].list);
 		dev->objectBucket[i].count = 0;
 	}
+
+	YINIT_LIST_HEAD(&dev->deferredHeaders);
 }
 
 static int yaffs_FindNiceObjectBucket(yaffs_Device *dev)
@@ -2481,6 +2526,29 @@ static int yaffs_BlockNotDisqualifiedFromGC(yaffs_Device *dev,
 	return (bi->sequenceNumber <= dev->oldestDirtySequence);
 }
 
+/* Cost-benefit of collecting a block, as in LFS: the space it frees,
+ * weighted by how long ago it was written. Blocks whose data has been
+ * left alone for a long time (cold) are unlikely to get any emptier, so
+ * they are worth collecting while still fairly full. Young blocks hold
+ * data that is still being rewritten (hot) and are better left to empty
+ * themselves out. With no sequence numbers (yaffs1) this is just the
+ * dirtiest block.
+ */
+static __u32 yaffs_GCScore(yaffs_Device *dev, yaffs_BlockInfo *bi,
+			int pagesInUse)
+{
+	__u32 age = 1;
+
+	if (dev->isYaffs2) {
+		age += dev->sequenceNumber - bi->sequenceNumber;
+		if (age > YAFFS_GC_MAX_AGE)
+			age = YAFFS_GC_MAX_AGE;
+	}
+
+	return ((dev->nChunksPerBlock - pagesInUse) * age) /
+		(dev->nChunksPerBlock + pagesInUse);
+}
+
 /* FindDiretiestBlock is used to select the dirtiest block (or close enough)
  * for garbage collection.
  */
@@ -2494,6 +2562,10 @@ static int yaffs_FindBlockForGarbageCollection(yaffs_Device *dev,
 	int iterations;
 	int dirtiest = -1;
 	int pagesInUse = 0;
+	int maxPagesInUse;
+	int live;
+	__u32 score;
+	__u32 bestScore = 0;
 	int prioritised = 0;
 	yaffs_BlockInfo *bi;
 	int pendingPrioritisedExist = 0;
@@ -2547,6 +2619,14 @@ static int yaffs_FindBlockForGarbageCollection(yaffs_Device *dev,
 			iterations = 200;
 	}
 
+	/* Of the blocks with fewer than maxPagesInUse pages in use, take the
+	 * one with the best cost-benefit. Aggressive GC is short of erased
+	 * blocks and needs the most space back for the fewest copies now, so
+	 * it takes the one with the fewest pages in use. A block with nothing
+	 * left in it can't be bettered.
+	 */
+	maxPagesInUse = pagesInUse;
+
 	for (i = 0; i <= iterations && pagesInUse > 0 && !prioritised; i++) {
 		b++;
 		if (b < dev->internalStartBlock || b > dev->internalEndBlock)
@@ -2560,11 +2640,26 @@ static int yaffs_FindBlockForGarbageCollection(yaffs_Device *dev,
 
 		bi = yaffs_GetBlockInfo(dev, b);
 
+		live = bi->pagesInUse - bi->softDeletions;
+
 		if (bi->blockState == YAFFS_BLOCK_STATE_FULL &&
-			(bi->pagesInUse - bi->softDeletions) < pagesInUse &&
+			live < maxPagesInUse &&
 				yaffs_BlockNotDisqualifiedFromGC(dev, bi)) {
-			dirtiest = b;
-			pagesInUse = (bi->pagesInUse - bi->softDeletions);
+			if (aggressive) {
+				if (dirtiest < 0 || live < pagesInUse) {
+					dirtiest = b;
+					pagesInUse = live;
+				}
+				continue;
+			}
+
+			score = yaffs_GCScore(dev, bi, live);
+			if (dirtiest < 0 || score > bestScore ||
+			    (score == bestScore && live < pagesInUse)) {
+				dirtiest = b;
+				pagesInUse = live;
+				bestScore = score;
+			}
 		}
 	}
 
@@ -2600,6 +2695,12 @@ static void yaffs_BlockBecameDirty(yaffs_Device *dev, int blockNo)
 
 	bi->blockState = YAFFS_BLOCK_STATE_DIRTY;
 
+	/* The summary chunk is free space again, erased or lost with the rest */
+	if (bi->hasSummary) {
+		dev->nFreeChunks++;
+		bi->hasSummary = 0;
+	}
+
 	if (!bi->needsRetiring) {
 		yaffs_InvalidateCheckpoint(dev);
 		erasedOk = yaffs_EraseBlockInNAND(dev, blockNo);
@@ -2649,6 +2750,11 @@ static void yaffs_BlockBecameDirty(yaffs_Device *dev, int blockNo)
 static int yaffs_FindBlockForAllocation(yaffs_Device *dev)
 {
 	int i;
+	int b;
+	int candidates = 0;
+	int cold = dev->isDoingGC;
+	int found = -1;
+	__u32 foundCount = 0;
 
 	yaffs_BlockInfo *bi;
 
@@ -2662,30 +2768,56 @@ static int yaffs_FindBlockForAllocation(yaffs_Device *dev)
 		return -1;
 	}
 
-	/* Find an empty block. */
+	/* Find an empty block.
+	 * Only the next few empty blocks after the last one allocated are
+	 * looked at, so the search stays about as short as taking the first
+	 * empty block. New data goes to the least worn of them. Data being
+	 * moved by GC has already outlived a block and is likely to stay
+	 * put, so it goes to the most worn one and gives that block a rest.
+	 * Ties go to the first of them, so with equal erase counts blocks are
+	 * still handed out in order.
+	 */
 
-	for (i = dev->internalStartBlock; i <= dev->internalEndBlock; i++) {
-		dev->allocationBlockFinder++;
-		if (dev->allocationBlockFinder < dev->internalStartBlock
-		    || dev->allocationBlockFinder > dev->internalEndBlock) {
-			dev->allocationBlockFinder = dev->internalStartBlock;
-		}
+	b = dev->allocationBlockFinder;
+	for (i = dev->internalStartBlock;
+	     i <= dev->internalEndBlock && candidates < YAFFS_ALLOC_CANDIDATES;
+	     i++) {
+		b++;
+		if (b < dev->internalStartBlock || b > dev->internalEndBlock)
+			b = dev->internalStartBlock;
+
+		bi = yaffs_GetBlockInfo(dev, b);
 
-		bi = yaffs_GetBlockInfo(dev, dev->allocationBlockFinder);
-
-		if (bi->blockState == YAFFS_BLOCK_STATE_EMPTY) {
-			bi->blockState = YAFFS_BLOCK_STATE_ALLOCATING;
-			dev->sequenceNumber++;
-			bi->sequenceNumber = dev->sequenceNumber;
-			dev->nErasedBlocks--;
-			T(YAFFS_TRACE_ALLOCATE,
-			  (TSTR("Allocated block %d, seq  %d, %d left" TENDSTR),
-			   dev->allocationBlockFinder, dev->sequenceNumber,
-			   dev->nErasedBlocks));
-			return dev->allocationBlockFinder;
+		if (bi->blockState != YAFFS_BLOCK_STATE_EMPTY)
+			continue;
+
+		candidates++;
+		if (found < 0 ||
+		    (cold && bi->eraseCount > foundCount) ||
+		    (!cold && bi->eraseCount < foundCount)) {
+			found = b;
+			foundCount = bi->eraseCount;
 		}
 	}
 
+	if (found >= 0) {
+		bi = yaffs_GetBlockInfo(dev, found);
+		bi->blockState = YAFFS_BLOCK_STATE_ALLOCATING;
+		dev->sequenceNumber++;
+		bi->sequenceNumber = dev->sequenceNumber;
+		dev->nErasedBlocks--;
+		dev->allocationBlockFinder = found;
+		if (cold)
+			dev->nColdAllocBlocks++;
+		else
+			dev->nHotAllocBlocks++;
+		T(YAFFS_TRACE_ALLOCATE,
+		  (TSTR("Allocated block %d, seq  %d, %d left, erased %d times"
+			TENDSTR), found, dev->sequenceNumber,
+		   dev->nErasedBlocks, foundCount));
+		return found;
+	}
+
 	T(YAFFS_TRACE_ALWAYS,
 	  (TSTR
 	   ("yaffs tragedy: no more erased blocks, but there should have been %d"
@@ -2758,12 +2890,15 @@ static int yaffs_AllocateChunk(yaffs_Device *dev, int useReserve,
 		yaffs_BlockInfo **blockUsedPtr)
 {
 	int retVal;
+	int reserved;
 	yaffs_BlockInfo *bi;
 
 	if (dev->allocationBlock < 0) {
 		/* Get next block to allocate off */
 		dev->allocationBlock = yaffs_FindBlockForAllocation(dev);
 		dev->allocationPage = 0;
+		if (dev->allocationBlock >= 0)
+			yaffs_SummaryStartBlock(dev, dev->allocationBlock);
 	}
 
 	if (!useReserve && !yaffs_CheckSpaceForAllocation(dev)) {
@@ -2790,9 +2925,18 @@ static int yaffs_AllocateChunk(yaffs_Device *dev, int useReserve,
 
 		dev->nFreeChunks--;
 
-		/* If the block is full set the state to full */
-		if (dev->allocationPage >= dev->nChunksPerBlock) {
+		/* If the block is full set the state to full.
+		 * The summary chunk, if any, is written once the last
+		 * data chunk is, and is not free space from now on.
+		 */
+		reserved = yaffs_SummaryChunksReserved(dev,
+						dev->allocationBlock);
+		if (dev->allocationPage >= dev->nChunksPerBlock - reserved) {
 			bi->blockState = YAFFS_BLOCK_STATE_FULL;
+			if (reserved) {
+				bi->hasSummary = 1;
+				dev->nFreeChunks--;
+			}
 			dev->allocationBlock = -1;
 		}
 
@@ -3083,6 +3227,7 @@ static int yaffs_CheckGarbageCollection(yaffs_Device *dev)
 	int aggressive;
 	int gcOk = YAFFS_OK;
 	int maxTries = 0;
+	int copies;
 
 	int checkpointBlockAdjust;
 
@@ -3110,6 +3255,10 @@ static int yaffs_CheckGarbageCollection(yaffs_Device *dev)
 			aggressive = 0;
 		}
 
+		/* Leisurely collection is the background thread's job */
+		if (!aggressive && dev->bgGCEnabled)
+			return YAFFS_OK;
+
 		if (dev->gcBlock <= 0) {
 			dev->gcBlock = yaffs_FindBlockForGarbageCollection(dev, aggressive);
 			dev->gcChunk = 0;
@@ -3127,7 +3276,10 @@ static int yaffs_CheckGarbageCollection(yaffs_Device *dev)
 			   ("yaffs: GC erasedBlocks %d aggressive %d" TENDSTR),
 			   dev->nErasedBlocks, aggressive));
 
+			dev->fgGCStalls++;
+			copies = dev->nGCCopies;
 			gcOk = yaffs_GarbageCollectBlock(dev, block, aggressive);
+			dev->fgGCCopies += dev->nGCCopies - copies;
 		}
 
 		if (dev->nErasedBlocks < (dev->nReservedBlocks) && block > 0) {
@@ -3143,6 +3295,54 @@ static int yaffs_CheckGarbageCollection(yaffs_Device *dev)
 	return aggressive ? gcOk : YAFFS_OK;
 }
 
+/*
+ * One step of background GC, called by the OS layer with the device
+ * locked while no foreground writes are going on.  Collects at most the
+ * passive GC quota of chunks so the caller can drop the lock between
+ * steps.  Below the foreground trigger plus bgGCSpareBlocks erased blocks
+ * it takes the dirtiest block it can find, above that only nearly empty
+ * ones.  Returns 1 if another step straight away is worthwhile.
+ */
+int yaffs_BackgroundGarbageCollect(yaffs_Device *dev)
+{
+	int block;
+	int urgent;
+	int copies;
+	int checkpointBlockAdjust;
+
+	if (dev->isDoingGC)
+		return 0;
+
+	checkpointBlockAdjust = yaffs_CalcCheckpointBlocksRequired(dev) - dev->blocksInCheckpoint;
+	if (checkpointBlockAdjust < 0)
+		checkpointBlockAdjust = 0;
+
+	urgent = (dev->nErasedBlocks < dev->nReservedBlocks +
+		  checkpointBlockAdjust + 2 + dev->bgGCSpareBlocks);
+
+	if (dev->gcBlock <= 0) {
+		/* No rate limiting, the device is idle */
+		dev->nonAggressiveSkip = 0;
+		dev->gcBlock = yaffs_FindBlockForGarbageCollection(dev, urgent);
+		dev->gcChunk = 0;
+	}
+
+	block = dev->gcBlock;
+	if (block <= 0)
+		return 0;
+
+	T(YAFFS_TRACE_GC,
+	  (TSTR("yaffs: background GC block %d erasedBlocks %d urgent %d"
+		TENDSTR), block, dev->nErasedBlocks, urgent));
+
+	dev->bgGarbageCollections++;
+	copies = dev->nGCCopies;
+	yaffs_GarbageCollectBlock(dev, block, 0);
+	dev->bgGCCopies += dev->nGCCopies - copies;
+
+	return 1;
+}
+
 /*-------------------------  TAGS --------------------------------*/
 
 static int yaffs_TagsMatch(const yaffs_ExtendedTags *tags, int objectId,
@@ -3418,6 +3618,42 @@ static int yaffs_ReadChunkDataFromObject(yaffs_Object *in, int chunkInInode,
 
 }
 
+/*
+ * Read up to maxChunks whole chunks of a file starting at chunkInInode.
+ * Chunks that follow the first one consecutively in NAND and are not in
+ * the short op cache are fetched with a single request.  Returns the
+ * number of chunks read, at least one.
+ */
+static int yaffs_ReadChunkRunFromObject(yaffs_Object *in, int chunkInInode,
+					int maxChunks, __u8 *buffer)
+{
+	yaffs_Device *dev = in->myDev;
+	int chunkInNAND;
+	int nChunks;
+
+	chunkInNAND = yaffs_FindChunkInFile(in, chunkInInode, NULL);
+	if (chunkInNAND < 0 || maxChunks < 2 || !dev->readChunksFromNAND) {
+		yaffs_ReadChunkDataFromObject(in, chunkInInode, buffer);
+		return 1;
+	}
+
+	if (maxChunks > YAFFS_MAX_CHUNK_RUN)
+		maxChunks = YAFFS_MAX_CHUNK_RUN;
+
+	for (nChunks = 1; nChunks < maxChunks; nChunks++) {
+		if (yaffs_FindChunkInFile(in, chunkInInode + nChunks, NULL) !=
+		    chunkInNAND + nChunks)
+			break;
+		/* A cached copy may be newer than NAND */
+		if (yaffs_LookupChunkCache(in, chunkInInode + nChunks))
+			break;
+	}
+
+	yaffs_ReadChunksFromNAND(dev, chunkInNAND, nChunks, buffer, NULL);
+
+	return nChunks;
+}
+
 void yaffs_DeleteChunk(yaffs_Device *dev, int chunkId, int markNAND, int lyn)
 {
 	int block;
@@ -3559,6 +3795,8 @@ int yaffs_UpdateObjectHeader(yaffs_Object *in, const YCHAR *name, int force,
 
 	yaffs_strcpy(oldName, _Y("silly old name"));
 
+	/* Whatever was put off is written now */
+	yaffs_UndeferObjectHeader(in);
 
 	if (!in->fake ||
 		in == dev->rootDir || /* The rootDir should also be saved */
@@ -3673,6 +3911,7 @@ int yaffs_UpdateObjectHeader(yaffs_Object *in, const YCHAR *name, int force,
 		if (newChunkId >= 0) {
 
 			in->hdrChunk = newChunkId;
+			dev->nHeaderWrites++;
 
 			if (prevChunkId > 0) {
 				yaffs_DeleteChunk(dev, prevChunkId, 1,
@@ -3710,10 +3949,43 @@ int yaffs_UpdateObjectHeader(yaffs_Object *in, const YCHAR *name, int force,
  *   In Linux, the page cache provides read buffering aand the short op cache provides write
  *   buffering.
  *
- *   There are a limited number (~10) of cache chunks per device so that we don't
- *   need a very intelligent search.
+ *   The cache is sized at mount time and can run to a few hundred chunks, so
+ *   lookups go through a hash on (object, chunkId). Only pushing out an entry
+ *   and the per-object operations walk the whole array.
+ *
+ *   Small writes to the same chunk (appends to a journal or a log) accumulate
+ *   in a dirty entry and are written out once, when the file is flushed or the
+ *   entry has to be pushed out. Clean entries are pushed out before dirty ones
+ *   to give the dirty ones as long as possible to fill up.
  */
 
+static __u32 yaffs_ChunkCacheHash(yaffs_Device *dev, const yaffs_Object *obj,
+				int chunkId)
+{
+	return (obj->objectId * 31 + chunkId) & dev->srCacheHashMask;
+}
+
+/* Put a free entry in use for the given chunk */
+static void yaffs_HashChunkCache(yaffs_Device *dev, yaffs_ChunkCache *cache,
+				yaffs_Object *obj, int chunkId)
+{
+	cache->object = obj;
+	cache->chunkId = chunkId;
+	cache->dirty = 0;
+	cache->locked = 0;
+	cache->lastUse = 0;
+	cache->prevUse = 0;
+	ylist_add(&cache->hashLink,
+		&dev->srCacheHash[yaffs_ChunkCacheHash(dev, obj, chunkId)]);
+}
+
+/* Free an entry. Does not write it out. */
+static void yaffs_UnhashChunkCache(yaffs_ChunkCache *cache)
+{
+	ylist_del_init(&cache->hashLink);
+	cache->object = NULL;
+}
+
 static int yaffs_ObjectHasCachedWriteData(yaffs_Object *obj)
 {
 	yaffs_Device *dev = obj->myDev;
@@ -3731,49 +4003,54 @@ static int yaffs_ObjectHasCachedWriteData(yaffs_Object *obj)
 	return 0;
 }
 
+static int yaffs_ChunkCacheCompare(const void *a, const void *b)
+{
+	const yaffs_ChunkCache *ca = *(const yaffs_ChunkCache **)a;
+	const yaffs_ChunkCache *cb = *(const yaffs_ChunkCache **)b;
+
+	return ca->chunkId - cb->chunkId;
+}
 
+/* Write out all the dirty chunks of an object, in file order so that
+ * consecutive chunks of the file end up consecutive in NAND.
+ */
 static void yaffs_FlushFilesChunkCache(yaffs_Object *obj)
 {
 	yaffs_Device *dev = obj->myDev;
-	int lowest = -99;	/* Stop compiler whining. */
-	int i;
+	yaffs_ChunkCache **list = dev->srCacheFlushList;
 	yaffs_ChunkCache *cache;
-	int chunkWritten = 0;
+	int chunkWritten = 1;
 	int nCaches = obj->myDev->nShortOpCaches;
+	int nDirty = 0;
+	int i;
 
 	if (nCaches > 0) {
-		do {
-			cache = NULL;
-
-			/* Find the dirty cache for this object with the lowest chunk id. */
-			for (i = 0; i < nCaches; i++) {
-				if (dev->srCache[i].object == obj &&
-				    dev->srCache[i].dirty) {
-					if (!cache
-					    || dev->srCache[i].chunkId <
-					    lowest) {
-						cache = &dev->srCache[i];
-						lowest = cache->chunkId;
-					}
-				}
-			}
-
-			if (cache && !cache->locked) {
-				/* Write it out and free it up */
+		for (i = 0; i < nCaches; i++) {
+			cache = &dev->srCache[i];
+			if (cache->object == obj && cache->dirty &&
+			    !cache->locked)
+				list[nDirty++] = cache;
+		}
 
-				chunkWritten =
-				    yaffs_WriteChunkDataToObject(cache->object,
-								 cache->chunkId,
-								 cache->data,
-								 cache->nBytes,
-								 1);
-				cache->dirty = 0;
-				cache->object = NULL;
-			}
+		if (nDirty > 1)
+			yaffs_qsort(list, nDirty, sizeof(yaffs_ChunkCache *),
+				    yaffs_ChunkCacheCompare);
 
-		} while (cache && chunkWritten > 0);
+		for (i = 0; i < nDirty && chunkWritten > 0; i++) {
+			/* Write it out and free it up */
+			cache = list[i];
+			chunkWritten =
+			    yaffs_WriteChunkDataToObject(cache->object,
+							 cache->chunkId,
+							 cache->data,
+							 cache->nBytes,
+							 1);
+			cache->dirty = 0;
+			yaffs_UnhashChunkCache(cache);
+			dev->cacheChunkWrites++;
+		}
 
-		if (cache) {
+		if (chunkWritten <= 0) {
 			/* Hoosterman, disk full while writing cache out. */
 			T(YAFFS_TRACE_ERROR,
 			  (TSTR("yaffs tragedy: no space during cache write" TENDSTR)));
@@ -3794,6 +4071,8 @@ void yaffs_FlushEntireDeviceCache(yaffs_Device *dev)
 	int nCaches = dev->nShortOpCaches;
 	int i;
 
+	yaffs_FlushDeferredHeaders(dev);
+
 	/* Find a dirty object in the cache and flush it...
 	 * until there are no further dirty objects.
 	 */
@@ -3812,11 +4091,21 @@ void yaffs_FlushEntireDeviceCache(yaffs_Device *dev)
 
 }
 
+/* LRU-2: order by the second most recent use, then by the most recent */
+static int yaffs_ChunkCacheOlder(const yaffs_ChunkCache *a,
+				const yaffs_ChunkCache *b)
+{
+	if (a->prevUse != b->prevUse)
+		return a->prevUse < b->prevUse;
+	return a->lastUse < b->lastUse;
+}
 
 /* Grab us a cache chunk for use.
  * First look for an empty one.
- * Then look for the least recently used non-dirty one.
- * Then look for the least recently used dirty one...., flush and look again.
+ * Then push out the LRU-2 oldest clean one.
+ * If they are all dirty, flush the object owning the LRU-2 oldest one,
+ * which frees all its chunks, and look again.
+ * The chunk returned is free: the caller hashes it.
  */
 static yaffs_ChunkCache *yaffs_GrabChunkCacheWorker(yaffs_Device *dev)
 {
@@ -3835,71 +4124,69 @@ static yaffs_ChunkCache *yaffs_GrabChunkCacheWorker(yaffs_Device *dev)
 static yaffs_ChunkCache *yaffs_GrabChunkCache(yaffs_Device *dev)
 {
 	yaffs_ChunkCache *cache;
-	yaffs_Object *theObj;
-	int usage;
+	yaffs_ChunkCache *clean = NULL;
+	yaffs_ChunkCache *dirty = NULL;
 	int i;
-	int pushout;
 
-	if (dev->nShortOpCaches > 0) {
-		/* Try find a non-dirty one... */
-
-		cache = yaffs_GrabChunkCacheWorker(dev);
+	if (dev->nShortOpCaches < 1)
+		return NULL;
 
-		if (!cache) {
-			/* They were all dirty, find the last recently used object and flush
-			 * its cache, then  find again.
-			 * NB what's here is not very accurate, we actually flush the object
-			 * the last recently used page.
-			 */
+	for (i = 0; i < dev->nShortOpCaches; i++) {
+		cache = &dev->srCache[i];
+		if (!cache->object)
+			return cache;
+		if (cache->locked)
+			continue;
+		if (!cache->dirty) {
+			if (!clean || yaffs_ChunkCacheOlder(cache, clean))
+				clean = cache;
+		} else if (!dirty || yaffs_ChunkCacheOlder(cache, dirty))
+			dirty = cache;
+	}
 
-			/* With locking we can't assume we can use entry zero */
+	if (clean) {
+		yaffs_UnhashChunkCache(clean);
+		return clean;
+	}
 
-			theObj = NULL;
-			usage = -1;
-			cache = NULL;
-			pushout = -1;
+	if (dirty) {
+		/* Flush and try again */
+		yaffs_FlushFilesChunkCache(dirty->object);
+		return yaffs_GrabChunkCacheWorker(dev);
+	}
 
-			for (i = 0; i < dev->nShortOpCaches; i++) {
-				if (dev->srCache[i].object &&
-				    !dev->srCache[i].locked &&
-				    (dev->srCache[i].lastUse < usage || !cache)) {
-					usage = dev->srCache[i].lastUse;
-					theObj = dev->srCache[i].object;
-					cache = &dev->srCache[i];
-					pushout = i;
-				}
-			}
+	return NULL;
+}
 
-			if (!cache || cache->dirty) {
-				/* Flush and try again */
-				yaffs_FlushFilesChunkCache(theObj);
-				cache = yaffs_GrabChunkCacheWorker(dev);
-			}
+/* Find a cached chunk without counting it as a hit */
+static yaffs_ChunkCache *yaffs_LookupChunkCache(const yaffs_Object *obj,
+						int chunkId)
+{
+	yaffs_Device *dev = obj->myDev;
+	struct ylist_head *i;
+	yaffs_ChunkCache *cache;
 
+	if (dev->nShortOpCaches > 0) {
+		ylist_for_each(i, &dev->srCacheHash[yaffs_ChunkCacheHash(dev,
+							obj, chunkId)]) {
+			cache = ylist_entry(i, yaffs_ChunkCache, hashLink);
+			if (cache->object == obj &&
+			    cache->chunkId == chunkId)
+				return cache;
 		}
-		return cache;
-	} else
-		return NULL;
-
+	}
+	return NULL;
 }
 
 /* Find a cached chunk */
 static yaffs_ChunkCache *yaffs_FindChunkCache(const yaffs_Object *obj,
 					      int chunkId)
 {
-	yaffs_Device *dev = obj->myDev;
-	int i;
-	if (dev->nShortOpCaches > 0) {
-		for (i = 0; i < dev->nShortOpCaches; i++) {
-			if (dev->srCache[i].object == obj &&
-			    dev->srCache[i].chunkId == chunkId) {
-				dev->cacheHits++;
+	yaffs_ChunkCache *cache = yaffs_LookupChunkCache(obj, chunkId);
 
-				return &dev->srCache[i];
-			}
-		}
-	}
-	return NULL;
+	if (cache)
+		obj->myDev->cacheHits++;
+	return cache;
 }
 
 /* Mark the chunk for the least recently used algorithym */
@@ -3908,21 +4195,29 @@ static void yaffs_UseChunkCache(yaffs_Device *dev, yaffs_ChunkCache *cache,
 {
 
 	if (dev->nShortOpCaches > 0) {
+		yaffs_LockState(dev);
 		if (dev->srLastUse < 0 || dev->srLastUse > 100000000) {
 			/* Reset the cache usages */
 			int i;
-			for (i = 1; i < dev->nShortOpCaches; i++)
+			for (i = 0; i < dev->nShortOpCaches; i++) {
 				dev->srCache[i].lastUse = 0;
+				dev->srCache[i].prevUse = 0;
+			}
 
 			dev->srLastUse = 0;
 		}
 
 		dev->srLastUse++;
 
+		cache->prevUse = cache->lastUse;
 		cache->lastUse = dev->srLastUse;
+		yaffs_UnlockState(dev);
 
-		if (isAWrite)
+		if (isAWrite) {
+			if (cache->dirty)
+				dev->cacheCoalescedWrites++;
 			cache->dirty = 1;
+		}
 	}
 }
 
@@ -3936,7 +4231,7 @@ static void yaffs_InvalidateChunkCache(yaffs_Object *object, int chunkId)
 		yaffs_ChunkCache *cache = yaffs_FindChunkCache(object, chunkId);
 
 		if (cache)
-			cache->object = NULL;
+			yaffs_UnhashChunkCache(cache);
 	}
 }
 
@@ -3952,7 +4247,7 @@ static void yaffs_InvalidateWholeChunkCache(yaffs_Object *in)
 		/* Invalidate it. */
 		for (i = 0; i < dev->nShortOpCaches; i++) {
 			if (dev->srCache[i].object == in)
-				dev->srCache[i].object = NULL;
+				yaffs_UnhashChunkCache(&dev->srCache[i]);
 		}
 	}
 }
@@ -3960,6 +4255,20 @@ static void yaffs_InvalidateWholeChunkCache(yaffs_Object *in)
 /*--------------------- Checkpointing --------------------*/
 
 
+/*
+ * Checkpoint versions we can read:
+ * 3 - yaffs_BlockInfo without the erase count, whole level 0 tnodes.
+ * 5 - yaffs_BlockInfo as it is now, level 0 tnodes that map a run of
+ *     consecutive chunks written as just the run, other level 0 tnodes
+ *     without padding. May be lzo compressed after the head marker.
+ * Version 4 block info had a different layout that is not read back:
+ * such a checkpoint is rejected and the mount falls back to a scan.
+ */
+#define YAFFS_CHECKPOINT_OLDEST_VERSION	3
+
+/* Set in the base offset of a level 0 tnode record for a run of chunks */
+#define YAFFS_CHECKPOINT_TNODE_RUN	0x80000000
+
 static int yaffs_WriteCheckpointValidityMarker(yaffs_Device *dev, int head)
 {
 	yaffs_CheckpointValidity cp;
@@ -3969,6 +4278,8 @@ static int yaffs_WriteCheckpointValidityMarker(yaffs_Device *dev, int head)
 	cp.structType = sizeof(cp);
 	cp.magic = YAFFS_MAGIC;
 	cp.version = YAFFS_CHECKPOINT_VERSION;
+	if (dev->checkpointCompress)
+		cp.version |= YAFFS_CHECKPOINT_LZO;
 	cp.head = (head) ? 1 : 0;
 
 	return (yaffs_CheckpointWrite(dev, &cp, sizeof(cp)) == sizeof(cp)) ?
@@ -3978,6 +4289,7 @@ static int yaffs_WriteCheckpointValidityMarker(yaffs_Device *dev, int head)
 static int yaffs_ReadCheckpointValidityMarker(yaffs_Device *dev, int head)
 {
 	yaffs_CheckpointValidity cp;
+	__u32 version;
 	int ok;
 
 	ok = (yaffs_CheckpointRead(dev, &cp, sizeof(cp)) == sizeof(cp));
@@ -3985,11 +4297,66 @@ static int yaffs_ReadCheckpointValidityMarker(yaffs_Device *dev, int head)
 	if (ok)
 		ok = (cp.structType == sizeof(cp)) &&
 		     (cp.magic == YAFFS_MAGIC) &&
-		     (cp.version == YAFFS_CHECKPOINT_VERSION) &&
 		     (cp.head == ((head) ? 1 : 0));
+
+	if (ok && head) {
+		version = cp.version & ~YAFFS_CHECKPOINT_LZO;
+		ok = (version == YAFFS_CHECKPOINT_OLDEST_VERSION ||
+		      version == YAFFS_CHECKPOINT_VERSION);
+		dev->checkpointVersion = cp.version;
+	} else if (ok)
+		ok = (cp.version == dev->checkpointVersion);
+
 	return ok ? 1 : 0;
 }
 
+/* yaffs_BlockInfo as it was in version 3 checkpoints, before eraseCount */
+typedef struct {
+	int softDeletions:10;
+	int pagesInUse:10;
+	unsigned blockState:4;
+	__u32 needsRetiring:1;
+	__u32 skipErasedCheck:1;
+	__u32 gcPrioritise:1;
+	__u32 chunkErrorStrikes:3;
+#ifdef CONFIG_YAFFS_YAFFS2
+	__u32 hasShrinkHeader:1;
+	__u32 sequenceNumber;
+#endif
+} yaffs_BlockInfoV3;
+
+static void yaffs_CopyOldBlockInfo(yaffs_BlockInfo *bi,
+				   const yaffs_BlockInfoV3 *old)
+{
+	memset(bi, 0, sizeof(yaffs_BlockInfo));
+	bi->softDeletions = old->softDeletions;
+	bi->pagesInUse = old->pagesInUse;
+	bi->blockState = old->blockState;
+	bi->needsRetiring = old->needsRetiring;
+	bi->skipErasedCheck = old->skipErasedCheck;
+	bi->gcPrioritise = old->gcPrioritise;
+	bi->chunkErrorStrikes = old->chunkErrorStrikes;
+#ifdef CONFIG_YAFFS_YAFFS2
+	bi->hasShrinkHeader = old->hasShrinkHeader;
+	bi->sequenceNumber = old->sequenceNumber;
+#endif
+}
+
+static int yaffs_ReadCheckpointOldBlockInfo(yaffs_Device *dev, int nBlocks)
+{
+	yaffs_BlockInfoV3 v3;
+	yaffs_BlockInfo *bi = dev->blockInfo;
+	int ok = 1;
+	int i;
+
+	for (i = 0; i < nBlocks && ok; i++, bi++) {
+		ok = (yaffs_CheckpointRead(dev, &v3, sizeof(v3)) == sizeof(v3));
+		yaffs_CopyOldBlockInfo(bi, &v3);
+	}
+
+	return ok;
+}
+
 static void yaffs_DeviceToCheckpointDevice(yaffs_CheckpointDevice *cp,
 					   yaffs_Device *dev)
 {
@@ -4069,9 +4436,13 @@ static int yaffs_ReadCheckpointDevice(yaffs_Device *dev)
 
 	yaffs_CheckpointDeviceToDevice(dev, &cp);
 
-	nBytes = nBlocks * sizeof(yaffs_BlockInfo);
-
-	ok = (yaffs_CheckpointRead(dev, dev->blockInfo, nBytes) == nBytes);
+	if ((dev->checkpointVersion & ~YAFFS_CHECKPOINT_LZO) == 3) {
+		ok = yaffs_ReadCheckpointOldBlockInfo(dev, nBlocks);
+	} else {
+		nBytes = nBlocks * sizeof(yaffs_BlockInfo);
+		ok = (yaffs_CheckpointRead(dev, dev->blockInfo, nBytes) ==
+			nBytes);
+	}
 
 	if (!ok)
 		return 0;
@@ -4163,6 +4534,39 @@ static int yaffs_CheckpointObjectToObject(yaffs_Object *obj, yaffs_CheckpointObj
 
 
 
+/*
+ * If a level 0 tnode maps a run of consecutive chunks, starting at its
+ * first entry and with nothing after the run, return the length of the
+ * run and its first chunk. Files written in one go are mostly made of
+ * these.
+ */
+static int yaffs_Level0TnodeRun(yaffs_Device *dev, yaffs_Tnode *tn,
+				__u32 *firstChunk)
+{
+	__u32 chunk;
+	int n;
+	int i;
+
+	if (dev->chunkGroupBits)
+		return 0;
+
+	*firstChunk = yaffs_GetChunkGroupBase(dev, tn, 0);
+	if (!*firstChunk)
+		return 0;
+
+	for (n = 1; n < YAFFS_NTNODES_LEVEL0; n++) {
+		chunk = yaffs_GetChunkGroupBase(dev, tn, n);
+		if (chunk != *firstChunk + n)
+			break;
+	}
+
+	for (i = n; i < YAFFS_NTNODES_LEVEL0; i++)
+		if (yaffs_GetChunkGroupBase(dev, tn, i))
+			return 0;
+
+	return n;
+}
+
 static int yaffs_CheckpointTnodeWorker(yaffs_Object *in, yaffs_Tnode *tn,
 					__u32 level, int chunkOffset)
 {
@@ -4170,9 +4574,8 @@ static int yaffs_CheckpointTnodeWorker(yaffs_Object *in, yaffs_Tnode *tn,
 	yaffs_Device *dev = in->myDev;
 	int ok = 1;
 	int tnodeSize = (dev->tnodeWidth * YAFFS_NTNODES_LEVEL0)/8;
-
-	if (tnodeSize < sizeof(yaffs_Tnode))
-		tnodeSize = sizeof(yaffs_Tnode);
+	__u32 run[2];
+	int nRun;
 
 
 	if (tn) {
@@ -4188,9 +4591,18 @@ static int yaffs_CheckpointTnodeWorker(yaffs_Object *in, yaffs_Tnode *tn,
 			}
 		} else if (level == 0) {
 			__u32 baseOffset = chunkOffset <<  YAFFS_TNODES_LEVEL0_BITS;
-			ok = (yaffs_CheckpointWrite(dev, &baseOffset, sizeof(baseOffset)) == sizeof(baseOffset));
-			if (ok)
-				ok = (yaffs_CheckpointWrite(dev, tn, tnodeSize) == tnodeSize);
+
+			nRun = yaffs_Level0TnodeRun(dev, tn, &run[1]);
+			if (nRun) {
+				/* The low bits of the offset are free */
+				run[0] = baseOffset | YAFFS_CHECKPOINT_TNODE_RUN |
+					(nRun - 1);
+				ok = (yaffs_CheckpointWrite(dev, run, sizeof(run)) == sizeof(run));
+			} else {
+				ok = (yaffs_CheckpointWrite(dev, &baseOffset, sizeof(baseOffset)) == sizeof(baseOffset));
+				if (ok)
+					ok = (yaffs_CheckpointWrite(dev, tn, tnodeSize) == tnodeSize);
+			}
 		}
 	}
 
@@ -4225,8 +4637,12 @@ static int yaffs_ReadCheckpointTnodes(yaffs_Object *obj)
 	yaffs_Tnode *tn;
 	int nread = 0;
 	int tnodeSize = (dev->tnodeWidth * YAFFS_NTNODES_LEVEL0)/8;
+	__u32 firstChunk;
+	int i;
 
-	if (tnodeSize < sizeof(yaffs_Tnode))
+	/* Older checkpoints padded level 0 tnodes to the in memory size */
+	if ((dev->checkpointVersion & ~YAFFS_CHECKPOINT_LZO) < 5 &&
+	    tnodeSize < sizeof(yaffs_Tnode))
 		tnodeSize = sizeof(yaffs_Tnode);
 
 	ok = (yaffs_CheckpointRead(dev, &baseChunk, sizeof(baseChunk)) == sizeof(baseChunk));
@@ -4236,11 +4652,16 @@ static int yaffs_ReadCheckpointTnodes(yaffs_Object *obj)
 		/* Read level 0 tnode */
 
 
-		tn = yaffs_GetTnodeRaw(dev);
-		if (tn)
-			ok = (yaffs_CheckpointRead(dev, tn, tnodeSize) == tnodeSize);
-		else
+		tn = yaffs_GetTnode(dev);
+		if (!tn)
 			ok = 0;
+		else if (baseChunk & YAFFS_CHECKPOINT_TNODE_RUN) {
+			ok = (yaffs_CheckpointRead(dev, &firstChunk, sizeof(firstChunk)) == sizeof(firstChunk));
+			for (i = 0; ok && i <= (baseChunk & YAFFS_TNODES_LEVEL0_MASK); i++)
+				yaffs_PutLevel0Tnode(dev, tn, i, firstChunk + i);
+			baseChunk &= ~(YAFFS_CHECKPOINT_TNODE_RUN | YAFFS_TNODES_LEVEL0_MASK);
+		} else
+			ok = (yaffs_CheckpointRead(dev, tn, tnodeSize) == tnodeSize);
 
 		if (tn && ok)
 			ok = yaffs_AddOrFindLevel0Tnode(dev,
@@ -4401,6 +4822,8 @@ static int yaffs_WriteCheckpointData(yaffs_Device *dev)
 		T(YAFFS_TRACE_CHECKPOINT, (TSTR("write checkpoint validity" TENDSTR)));
 		ok = yaffs_WriteCheckpointValidityMarker(dev, 1);
 	}
+	if (ok && dev->checkpointCompress)
+		ok = yaffs_CheckpointStartCompression(dev);
 	if (ok) {
 		T(YAFFS_TRACE_CHECKPOINT, (TSTR("write checkpoint device" TENDSTR)));
 		ok = yaffs_WriteCheckpointDevice(dev);
@@ -4444,6 +4867,8 @@ static int yaffs_ReadCheckpointData(yaffs_Device *dev)
 		T(YAFFS_TRACE_CHECKPOINT, (TSTR("read checkpoint validity" TENDSTR)));
 		ok = yaffs_ReadCheckpointValidityMarker(dev, 1);
 	}
+	if (ok && (dev->checkpointVersion & YAFFS_CHECKPOINT_LZO))
+		ok = yaffs_CheckpointStartCompression(dev);
 	if (ok) {
 		T(YAFFS_TRACE_CHECKPOINT, (TSTR("read checkpoint device" TENDSTR)));
 		ok = yaffs_ReadCheckpointDevice(dev);
@@ -4491,6 +4916,9 @@ int yaffs_CheckpointSave(yaffs_Device *dev)
 
 	T(YAFFS_TRACE_CHECKPOINT, (TSTR("save entry: isCheckpointed %d"TENDSTR), dev->isCheckpointed));
 
+	/* The checkpoint does not carry what is only in the headers */
+	yaffs_FlushDeferredHeaders(dev);
+
 	yaffs_VerifyObjects(dev);
 	yaffs_VerifyBlocks(dev);
 	yaffs_VerifyFreeChunks(dev);
@@ -4531,6 +4959,11 @@ int yaffs_CheckpointRestore(yaffs_Device *dev)
  * An incomplete chunk to end off with
  *
  * Curve-balls: the first chunk might also be the last chunk.
+ *
+ * Reads may run concurrently with other reads (the OS layer only holds
+ * its lock shared), so the read side never grabs or evicts cache entries:
+ * that can mean flushing a dirty chunk, which allocates and may GC.  It
+ * copies from the cache on a hit and otherwise reads NAND directly.
  */
 
 int yaffs_ReadDataFromFile(yaffs_Object *in, __u8 *buffer, loff_t offset,
@@ -4564,54 +4997,36 @@ int yaffs_ReadDataFromFile(yaffs_Object *in, __u8 *buffer, loff_t offset,
 
 		cache = yaffs_FindChunkCache(in, chunk);
 
-		/* If the chunk is already in the cache or it is less than a whole chunk
-		 * or we're using inband tags then use the cache (if there is caching)
-		 * else bypass the cache.
+		/* If the chunk is in the cache, copy it from there (it may be
+		 * newer than NAND). Else if it is less than a whole chunk or
+		 * we're using inband tags read via a temp buffer, else read
+		 * straight into the supplied buffer.
 		 */
-		if (cache || nToCopy != dev->nDataBytesPerChunk || dev->inbandTags) {
-			if (dev->nShortOpCaches > 0) {
-
-				/* If we can't find the data in the cache, then load it up. */
-
-				if (!cache) {
-					cache = yaffs_GrabChunkCache(in->myDev);
-					cache->object = in;
-					cache->chunkId = chunk;
-					cache->dirty = 0;
-					cache->locked = 0;
-					yaffs_ReadChunkDataFromObject(in, chunk,
-								      cache->
-								      data);
-					cache->nBytes = 0;
-				}
-
-				yaffs_UseChunkCache(dev, cache, 0);
-
-				cache->locked = 1;
-
-
-				memcpy(buffer, &cache->data[start], nToCopy);
-
-				cache->locked = 0;
-			} else {
-				/* Read into the local buffer then copy..*/
-
-				__u8 *localBuffer =
-				    yaffs_GetTempBuffer(dev, __LINE__);
-				yaffs_ReadChunkDataFromObject(in, chunk,
-							      localBuffer);
-
-				memcpy(buffer, &localBuffer[start], nToCopy);
+		if (cache) {
+			yaffs_UseChunkCache(dev, cache, 0);
+			memcpy(buffer, &cache->data[start], nToCopy);
+		} else if (nToCopy != dev->nDataBytesPerChunk || dev->inbandTags) {
+			/* Read into the local buffer then copy..*/
+
+			__u8 *localBuffer =
+			    yaffs_GetTempBuffer(dev, __LINE__);
+			yaffs_ReadChunkDataFromObject(in, chunk,
+						      localBuffer);
 
+			memcpy(buffer, &localBuffer[start], nToCopy);
 
-				yaffs_ReleaseTempBuffer(dev, localBuffer,
-							__LINE__);
-			}
 
+			yaffs_ReleaseTempBuffer(dev, localBuffer,
+						__LINE__);
 		} else {
 
-			/* A full chunk. Read directly into the supplied buffer. */
-			yaffs_ReadChunkDataFromObject(in, chunk, buffer);
+			/* One or more full chunks. Read directly into the
+			 * supplied buffer, as a run where they are consecutive
+			 * in NAND.
+			 */
+			nToCopy = yaffs_ReadChunkRunFromObject(in, chunk,
+					n / dev->nDataBytesPerChunk, buffer) *
+				dev->nDataBytesPerChunk;
 
 		}
 
@@ -4705,13 +5120,12 @@ int yaffs_WriteDataToFile(yaffs_Object *in, const __u8 *buffer, loff_t offset,
 				    && yaffs_CheckSpaceForAllocation(in->
 								     myDev)) {
 					cache = yaffs_GrabChunkCache(in->myDev);
-					cache->object = in;
-					cache->chunkId = chunk;
-					cache->dirty = 0;
-					cache->locked = 0;
-					yaffs_ReadChunkDataFromObject(in, chunk,
-								      cache->
-								      data);
+					if (cache) {
+						yaffs_HashChunkCache(dev, cache,
+								in, chunk);
+						yaffs_ReadChunkDataFromObject(in,
+							chunk, cache->data);
+					}
 				} else if (cache &&
 					!cache->dirty &&
 					!yaffs_CheckSpaceForAllocation(in->myDev)) {
@@ -4956,6 +5370,75 @@ int yaffs_FlushFile(yaffs_Object *in, int updateTime)
 
 }
 
+/*
+ * Deferred object headers.
+ *
+ * Closing a written file and adding or removing a directory entry each
+ * rewrite an object header, only to record a new size or new times. With
+ * deferHeaders set these rewrites are put off and done together by
+ * yaffs_FlushDeferredHeaders(), so an object touched many times in a
+ * short while gets one header write. Anything else that writes the header
+ * (fsync, rename, truncate, chmod...) writes the deferred state too.
+ *
+ * Nothing that a scan needs is deferred: a file's size can be rebuilt
+ * from its data chunks, and a directory entry lives in the header of the
+ * child, which is written straight away.
+ */
+static void yaffs_DeferObjectHeader(yaffs_Object *obj)
+{
+	yaffs_Device *dev = obj->myDev;
+
+	if (obj->deferredHeader) {
+		dev->nHeadersCoalesced++;
+		return;
+	}
+
+	obj->deferredHeader = 1;
+	ylist_add_tail(&obj->deferredLink, &dev->deferredHeaders);
+	dev->nDeferredHeaders++;
+
+	if (dev->superBlock && dev->markSuperBlockDirty)
+		dev->markSuperBlockDirty(dev->superBlock);
+}
+
+/* On close: update the modification time, write the header later */
+void yaffs_DeferFlushFile(yaffs_Object *in)
+{
+	if (!in->dirty)
+		return;
+
+	if (!in->myDev->deferHeaders) {
+		yaffs_FlushFile(in, 1);
+		return;
+	}
+
+#ifdef CONFIG_YAFFS_WINCE
+	yfsd_WinFileTimeNow(in->win_mtime);
+#else
+	in->yst_mtime = Y_CURRENT_TIME;
+#endif
+	yaffs_DeferObjectHeader(in);
+}
+
+/*
+ * Objects are taken off the list one at a time before their header is
+ * written: writing it can run GC, which may free other deferred objects
+ * and so take them off the list too.
+ */
+void yaffs_FlushDeferredHeaders(yaffs_Device *dev)
+{
+	yaffs_Object *obj;
+
+	while (!ylist_empty(&dev->deferredHeaders)) {
+		obj = ylist_entry(dev->deferredHeaders.next, yaffs_Object,
+				  deferredLink);
+		yaffs_UndeferObjectHeader(obj);
+
+		/* Writes nothing if the object is not dirty any more */
+		yaffs_FlushFile(obj, 0);
+	}
+}
+
 static int yaffs_DoGenericObjectDeletion(yaffs_Object *in)
 {
 
@@ -5899,8 +6382,13 @@ static void yaffs_CheckObjectDetailsLoaded(yaffs_Object *in)
 		in->lazyLoaded ? "not yet" : "already"));
 #endif
 
-	if (in->lazyLoaded && in->hdrChunk > 0) {
-		in->lazyLoaded = 0;
+	if (!in->lazyLoaded || in->hdrChunk <= 0)
+		return;
+
+	/* Concurrent lookups may both find the object still lazy */
+	yaffs_LockLazyLoad(dev);
+
+	if (in->lazyLoaded) {
 		chunkData = yaffs_GetTempBuffer(dev, __LINE__);
 
 		result = yaffs_ReadChunkWithTagsFromNAND(dev, in->hdrChunk, chunkData, &tags);
@@ -5933,6 +6421,40 @@ static void yaffs_CheckObjectDetailsLoaded(yaffs_Object *in)
 		}
 
 		yaffs_ReleaseTempBuffer(dev, chunkData, __LINE__);
+
+		/* Only now, so nobody sees the fields half filled in */
+		in->lazyLoaded = 0;
+	}
+
+	yaffs_UnlockLazyLoad(dev);
+}
+
+/* After a scan only blocks with a summary know their erase count. Give
+ * the rest the average of those that do, so they are neither favoured
+ * nor shunned by the allocator.
+ */
+static void yaffs_GuessEraseCounts(yaffs_Device *dev)
+{
+	yaffs_BlockInfo *bi;
+	__u32 total = 0;
+	int nKnown = 0;
+	int b;
+
+	for (b = dev->internalStartBlock; b <= dev->internalEndBlock; b++) {
+		bi = yaffs_GetBlockInfo(dev, b);
+		if (bi->eraseCount) {
+			total += bi->eraseCount;
+			nKnown++;
+		}
+	}
+
+	if (!nKnown)
+		return;
+
+	for (b = dev->internalStartBlock; b <= dev->internalEndBlock; b++) {
+		bi = yaffs_GetBlockInfo(dev, b);
+		if (!bi->eraseCount)
+			bi->eraseCount = total / nKnown;
 	}
 }
 
@@ -5965,6 +6487,8 @@ static int yaffs_ScanBackwards(yaffs_Device *dev)
 	int foundChunksInBlock;
 	int equivalentObjectId;
 	int alloc_failed = 0;
+	yaffs_SummaryTags *summary;
+	int summaryAvailable;
 
 
 	yaffs_BlockIndex *blockIndex = NULL;
@@ -6001,6 +6525,9 @@ static int yaffs_ScanBackwards(yaffs_Device *dev)
 
 	chunkData = yaffs_GetTempBuffer(dev, __LINE__);
 
+	/* Without this we just read the tags of every chunk */
+	summary = YMALLOC(dev->nChunksPerBlock * sizeof(yaffs_SummaryTags));
+
 	/* Scan all the blocks to determine their state */
 	for (blk = dev->internalStartBlock; blk <= dev->internalEndBlock; blk++) {
 		bi = yaffs_GetBlockInfo(dev, blk);
@@ -6118,6 +6645,7 @@ static int yaffs_ScanBackwards(yaffs_Device *dev)
 
 		/* For each chunk in each block that needs scanning.... */
 		foundChunksInBlock = 0;
+		summaryAvailable = 0;
 		for (c = dev->nChunksPerBlock - 1;
 		     !alloc_failed && c >= 0 &&
 		     (state == YAFFS_BLOCK_STATE_NEEDS_SCANNING ||
@@ -6128,8 +6656,13 @@ static int yaffs_ScanBackwards(yaffs_Device *dev)
 
 			chunk = blk * dev->nChunksPerBlock + c;
 
-			result = yaffs_ReadChunkWithTagsFromNAND(dev, chunk, NULL,
-							&tags);
+			if (summaryAvailable) {
+				yaffs_SummaryGetTags(dev, summary, c,
+						bi->sequenceNumber, &tags);
+				result = YAFFS_OK;
+			} else
+				result = yaffs_ReadChunkWithTagsFromNAND(dev,
+							chunk, NULL, &tags);
 
 			/* Let's have a good look at this chunk... */
 
@@ -6189,6 +6722,27 @@ static int yaffs_ScanBackwards(yaffs_Device *dev)
 
 				  dev->nFreeChunks++;
 
+			} else if (tags.objectId == YAFFS_OBJECTID_SUMMARY) {
+				/* The block summary, holding the tags of the
+				 * rest of the block, which takes its chunk
+				 * until the block is erased; or a chunk that
+				 * the summary records as skipped, which is
+				 * garbage.
+				 */
+				foundChunksInBlock = 1;
+
+				if (c == dev->nChunksPerBlock - 1) {
+					bi->hasSummary = 1;
+					if (summary &&
+					    yaffs_SummaryRead(dev, blk,
+						bi->sequenceNumber,
+						summary) == YAFFS_OK) {
+						summaryAvailable = 1;
+						dev->nSummaryScans++;
+					}
+				} else
+					dev->nFreeChunks++;
+
 			} else if (tags.chunkId > 0) {
 				/* chunkId > 0 so it is a data chunk... */
 				unsigned int endpos;
@@ -6583,6 +7137,11 @@ static int yaffs_ScanBackwards(yaffs_Device *dev)
 	else
 		YFREE(blockIndex);
 
+	if (summary)
+		YFREE(summary);
+
+	yaffs_GuessEraseCounts(dev);
+
 	/* Ok, we've done all the scanning.
 	 * Fix up the hard link chains.
 	 * We should now have scanned all the objects, now it's time to add these
@@ -6697,7 +7256,10 @@ static void yaffs_UpdateParent(yaffs_Object *obj)
 	obj->dirty = 1;
 	obj->yst_mtime = obj->yst_ctime = Y_CURRENT_TIME;
 
-	yaffs_UpdateObjectHeader(obj,NULL,0,0,0);
+	if (obj->myDev->deferHeaders)
+		yaffs_DeferObjectHeader(obj);
+	else
+		yaffs_UpdateObjectHeader(obj,NULL,0,0,0);
 }
 
 static void yaffs_RemoveObjectFromDirectory(yaffs_Object *obj)
@@ -7289,6 +7851,17 @@ int yaffs_GutsInitialise(yaffs_Device *dev)
 	/* More device initialisation */
 	dev->garbageCollections = 0;
 	dev->passiveGarbageCollections = 0;
+	dev->bgGarbageCollections = 0;
+	dev->bgGCCopies = 0;
+	dev->fgGCStalls = 0;
+	dev->fgGCCopies = 0;
+	dev->nSummariesWritten = 0;
+	dev->nSummaryScans = 0;
+	dev->nDeferredHeaders = 0;
+	dev->nHeaderWrites = 0;
+	dev->nHeadersCoalesced = 0;
+	dev->nHotAllocBlocks = 0;
+	dev->nColdAllocBlocks = 0;
 	dev->currentDirtyChecker = 0;
 	dev->bufferedBlock = -1;
 	dev->doingBufferedBlockRewrite = 0;
@@ -7309,6 +7882,8 @@ int yaffs_GutsInitialise(yaffs_Device *dev)
 		init_failed = 1;
 
 	dev->srCache = NULL;
+	dev->srCacheHash = NULL;
+	dev->srCacheFlushList = NULL;
 	dev->gcCleanupList = NULL;
 
 
@@ -7316,21 +7891,38 @@ int yaffs_GutsInitialise(yaffs_Device *dev)
 	    dev->nShortOpCaches > 0) {
 		int i;
 		void *buf;
-		int srCacheBytes = dev->nShortOpCaches * sizeof(yaffs_ChunkCache);
+		int srCacheBytes;
+		int nBuckets = 1;
 
 		if (dev->nShortOpCaches > YAFFS_MAX_SHORT_OP_CACHES)
 			dev->nShortOpCaches = YAFFS_MAX_SHORT_OP_CACHES;
 
+		srCacheBytes = dev->nShortOpCaches * sizeof(yaffs_ChunkCache);
+
+		while (nBuckets < dev->nShortOpCaches)
+			nBuckets <<= 1;
+		dev->srCacheHashMask = nBuckets - 1;
+
 		dev->srCache =  YMALLOC(srCacheBytes);
+		dev->srCacheHash = YMALLOC(nBuckets * sizeof(struct ylist_head));
+		dev->srCacheFlushList = YMALLOC(dev->nShortOpCaches *
+						sizeof(yaffs_ChunkCache *));
 
 		buf = (__u8 *) dev->srCache;
+		if (!dev->srCacheHash || !dev->srCacheFlushList)
+			buf = NULL;
 
 		if (dev->srCache)
 			memset(dev->srCache, 0, srCacheBytes);
 
+		for (i = 0; i < nBuckets && buf; i++)
+			YINIT_LIST_HEAD(&dev->srCacheHash[i]);
+
 		for (i = 0; i < dev->nShortOpCaches && buf; i++) {
+			YINIT_LIST_HEAD(&dev->srCache[i].hashLink);
 			dev->srCache[i].object = NULL;
 			dev->srCache[i].lastUse = 0;
+			dev->srCache[i].prevUse = 0;
 			dev->srCache[i].dirty = 0;
 			dev->srCache[i].data = buf = YMALLOC_DMA(dev->totalBytesPerChunk);
 		}
@@ -7341,6 +7933,8 @@ int yaffs_GutsInitialise(yaffs_Device *dev)
 	}
 
 	dev->cacheHits = 0;
+	dev->cacheCoalescedWrites = 0;
+	dev->cacheChunkWrites = 0;
 
 	if (!init_failed) {
 		dev->gcCleanupList = YMALLOC(dev->nChunksPerBlock * sizeof(__u32));
@@ -7348,6 +7942,9 @@ int yaffs_GutsInitialise(yaffs_Device *dev)
 			init_failed = 1;
 	}
 
+	if (!init_failed && !yaffs_SummaryInitialise(dev))
+		init_failed = 1;
+
 	if (dev->isYaffs2)
 		dev->useHeaderFileSize = 1;
 
@@ -7459,8 +8056,15 @@ void yaffs_Deinitialise(yaffs_Device *dev)
 			YFREE(dev->srCache);
 			dev->srCache = NULL;
 		}
+		if (dev->srCacheHash)
+			YFREE(dev->srCacheHash);
+		dev->srCacheHash = NULL;
+		if (dev->srCacheFlushList)
+			YFREE(dev->srCacheFlushList);
+		dev->srCacheFlushList = NULL;
 
 		YFREE(dev->gcCleanupList);
+		yaffs_SummaryDeinitialise(dev);
 
 		for (i = 0; i < YAFFS_N_TEMP_BUFFERS; i++)
 			YFREE(dev->tempBuffer[i].buffer);
@@ -7490,7 +8094,7 @@ static int yaffs_CountFreeChunks(yaffs_Device *dev)
 		case YAFFS_BLOCK_STATE_FULL:
 			nFree +=
 			    (dev->nChunksPerBlock - blk->pagesInUse +
-			     blk->softDeletions);
+			     blk->softDeletions - blk->hasSummary);
 			break;
 		default:
 			break;
@@ -7542,6 +8146,32 @@ int yaffs_GetNumberOfFreeChunks(yaffs_Device *dev)
 
 }
 
+void yaffs_GetEraseCounts(yaffs_Device *dev, __u32 *minCount,
+			__u32 *maxCount, __u32 *avgCount)
+{
+	yaffs_BlockInfo *bi;
+	__u32 total = 0;
+	int nBlocks = 0;
+	int b;
+
+	*minCount = 0;
+	*maxCount = 0;
+
+	for (b = dev->internalStartBlock; b <= dev->internalEndBlock; b++) {
+		bi = yaffs_GetBlockInfo(dev, b);
+		if (bi->blockState == YAFFS_BLOCK_STATE_DEAD)
+			continue;
+		if (!nBlocks || bi->eraseCount < *minCount)
+			*minCount = bi->eraseCount;
+		if (bi->eraseCount > *maxCount)
+			*maxCount = bi->eraseCount;
+		total += bi->eraseCount;
+		nBlocks++;
+	}
+
+	*avgCount = nBlocks ? total / nBlocks : 0;
+}
+
 static int yaffs_freeVerificationFailures;
 
 static void yaffs_VerifyFreeChunks(yaffs_Device *dev)
@@ -7585,6 +8215,9 @@ static int yaffs_CheckStructures(void)
 #endif
 #ifndef CONFIG_YAFFS_WINCE
 	yaffs_CheckStruct(yaffs_ObjectHeader, 512, "yaffs_ObjectHeader");
+#endif
+#ifdef CONFIG_YAFFS_YAFFS2
+	yaffs_CheckStruct(yaffs_BlockInfo, 12, "yaffs_BlockInfo");
 #endif
 	return YAFFS_OK;
 }
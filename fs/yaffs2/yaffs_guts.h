@@ -63,7 +63,12 @@
 
 #define YAFFS_OBJECT_SPACE		0x40000
 
-#define YAFFS_CHECKPOINT_VERSION 	3
+#define YAFFS_CHECKPOINT_VERSION 	5
+
+/* Or'ed into the checkpoint version when everything after the head
+ * validity marker is lzo compressed.
+ */
+#define YAFFS_CHECKPOINT_LZO		0x100
 
 #ifdef CONFIG_YAFFS_UNICODE
 #define YAFFS_MAX_NAME_LENGTH		127
@@ -86,11 +91,17 @@
 #define YAFFS_OBJECTID_CHECKPOINT_DATA	0x20
 #define YAFFS_SEQUENCE_CHECKPOINT_DATA  0x21
 
+/* Pseudo object id for block summary chunks */
+#define YAFFS_OBJECTID_SUMMARY		0x11
+
 /* */
 
-#define YAFFS_MAX_SHORT_OP_CACHES	20
+#define YAFFS_MAX_SHORT_OP_CACHES	256
+
+#define YAFFS_N_TEMP_BUFFERS		8
 
-#define YAFFS_N_TEMP_BUFFERS		6
+/* Most chunks fetched from NAND with one multi-chunk read */
+#define YAFFS_MAX_CHUNK_RUN		32
 
 /* We limit the number attempts at sucessfully saving a chunk of data.
  * Small-page devices have 32 pages per block; large-page devices have 64.
@@ -111,11 +122,16 @@
 /* Special sequence number for bad block that failed to be marked bad */
 #define YAFFS_SEQUENCE_BAD_BLOCK	0xFFFF0000
 
-/* ChunkCache is used for short read/write operations.*/
+/* ChunkCache is used for short read/write operations.
+ * Entries in use are hashed on (object, chunkId). Replacement is LRU-2:
+ * the entry whose second most recent use is oldest goes first.
+ */
 typedef struct {
+	struct ylist_head hashLink;
 	struct yaffs_ObjectStruct *object;
 	int chunkId;
 	int lastUse;
+	int prevUse;		/* Use before lastUse, 0 if used only once */
 	int dirty;
 	int nBytes;		/* Only valid if the cache is dirty */
 	int locked;		/* Can't push out or flush while locked. */
@@ -152,6 +168,13 @@ typedef union {
 
 /* Stuff used for extended tags in YAFFS2 */
 
+/* Tags of one chunk as recorded in a block summary */
+typedef struct {
+	__u32 objectId;
+	__u32 chunkId;
+	__u32 byteCount;
+} yaffs_SummaryTags;
+
 typedef enum {
 	YAFFS_ECC_RESULT_UNKNOWN,
 	YAFFS_ECC_RESULT_NO_ERROR,
@@ -289,8 +312,13 @@ typedef struct {
 
 #ifdef CONFIG_YAFFS_YAFFS2
 	__u32 hasShrinkHeader:1; /* This block has at least one shrink object header */
+	__u32 hasSummary:1;	/* The last chunk is taken by a block summary */
 	__u32 sequenceNumber;	 /* block sequence number for yaffs2 */
 #endif
+	/* Kept after the bitfields so that they all share one word: block
+	 * info is held in RAM for every block and saved in the checkpoint.
+	 */
+	__u32 eraseCount;	/* Erasures seen, as far as we know */
 
 } yaffs_BlockInfo;
 
@@ -424,6 +452,7 @@ struct yaffs_ObjectStruct {
 				 * until the inode is released.
 				 */
 	__u8 beingCreated:1;	/* This object is still being created so skip some checks. */
+	__u8 deferredHeader:1;	/* Header rewrite put off, see deferHeaders */
 
 	__u8 serial;		/* serial number of chunk in NAND. Cached here */
 	__u16 sum;		/* sum of the name to speed searching */
@@ -434,6 +463,8 @@ struct yaffs_ObjectStruct {
 
 	struct ylist_head hardLinks;    /* all the equivalent hard linked objects */
 
+	struct ylist_head deferredLink; /* on dev->deferredHeaders if deferredHeader */
+
 	/* directory structure stuff */
 	/* also used for linking up the free list */
 	struct yaffs_ObjectStruct *parent;
@@ -589,6 +620,14 @@ struct yaffs_DeviceStruct {
 	int (*markNANDBlockBad) (struct yaffs_DeviceStruct *dev, int blockNo);
 	int (*queryNANDBlock) (struct yaffs_DeviceStruct *dev, int blockNo,
 			       yaffs_BlockState *state, __u32 *sequenceNumber);
+	/* Optional. Reads the data of nChunks consecutive chunks and, if
+	 * tags is not NULL, their tags into tags[0..nChunks-1]. Returns
+	 * YAFFS_FAIL on any ECC trouble so the chunks get re-read one at a
+	 * time.
+	 */
+	int (*readChunksFromNAND) (struct yaffs_DeviceStruct *dev,
+				   int chunkInNAND, int nChunks, __u8 *data,
+				   yaffs_ExtendedTags *tags);
 #endif
 
 	int isYaffs2;
@@ -604,6 +643,12 @@ struct yaffs_DeviceStruct {
 
 	int wideTnodesDisabled; /* Set to disable wide tnodes */
 
+	int blockSummary;	/* Set to write a summary chunk at the end of
+				 * each block. yaffs2 only.
+				 */
+
+	int checkpointCompress;	/* Set to lzo compress checkpoints */
+
 	YCHAR *pathDividers;	/* String of legal path dividers */
 
 
@@ -613,6 +658,20 @@ struct yaffs_DeviceStruct {
 	__u8 skipCheckpointRead;
 	__u8 skipCheckpointWrite;
 
+	/* Background GC control. Can be set before or after initialisation.
+	 * When bgGCEnabled the OS layer calls yaffs_BackgroundGarbageCollect()
+	 * while the device is idle, and foreground writes leave passive GC
+	 * to it.
+	 */
+	int bgGCEnabled;
+	int bgGCSpareBlocks;	/* Erased blocks to keep beyond the GC trigger */
+
+	/* Set to put off object header rewrites that only record times and
+	 * sizes (close, directory updates) until yaffs_FlushDeferredHeaders().
+	 * The OS layer must then call that periodically and on sync.
+	 */
+	int deferHeaders;
+
 	/* Runtime parameters. Set up by YAFFS. */
 
 	__u16 chunkGroupBits;	/* 0 for devices <= 32MB. else log2(nchunks) - 16 */
@@ -634,7 +693,19 @@ struct yaffs_DeviceStruct {
 #ifdef __KERNEL__
 
 	struct semaphore sem;	/* Semaphore for waiting on erasure.*/
-	struct semaphore grossLock;	/* Gross locking semaphore */
+	struct rw_semaphore grossLock;	/* Shared by readers, exclusive otherwise */
+	spinlock_t stateLock;	/* Device state readers modify under a shared
+				 * grossLock: temp buffers, cache LRU stamps,
+				 * chunk error strikes.
+				 */
+	struct mutex lazyLoadLock;	/* Serialises lazy loading of headers */
+	struct task_struct *bgGCThread;	/* Background GC, if running */
+	int noBackgroundGC;	/* Mounted with no-bg-gc */
+	int noDeferredHeaders;	/* Mounted with no-deferred-headers */
+	__u8 *readAheadBuffer;	/* Bounce buffer for readpages */
+	struct mutex readAheadLock;
+	unsigned long lastForegroundWrite;	/* jiffies */
+	unsigned long deferredHeadersSeen;	/* jiffies */
 	__u8 *spareBuffer;	/* For mtdif2 use. Don't know the size of the buffer
 				 * at compile time so we have to allocate it.
 				 */
@@ -667,6 +738,19 @@ struct yaffs_DeviceStruct {
 	int checkpointMaxBlocks;
 	__u32 checkpointSum;
 	__u32 checkpointXor;
+	__u32 checkpointVersion;	/* Of the checkpoint being read */
+	__u8 *checkpointReadahead;	/* Chunks read ahead in the block */
+	yaffs_ExtendedTags *checkpointReadaheadTags;	/* and their tags */
+	int checkpointReadaheadChunks;
+	int checkpointReadaheadOffset;
+	int checkpointLzo;		/* Stream is being (de)compressed */
+	__u8 *checkpointLzoBuffer;	/* Uncompressed frame */
+	__u8 *checkpointLzoStored;	/* Compressed frame */
+	void *checkpointLzoWork;
+	int checkpointLzoOffset;
+	int checkpointLzoBytes;
+	int checkpointBytes;		/* Size of the last checkpoint... */
+	int checkpointStoredBytes;	/* ... and what it took in NAND */
 
 	int nCheckpointBlocksRequired; /* Number of blocks needed to store current checkpoint set */
 
@@ -704,6 +788,8 @@ struct yaffs_DeviceStruct {
 
 	yaffs_ObjectBucket objectBucket[YAFFS_NOBJECT_BUCKETS];
 
+	struct ylist_head deferredHeaders;	/* Objects with deferredHeader set */
+
 	int nFreeChunks;
 
 	int currentDirtyChecker;	/* Used to find current dirtiest block */
@@ -711,14 +797,24 @@ struct yaffs_DeviceStruct {
 	__u32 *gcCleanupList;	/* objects to delete at the end of a GC. */
 	int nonAggressiveSkip;	/* GC state/mode */
 
+	/* Block summary of the allocation block, built up as it is written */
+	yaffs_SummaryTags *sumTags;
+	int sumBlock;		/* Block being summarised, -1 if none */
+
 	/* Statistcs */
 	int nPageWrites;
 	int nPageReads;
+	int nMultiChunkReads;	/* Requests covering more than one chunk */
+	int nMultiChunkReadChunks;
 	int nBlockErasures;
 	int nErasureFailures;
 	int nGCCopies;
 	int garbageCollections;
 	int passiveGarbageCollections;
+	int bgGarbageCollections;	/* Background GC steps */
+	int bgGCCopies;
+	int fgGCStalls;		/* Writes that had to collect a block */
+	int fgGCCopies;
 	int nRetriedWrites;
 	int nRetiredBlocks;
 	int eccFixed;
@@ -727,6 +823,13 @@ struct yaffs_DeviceStruct {
 	int tagsEccUnfixed;
 	int nDeletions;
 	int nUnmarkedDeletions;
+	int nSummariesWritten;
+	int nHotAllocBlocks;	/* Allocation blocks opened for new data */
+	int nColdAllocBlocks;	/* ... and for data relocated by GC */
+	int nSummaryScans;	/* Blocks scanned from their summary */
+	int nDeferredHeaders;	/* Objects with deferredHeader set */
+	int nHeaderWrites;	/* Object headers written */
+	int nHeadersCoalesced;	/* Header rewrites saved by deferring */
 
 	int hasPendingPrioritisedGCs; /* We think this device might have pending prioritised gcs */
 
@@ -743,9 +846,14 @@ struct yaffs_DeviceStruct {
 	int doingBufferedBlockRewrite;
 
 	yaffs_ChunkCache *srCache;
+	struct ylist_head *srCacheHash;
+	__u32 srCacheHashMask;
+	yaffs_ChunkCache **srCacheFlushList;	/* Scratch for cache flushes */
 	int srLastUse;
 
 	int cacheHits;
+	int cacheCoalescedWrites;	/* Writes into an already dirty chunk */
+	int cacheChunkWrites;	/* Chunks written out from the cache */
 
 	/* Stuff for background deletion and unlinked files.*/
 	yaffs_Object *unlinkedDir;	/* Directory where unlinked and deleted files live. */
@@ -771,6 +879,25 @@ struct yaffs_DeviceStruct {
 
 typedef struct yaffs_DeviceStruct yaffs_Device;
 
+/*
+ * Readers (readpage, lookup, readdir, readlink) run with grossLock held
+ * shared, so anything they modify in the device needs one of these.
+ * Everything that allocates chunks, runs GC or changes the tree holds
+ * grossLock exclusive and does not need them, but takes them anyway when
+ * it shares code with the readers.
+ */
+#ifdef __KERNEL__
+#define yaffs_LockState(dev)		spin_lock(&(dev)->stateLock)
+#define yaffs_UnlockState(dev)		spin_unlock(&(dev)->stateLock)
+#define yaffs_LockLazyLoad(dev)		mutex_lock(&(dev)->lazyLoadLock)
+#define yaffs_UnlockLazyLoad(dev)	mutex_unlock(&(dev)->lazyLoadLock)
+#else
+#define yaffs_LockState(dev)		do { } while (0)
+#define yaffs_UnlockState(dev)		do { } while (0)
+#define yaffs_LockLazyLoad(dev)		do { } while (0)
+#define yaffs_UnlockLazyLoad(dev)	do { } while (0)
+#endif
+
 /* The static layout of block usage etc is stored in the super block header */
 typedef struct {
 	int StructType;
@@ -817,6 +944,10 @@ int yaffs_GutsInitialise(yaffs_Device *dev);
 void yaffs_Deinitialise(yaffs_Device *dev);
 
 int yaffs_GetNumberOfFreeChunks(yaffs_Device *dev);
+void yaffs_GetEraseCounts(yaffs_Device *dev, __u32 *minCount,
+			__u32 *maxCount, __u32 *avgCount);
+
+int yaffs_BackgroundGarbageCollect(yaffs_Device *dev);
 
 int yaffs_RenameObject(yaffs_Object *oldDir, const YCHAR *oldName,
 		       yaffs_Object *newDir, const YCHAR *newName);
@@ -843,6 +974,8 @@ int yaffs_ResizeFile(yaffs_Object *obj, loff_t newSize);
 yaffs_Object *yaffs_MknodFile(yaffs_Object *parent, const YCHAR *name,
 				__u32 mode, __u32 uid, __u32 gid);
 int yaffs_FlushFile(yaffs_Object *obj, int updateTime);
+void yaffs_DeferFlushFile(yaffs_Object *obj);
+void yaffs_FlushDeferredHeaders(yaffs_Device *dev);
 
 /* Flushing and checkpointing */
 void yaffs_FlushEntireDeviceCache(yaffs_Device *dev);
@@ -109,6 +109,7 @@ int nandmtd2_ReadChunkWithTagsFromNAND(yaffs_Device *dev, int chunkInNAND,
 	size_t dummy;
 	int retval = 0;
 	int localData = 0;
+	__u8 *spare = NULL;
 
 	loff_t addr = ((loff_t) chunkInNAND) * dev->totalBytesPerChunk;
 
@@ -127,6 +128,11 @@ int nandmtd2_ReadChunkWithTagsFromNAND(yaffs_Device *dev, int chunkInNAND,
 		}
 
 
+	} else if (tags) {
+		/* Readers can be in here concurrently, so no dev->spareBuffer.
+		 * Temp buffers are big enough for the oob and safe to DMA to.
+		 */
+		spare = yaffs_GetTempBuffer(dev, __LINE__);
 	}
 
 
@@ -140,14 +146,14 @@ int nandmtd2_ReadChunkWithTagsFromNAND(yaffs_Device *dev, int chunkInNAND,
 		ops.len = data ? dev->nDataBytesPerChunk : sizeof(pt);
 		ops.ooboffs = 0;
 		ops.datbuf = data;
-		ops.oobbuf = dev->spareBuffer;
+		ops.oobbuf = spare;
 		retval = mtd->read_oob(mtd, addr, &ops);
 	}
 #else
 	if (!dev->inbandTags && data && tags) {
 
 		retval = mtd->read_ecc(mtd, addr, dev->nDataBytesPerChunk,
-					  &dummy, data, dev->spareBuffer,
+					  &dummy, data, spare,
 					  NULL);
 	} else {
 		if (data)
@@ -157,7 +163,7 @@ int nandmtd2_ReadChunkWithTagsFromNAND(yaffs_Device *dev, int chunkInNAND,
 		if (!dev->inbandTags && tags)
 			retval =
 			    mtd->read_oob(mtd, addr, mtd->oobsize, &dummy,
-					  dev->spareBuffer);
+					  spare);
 	}
 #endif
 
@@ -170,13 +176,15 @@ int nandmtd2_ReadChunkWithTagsFromNAND(yaffs_Device *dev, int chunkInNAND,
 		}
 	} else {
 		if (tags) {
-			memcpy(&pt, dev->spareBuffer, sizeof(pt));
+			memcpy(&pt, spare, sizeof(pt));
 			yaffs_UnpackTags2(tags, &pt);
 		}
 	}
 
 	if (localData)
 		yaffs_ReleaseTempBuffer(dev, data, __LINE__);
+	if (spare)
+		yaffs_ReleaseTempBuffer(dev, spare, __LINE__);
 
 	if (tags && retval == -EBADMSG && tags->eccResult == YAFFS_ECC_RESULT_NO_ERROR) {
 		tags->eccResult = YAFFS_ECC_RESULT_UNFIXED;
@@ -192,6 +200,71 @@ int nandmtd2_ReadChunkWithTagsFromNAND(yaffs_Device *dev, int chunkInNAND,
 		return YAFFS_FAIL;
 }
 
+/*
+ * One MTD read for a run of chunks, so the driver can stream the pages
+ * instead of being asked for them one command at a time.  Only used
+ * without inband tags, where the data of consecutive chunks is
+ * contiguous in the MTD address space.  With tags, the oob of each page
+ * comes back as the oobavail bytes of it that hold the packed tags.
+ */
+int nandmtd2_ReadChunksFromNAND(yaffs_Device *dev, int chunkInNAND,
+				int nChunks, __u8 *data,
+				yaffs_ExtendedTags *tags)
+{
+	struct mtd_info *mtd = (struct mtd_info *)(dev->genericDevice);
+#if (MTD_VERSION_CODE > MTD_VERSION(2, 6, 17))
+	struct mtd_oob_ops ops;
+	yaffs_PackedTags2 pt;
+	__u8 *spare;
+	int i;
+#endif
+	loff_t addr = ((loff_t) chunkInNAND) * dev->totalBytesPerChunk;
+	size_t len = nChunks * dev->nDataBytesPerChunk;
+	size_t retlen = 0;
+	int retval;
+
+	T(YAFFS_TRACE_MTD,
+	  (TSTR("nandmtd2_ReadChunksFromNAND chunk %d n %d data %p tags %p"
+		TENDSTR), chunkInNAND, nChunks, data, tags));
+
+	if (!tags) {
+		retval = mtd->read(mtd, addr, len, &retlen, data);
+	} else {
+#if (MTD_VERSION_CODE > MTD_VERSION(2, 6, 17))
+		if (mtd->oobavail < sizeof(pt) ||
+		    nChunks * mtd->oobavail > dev->nDataBytesPerChunk)
+			return YAFFS_FAIL;
+
+		/* Temp buffers are safe to DMA to, as for single reads */
+		spare = yaffs_GetTempBuffer(dev, __LINE__);
+
+		ops.mode = MTD_OOB_AUTO;
+		ops.len = len;
+		ops.ooblen = nChunks * mtd->oobavail;
+		ops.ooboffs = 0;
+		ops.datbuf = data;
+		ops.oobbuf = spare;
+		retval = mtd->read_oob(mtd, addr, &ops);
+		retlen = ops.retlen;
+
+		for (i = 0; retval == 0 && i < nChunks; i++) {
+			memcpy(&pt, spare + i * mtd->oobavail, sizeof(pt));
+			yaffs_UnpackTags2(&tags[i], &pt);
+		}
+
+		yaffs_ReleaseTempBuffer(dev, spare, __LINE__);
+#else
+		return YAFFS_FAIL;
+#endif
+	}
+
+	/* -EUCLEAN too: let the single reads mark the block for GC */
+	if (retval == 0 && retlen == len)
+		return YAFFS_OK;
+	else
+		return YAFFS_FAIL;
+}
+
 int nandmtd2_MarkNANDBlockBad(struct yaffs_DeviceStruct *dev, int blockNo)
 {
 	struct mtd_info *mtd = (struct mtd_info *)(dev->genericDevice);
@@ -53,6 +53,41 @@ int yaffs_ReadChunkWithTagsFromNAND(yaffs_Device *dev, int chunkInNAND,
 	return result;
 }
 
+/*
+ * Read the data of a run of consecutive chunks, and their tags into
+ * tags[0..nChunks-1] if tags is not NULL.  Falls back to one chunk at a
+ * time if the driver can't do runs or the run read hit ECC trouble, so
+ * that errors are still accounted to the right block and show up in the
+ * tags of the chunk they hit.
+ */
+int yaffs_ReadChunksFromNAND(yaffs_Device *dev, int chunkInNAND,
+				int nChunks, __u8 *buffer,
+				yaffs_ExtendedTags *tags)
+{
+	int i;
+
+	if (nChunks > 1 && dev->readChunksFromNAND) {
+		dev->nPageReads += nChunks;
+		dev->nMultiChunkReads++;
+		dev->nMultiChunkReadChunks += nChunks;
+
+		if (dev->readChunksFromNAND(dev, chunkInNAND - dev->chunkOffset,
+					nChunks, buffer, tags) == YAFFS_OK)
+			return YAFFS_OK;
+
+		T(YAFFS_TRACE_NANDACCESS,
+		  (TSTR("Run read of %d chunks at %d failed, retrying singly"
+			TENDSTR), nChunks, chunkInNAND));
+	}
+
+	for (i = 0; i < nChunks; i++)
+		yaffs_ReadChunkWithTagsFromNAND(dev, chunkInNAND + i,
+				buffer + i * dev->nDataBytesPerChunk,
+				tags ? &tags[i] : NULL);
+
+	return YAFFS_OK;
+}
+
 int yaffs_WriteChunkWithTagsToNAND(yaffs_Device *dev,
 						   int chunkInNAND,
 						   const __u8 *buffer,
@@ -122,6 +157,8 @@ int yaffs_EraseBlockInNAND(struct yaffs_DeviceStruct *dev,
 {
 	int result;
 
+	yaffs_GetBlockInfo(dev, blockInNAND)->eraseCount++;
+
 	blockInNAND -= dev->blockOffset;
 
 	dev->nBlockErasures++;
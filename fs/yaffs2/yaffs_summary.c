@@ -0,0 +1,266 @@
+/*
+ * YAFFS: Yet Another Flash File System. A NAND-flash specific file system.
+ *
+ * Copyright (C) 2002-2007 Aleph One Ltd.
+ *   for Toby Churchill Ltd and Brightstar Engineering
+ *
+ * Created by Charles Manning <charles@aleph1.co.uk>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+const char *yaffs_summary_c_version =
+	"$Id$";
+
+
+#include "yaffs_summary.h"
+#include "yaffs_packedtags2.h"
+#include "yaffs_nand.h"
+#include "yaffs_getblockinfo.h"
+
+static __u32 yaffs_SummaryChecksum(const yaffs_SummaryHeader *hdr,
+				const yaffs_SummaryTags *st)
+{
+	const __u32 *p = (const __u32 *)st;
+	int nWords = hdr->nEntries * sizeof(yaffs_SummaryTags) / sizeof(__u32);
+	__u32 sum;
+	int i;
+
+	sum = hdr->magic ^ hdr->version ^ hdr->block ^ hdr->sequenceNumber ^
+		hdr->eraseCount;
+	for (i = 0; i < nWords; i++)
+		sum = ((sum << 1) | (sum >> 31)) + p[i];
+
+	return sum;
+}
+
+int yaffs_SummaryInitialise(yaffs_Device *dev)
+{
+	int nBytes = sizeof(yaffs_SummaryHeader) +
+			(dev->nChunksPerBlock - 1) * sizeof(yaffs_SummaryTags);
+
+	dev->sumTags = NULL;
+	dev->sumBlock = -1;
+
+	if (!dev->isYaffs2)
+		dev->blockSummary = 0;
+
+	if (!dev->blockSummary)
+		return YAFFS_OK;
+
+	if (nBytes > dev->nDataBytesPerChunk) {
+		T(YAFFS_TRACE_ALWAYS,
+		  (TSTR("yaffs: block summary does not fit in a chunk, disabled"
+			TENDSTR)));
+		dev->blockSummary = 0;
+		return YAFFS_OK;
+	}
+
+	dev->sumTags = YMALLOC(dev->nChunksPerBlock * sizeof(yaffs_SummaryTags));
+
+	return dev->sumTags ? YAFFS_OK : YAFFS_FAIL;
+}
+
+void yaffs_SummaryDeinitialise(yaffs_Device *dev)
+{
+	if (dev->sumTags)
+		YFREE(dev->sumTags);
+	dev->sumTags = NULL;
+	dev->sumBlock = -1;
+}
+
+int yaffs_SummaryChunksReserved(yaffs_Device *dev, int blockInNAND)
+{
+	return (dev->sumTags && blockInNAND == dev->sumBlock) ? 1 : 0;
+}
+
+/*
+ * Called when allocation starts on a fresh block. A block we start on part
+ * way through (after a mount) has no record of its earlier chunks, so it
+ * gets no summary and allocation uses all of it.
+ */
+void yaffs_SummaryStartBlock(yaffs_Device *dev, int blockInNAND)
+{
+	if (!dev->sumTags)
+		return;
+
+	memset(dev->sumTags, 0xff,
+		dev->nChunksPerBlock * sizeof(yaffs_SummaryTags));
+	dev->sumBlock = blockInNAND;
+}
+
+static void yaffs_SummaryWrite(yaffs_Device *dev, int blockInNAND)
+{
+	yaffs_BlockInfo *bi = yaffs_GetBlockInfo(dev, blockInNAND);
+	yaffs_SummaryHeader *hdr;
+	yaffs_ExtendedTags tags;
+	int nEntries = dev->nChunksPerBlock - 1;
+	int chunk = blockInNAND * dev->nChunksPerBlock + nEntries;
+	__u8 *buffer;
+
+	/* Chunk writes are stamped with the current sequence number */
+	if (bi->sequenceNumber != dev->sequenceNumber)
+		return;
+
+	buffer = yaffs_GetTempBuffer(dev, __LINE__);
+	memset(buffer, 0xff, dev->nDataBytesPerChunk);
+
+	hdr = (yaffs_SummaryHeader *)buffer;
+	hdr->magic = YAFFS_SUMMARY_MAGIC;
+	hdr->version = YAFFS_SUMMARY_VERSION;
+	hdr->block = blockInNAND;
+	hdr->sequenceNumber = bi->sequenceNumber;
+	hdr->nEntries = nEntries;
+	hdr->eraseCount = bi->eraseCount;
+	hdr->checksum = yaffs_SummaryChecksum(hdr, dev->sumTags);
+	memcpy(buffer + sizeof(yaffs_SummaryHeader), dev->sumTags,
+		nEntries * sizeof(yaffs_SummaryTags));
+
+	yaffs_InitialiseTags(&tags);
+	tags.objectId = YAFFS_OBJECTID_SUMMARY;
+	tags.chunkId = 1;
+	tags.byteCount = sizeof(yaffs_SummaryHeader) +
+			nEntries * sizeof(yaffs_SummaryTags);
+
+	if (yaffs_WriteChunkWithTagsToNAND(dev, chunk, buffer, &tags) ==
+		YAFFS_OK) {
+		dev->nSummariesWritten++;
+	} else {
+		/* The block will be scanned chunk by chunk instead */
+		T(YAFFS_TRACE_ERROR,
+		  (TSTR("**>> yaffs summary write failed in block %d" TENDSTR),
+		   blockInNAND));
+		yaffs_HandleChunkError(dev, bi);
+	}
+
+	yaffs_ReleaseTempBuffer(dev, buffer, __LINE__);
+}
+
+/* Write out the summary once the last data chunk of the block is done */
+static void yaffs_SummaryChunkDone(yaffs_Device *dev, int chunkInNAND)
+{
+	int blockInNAND = chunkInNAND / dev->nChunksPerBlock;
+
+	if (chunkInNAND % dev->nChunksPerBlock == dev->nChunksPerBlock - 2) {
+		yaffs_SummaryWrite(dev, blockInNAND);
+		dev->sumBlock = -1;
+	}
+}
+
+/* Record the tags of a chunk that has just been written */
+void yaffs_SummaryAdd(yaffs_Device *dev, int chunkInNAND,
+			const yaffs_ExtendedTags *tags)
+{
+	int blockInNAND = chunkInNAND / dev->nChunksPerBlock;
+	int chunkInBlock = chunkInNAND % dev->nChunksPerBlock;
+	yaffs_PackedTags2TagsPart pt;
+	yaffs_SummaryTags *st;
+
+	if (!dev->sumTags || blockInNAND != dev->sumBlock)
+		return;
+
+	yaffs_PackTags2TagsPart(&pt, tags);
+	st = &dev->sumTags[chunkInBlock];
+	st->objectId = pt.objectId;
+	st->chunkId = pt.chunkId;
+	st->byteCount = pt.byteCount;
+
+	yaffs_SummaryChunkDone(dev, chunkInNAND);
+}
+
+/*
+ * Record a chunk that was allocated but given up on by a write retry as
+ * garbage, rather than leave it looking unwritten.
+ */
+void yaffs_SummarySkip(yaffs_Device *dev, int chunkInNAND)
+{
+	int blockInNAND = chunkInNAND / dev->nChunksPerBlock;
+	yaffs_SummaryTags *st;
+
+	if (!dev->sumTags || blockInNAND != dev->sumBlock)
+		return;
+
+	st = &dev->sumTags[chunkInNAND % dev->nChunksPerBlock];
+	st->objectId = YAFFS_OBJECTID_SUMMARY;
+	st->chunkId = 1;
+	st->byteCount = 0;
+
+	yaffs_SummaryChunkDone(dev, chunkInNAND);
+}
+
+/*
+ * Read the summary of a block into st, which must have room for
+ * nChunksPerBlock entries. Fails if the block has no summary or the
+ * summary is not for this instance of the block. Also picks up the
+ * block's erase count, which a scan has no other way of knowing.
+ */
+int yaffs_SummaryRead(yaffs_Device *dev, int blockInNAND,
+			__u32 sequenceNumber, yaffs_SummaryTags *st)
+{
+	yaffs_SummaryHeader *hdr;
+	yaffs_ExtendedTags tags;
+	int nEntries = dev->nChunksPerBlock - 1;
+	int chunk = blockInNAND * dev->nChunksPerBlock + nEntries;
+	int nBytes = sizeof(yaffs_SummaryHeader) +
+			nEntries * sizeof(yaffs_SummaryTags);
+	int retval = YAFFS_FAIL;
+	__u8 *buffer;
+
+	if (nBytes > dev->nDataBytesPerChunk)
+		return YAFFS_FAIL;
+
+	buffer = yaffs_GetTempBuffer(dev, __LINE__);
+	yaffs_ReadChunkWithTagsFromNAND(dev, chunk, buffer, &tags);
+
+	hdr = (yaffs_SummaryHeader *)buffer;
+	if (tags.chunkUsed &&
+	    tags.eccResult <= YAFFS_ECC_RESULT_FIXED &&
+	    tags.objectId == YAFFS_OBJECTID_SUMMARY &&
+	    hdr->magic == YAFFS_SUMMARY_MAGIC &&
+	    hdr->version == YAFFS_SUMMARY_VERSION &&
+	    hdr->block == blockInNAND &&
+	    hdr->sequenceNumber == sequenceNumber &&
+	    hdr->nEntries == nEntries) {
+		memcpy(st, buffer + sizeof(yaffs_SummaryHeader),
+			nEntries * sizeof(yaffs_SummaryTags));
+		if (hdr->checksum == yaffs_SummaryChecksum(hdr, st)) {
+			yaffs_GetBlockInfo(dev, blockInNAND)->eraseCount =
+				hdr->eraseCount;
+			retval = YAFFS_OK;
+		}
+	}
+
+	yaffs_ReleaseTempBuffer(dev, buffer, __LINE__);
+
+	if (retval != YAFFS_OK)
+		T(YAFFS_TRACE_SCAN,
+		  (TSTR("Block %d summary invalid, scanning chunks" TENDSTR),
+		   blockInNAND));
+
+	return retval;
+}
+
+/* Rebuild the tags of a chunk from its summary entry */
+void yaffs_SummaryGetTags(yaffs_Device *dev, yaffs_SummaryTags *st,
+			int chunkInBlock, __u32 sequenceNumber,
+			yaffs_ExtendedTags *tags)
+{
+	yaffs_PackedTags2TagsPart pt;
+
+	pt.objectId = st[chunkInBlock].objectId;
+	pt.chunkId = st[chunkInBlock].chunkId;
+	pt.byteCount = st[chunkInBlock].byteCount;
+
+	/*
+	 * Entries of chunks that were never written are left as 0xff,
+	 * skipped chunks come back tagged YAFFS_OBJECTID_SUMMARY.
+	 */
+	if (pt.objectId == 0xFFFFFFFF)
+		pt.sequenceNumber = 0xFFFFFFFF;
+	else
+		pt.sequenceNumber = sequenceNumber;
+
+	yaffs_UnpackTags2TagsPart(tags, &pt);
+}
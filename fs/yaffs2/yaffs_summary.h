@@ -0,0 +1,67 @@
+/*
+ * YAFFS: Yet another Flash File System . A NAND-flash specific file system.
+ *
+ * Copyright (C) 2002-2007 Aleph One Ltd.
+ *   for Toby Churchill Ltd and Brightstar Engineering
+ *
+ * Created by Charles Manning <charles@aleph1.co.uk>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License version 2.1 as
+ * published by the Free Software Foundation.
+ *
+ * Note: Only YAFFS headers are LGPL, YAFFS C code is covered by GPL.
+ */
+
+#ifndef __YAFFS_SUMMARY_H__
+#define __YAFFS_SUMMARY_H__
+
+#include "yaffs_guts.h"
+
+/*
+ * Block summaries.
+ *
+ * When enabled, the last chunk of every block is reserved for a summary
+ * holding the tags of the other chunks in the block. It is written once the
+ * last data chunk of the block has been written, so a scan can read one
+ * chunk instead of the tags of the whole block.
+ *
+ * The summary chunk is tagged with YAFFS_OBJECTID_SUMMARY. It never holds
+ * live data, but it cannot be written again until the block is erased: the
+ * block's hasSummary flag keeps it out of nFreeChunks until then. Chunks
+ * skipped by a write retry are recorded in the summary with that object id
+ * too, so a scan takes them for garbage.
+ */
+
+#define YAFFS_SUMMARY_MAGIC	0x5953554d	/* "YSUM" */
+#define YAFFS_SUMMARY_VERSION	2
+
+typedef struct {
+	__u32 magic;
+	__u32 version;
+	__u32 block;
+	__u32 sequenceNumber;
+	__u32 nEntries;
+	__u32 eraseCount;	/* Of the block when it was written */
+	__u32 checksum;
+} yaffs_SummaryHeader;
+
+int yaffs_SummaryInitialise(yaffs_Device *dev);
+void yaffs_SummaryDeinitialise(yaffs_Device *dev);
+
+/* Chunks at the end of each block kept back for the summary: 0 or 1 */
+int yaffs_SummaryChunksReserved(yaffs_Device *dev, int blockInNAND);
+
+void yaffs_SummaryStartBlock(yaffs_Device *dev, int blockInNAND);
+void yaffs_SummaryAdd(yaffs_Device *dev, int chunkInNAND,
+			const yaffs_ExtendedTags *tags);
+void yaffs_SummarySkip(yaffs_Device *dev, int chunkInNAND);
+
+/* Scanning side */
+int yaffs_SummaryRead(yaffs_Device *dev, int blockInNAND,
+			__u32 sequenceNumber, yaffs_SummaryTags *st);
+void yaffs_SummaryGetTags(yaffs_Device *dev, yaffs_SummaryTags *st,
+			int chunkInBlock, __u32 sequenceNumber,
+			yaffs_ExtendedTags *tags);
+
+#endif
@@ -47,6 +47,9 @@
 #include <linux/string.h>
 #include <linux/slab.h>
 #include <linux/vmalloc.h>
+#include <linux/spinlock.h>
+#include <linux/mutex.h>
+#include <linux/rwsem.h>
 
 #define YCHAR char
 #define YUCHAR unsigned char
@@ -195,6 +195,10 @@ struct request {
 
 	struct gendisk *rq_disk;
 	unsigned long start_time;
+#ifdef CONFIG_BLK_DEV_LATENCY_HIST
+	u64 start_time_ns;
+	u64 io_start_time_ns;	/* when passed to the driver */
+#endif
 
 	/* Number of scatter-gather DMA addr+len pairs after
 	 * physical address coalescing is performed.
@@ -327,6 +331,39 @@ struct queue_limits {
 	unsigned char		no_cluster;
 };
 
+#ifdef CONFIG_BLK_DEV_LATENCY_HIST
+/* bucket i counts latencies below 2^i usecs, the last one everything above */
+#define BLK_LATENCY_BUCKETS	24
+
+struct blk_latency_hist {
+	unsigned long		queue[BLK_LATENCY_BUCKETS];	/* queued to issued */
+	unsigned long		device[BLK_LATENCY_BUCKETS];	/* issued to completed */
+};
+#endif
+
+#ifdef CONFIG_BLK_DEV_DISCARD_BATCH
+/* see block/blk-discard.c */
+struct blk_discard_batch {
+	spinlock_t		lock;
+	struct rb_root		ranges;		/* pending, non-adjacent ranges */
+	unsigned int		nr_ranges;
+	sector_t		nr_sectors;	/* sectors in the pending ranges */
+	unsigned int		max_kb;		/* backlog limit, 0 = disabled */
+	unsigned int		idle_msecs;
+	unsigned long		last_io;	/* jiffies of the last read/write */
+	struct block_device	*bdev;		/* whole disk, while non-empty */
+
+	/* the piece being submitted, writes to it are held on @deferred */
+	struct task_struct	*issuer;
+	sector_t		issue_start, issue_end;
+	struct bio		*deferred, *deferred_tail;
+	struct delayed_work	work;
+
+	unsigned long		queued, merged, issued;
+	unsigned long long	cancelled;	/* sectors rewritten while pending */
+};
+#endif
+
 struct request_queue
 {
 	/*
@@ -438,6 +475,13 @@ struct request_queue
 	int			node;
 #ifdef CONFIG_BLK_DEV_IO_TRACE
 	struct blk_trace	*blk_trace;
+#endif
+#ifdef CONFIG_BLK_DEV_LATENCY_HIST
+	/* one per data direction, protected by queue_lock */
+	struct blk_latency_hist	latency_hist[2];
+#endif
+#ifdef CONFIG_BLK_DEV_DISCARD_BATCH
+	struct blk_discard_batch discard_batch;
 #endif
 	/*
 	 * reserved for flush operations
@@ -983,6 +1027,14 @@ static inline int sb_issue_discard(struct super_block *sb,
 				    DISCARD_FL_BARRIER);
 }
 
+#ifdef CONFIG_BLK_DEV_DISCARD_BATCH
+extern void blk_discard_batch_flush(struct request_queue *q);
+#else
+static inline void blk_discard_batch_flush(struct request_queue *q)
+{
+}
+#endif
+
 extern int blk_verify_command(unsigned char *cmd, fmode_t has_write_perm);
 
 #define MAX_PHYS_SEGMENTS 128
@@ -1140,6 +1192,8 @@ static inline void put_dev_sector(Sector p)
 
 struct work_struct;
 int kblockd_schedule_work(struct request_queue *q, struct work_struct *work);
+int kblockd_schedule_delayed_work(struct request_queue *q,
+				  struct delayed_work *dwork, unsigned long delay);
 
 #define MODULE_ALIAS_BLOCKDEV(major,minor) \
 	MODULE_ALIAS("block-major-" __stringify(major) "-" __stringify(minor))
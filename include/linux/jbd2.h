@@ -648,6 +648,11 @@ struct transaction_s
 	 */
 	int t_handle_count;
 
+	/*
+	 * How many of them were synchronous (fsync)? [t_handle_lock]
+	 */
+	int t_sync_count;
+
 	/*
 	 * For use by the filesystem to store fs-specific data
 	 * structures associated with the transaction
@@ -663,6 +668,7 @@ struct transaction_run_stats_s {
 	unsigned long		rs_logging;
 
 	unsigned long		rs_handle_count;
+	unsigned long		rs_sync_count;
 	unsigned long		rs_blocks;
 	unsigned long		rs_blocks_logged;
 };
@@ -690,6 +696,10 @@ jbd2_time_diff(unsigned long start, unsigned long end)
 
 #define JBD2_NR_BATCH	64
 
+/* log2 buckets of the commit time (us) and sync handles per commit */
+#define JBD2_COMMIT_HIST_BUCKETS	20
+#define JBD2_BATCH_HIST_BUCKETS		8
+
 /**
  * struct journal_s - The journal_s type is the concrete type associated with
  *     journal_t.
@@ -751,12 +761,16 @@ jbd2_time_diff(unsigned long start, unsigned long end)
  * @j_wbufsize: maximum number of buffer_heads allowed in j_wbuf, the
  *	number that will fit in j_blocksize
  * @j_last_sync_writer: most recent pid which did a synchronous write
+ * @j_last_sync_time: when the last synchronous handle was closed
+ * @j_average_sync_interval: average time between synchronous handles
  * @j_history: Buffer storing the transactions statistics history
  * @j_history_max: Maximum number of transactions in the statistics history
  * @j_history_cur: Current number of transactions in the statistics history
  * @j_history_lock: Protect the transactions statistics history
  * @j_proc_entry: procfs entry for the jbd statistics directory
  * @j_stats: Overall statistics
+ * @j_commit_hist: Histogram of the commit times
+ * @j_batch_hist: Histogram of the synchronous handles per commit
  * @j_private: An opaque pointer to fs-private information.
  */
 
@@ -961,6 +975,14 @@ struct journal_s
 	 */
 	pid_t			j_last_sync_writer;
 
+	/*
+	 * when the last synchronous handle was closed, and the average time
+	 * in nanoseconds between two of them, to tell whether it is worth
+	 * waiting for more to join a transaction. [j_state_lock]
+	 */
+	ktime_t			j_last_sync_time;
+	u64			j_average_sync_interval;
+
 	/*
 	 * the average amount of time in nanoseconds it takes to commit a
 	 * transaction to disk. [j_state_lock]
@@ -991,6 +1013,8 @@ struct journal_s
 	spinlock_t		j_history_lock;
 	struct proc_dir_entry	*j_proc_entry;
 	struct transaction_stats_s j_stats;
+	unsigned long		j_commit_hist[JBD2_COMMIT_HIST_BUCKETS];
+	unsigned long		j_batch_hist[JBD2_BATCH_HIST_BUCKETS];
 
 	/* Failed journal commit ID */
 	unsigned int		j_failed_commit;
@@ -18,6 +18,7 @@
 #include <linux/blkdev.h>
 #include <linux/spinlock.h>
 #include <linux/mutex.h>
+#include <linux/rwsem.h>
 
 /* Possible states of device */
 enum {
@@ -27,6 +28,7 @@ enum {
 };
 
 struct loop_func_table;
+struct loop_extent;
 
 struct loop_device {
 	int		lo_number;
@@ -66,6 +68,14 @@ struct loop_device {
 	struct request_queue	*lo_queue;
 	struct gendisk		*lo_disk;
 	struct list_head	lo_list;
+
+	/* LO_FLAGS_BMAP: where the backing file is on its filesystem's bdev */
+	struct rw_semaphore	lo_map_sem;
+	struct loop_extent	*lo_extents;
+	int			lo_nr_extents;
+	struct block_device	*lo_map_bdev;
+	atomic_t		lo_map_inflight;	/* bios sent to it */
+	wait_queue_head_t	lo_map_wait;
 };
 
 #endif /* __KERNEL__ */
@@ -77,6 +87,7 @@ enum {
 	LO_FLAGS_READ_ONLY	= 1,
 	LO_FLAGS_USE_AOPS	= 2,
 	LO_FLAGS_AUTOCLEAR	= 4,
+	LO_FLAGS_BMAP		= 8,
 };
 
 #include <asm/posix_types.h>	/* for __kernel_old_dev_t */
@@ -0,0 +1,111 @@
+/*
+ * Per-task and global memory pressure statistics
+ *
+ * Released under the GPL, see the file COPYING for details.
+ */
+
+#ifndef _LINUX_MM_PRESSURE_H
+#define _LINUX_MM_PRESSURE_H
+
+#include <linux/sched.h>
+
+#ifdef CONFIG_MM_PRESSURE_STATS
+extern void __mm_pressure_account(struct task_mm_pressure *delta);
+
+static inline u64 mm_pressure_clock(void)
+{
+	return cpu_clock(raw_smp_processor_id());
+}
+
+/*
+ * The "start" helpers return a timestamp to be handed back to the
+ * matching "end" helper, so callers need no state of their own.
+ */
+static inline u64 mm_pressure_reclaim_start(void)
+{
+	return mm_pressure_clock();
+}
+
+static inline void mm_pressure_reclaim_end(u64 start)
+{
+	struct task_mm_pressure delta = {
+		.reclaim_delay = mm_pressure_clock() - start,
+		.reclaim_count = 1,
+	};
+
+	__mm_pressure_account(&delta);
+}
+
+static inline u64 mm_pressure_swapin_start(void)
+{
+	return mm_pressure_clock();
+}
+
+static inline void mm_pressure_swapin_end(u64 start)
+{
+	struct task_mm_pressure delta = {
+		.swapin_delay = mm_pressure_clock() - start,
+		.swapin_count = 1,
+		.refault_count = 1,
+	};
+
+	__mm_pressure_account(&delta);
+}
+
+static inline void mm_pressure_refault(void)
+{
+	struct task_mm_pressure delta = {
+		.refault_count = 1,
+	};
+
+	__mm_pressure_account(&delta);
+}
+
+static inline void task_mm_pressure_add(struct task_mm_pressure *dst,
+					struct task_mm_pressure *src)
+{
+	dst->reclaim_delay += src->reclaim_delay;
+	dst->reclaim_count += src->reclaim_count;
+	dst->swapin_delay += src->swapin_delay;
+	dst->swapin_count += src->swapin_count;
+	dst->refault_count += src->refault_count;
+}
+
+static inline void task_mm_pressure_init(struct task_mm_pressure *mmp)
+{
+	memset(mmp, 0, sizeof(*mmp));
+}
+#else
+static inline u64 mm_pressure_reclaim_start(void)
+{
+	return 0;
+}
+
+static inline void mm_pressure_reclaim_end(u64 start)
+{
+}
+
+static inline u64 mm_pressure_swapin_start(void)
+{
+	return 0;
+}
+
+static inline void mm_pressure_swapin_end(u64 start)
+{
+}
+
+static inline void mm_pressure_refault(void)
+{
+}
+
+static inline void task_mm_pressure_add(struct task_mm_pressure *dst,
+					struct task_mm_pressure *src)
+{
+}
+
+static inline void task_mm_pressure_init(struct task_mm_pressure *mmp)
+{
+}
+#endif /* CONFIG_MM_PRESSURE_STATS */
+
+#endif /* _LINUX_MM_PRESSURE_H */
@@ -51,6 +51,18 @@ struct mmc_ios {
 };
 
 struct mmc_host_ops {
+	/*
+	 * pre_req and post_req are optional.  pre_req is called for the
+	 * next request while the current one is still being transferred,
+	 * so that DMA mapping and cache maintenance can be done ahead of
+	 * time; is_first_req is set when nothing is in flight.  post_req
+	 * undoes that once the request has completed, or with err set if
+	 * it was never started.
+	 */
+	void	(*post_req)(struct mmc_host *host, struct mmc_request *req,
+			    int err);
+	void	(*pre_req)(struct mmc_host *host, struct mmc_request *req,
+			   bool is_first_req);
 	void	(*request)(struct mmc_host *host, struct mmc_request *req);
 	/*
 	 * Avoid calling these three functions too often or in a "fast path",
@@ -171,6 +183,8 @@ struct mmc_host {
 
 	struct dentry		*debugfs_root;
 
+	struct mmc_async_req	*areq;		/* active async req */
+
 #ifdef CONFIG_MMC_EMBEDDED_SDIO
 	struct {
 		struct sdio_cis			*cis;
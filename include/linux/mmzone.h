@@ -172,6 +172,12 @@ struct per_cpu_pages {
 	int high;		/* high watermark, emptying needed */
 	int batch;		/* chunk size for buddy add/remove */
 	struct list_head list;	/* the list of pages */
+
+	/* Burst adaptation: high and batch are base_* << scale */
+	int base_high;
+	int base_batch;
+	int scale;
+	unsigned long last_refill;	/* jiffies */
 };
 
 struct per_cpu_pageset {
@@ -359,6 +365,21 @@ struct zone {
 	 */
 	unsigned int inactive_ratio;
 
+	/*
+	 * Ticks whenever a file page leaves the inactive list, by eviction
+	 * or activation: the clock that refault distances are measured by.
+	 */
+	atomic_long_t inactive_age;
+
+#ifdef CONFIG_COMPACTION
+	/*
+	 * After compaction of this zone fails, the next
+	 * 1 << compact_defer_shift attempts are skipped; every failure in
+	 * a row doubles that, a success resets it.
+	 */
+	unsigned int compact_considered;
+	unsigned int compact_defer_shift;
+#endif
 
 	ZONE_PADDING(_pad2_)
 	/* Rarely used or read-mostly fields */
@@ -754,6 +775,7 @@ int min_free_kbytes_sysctl_handler(struct ctl_table *, int, struct file *,
 extern int sysctl_lowmem_reserve_ratio[MAX_NR_ZONES-1];
 int lowmem_reserve_ratio_sysctl_handler(struct ctl_table *, int, struct file *,
 					void __user *, size_t *, loff_t *);
+extern int percpu_pagelist_burst_scale;
 int percpu_pagelist_fraction_sysctl_handler(struct ctl_table *, int, struct file *,
 					void __user *, size_t *, loff_t *);
 int sysctl_min_unmapped_ratio_sysctl_handler(struct ctl_table *, int,
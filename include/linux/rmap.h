@@ -36,8 +36,37 @@ struct anon_vma {
 	 * mm_take_all_locks() (mm_all_locks_mutex).
 	 */
 	struct list_head head;	/* List of private "related" vmas */
+#ifdef CONFIG_MIGRATION
+	/*
+	 * Page migration pins the anon_vma while a page's ptes are replaced
+	 * by migration entries, so that it is not freed if the last vma goes
+	 * away before the entries are removed again.
+	 */
+	atomic_t external_refcount;
+#endif
 };
 
+#ifdef CONFIG_MIGRATION
+static inline void anonvma_external_refcount_init(struct anon_vma *anon_vma)
+{
+	atomic_set(&anon_vma->external_refcount, 0);
+}
+
+static inline int anonvma_external_refcount(struct anon_vma *anon_vma)
+{
+	return atomic_read(&anon_vma->external_refcount);
+}
+#else
+static inline void anonvma_external_refcount_init(struct anon_vma *anon_vma)
+{
+}
+
+static inline int anonvma_external_refcount(struct anon_vma *anon_vma)
+{
+	return 0;
+}
+#endif
+
 #ifdef CONFIG_MMU
 
 static inline struct anon_vma *page_anon_vma(struct page *page)
@@ -66,6 +95,7 @@ static inline void anon_vma_unlock(struct vm_area_struct *vma)
  * anon_vma helper functions.
  */
 void anon_vma_init(void);	/* create anon_vma_cachep */
+void drop_anon_vma(struct anon_vma *);
 int  anon_vma_prepare(struct vm_area_struct *);
 void __anon_vma_merge(struct vm_area_struct *, struct vm_area_struct *);
 void anon_vma_unlink(struct vm_area_struct *);
@@ -85,6 +85,7 @@ struct sched_param {
 #include <linux/timer.h>
 #include <linux/hrtimer.h>
 #include <linux/task_io_accounting.h>
+#include <linux/task_mm_pressure.h>
 #include <linux/kobject.h>
 #include <linux/latencytop.h>
 #include <linux/cred.h>
@@ -544,6 +545,7 @@ struct signal_struct {
 	unsigned long min_flt, maj_flt, cmin_flt, cmaj_flt;
 	unsigned long inblock, oublock, cinblock, coublock;
 	struct task_io_accounting ioac;
+	struct task_mm_pressure mm_pressure;
 
 	/*
 	 * Cumulative ns of schedule CPU time fo dead threads in the
@@ -1319,6 +1321,7 @@ struct task_struct {
 	unsigned long ptrace_message;
 	siginfo_t *last_siginfo; /* For ptrace use.  */
 	struct task_io_accounting ioac;
+	struct task_mm_pressure mm_pressure;
 #if defined(CONFIG_TASK_XACCT)
 	u64 acct_rss_mem1;	/* accumulated rss usage */
 	u64 acct_vm_mem1;	/* accumulated virtual memory usage */
@@ -0,0 +1,22 @@
+/*
+ * task_mm_pressure: a structure which is used for recording how much a
+ * single task has been held up by memory pressure.
+ *
+ * Don't include this header file directly - it is designed to be dragged in via
+ * sched.h.
+ */
+
+struct task_mm_pressure {
+#ifdef CONFIG_MM_PRESSURE_STATS
+	/* ns spent in direct reclaim, and the number of direct reclaims */
+	u64 reclaim_delay;
+	u32 reclaim_count;
+
+	/* ns spent waiting for swap-in, and the number of swap-in faults */
+	u64 swapin_delay;
+	u32 swapin_count;
+
+	/* # of evicted pages which had to be read back in */
+	u32 refault_count;
+#endif /* CONFIG_MM_PRESSURE_STATS */
+};
@@ -56,6 +56,7 @@
 #include <linux/cn_proc.h>
 #include <linux/freezer.h>
 #include <linux/delayacct.h>
+#include <linux/mm_pressure.h>
 #include <linux/taskstats_kern.h>
 #include <linux/random.h>
 #include <linux/tty.h>
@@ -879,6 +880,7 @@ static int copy_signal(unsigned long clone_flags, struct task_struct *tsk)
 	sig->min_flt = sig->maj_flt = sig->cmin_flt = sig->cmaj_flt = 0;
 	sig->inblock = sig->oublock = sig->cinblock = sig->coublock = 0;
 	task_io_accounting_init(&sig->ioac);
+	task_mm_pressure_init(&sig->mm_pressure);
 	sig->sum_sched_runtime = 0;
 	taskstats_tgid_init(sig);
 
@@ -1072,6 +1074,7 @@ static struct task_struct *copy_process(unsigned long clone_flags,
 #endif
 
 	task_io_accounting_init(&p->ioac);
+	task_mm_pressure_init(&p->mm_pressure);
 	acct_clear_integrals(p);
 
 	posix_cpu_timers_init(p);
@@ -0,0 +1,657 @@
+/*
+ * linux/mm/compaction.c
+ *
+ * Memory compaction for the reduction of external fragmentation. Note that
+ * this heavily depends upon page migration to do all the real heavy
+ * lifting
+ *
+ * Two scanners walk a zone from opposite ends: the migration scanner
+ * isolates movable LRU pages from the bottom up, the free scanner
+ * isolates free pages from the top down, and migrate_pages() moves the
+ * former into the latter.  When the scanners meet, the in-use pages have
+ * been packed into the top of the zone and the free memory at the bottom
+ * has coalesced into high-order blocks.
+ *
+ * Compaction runs directly from the allocator slow path for high-order
+ * requests, ahead of lumpy reclaim, and in the background from kcompactd
+ * whenever a high-order allocation leaves the zone with fewer than
+ * vm.kcompactd_min_free_blocks free blocks of order 2 or more.  Writing
+ * to /proc/sys/vm/compact_memory compacts every zone completely.
+ */
+#include <linux/swap.h>
+#include <linux/sched.h>
+#include <linux/migrate.h>
+#include <linux/ksm.h>
+#include <linux/compaction.h>
+#include <linux/mm_inline.h>
+#include <linux/kthread.h>
+#include <linux/freezer.h>
+#include <linux/sysctl.h>
+#include <linux/wait.h>
+#include <linux/init.h>
+#include "internal.h"
+
+/* Pages isolated for migration in one go */
+#define COMPACT_CLUSTER_MAX	32
+
+/* Smallest order that kcompactd keeps free blocks of */
+#define KCOMPACTD_ORDER		2
+
+/* Skip at most 1 << COMPACT_MAX_DEFER_SHIFT attempts after failures */
+#define COMPACT_MAX_DEFER_SHIFT	6
+
+/*
+ * compact_control is used to track pages being migrated and the free pages
+ * they are being migrated to during memory compaction. The free_pfn starts
+ * at the end of a zone and migrate_pfn begins at the start. Movable pages
+ * are moved to the end of a zone during a compaction run and the run
+ * completes when free_pfn <= migrate_pfn
+ */
+struct compact_control {
+	struct list_head freepages;	/* List of free pages to migrate to */
+	struct list_head migratepages;	/* List of pages being migrated */
+	unsigned long nr_freepages;	/* Number of isolated free pages */
+	unsigned long nr_migratepages;	/* Number of pages to migrate */
+	unsigned long free_pfn;		/* isolate_freepages search base */
+	unsigned long migrate_pfn;	/* isolate_migratepages search base */
+
+	int order;			/* order a direct compactor needs */
+	unsigned long min_blocks;	/* free blocks of order to stop at */
+	struct zone *zone;
+};
+
+int sysctl_kcompactd_min_free_blocks = 16;
+
+static DECLARE_WAIT_QUEUE_HEAD(kcompactd_wait);
+static int kcompactd_order;
+
+static unsigned long release_freepages(struct list_head *freelist)
+{
+	struct page *page, *next;
+	unsigned long count = 0;
+
+	list_for_each_entry_safe(page, next, freelist, lru) {
+		list_del(&page->lru);
+		__free_page(page);
+		count++;
+	}
+
+	return count;
+}
+
+/* Isolate free pages onto a private freelist. Must hold zone->lock */
+static unsigned long isolate_freepages_block(struct zone *zone,
+				unsigned long blockpfn,
+				struct list_head *freelist)
+{
+	unsigned long zone_end_pfn, end_pfn;
+	int total_isolated = 0;
+
+	/* Get the last PFN we should scan for free pages at */
+	zone_end_pfn = zone->zone_start_pfn + zone->spanned_pages;
+	end_pfn = min(blockpfn + pageblock_nr_pages, zone_end_pfn);
+
+	/* Isolate free pages. This assumes the block is valid */
+	for (; blockpfn < end_pfn; blockpfn++) {
+		struct page *page;
+		int isolated, i;
+
+		if (!pfn_valid_within(blockpfn))
+			continue;
+
+		page = pfn_to_page(blockpfn);
+		if (!PageBuddy(page))
+			continue;
+
+		/* Found a free page, break it into order-0 pages */
+		isolated = split_free_page(page);
+		if (!isolated)
+			break;
+		total_isolated += isolated;
+		for (i = 0; i < isolated; i++) {
+			list_add(&page->lru, freelist);
+			page++;
+		}
+
+		/* If a page was split, advance to the end of it */
+		blockpfn += isolated - 1;
+	}
+
+	return total_isolated;
+}
+
+/* Returns true if the page is within a block suitable for migration to */
+static int suitable_migration_target(struct page *page)
+{
+	int migratetype = get_pageblock_migratetype(page);
+
+	/* Don't interfere with memory hot-remove or the min_free_kbytes blocks */
+	if (migratetype == MIGRATE_ISOLATE || migratetype == MIGRATE_RESERVE)
+		return 0;
+
+	/* If the page is a large free page, then allow migration */
+	if (PageBuddy(page) && page_order(page) >= pageblock_order)
+		return 1;
+
+	/* If the block is MIGRATE_MOVABLE, allow migration */
+	if (migratetype == MIGRATE_MOVABLE)
+		return 1;
+
+	/* Otherwise skip the block */
+	return 0;
+}
+
+/* Prepare isolated free pages for use, as the allocator would */
+static void map_pages(struct list_head *list)
+{
+	struct page *page;
+
+	list_for_each_entry(page, list, lru) {
+		arch_alloc_page(page, 0);
+		kernel_map_pages(page, 1, 1);
+	}
+}
+
+/*
+ * Based on information in the current compact_control, find blocks
+ * suitable for isolating free pages from and then isolate them.
+ */
+static void isolate_freepages(struct zone *zone,
+				struct compact_control *cc)
+{
+	struct page *page;
+	unsigned long high_pfn, low_pfn, pfn;
+	unsigned long flags;
+	unsigned long nr_freepages = cc->nr_freepages;
+	struct list_head *freelist = &cc->freepages;
+
+	pfn = cc->free_pfn;
+	low_pfn = cc->migrate_pfn + pageblock_nr_pages;
+	high_pfn = low_pfn;
+
+	/*
+	 * Isolate free pages until enough are available to migrate the
+	 * pages on cc->migratepages. We stop searching if the migrate
+	 * and free page scanners meet or enough free pages are isolated.
+	 */
+	spin_lock_irqsave(&zone->lock, flags);
+	for (; pfn > low_pfn && cc->nr_migratepages > nr_freepages;
+					pfn -= pageblock_nr_pages) {
+		unsigned long isolated;
+
+		if (!pfn_valid(pfn))
+			continue;
+
+		/*
+		 * Check for overlapping nodes/zones. It's possible on some
+		 * configurations to have a setup like
+		 * node0 node1 node0
+		 * i.e. it's possible that all pages within a zones range of
+		 * pages do not belong to a single zone.
+		 */
+		page = pfn_to_page(pfn);
+		if (page_zone(page) != zone)
+			continue;
+
+		/* Check the block is suitable for migration */
+		if (!suitable_migration_target(page))
+			continue;
+
+		/* Found a block suitable for isolating free pages from */
+		isolated = isolate_freepages_block(zone, pfn, freelist);
+		nr_freepages += isolated;
+
+		/*
+		 * Record the highest PFN we isolated pages from. When next
+		 * looking for free pages, the search will restart here as
+		 * page migration may have returned some pages to the allocator
+		 */
+		if (isolated)
+			high_pfn = max(high_pfn, pfn);
+	}
+	spin_unlock_irqrestore(&zone->lock, flags);
+
+	/* split_free_page does not map the pages */
+	map_pages(freelist);
+
+	cc->free_pfn = high_pfn;
+	cc->nr_freepages = nr_freepages;
+}
+
+/*
+ * Isolate all pages that can be migrated from the block pointed to by
+ * the migrate scanner within compact_control.
+ */
+static unsigned long isolate_migratepages(struct zone *zone,
+					struct compact_control *cc)
+{
+	unsigned long low_pfn, end_pfn;
+	struct list_head *migratelist = &cc->migratepages;
+
+	/* Do not scan outside zone boundaries */
+	low_pfn = max(cc->migrate_pfn, zone->zone_start_pfn);
+
+	/* Only scan within a pageblock boundary */
+	end_pfn = ALIGN(low_pfn + 1, pageblock_nr_pages);
+
+	/* Do not cross the free scanner or scan within a memory hole */
+	if (end_pfn > cc->free_pfn || !pfn_valid(low_pfn)) {
+		cc->migrate_pfn = end_pfn;
+		return 0;
+	}
+
+	/* Time to isolate some pages for migration */
+	for (; low_pfn < end_pfn; low_pfn++) {
+		struct page *page;
+
+		if (!pfn_valid_within(low_pfn))
+			continue;
+
+		/* Get the page and skip if free */
+		page = pfn_to_page(low_pfn);
+		if (PageBuddy(page))
+			continue;
+
+		/*
+		 * A KSM page holds a stable_node, not an anon_vma, in its
+		 * mapping, which page migration would take for an anon_vma.
+		 */
+		if (PageKsm(page) ||
+		    ((unsigned long)page->mapping & PAGE_MAPPING_KSM))
+			continue;
+
+		/* Try isolate the page, which takes a reference on it */
+		if (!PageLRU(page) || !page_count(page))
+			continue;
+		if (isolate_lru_page(page))
+			continue;
+
+		list_add(&page->lru, migratelist);
+		cc->nr_migratepages++;
+
+		/* Avoid isolating too much */
+		if (cc->nr_migratepages == COMPACT_CLUSTER_MAX) {
+			low_pfn++;
+			break;
+		}
+	}
+
+	cc->migrate_pfn = low_pfn;
+
+	return cc->nr_migratepages;
+}
+
+/*
+ * This is a migrate-callback that "allocates" freepages by taking pages
+ * from the isolated freelists in the block we are migrating to.
+ */
+static struct page *compaction_alloc(struct page *migratepage,
+					unsigned long data,
+					int **result)
+{
+	struct compact_control *cc = (struct compact_control *)data;
+	struct page *freepage;
+
+	/* Isolate free pages if necessary */
+	if (list_empty(&cc->freepages)) {
+		isolate_freepages(cc->zone, cc);
+
+		if (list_empty(&cc->freepages))
+			return NULL;
+	}
+
+	freepage = list_entry(cc->freepages.next, struct page, lru);
+	list_del(&freepage->lru);
+	cc->nr_freepages--;
+
+	return freepage;
+}
+
+/* Number of free blocks of at least the given order in the zone */
+static unsigned long zone_free_blocks(struct zone *zone, int order)
+{
+	unsigned long blocks = 0;
+	int o;
+
+	for (o = order; o < MAX_ORDER; o++)
+		blocks += zone->free_area[o].nr_free << (o - order);
+
+	return blocks;
+}
+
+/*
+ * Compaction of the zone failed: skip the next attempts, twice as many as
+ * after the previous failure.
+ */
+void defer_compaction(struct zone *zone)
+{
+	zone->compact_considered = 0;
+	if (++zone->compact_defer_shift > COMPACT_MAX_DEFER_SHIFT)
+		zone->compact_defer_shift = COMPACT_MAX_DEFER_SHIFT;
+}
+
+/* Count an attempt at compacting the zone, returns 1 if it is skipped */
+static int compaction_deferred(struct zone *zone)
+{
+	unsigned long defer_limit = 1UL << zone->compact_defer_shift;
+
+	if (++zone->compact_considered > defer_limit)
+		zone->compact_considered = defer_limit;
+
+	return zone->compact_considered < defer_limit;
+}
+
+/*
+ * Whether the zone is still backing off, without counting an attempt. A
+ * zone that has not failed since its last success is not: both counters
+ * are 0 then.
+ */
+static int compaction_backing_off(struct zone *zone)
+{
+	if (!zone->compact_defer_shift)
+		return 0;
+
+	return zone->compact_considered < (1UL << zone->compact_defer_shift);
+}
+
+static int compact_finished(struct zone *zone,
+						struct compact_control *cc)
+{
+	unsigned long watermark;
+
+	if (fatal_signal_pending(current))
+		return COMPACT_PARTIAL;
+
+	/* Compaction run completes if the migrate and free scanner meet */
+	if (cc->free_pfn <= cc->migrate_pfn)
+		return COMPACT_COMPLETE;
+
+	/* Compaction run is not finished if the watermark is not met */
+	if (cc->order < 0)
+		return COMPACT_CONTINUE;
+
+	watermark = zone->pages_low + (1 << cc->order);
+	if (!zone_watermark_ok(zone, cc->order, watermark, 0, 0))
+		return COMPACT_CONTINUE;
+
+	if (zone_free_blocks(zone, cc->order) >= cc->min_blocks)
+		return COMPACT_PARTIAL;
+
+	return COMPACT_CONTINUE;
+}
+
+static int compact_zone(struct zone *zone, struct compact_control *cc)
+{
+	int ret;
+
+	/* Setup to move all movable pages to the end of the zone */
+	cc->migrate_pfn = zone->zone_start_pfn;
+	cc->free_pfn = cc->migrate_pfn + zone->spanned_pages;
+	cc->free_pfn &= ~(pageblock_nr_pages-1);
+
+	migrate_prep();
+
+	while ((ret = compact_finished(zone, cc)) == COMPACT_CONTINUE) {
+		unsigned long nr_migrate;
+		int nr_remaining;
+
+		if (!isolate_migratepages(zone, cc))
+			continue;
+
+		nr_migrate = cc->nr_migratepages;
+		nr_remaining = migrate_pages(&cc->migratepages, compaction_alloc,
+						(unsigned long)cc);
+
+		/* migrate_pages() always empties the list */
+		cc->nr_migratepages = 0;
+
+		count_vm_event(COMPACTBLOCKS);
+		if (nr_remaining >= 0) {
+			count_vm_events(COMPACTPAGES, nr_migrate - nr_remaining);
+			count_vm_events(COMPACTPAGEFAILED, nr_remaining);
+		} else
+			count_vm_events(COMPACTPAGEFAILED, nr_migrate);
+
+		cond_resched();
+	}
+
+	/* Release free pages and check accounting */
+	cc->nr_freepages -= release_freepages(&cc->freepages);
+	VM_BUG_ON(cc->nr_freepages != 0);
+
+	return ret;
+}
+
+static int compact_zone_order(struct zone *zone, int order,
+			      unsigned long min_blocks)
+{
+	struct compact_control cc = {
+		.nr_freepages = 0,
+		.nr_migratepages = 0,
+		.order = order,
+		.min_blocks = min_blocks,
+		.zone = zone,
+	};
+	int ret;
+
+	INIT_LIST_HEAD(&cc.freepages);
+	INIT_LIST_HEAD(&cc.migratepages);
+
+	ret = compact_zone(zone, &cc);
+
+	/*
+	 * A zone scanned end to end without reaching the target is badly
+	 * fragmented by unmovable pages: back off from it.
+	 */
+	if (ret == COMPACT_COMPLETE && order >= 0)
+		defer_compaction(zone);
+	else if (ret == COMPACT_PARTIAL) {
+		zone->compact_considered = 0;
+		zone->compact_defer_shift = 0;
+	}
+
+	return ret;
+}
+
+/*
+ * Is there enough free memory to migrate into, and is the allocation not
+ * going to succeed without compaction anyway?
+ */
+static int compaction_suitable(struct zone *zone, int order)
+{
+	unsigned long watermark;
+
+	watermark = zone->pages_low + (2UL << order);
+	if (!zone_watermark_ok(zone, 0, watermark, 0, 0))
+		return COMPACT_SKIPPED;
+
+	if (zone_watermark_ok(zone, order, watermark, 0, 0))
+		return COMPACT_PARTIAL;
+
+	return COMPACT_CONTINUE;
+}
+
+/**
+ * try_to_compact_pages - Direct compact to satisfy a high-order allocation
+ * @zonelist: The zonelist used for the current allocation
+ * @order: The order of the current allocation
+ * @gfp_mask: The GFP mask of the current allocation
+ * @nodemask: The allowed nodes to allocate from
+ *
+ * This is the main entry point for direct page compaction.
+ */
+unsigned long try_to_compact_pages(struct zonelist *zonelist,
+			int order, gfp_t gfp_mask, nodemask_t *nodemask)
+{
+	enum zone_type high_zoneidx = gfp_zone(gfp_mask);
+	int may_enter_fs = gfp_mask & __GFP_FS;
+	int may_perform_io = gfp_mask & __GFP_IO;
+	unsigned long watermark;
+	struct zoneref *z;
+	struct zone *zone;
+	int rc = COMPACT_SKIPPED;
+
+	/*
+	 * Check whether it is worth even starting compaction. The order check is
+	 * made because an assumption is made that the page allocator can satisfy
+	 * the "cheaper" orders without taking special steps
+	 */
+	if (order <= 1 || !may_enter_fs || !may_perform_io)
+		return rc;
+
+	count_vm_event(COMPACTSTALL);
+
+	/* Compact each zone in the list */
+	for_each_zone_zonelist_nodemask(zone, z, zonelist, high_zoneidx,
+								nodemask) {
+		int status;
+
+		if (compaction_deferred(zone))
+			continue;
+		if (compaction_suitable(zone, order) != COMPACT_CONTINUE)
+			continue;
+
+		status = compact_zone_order(zone, order, 1);
+		rc = max(status, rc);
+
+		watermark = zone->pages_low + (1 << order);
+		if (zone_watermark_ok(zone, order, watermark, 0, 0))
+			break;
+	}
+
+	return rc;
+}
+
+/**
+ * wakeup_kcompactd - replenish free high-order blocks in the background
+ * @zone: zone a high-order page was just allocated from
+ * @order: order of that allocation
+ *
+ * Called by the page allocator after high-order allocations: wakes
+ * kcompactd once the zone's free blocks of order KCOMPACTD_ORDER and up
+ * have dropped below vm.kcompactd_min_free_blocks, unless compaction of
+ * the zone failed recently.  Each such allocation counts as an attempt
+ * towards the end of the back-off.
+ */
+void wakeup_kcompactd(struct zone *zone, int order)
+{
+	if (order < KCOMPACTD_ORDER || !sysctl_kcompactd_min_free_blocks)
+		return;
+	if (zone_free_blocks(zone, KCOMPACTD_ORDER) >=
+				sysctl_kcompactd_min_free_blocks)
+		return;
+	if (compaction_deferred(zone))
+		return;
+	if (!waitqueue_active(&kcompactd_wait))
+		return;
+	kcompactd_order = KCOMPACTD_ORDER;
+	wake_up_interruptible(&kcompactd_wait);
+}
+
+static int kcompactd(void *unused)
+{
+	struct zone *zone;
+
+	set_freezable();
+	set_user_nice(current, 5);
+
+	while (!kthread_should_stop()) {
+		wait_event_freezable(kcompactd_wait,
+			kcompactd_order || kthread_should_stop());
+		if (kthread_should_stop())
+			break;
+		kcompactd_order = 0;
+		count_vm_event(KCOMPACTD_WAKE);
+
+		for_each_zone(zone) {
+			unsigned long min_blocks = sysctl_kcompactd_min_free_blocks;
+
+			if (!populated_zone(zone))
+				continue;
+			if (zone_free_blocks(zone, KCOMPACTD_ORDER) >= min_blocks)
+				continue;
+			if (compaction_backing_off(zone))
+				continue;
+			if (compaction_suitable(zone, KCOMPACTD_ORDER) ==
+							COMPACT_SKIPPED)
+				continue;
+
+			compact_zone_order(zone, KCOMPACTD_ORDER, min_blocks);
+		}
+	}
+	return 0;
+}
+
+/* Compact all zones within a node */
+static int compact_node(int nid)
+{
+	int zoneid;
+	pg_data_t *pgdat;
+	struct zone *zone;
+
+	if (nid < 0 || nid >= nr_node_ids || !node_online(nid))
+		return -EINVAL;
+	pgdat = NODE_DATA(nid);
+
+	/* Flush pending updates to the LRU lists */
+	lru_add_drain_all();
+
+	for (zoneid = 0; zoneid < MAX_NR_ZONES; zoneid++) {
+		struct compact_control cc = {
+			.nr_freepages = 0,
+			.nr_migratepages = 0,
+			.order = -1,
+		};
+
+		zone = &pgdat->node_zones[zoneid];
+		if (!populated_zone(zone))
+			continue;
+
+		cc.zone = zone;
+		INIT_LIST_HEAD(&cc.freepages);
+		INIT_LIST_HEAD(&cc.migratepages);
+
+		compact_zone(zone, &cc);
+
+		VM_BUG_ON(!list_empty(&cc.freepages));
+		VM_BUG_ON(!list_empty(&cc.migratepages));
+	}
+
+	return 0;
+}
+
+/* Compact all nodes in the system */
+static void compact_nodes(void)
+{
+	int nid;
+
+	for_each_online_node(nid)
+		compact_node(nid);
+}
+
+/* The written value is actually unused, all memory is compacted */
+int sysctl_compact_memory;
+
+/* This is the entry point for compacting all nodes via /proc/sys/vm */
+int sysctl_compaction_handler(struct ctl_table *table, int write,
+			struct file *file, void __user *buffer,
+			size_t *length, loff_t *ppos)
+{
+	if (write)
+		compact_nodes();
+
+	return 0;
+}
+
+static int __init kcompactd_init(void)
+{
+	struct task_struct *task;
+
+	task = kthread_run(kcompactd, NULL, "kcompactd");
+	if (IS_ERR(task)) {
+		printk(KERN_ERR "compaction: creating kcompactd failed\n");
+		return PTR_ERR(task);
+	}
+	return 0;
+}
+module_init(kcompactd_init)
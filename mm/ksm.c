@@ -121,7 +121,8 @@ struct stable_node {
 /**
  * struct rmap_item - reverse mapping item for virtual addresses
  * @rmap_list: next rmap_item in mm_slot's singly-linked rmap_list
- * @filler: unused space we're making available in this patch
+ * @skip_interval: passes to skip after the checksum last changed (back-off)
+ * @skip_remaining: passes still to be skipped before this page is looked at
  * @mm: the memory structure this rmap_item is pointing into
  * @address: the virtual address this rmap_item tracks (+ flags in low bits)
  * @oldchecksum: previous checksum of the page at that virtual address
@@ -131,7 +132,8 @@ struct stable_node {
  */
 struct rmap_item {
 	struct rmap_item *rmap_list;
-	unsigned long filler;
+	unsigned short skip_interval;	/* when volatile */
+	unsigned short skip_remaining;	/* when volatile */
 	struct mm_struct *mm;
 	unsigned long address;		/* + low bits used for flags below */
 	unsigned int oldchecksum;	/* when unstable */
@@ -181,6 +183,22 @@ static unsigned long ksm_rmap_items;
 /* Limit on the number of unswappable pages used */
 static unsigned long ksm_max_kernel_pages;
 
+/* The number of rmap_items looked at by ksmd */
+static unsigned long ksm_pages_scanned;
+
+/* The number of rmap_items passed over because of volatility back-off */
+static unsigned long ksm_pages_skipped;
+
+/* The number of checksums calculated, and how many of them had changed */
+static unsigned long ksm_checksums;
+static unsigned long ksm_checksums_changed;
+
+/* Upper bound on full scans a volatile page may be skipped for, 0 = off */
+static unsigned int ksm_max_skip_scans = 8;
+
+/* Checksum only a sample of each page, rather than all of it */
+static unsigned int ksm_sampled_checksum = 1;
+
 /* Number of pages ksmd should scan in one batch */
 static unsigned int ksm_thread_pages_to_scan = 100;
 
@@ -599,15 +617,61 @@ error:
 }
 #endif /* CONFIG_SYSFS */
 
+/*
+ * The checksum is only used to spot pages which are being written to,
+ * so that they are kept out of the unstable tree: pages_identical() does
+ * the real comparison before anything is merged.  A sampled checksum may
+ * therefore miss some changes without harm, and hashing a handful of
+ * cachelines spread across the page costs a fraction of the full jhash.
+ */
+#define CHECKSUM_SAMPLE_WORDS	8	/* u32s hashed per sample */
+#define CHECKSUM_SAMPLES	16	/* samples spread across the page */
+#define CHECKSUM_SAMPLE_STRIDE	(PAGE_SIZE / 4 / CHECKSUM_SAMPLES)
+
 static u32 calc_checksum(struct page *page)
 {
 	u32 checksum;
-	void *addr = kmap_atomic(page, KM_USER0);
-	checksum = jhash2(addr, PAGE_SIZE / 4, 17);
+	u32 *addr = kmap_atomic(page, KM_USER0);
+
+	if (ksm_sampled_checksum) {
+		int i;
+
+		checksum = 17;
+		for (i = 0; i < CHECKSUM_SAMPLES; i++)
+			checksum = jhash2(addr + i * CHECKSUM_SAMPLE_STRIDE,
+					  CHECKSUM_SAMPLE_WORDS, checksum);
+	} else
+		checksum = jhash2(addr, PAGE_SIZE / 4, 17);
 	kunmap_atomic(addr, KM_USER0);
+	ksm_checksums++;
 	return checksum;
 }
 
+/*
+ * A page whose checksum keeps changing is unlikely to become mergeable
+ * soon: skip it for an exponentially growing number of full scans, up to
+ * ksm_max_skip_scans, and forget the back-off as soon as it settles down.
+ */
+static inline void ksm_backoff_volatile(struct rmap_item *rmap_item)
+{
+	unsigned int interval = rmap_item->skip_interval;
+
+	interval = interval ? interval * 2 : 1;
+	if (interval > ksm_max_skip_scans)
+		interval = ksm_max_skip_scans;
+	rmap_item->skip_interval = interval;
+	rmap_item->skip_remaining = interval;
+}
+
+static inline int ksm_should_skip(struct rmap_item *rmap_item)
+{
+	if (!rmap_item->skip_remaining)
+		return 0;
+	rmap_item->skip_remaining--;
+	ksm_pages_skipped++;
+	return 1;
+}
+
 static int memcmp_pages(struct page *page1, struct page *page2)
 {
 	char *addr1, *addr2;
@@ -1126,8 +1190,12 @@ static void cmp_and_merge_page(struct page *page, struct rmap_item *rmap_item)
 	checksum = calc_checksum(page);
 	if (rmap_item->oldchecksum != checksum) {
 		rmap_item->oldchecksum = checksum;
+		ksm_checksums_changed++;
+		if (ksm_max_skip_scans)
+			ksm_backoff_volatile(rmap_item);
 		return;
 	}
+	rmap_item->skip_interval = 0;
 
 	tree_rmap_item =
 		unstable_tree_search_insert(rmap_item, page, &tree_page);
@@ -1327,6 +1395,11 @@ static void ksm_do_scan(unsigned int scan_npages)
 		rmap_item = scan_get_next_rmap_item(&page);
 		if (!rmap_item)
 			return;
+		ksm_pages_scanned++;
+		if (ksm_should_skip(rmap_item)) {
+			put_page(page);
+			continue;
+		}
 		if (!PageKsm(page) || !in_stable_tree(rmap_item))
 			cmp_and_merge_page(page, rmap_item);
 		put_page(page);
@@ -1716,6 +1789,56 @@ static ssize_t max_kernel_pages_show(struct kobject *kobj,
 }
 KSM_ATTR(max_kernel_pages);
 
+static ssize_t max_skip_scans_show(struct kobject *kobj,
+				   struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%u\n", ksm_max_skip_scans);
+}
+
+static ssize_t max_skip_scans_store(struct kobject *kobj,
+				    struct kobj_attribute *attr,
+				    const char *buf, size_t count)
+{
+	int err;
+	unsigned long scans;
+
+	err = strict_strtoul(buf, 10, &scans);
+	if (err || scans > USHORT_MAX)
+		return -EINVAL;
+
+	ksm_max_skip_scans = scans;
+
+	return count;
+}
+KSM_ATTR(max_skip_scans);
+
+static ssize_t sampled_checksum_show(struct kobject *kobj,
+				     struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%u\n", ksm_sampled_checksum);
+}
+
+static ssize_t sampled_checksum_store(struct kobject *kobj,
+				      struct kobj_attribute *attr,
+				      const char *buf, size_t count)
+{
+	int err;
+	unsigned long sampled;
+
+	err = strict_strtoul(buf, 10, &sampled);
+	if (err || sampled > 1)
+		return -EINVAL;
+
+	/*
+	 * Switching mode makes every remembered checksum stale once, which
+	 * costs one extra pass before pages reach the unstable tree again.
+	 */
+	ksm_sampled_checksum = sampled;
+
+	return count;
+}
+KSM_ATTR(sampled_checksum);
+
 static ssize_t pages_shared_show(struct kobject *kobj,
 				 struct kobj_attribute *attr, char *buf)
 {
@@ -1761,16 +1884,50 @@ static ssize_t full_scans_show(struct kobject *kobj,
 }
 KSM_ATTR_RO(full_scans);
 
+static ssize_t pages_scanned_show(struct kobject *kobj,
+				  struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%lu\n", ksm_pages_scanned);
+}
+KSM_ATTR_RO(pages_scanned);
+
+static ssize_t pages_skipped_show(struct kobject *kobj,
+				  struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%lu\n", ksm_pages_skipped);
+}
+KSM_ATTR_RO(pages_skipped);
+
+static ssize_t checksums_show(struct kobject *kobj,
+			      struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%lu\n", ksm_checksums);
+}
+KSM_ATTR_RO(checksums);
+
+static ssize_t checksums_changed_show(struct kobject *kobj,
+				      struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%lu\n", ksm_checksums_changed);
+}
+KSM_ATTR_RO(checksums_changed);
+
 static struct attribute *ksm_attrs[] = {
 	&sleep_millisecs_attr.attr,
 	&pages_to_scan_attr.attr,
 	&run_attr.attr,
 	&max_kernel_pages_attr.attr,
+	&max_skip_scans_attr.attr,
+	&sampled_checksum_attr.attr,
 	&pages_shared_attr.attr,
 	&pages_sharing_attr.attr,
 	&pages_unshared_attr.attr,
 	&pages_volatile_attr.attr,
 	&full_scans_attr.attr,
+	&pages_scanned_attr.attr,
+	&pages_skipped_attr.attr,
+	&checksums_attr.attr,
+	&checksums_changed_attr.attr,
 	NULL,
 };
 
@@ -166,14 +166,17 @@ static void remove_file_migration_ptes(struct page *old, struct page *new)
 
 /*
  * Must hold mmap_sem lock on at least one of the vmas containing
- * the page so that the anon_vma cannot vanish.
+ * the page, or a reference on its anon_vma, so that the anon_vma
+ * cannot vanish.
  */
 static void remove_anon_migration_ptes(struct page *old, struct page *new)
 {
+	struct vm_area_struct *vma;
 	struct anon_vma *anon_vma;
-	
+
 	/*
-	 * We hold the mmap_sem lock. So no need to call page_lock_anon_vma.
+	 * We hold the mmap_sem lock or an anon_vma reference. So no need
+	 * to call page_lock_anon_vma.
 	 */
 	anon_vma = page_anon_vma(new);
         if (!anon_vma)
@@ -541,7 +544,8 @@ static int fallback_migrate_page(struct address_space *mapping,
  *   < 0 - error code
  *  == 0 - success
  */
-static int move_to_new_page(struct page *newpage, struct page *page)
+static int move_to_new_page(struct page *newpage, struct page *page,
+			    int remap_swapcache)
 {
 	struct address_space *mapping;
 	int rc;
@@ -577,7 +581,8 @@ static int move_to_new_page(struct page *newpage, struct page *page)
 		rc = fallback_migrate_page(mapping, newpage, page);
 
 	if (!rc) {
-		remove_migration_ptes(page, newpage);
+		if (remap_swapcache)
+			remove_migration_ptes(page, newpage);
 	} else
 		newpage->mapping = NULL;
 
@@ -599,6 +604,8 @@ static int unmap_and_move(new_page_t get_new_page, unsigned long private,
 	int rcu_locked = 0;
 	int charge = 0;
 	struct mem_cgroup *mem;
+	int remap_swapcache = 1;
+	struct anon_vma *anon_vma = NULL;
 
 	if (!newpage)
 		return -ENOMEM;
@@ -637,10 +644,26 @@ static int unmap_and_move(new_page_t get_new_page, unsigned long private,
 	 * of migration. File cache pages are no problem because of page_lock()
 	 * File Caches may use write_page() or lock_page() in migration, then,
 	 * just care Anon page here.
+	 *
+	 * rcu_read_lock() alone does not keep the anon_vma alive once the
+	 * last pte is gone: callers such as compaction hold no mmap_sem, so
+	 * the vmas may be unmapped while the migration ptes are in place.
+	 * Take a reference on the anon_vma of a mapped page for that. The
+	 * anon_vma of an unmapped swapcache page may already be gone, so
+	 * such a page is migrated but not remapped.
 	 */
 	if (PageAnon(page)) {
 		rcu_read_lock();
 		rcu_locked = 1;
+
+		if (!page_mapped(page)) {
+			if (!PageSwapCache(page))
+				goto rcu_unlock;
+			remap_swapcache = 0;
+		} else {
+			anon_vma = page_anon_vma(page);
+			atomic_inc(&anon_vma->external_refcount);
+		}
 	}
 
 	/*
@@ -673,11 +696,13 @@ static int unmap_and_move(new_page_t get_new_page, unsigned long private,
 	try_to_unmap(page, TTU_MIGRATION|TTU_IGNORE_MLOCK|TTU_IGNORE_ACCESS);
 
 	if (!page_mapped(page))
-		rc = move_to_new_page(newpage, page);
+		rc = move_to_new_page(newpage, page, remap_swapcache);
 
-	if (rc)
+	if (rc && remap_swapcache)
 		remove_migration_ptes(page, page);
 rcu_unlock:
+	if (anon_vma)
+		drop_anon_vma(anon_vma);
 	if (rcu_locked)
 		rcu_read_unlock();
 uncharge:
@@ -0,0 +1,82 @@
+/*
+ * Per-task and global memory pressure statistics
+ *
+ * Every task keeps track of how long it stalled in direct reclaim, how
+ * long it waited for swap-in, and how many evicted pages it had to read
+ * back in.  The same events are summed system-wide in per-cpu counters,
+ * so that updating them never takes a lock or bounces a cacheline.
+ *
+ * Per-task figures are in /proc/<pid>/mm_pressure (summed over the thread
+ * group, including threads which have exited) and in
+ * /proc/<pid>/task/<tid>/mm_pressure; the totals are in /proc/mm_pressure.
+ *
+ * Released under the GPL, see the file COPYING for details.
+ */
+
+#include <linux/init.h>
+#include <linux/kernel.h>
+#include <linux/percpu.h>
+#include <linux/proc_fs.h>
+#include <linux/seq_file.h>
+#include <linux/mm_pressure.h>
+
+static DEFINE_PER_CPU(struct task_mm_pressure, mm_pressure_events);
+
+void __mm_pressure_account(struct task_mm_pressure *delta)
+{
+	struct task_mm_pressure *global;
+
+	task_mm_pressure_add(&current->mm_pressure, delta);
+
+	global = &get_cpu_var(mm_pressure_events);
+	task_mm_pressure_add(global, delta);
+	put_cpu_var(mm_pressure_events);
+}
+
+static void mm_pressure_sum_events(struct task_mm_pressure *ret)
+{
+	int cpu;
+
+	task_mm_pressure_init(ret);
+	/* an offlined cpu keeps its counts, they must not drop out */
+	for_each_possible_cpu(cpu)
+		task_mm_pressure_add(ret, &per_cpu(mm_pressure_events, cpu));
+}
+
+static int mm_pressure_proc_show(struct seq_file *m, void *v)
+{
+	struct task_mm_pressure sum;
+
+	mm_pressure_sum_events(&sum);
+	seq_printf(m,
+		   "reclaim_stalls: %u\n"
+		   "reclaim_stall_ns: %llu\n"
+		   "swapins: %u\n"
+		   "swapin_wait_ns: %llu\n"
+		   "refaults: %u\n",
+		   sum.reclaim_count,
+		   (unsigned long long)sum.reclaim_delay,
+		   sum.swapin_count,
+		   (unsigned long long)sum.swapin_delay,
+		   sum.refault_count);
+	return 0;
+}
+
+static int mm_pressure_proc_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, mm_pressure_proc_show, NULL);
+}
+
+static const struct file_operations mm_pressure_proc_fops = {
+	.open		= mm_pressure_proc_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+static int __init mm_pressure_init(void)
+{
+	proc_create("mm_pressure", S_IRUGO, NULL, &mm_pressure_proc_fops);
+	return 0;
+}
+module_init(mm_pressure_init);
@@ -47,6 +47,7 @@
 #include <linux/page_cgroup.h>
 #include <linux/debugobjects.h>
 #include <linux/mem_notify.h>
+#include <linux/compaction.h>
 
 #include <asm/tlbflush.h>
 #include <asm/div64.h>
@@ -72,6 +73,7 @@ unsigned long totalram_pages __read_mostly;
 unsigned long totalreserve_pages __read_mostly;
 unsigned long highest_memmap_pfn __read_mostly;
 int percpu_pagelist_fraction;
+int percpu_pagelist_burst_scale = 2;
 gfp_t gfp_allowed_mask __read_mostly = GFP_BOOT_MASK;
 
 #ifdef CONFIG_PM_SLEEP
@@ -1099,6 +1101,87 @@ void split_page(struct page *page, unsigned int order)
 		set_page_refcounted(page + i);
 }
 
+/*
+ * Similar to split_page except the page is already free. As this is only
+ * being used for migration, the migratetype of the block also changes.
+ * As this is called with interrupts disabled, the caller is responsible
+ * for calling arch_alloc_page() and kernel_map_page() after interrupts
+ * are enabled.
+ *
+ * Note: this is probably too low level an operation for use in drivers.
+ * Please consult with lkml before using this in your driver.
+ */
+int split_free_page(struct page *page)
+{
+	unsigned int order;
+	unsigned long watermark;
+	struct zone *zone;
+
+	BUG_ON(!PageBuddy(page));
+
+	zone = page_zone(page);
+	order = page_order(page);
+
+	/* Obey watermarks as if the page was being allocated */
+	watermark = zone->pages_low + (1 << order);
+	if (!zone_watermark_ok(zone, 0, watermark, 0, 0))
+		return 0;
+
+	/* Remove page from free list */
+	list_del(&page->lru);
+	zone->free_area[order].nr_free--;
+	rmv_page_order(page);
+	__mod_zone_page_state(zone, NR_FREE_PAGES, -(1UL << order));
+
+	/* Split into individual pages */
+	set_page_refcounted(page);
+	split_page(page, order);
+
+	if (order >= pageblock_order - 1) {
+		struct page *endpage = page + (1 << order) - 1;
+		for (; page < endpage; page += pageblock_nr_pages)
+			set_pageblock_migratetype(page, MIGRATE_MOVABLE);
+	}
+
+	return 1 << order;
+}
+
+/*
+ * Refills that come within this many jiffies of each other are a burst.
+ */
+#define PCP_BURST_JIFFIES	(HZ / 100 ? : 1)
+
+/*
+ * Allocation bursts (binder transactions, network receive) empty the
+ * per-cpu list over and over, taking zone->lock each time for only
+ * pcp->batch pages: with the small zones of a low-memory device that
+ * is just a handful of pages.  While refills follow each other closely,
+ * double batch and high, up to percpu_pagelist_burst_scale times, and
+ * step back down on every refill that does not, so the lists shrink
+ * back to their configured size once the burst is over.  Pages parked
+ * on per-cpu lists are lost to everyone else, so only grow while the
+ * zone is comfortably above its high watermark.
+ */
+static void pcp_adapt_to_refill(struct zone *zone, struct per_cpu_pages *pcp)
+{
+	unsigned long now = jiffies;
+	int scale = pcp->scale;
+
+	if (time_before_eq(now, pcp->last_refill + PCP_BURST_JIFFIES) &&
+	    zone_page_state(zone, NR_FREE_PAGES) > 2 * zone->pages_high) {
+		if (scale < percpu_pagelist_burst_scale)
+			scale++;
+	} else if (scale)
+		scale--;
+	pcp->last_refill = now;
+
+	if (scale != pcp->scale) {
+		pcp->scale = scale;
+		pcp->batch = pcp->base_batch << scale;
+		pcp->high = pcp->base_high << scale;
+	}
+}
+
 /*
  * Really, prep_compound_page() should be called from __rmqueue_bulk().  But
  * we cheat by calling it from here, in the order > 0 path.  Saves a branch
@@ -1121,6 +1204,7 @@ again:
 		pcp = &zone_pcp(zone, cpu)->pcp;
 		local_irq_save(flags);
 		if (!pcp->count) {
+			pcp_adapt_to_refill(zone, pcp);
 			pcp->count = rmqueue_bulk(zone, 0,
 					pcp->batch, &pcp->list, migratetype);
 			if (unlikely(!pcp->count))
@@ -1140,6 +1224,7 @@ again:
 
 		/* Allocate more to the pcp list if necessary */
 		if (unlikely(&page->lru == &pcp->list)) {
+			pcp_adapt_to_refill(zone, pcp);
 			pcp->count += rmqueue_bulk(zone, 0,
 					pcp->batch, &pcp->list, migratetype);
 			page = list_entry(pcp->list.next, struct page, lru);
@@ -1160,6 +1245,9 @@ again:
 	local_irq_restore(flags);
 	put_cpu();
 
+	if (unlikely(order))
+		wakeup_kcompactd(zone, order);
+
 	VM_BUG_ON(bad_range(zone, page));
 	if (prep_new_page(page, order, gfp_flags))
 		goto again;
@@ -1630,6 +1718,51 @@ __alloc_pages_direct_reclaim(gfp_t gfp_mask, unsigned int order,
        return page;
 }
 
+/* Try memory compaction for high-order allocations before reclaim */
+static struct page *
+__alloc_pages_direct_compact(gfp_t gfp_mask, unsigned int order,
+	struct zonelist *zonelist, enum zone_type high_zoneidx,
+	nodemask_t *nodemask, int alloc_flags, struct zone *preferred_zone,
+	int migratetype)
+{
+	struct page *page;
+	struct task_struct *p = current;
+	unsigned long compact_result;
+
+	if (!order)
+		return NULL;
+
+	p->flags |= PF_MEMALLOC;
+	compact_result = try_to_compact_pages(zonelist, order, gfp_mask,
+						nodemask);
+	p->flags &= ~PF_MEMALLOC;
+	if (compact_result == COMPACT_SKIPPED)
+		return NULL;
+
+	/* Page migration frees to the PCP lists but we want merging */
+	drain_pages(get_cpu());
+	put_cpu();
+
+	page = get_page_from_freelist(gfp_mask, nodemask, order, zonelist,
+			high_zoneidx, alloc_flags, preferred_zone,
+			migratetype);
+	if (page) {
+		count_vm_event(COMPACTSUCCESS);
+		return page;
+	}
+
+	/*
+	 * It's bad if compaction run occurs and fails. The most likely
+	 * reason is that pages exist, but not enough to satisfy watermarks.
+	 */
+	count_vm_event(COMPACTFAIL);
+	defer_compaction(preferred_zone);
+
+	cond_resched();
+
+	return NULL;
+}
+
 /*
  * This is called in the allocator slow-path if the allocation request is of
  * sufficient urgency to ignore watermarks and take other desperate measures
@@ -1766,6 +1899,18 @@ rebalance:
 	if (test_thread_flag(TIF_MEMDIE) && !(gfp_mask & __GFP_NOFAIL))
 		goto nopage;
 
+	/*
+	 * Try direct compaction: moving pages is cheaper than evicting
+	 * the working set with lumpy reclaim.
+	 */
+	page = __alloc_pages_direct_compact(gfp_mask, order,
+					zonelist, high_zoneidx,
+					nodemask,
+					alloc_flags, preferred_zone,
+					migratetype);
+	if (page)
+		goto got_pg;
+
 	/* Try direct reclaim and then allocating */
        page = __alloc_pages_direct_reclaim(gfp_mask, order,
                                        zonelist, high_zoneidx,
@@ -2968,8 +3113,8 @@ static void setup_pageset(struct per_cpu_pageset *p, unsigned long batch)
 
 	pcp = &p->pcp;
 	pcp->count = 0;
-	pcp->high = 6 * batch;
-	pcp->batch = max(1UL, 1 * batch);
+	pcp->high = pcp->base_high = 6 * batch;
+	pcp->batch = pcp->base_batch = max(1UL, 1 * batch);
 	INIT_LIST_HEAD(&pcp->list);
 }
 
@@ -2988,6 +3133,9 @@ static void setup_pagelist_highmark(struct per_cpu_pageset *p,
 	pcp->batch = max(1UL, high/4);
 	if ((high/4) > (PAGE_SHIFT * 8))
 		pcp->batch = PAGE_SHIFT * 8;
+	pcp->base_high = pcp->high;
+	pcp->base_batch = pcp->batch;
+	pcp->scale = 0;
 }
 
 
@@ -0,0 +1,163 @@
+/*
+ * Page allocator microbenchmark
+ *
+ * Measures the latency of alloc_pages() and __free_pages() for orders 0
+ * to max_order, in two patterns:
+ *
+ *  burst:    allocate nr_pages blocks, then free them all, which drains
+ *            and refills the per-cpu lists and exercises zone->lock;
+ *  pingpong: allocate and immediately free one block, nr_pages times,
+ *            which order-0 requests should serve from the per-cpu list.
+ *
+ * Everything runs when the module is loaded, and the results are written
+ * to the kernel log; the module can then be removed again.  Only
+ * alloc_pages() and the generic clock are used, so it runs on any config,
+ * qemu included.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as published by
+ * the Free Software Foundation.
+ */
+
+#include <linux/init.h>
+#include <linux/module.h>
+#include <linux/moduleparam.h>
+#include <linux/gfp.h>
+#include <linux/mm.h>
+#include <linux/slab.h>
+#include <linux/sched.h>
+#include <linux/ktime.h>
+#include <linux/math64.h>
+
+#define PRINT_PREF KERN_INFO "page_alloc_bench: "
+
+static int max_order = 3;
+module_param(max_order, int, S_IRUGO);
+MODULE_PARM_DESC(max_order, "Highest allocation order to measure");
+
+static int nr_pages = 256;
+module_param(nr_pages, int, S_IRUGO);
+MODULE_PARM_DESC(nr_pages, "Blocks allocated per round");
+
+static int rounds = 16;
+module_param(rounds, int, S_IRUGO);
+MODULE_PARM_DESC(rounds, "Rounds per order and pattern");
+
+struct bench_stat {
+	unsigned long nr;
+	unsigned long failed;
+	s64 total_ns;
+	s64 max_ns;
+};
+
+static struct page **pages;
+
+static inline void bench_account(struct bench_stat *stat, ktime_t start)
+{
+	s64 ns = ktime_to_ns(ktime_sub(ktime_get(), start));
+
+	stat->nr++;
+	stat->total_ns += ns;
+	if (ns > stat->max_ns)
+		stat->max_ns = ns;
+}
+
+static void bench_report(const char *what, int order, struct bench_stat *stat)
+{
+	s64 avg = 0;
+
+	if (stat->nr)
+		avg = div_u64(stat->total_ns, stat->nr);
+	printk(PRINT_PREF "%-14s order %d: %8lu ops, avg %6lld ns, "
+	       "max %8lld ns, %lu failed\n", what, order, stat->nr,
+	       (long long)avg, (long long)stat->max_ns, stat->failed);
+}
+
+static void bench_burst(int order)
+{
+	struct bench_stat alloc = { 0 }, free = { 0 };
+	ktime_t start;
+	int r, i, got;
+
+	for (r = 0; r < rounds; r++) {
+		got = 0;
+		for (i = 0; i < nr_pages; i++) {
+			start = ktime_get();
+			pages[got] = alloc_pages(GFP_KERNEL, order);
+			if (!pages[got]) {
+				alloc.failed++;
+				continue;
+			}
+			bench_account(&alloc, start);
+			got++;
+		}
+		for (i = 0; i < got; i++) {
+			start = ktime_get();
+			__free_pages(pages[i], order);
+			bench_account(&free, start);
+		}
+		cond_resched();
+	}
+	bench_report("burst alloc", order, &alloc);
+	bench_report("burst free", order, &free);
+}
+
+static void bench_pingpong(int order)
+{
+	struct bench_stat alloc = { 0 }, free = { 0 };
+	struct page *page;
+	ktime_t start;
+	int r, i;
+
+	for (r = 0; r < rounds; r++) {
+		for (i = 0; i < nr_pages; i++) {
+			start = ktime_get();
+			page = alloc_pages(GFP_KERNEL, order);
+			if (!page) {
+				alloc.failed++;
+				continue;
+			}
+			bench_account(&alloc, start);
+			start = ktime_get();
+			__free_pages(page, order);
+			bench_account(&free, start);
+		}
+		cond_resched();
+	}
+	bench_report("pingpong alloc", order, &alloc);
+	bench_report("pingpong free", order, &free);
+}
+
+static int __init page_alloc_bench_init(void)
+{
+	int order;
+
+	if (max_order < 0 || max_order >= MAX_ORDER || nr_pages <= 0 ||
+	    rounds <= 0) {
+		printk(PRINT_PREF "invalid parameters\n");
+		return -EINVAL;
+	}
+
+	pages = kmalloc(nr_pages * sizeof(*pages), GFP_KERNEL);
+	if (!pages)
+		return -ENOMEM;
+
+	printk(PRINT_PREF "orders 0-%d, %d blocks x %d rounds\n",
+	       max_order, nr_pages, rounds);
+	for (order = 0; order <= max_order; order++) {
+		bench_burst(order);
+		bench_pingpong(order);
+	}
+
+	kfree(pages);
+	return 0;
+}
+module_init(page_alloc_bench_init);
+
+static void __exit page_alloc_bench_exit(void)
+{
+}
+module_exit(page_alloc_bench_exit);
+
+MODULE_DESCRIPTION("Page allocator microbenchmark");
+MODULE_LICENSE("GPL");
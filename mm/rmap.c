@@ -167,18 +167,40 @@ void anon_vma_unlink(struct vm_area_struct *vma)
 	list_del(&vma->anon_vma_node);
 
 	/* We must garbage collect the anon_vma if it's empty */
+	empty = list_empty(&anon_vma->head) &&
+		!anonvma_external_refcount(anon_vma);
+	spin_unlock(&anon_vma->lock);
+
+	if (empty)
+		anon_vma_free(anon_vma);
+}
+
+#ifdef CONFIG_MIGRATION
+/*
+ * Drop a reference taken by page migration, freeing the anon_vma if its
+ * last vma was unlinked while the reference was held.
+ */
+void drop_anon_vma(struct anon_vma *anon_vma)
+{
+	int empty;
+
+	if (!atomic_dec_and_lock(&anon_vma->external_refcount,
+				 &anon_vma->lock))
+		return;
 	empty = list_empty(&anon_vma->head);
 	spin_unlock(&anon_vma->lock);
 
 	if (empty)
 		anon_vma_free(anon_vma);
 }
+#endif
 
 static void anon_vma_ctor(void *data)
 {
 	struct anon_vma *anon_vma = data;
 
 	spin_lock_init(&anon_vma->lock);
+	anonvma_external_refcount_init(anon_vma);
 	INIT_LIST_HEAD(&anon_vma->head);
 }
 
@@ -40,6 +40,7 @@
 #include <linux/memcontrol.h>
 #include <linux/mem_notify.h>
 #include <linux/delayacct.h>
+#include <linux/mm_pressure.h>
 #include <linux/sysctl.h>
 
 #include <asm/tlbflush.h>
@@ -755,6 +756,9 @@ static unsigned long shrink_page_list(struct list_head *page_list,
 		if (!mapping || !__remove_mapping(mapping, page))
 			goto keep_locked;
 
+		if (page_is_file_cache(page))
+			workingset_eviction(mapping, page);
+
 		/*
 		 * At this point, we have no other references and there is
 		 * no way to pick any more up (removed from LRU, removed
@@ -1746,8 +1750,14 @@ unsigned long try_to_free_pages(struct zonelist *zonelist, int order,
 	struct shrink_control shrink = {
 		.gfp_mask = sc.gfp_mask,
 	};
-		
-	return do_try_to_free_pages(zonelist, &sc, &shrink);
+	unsigned long nr_reclaimed;
+	u64 stall_start;
+
+	stall_start = mm_pressure_reclaim_start();
+	nr_reclaimed = do_try_to_free_pages(zonelist, &sc, &shrink);
+	mm_pressure_reclaim_end(stall_start);
+
+	return nr_reclaimed;
 }
 
 #ifdef CONFIG_CGROUP_MEM_RES_CTLR
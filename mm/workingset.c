@@ -0,0 +1,211 @@
+/*
+ * Workingset detection
+ *
+ * A file page which is reclaimed from the inactive list and read back in
+ * shortly afterwards is not cold: the inactive list was simply too short
+ * for it to be referenced twice before it reached the tail.  Treating it
+ * like a first access puts it back on the inactive list, where it will be
+ * evicted again, and an application launch which needs slightly more
+ * page cache than is left after the active list ends up thrashing.
+ *
+ * Every zone has an "inactive age" clock, which ticks whenever a file
+ * page leaves the inactive list, either by being evicted or by being
+ * activated.  When a page is evicted, the current value of the clock is
+ * remembered for it; when the page is read back in, the difference
+ * between the clock then and the remembered value is the number of
+ * inactive list slots that it missed staying resident by (the refault
+ * distance).  Had the active list been that much shorter, the page would
+ * have been activated in time, so if the refault distance is no larger
+ * than the active file list the page is activated straight away, to
+ * compete with the existing active pages for its place.
+ *
+ * The remembered values are kept in a fixed-size, lossy hash table of
+ * non-resident pages keyed by mapping and index, rather than in the page
+ * cache radix tree itself: that keeps every radix tree walker in the
+ * kernel unaware of them, and bounds their memory cost up front.  A slot
+ * that is overwritten before its page refaults just loses the hint, and
+ * a stale match can at worst activate a page that did not deserve it, so
+ * the table is updated without locking.
+ */
+
+#include <linux/mm.h>
+#include <linux/mmzone.h>
+#include <linux/swap.h>
+#include <linux/jhash.h>
+#include <linux/vmalloc.h>
+#include <linux/vmstat.h>
+#include <linux/init.h>
+#include <linux/log2.h>
+#include <linux/mm_pressure.h>
+
+#define WORKINGSET_SLOTS	8	/* entries per bucket: one cacheline */
+
+/*
+ * An entry packs, from the bottom up, the eviction age, the zone the page
+ * was evicted from, and a tag taken from the hash of mapping and index.
+ *
+ * The age only has to tell apart refault distances up to the size of
+ * memory, so it gets just enough bits for twice that, and the tag gets
+ * everything else, up to the hash bits not used to pick the bucket.  The
+ * lowest tag bit is always set, so a lookup matches a stranger in a full
+ * bucket with a probability of about WORKINGSET_SLOTS / 2^(tag bits - 1):
+ * with 512MB of memory and two zones on a 32-bit machine the tag has 13
+ * bits, which makes that 1 in 512, against 1 in 16 for a fixed 8-bit tag;
+ * on 64-bit the tag is only limited by the hash.  A false match
+ * activates a page that should have stayed inactive, and is counted as a
+ * refault like a true one.
+ */
+#define ZONEID_BITS		(NODES_SHIFT + ZONES_SHIFT)
+#define ZONEID_MASK		((1UL << ZONEID_BITS) - 1)
+
+struct workingset_bucket {
+	unsigned long entry[WORKINGSET_SLOTS];
+};
+
+static struct workingset_bucket *workingset_table;
+static unsigned int workingset_hash_shift;
+static unsigned int workingset_age_bits;
+static unsigned int workingset_tag_bits;
+
+#define AGE_BITS		workingset_age_bits
+#define AGE_MASK		((1UL << AGE_BITS) - 1)
+#define TAG_BITS		workingset_tag_bits
+
+static struct workingset_bucket *workingset_bucket(struct address_space *mapping,
+						   pgoff_t index,
+						   unsigned long *tag)
+{
+	u32 hash = jhash_2words((u32)(unsigned long)mapping, (u32)index,
+				(u32)((unsigned long)mapping >> 16));
+
+	/* The tag is never 0, which is what marks an empty slot */
+	*tag = ((hash >> (32 - TAG_BITS)) | 1) << (AGE_BITS + ZONEID_BITS);
+	return workingset_table + (hash & ((1 << workingset_hash_shift) - 1));
+}
+
+static unsigned long pack_entry(unsigned long tag, struct zone *zone,
+				unsigned long age)
+{
+	unsigned long zoneid;
+
+	zoneid = (zone_to_nid(zone) << ZONES_SHIFT) | zone_idx(zone);
+	return tag | (zoneid << AGE_BITS) | (age & AGE_MASK);
+}
+
+static struct zone *unpack_zone(unsigned long entry)
+{
+	unsigned long zoneid = (entry >> AGE_BITS) & ZONEID_MASK;
+
+	return NODE_DATA(zoneid >> ZONES_SHIFT)->node_zones +
+		(zoneid & ((1UL << ZONES_SHIFT) - 1));
+}
+
+/**
+ * workingset_eviction - note the eviction of a file page
+ * @mapping: address space the page was removed from
+ * @page: the page being evicted
+ *
+ * Called by page reclaim once @page has been removed from the page cache.
+ */
+void workingset_eviction(struct address_space *mapping, struct page *page)
+{
+	struct zone *zone = page_zone(page);
+	struct workingset_bucket *bucket;
+	unsigned long tag, age;
+	int i, slot;
+
+	if (!workingset_table)
+		return;
+
+	age = atomic_long_inc_return(&zone->inactive_age);
+	bucket = workingset_bucket(mapping, page->index, &tag);
+
+	slot = age % WORKINGSET_SLOTS;
+	for (i = 0; i < WORKINGSET_SLOTS; i++) {
+		if (!bucket->entry[i]) {
+			slot = i;
+			break;
+		}
+	}
+	bucket->entry[slot] = pack_entry(tag, zone, age);
+}
+
+/**
+ * workingset_refault - evaluate the refault of a previously evicted page
+ * @mapping: address space the page is being added to
+ * @index: offset of the page in @mapping
+ *
+ * Returns 1 if the page should go straight onto the active list.
+ */
+int workingset_refault(struct address_space *mapping, pgoff_t index)
+{
+	struct workingset_bucket *bucket;
+	unsigned long tag, entry, distance;
+	struct zone *zone;
+	int i;
+
+	if (!workingset_table)
+		return 0;
+
+	bucket = workingset_bucket(mapping, index, &tag);
+	for (i = 0; i < WORKINGSET_SLOTS; i++) {
+		entry = bucket->entry[i];
+		if ((entry & ~((1UL << (AGE_BITS + ZONEID_BITS)) - 1)) == tag)
+			break;
+	}
+	if (i == WORKINGSET_SLOTS)
+		return 0;
+	bucket->entry[i] = 0;
+
+	zone = unpack_zone(entry);
+	distance = (atomic_long_read(&zone->inactive_age) - entry) & AGE_MASK;
+
+	count_vm_event(WORKINGSET_REFAULT);
+	mm_pressure_refault();
+
+	if (distance > zone_page_state(zone, NR_ACTIVE_FILE))
+		return 0;
+
+	count_vm_event(WORKINGSET_ACTIVATE);
+	return 1;
+}
+
+/**
+ * workingset_activation - note a page activation
+ * @page: page that is being activated
+ */
+void workingset_activation(struct page *page)
+{
+	atomic_long_inc(&page_zone(page)->inactive_age);
+}
+
+static int __init workingset_init(void)
+{
+	unsigned long entries, size;
+
+	/*
+	 * Remember about as many non-resident pages as half the memory
+	 * holds: refault distances larger than the active list are not
+	 * acted upon, and that can never exceed memory size.
+	 */
+	entries = max(totalram_pages / 2, 1024UL);
+	workingset_hash_shift = ilog2(entries / WORKINGSET_SLOTS);
+	size = sizeof(struct workingset_bucket) << workingset_hash_shift;
+
+	workingset_age_bits = order_base_2(totalram_pages) + 1;
+	workingset_tag_bits = min(BITS_PER_LONG - ZONEID_BITS - AGE_BITS,
+				  32 - workingset_hash_shift);
+
+	workingset_table = __vmalloc(size, GFP_KERNEL | __GFP_ZERO, PAGE_KERNEL);
+	if (!workingset_table) {
+		printk(KERN_ERR "workingset: cannot allocate %lu byte table\n",
+		       size);
+		return -ENOMEM;
+	}
+	printk(KERN_INFO "workingset: tracking %lu non-resident pages, "
+	       "%u bit tags\n",
+	       (unsigned long)WORKINGSET_SLOTS << workingset_hash_shift,
+	       TAG_BITS);
+	return 0;
+}
+module_init(workingset_init);